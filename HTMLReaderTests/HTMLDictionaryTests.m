@@ -4,6 +4,7 @@
 
 #import <XCTest/XCTest.h>
 #import "HTMLOrderedDictionary.h"
+#import "HTMLString.h"
 
 @interface HTMLDictionaryTests : XCTestCase
 
@@ -193,4 +194,44 @@ static NSArray *fixtureKeys;
     XCTAssertEqualObjects(_dictionary.lastKey, fixtureKeys.lastObject);
 }
 
+- (void)testDeferredStrings
+{
+    _dictionary[@"plain"] = [[HTMLDeferredString alloc] initWithSource:@"<a b=c>" range:NSMakeRange(5, 1) preprocess:NO];
+    _dictionary[@"preprocessed"] = [[HTMLDeferredString alloc] initWithSource:@"x\r\ny\rz\0" range:NSMakeRange(0, 6) preprocess:YES];
+    XCTAssertEqualObjects(_dictionary[@"plain"], @"c");
+    XCTAssertEqualObjects(_dictionary[@"preprocessed"], @"x\ny\nz\uFFFD");
+    
+    HTMLOrderedDictionary *copy = [_dictionary copy];
+    XCTAssertEqualObjects(copy, _dictionary);
+    [copy resolveDeferredStrings];
+    XCTAssertEqualObjects(copy, (@{ @"plain": @"c", @"preprocessed": @"x\ny\nz\uFFFD" }));
+}
+
+- (void)testSearchesKeysByPointer
+{
+    [self populateDictionary];
+    _dictionary.searchesKeysByPointer = YES;
+    NSString *yo = fixtureKeys[3];
+    XCTAssertEqualObjects(_dictionary[yo], @"yo");
+    XCTAssertEqualObjects(_dictionary[[@"y" stringByAppendingString:@"o"]], @"yo");
+    
+    // Changes made while searching by pointer have to show up either way.
+    _dictionary[yo] = @"hey";
+    [_dictionary removeObjectForKey:@"ahoy"];
+    [_dictionary insertObject:[[HTMLDeferredString alloc] initWithSource:@"<a b=c>" range:NSMakeRange(5, 1) preprocess:NO] forKey:@"first" atIndex:0];
+    XCTAssertEqualObjects(_dictionary[yo], @"hey");
+    XCTAssertNil(_dictionary[@"ahoy"]);
+    XCTAssertEqualObjects(_dictionary[@"first"], @"c");
+    
+    HTMLOrderedDictionary *copy = [_dictionary copy];
+    XCTAssertTrue(copy.searchesKeysByPointer);
+    [copy resolveDeferredStrings];
+    XCTAssertEqualObjects(copy[@"first"], @"c");
+    XCTAssertEqualObjects(copy[yo], @"hey");
+    
+    _dictionary.searchesKeysByPointer = NO;
+    XCTAssertEqualObjects(_dictionary[yo], @"hey");
+    XCTAssertEqualObjects(_dictionary, copy);
+}
+
 @end
@@ -4,6 +4,10 @@
 
 #import <XCTest/XCTest.h>
 #import "HTMLDocument.h"
+#import "HTMLParserStatistics.h"
+#import "HTMLSelector.h"
+#import "HTMLSerialization.h"
+#import "HTMLTextNode.h"
 
 @interface HTMLDocumentTests : XCTestCase
 
@@ -46,4 +50,224 @@
     XCTAssertEqual(document.parsedStringEncoding, (NSStringEncoding)NSWindowsCP1252StringEncoding);
 }
 
+- (void)testFreeze
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<!doctype html><title>Hi</title><p class=greeting>Hello <b>there</b><!-- you -->"];
+    NSString *serialized = document.serializedFragment;
+    XCTAssertFalse(document.frozen);
+    
+    [document freeze];
+    XCTAssertTrue(document.frozen);
+    for (HTMLNode *node in document.treeEnumerator) {
+        XCTAssertTrue(node.frozen);
+    }
+    XCTAssertEqualObjects(document.serializedFragment, serialized);
+    XCTAssertEqualObjects([document firstNodeMatchingSelector:@".greeting"].textContent, @"Hello there");
+    
+    [document freeze];
+    XCTAssertTrue(document.frozen);
+}
+
+- (void)testFrozenDocumentRejectsMutation
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p>Hello <b>there</b>"];
+    [document freeze];
+    HTMLElement *p = [document firstNodeMatchingSelector:@"p"];
+    HTMLElement *b = [document firstNodeMatchingSelector:@"b"];
+    HTMLTextNode *text = (HTMLTextNode *)[p childAtIndex:0];
+    
+    XCTAssertThrowsSpecificNamed([p addChild:[HTMLElement new]], NSException, NSInternalInconsistencyException);
+    XCTAssertThrowsSpecificNamed([b removeFromParentNode], NSException, NSInternalInconsistencyException);
+    XCTAssertThrowsSpecificNamed([[HTMLElement new] addChild:b], NSException, NSInternalInconsistencyException);
+    XCTAssertThrowsSpecificNamed(p[@"id"] = @"greeting", NSException, NSInternalInconsistencyException);
+    XCTAssertThrowsSpecificNamed([text appendString:@"!"], NSException, NSInternalInconsistencyException);
+    XCTAssertThrowsSpecificNamed(p.textContent = @"Bye", NSException, NSInternalInconsistencyException);
+    XCTAssertThrowsSpecificNamed(document.quirksMode = HTMLQuirksModeQuirks, NSException, NSInternalInconsistencyException);
+    XCTAssertEqualObjects(p.textContent, @"Hello there");
+    
+    HTMLElement *copy = [p copy];
+    XCTAssertFalse(copy.frozen);
+    copy[@"id"] = @"greeting";
+    XCTAssertEqualObjects(copy[@"id"], @"greeting");
+    
+    HTMLTextNode *textCopy = [text copy];
+    [textCopy appendString:@"!"];
+    XCTAssertEqualObjects(textCopy.data, @"Hello !");
+    XCTAssertEqualObjects(text.data, @"Hello ");
+}
+
+- (void)testFrozenNodeOutlivesDocument
+{
+    HTMLElement *b;
+    @autoreleasepool {
+        HTMLDocument *document = [HTMLDocument documentWithString:@"<p>Hello <b>there</b>"];
+        [document freeze];
+        b = [document firstNodeMatchingSelector:@"b"];
+        XCTAssertEqualObjects(b.parentElement.tagName, @"p");
+        XCTAssertEqual(b.document, document);
+        
+        // Let the document go on another thread.
+        dispatch_group_t group = dispatch_group_create();
+        __block HTMLDocument *handedOff = document;
+        document = nil;
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            handedOff = nil;
+        });
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    }
+    XCTAssertNil(b.document);
+    XCTAssertNil(b.parentNode);
+    XCTAssertEqualObjects(b.textContent, @"there");
+}
+
+- (void)testFrozenDocumentConcurrentReads
+{
+    NSMutableString *string = [NSMutableString new];
+    for (NSUInteger i = 0; i < 200; i++) {
+        [string appendFormat:@"<div class=item id=item%@><a href='/%@'>Item <em>%@</em></a></div>", @(i), @(i), @(i)];
+    }
+    HTMLDocument *document = [HTMLDocument documentWithString:string];
+    [document freeze];
+    NSString *serialized = document.serializedFragment;
+    NSString *textContent = document.textContent;
+    
+    __block NSUInteger failures = 0;
+    dispatch_apply(32, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        BOOL ok = ([document nodesMatchingSelector:@"div.item > a em"].count == 200
+                   && [document.serializedFragment isEqualToString:serialized]
+                   && [document.textContent isEqualToString:textContent]);
+        if (!ok) {
+            @synchronized (document) {
+                failures++;
+            }
+        }
+    });
+    XCTAssertEqual(failures, (NSUInteger)0);
+}
+
+- (void)testParserStatistics
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<table><b>x<tr><td>y &amp; z</table><p><b><i>z</b>w</i>"];
+#if HTMLREADER_COLLECT_STATISTICS
+    NSDictionary *statistics = document.parserStatistics;
+    XCTAssertEqualObjects(statistics[@"tokens"][@"startTag"], @7);
+    XCTAssertEqualObjects(statistics[@"tokens"][@"endTag"], @3);
+    XCTAssertEqualObjects(statistics[@"namedCharacterReferences"], @1);
+    XCTAssertTrue([statistics[@"tokenizerStateVisits"][@"TagName"] integerValue] > 0);
+    XCTAssertNil(statistics[@"tokenizerStateVisits"][@"CDATASection"]);
+    XCTAssertTrue([statistics[@"adoptionAgencyRuns"] integerValue] > 0);
+    XCTAssertTrue([statistics[@"fosterParentedInsertions"] integerValue] > 0);
+    XCTAssertTrue([statistics[@"parseErrors"] integerValue] > 0);
+    XCTAssertEqualObjects(statistics[@"encodingRestarts"], @0);
+    
+    // Each of these exercises one thing, so the counts can be worked out by hand.
+    statistics = [HTMLDocument documentWithString:@"<p><b><i>z</b>w</i>"].parserStatistics;
+    XCTAssertEqualObjects(statistics[@"adoptionAgencyRuns"], @2);
+    XCTAssertEqualObjects(statistics[@"activeFormattingElementReconstructions"], @1);
+    XCTAssertEqualObjects(statistics[@"fosterParentedInsertions"], @0);
+    
+    statistics = [HTMLDocument documentWithString:@"<table>x</table>"].parserStatistics;
+    XCTAssertEqualObjects(statistics[@"tokens"][@"startTag"], @1);
+    XCTAssertEqualObjects(statistics[@"tokens"][@"endTag"], @1);
+    XCTAssertEqualObjects(statistics[@"fosterParentedInsertions"], @1);
+    XCTAssertEqualObjects(statistics[@"adoptionAgencyRuns"], @0);
+    
+    statistics = [HTMLDocument documentWithString:@"&amp; &#38; &#x26; &lt"].parserStatistics;
+    XCTAssertEqualObjects(statistics[@"namedCharacterReferences"], @2);
+    XCTAssertEqualObjects(statistics[@"numericCharacterReferences"], @2);
+    XCTAssertEqualObjects(statistics[@"tokens"][@"startTag"], @0);
+    
+    statistics = [HTMLDocument documentWithString:@"<div><div><div></div></div></div>"].parserStatistics;
+    XCTAssertEqualObjects(statistics[@"maximumStackDepth"], @5);
+    XCTAssertEqualObjects(statistics[@"parseErrors"], @1);
+#else
+    XCTAssertNil(document.parserStatistics);
+#endif
+}
+
+- (void)testMutationVersion
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p class=a>Hello"];
+    NSUInteger version = document.mutationVersion;
+    HTMLElement *p = [document firstNodeMatchingSelector:@"p"];
+    XCTAssertEqual(document.mutationVersion, version);
+    
+    p[@"class"] = @"b";
+    XCTAssertNotEqual(document.mutationVersion, version);
+    version = document.mutationVersion;
+    
+    HTMLTextNode *text = p.children.firstObject;
+    [text appendString:@" there"];
+    XCTAssertNotEqual(document.mutationVersion, version);
+    version = document.mutationVersion;
+    
+    HTMLElement *detached = [[HTMLElement alloc] initWithTagName:@"div" attributes:nil];
+    detached[@"id"] = @"x";
+    XCTAssertEqual(document.mutationVersion, version);
+    
+    [p addChild:detached];
+    XCTAssertNotEqual(document.mutationVersion, version);
+    version = document.mutationVersion;
+    
+    [detached removeFromParentNode];
+    XCTAssertNotEqual(document.mutationVersion, version);
+}
+
+- (void)testQueryCache
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p class=a>One<p class=a>Two<p>Three"];
+    XCTAssertEqual([document nodesMatchingSelector:@".a"].count, (NSUInteger)2);
+    XCTAssertEqual(document.queryCacheHitCount, (NSUInteger)0);
+    
+    document.queryCacheCapacity = 10;
+    NSArray *first = [document nodesMatchingSelector:@".a"];
+    NSArray *second = [document nodesMatchingSelector:@".a"];
+    XCTAssertEqual(first, second);
+    XCTAssertEqual(document.queryCacheMissCount, (NSUInteger)1);
+    XCTAssertEqual(document.queryCacheHitCount, (NSUInteger)1);
+    
+    HTMLElement *body = document.bodyElement;
+    XCTAssertEqual([body nodesMatchingSelector:@".a"].count, (NSUInteger)2);
+    XCTAssertEqual(document.queryCacheMissCount, (NSUInteger)2);
+    XCTAssertNil([document firstNodeMatchingSelector:@"table"]);
+    XCTAssertNil([document firstNodeMatchingSelector:@"table"]);
+    XCTAssertEqual(document.queryCacheHitCount, (NSUInteger)2);
+    
+    [body.children.lastObject setObject:@"a" forKeyedSubscript:@"class"];
+    XCTAssertEqual([document nodesMatchingSelector:@".a"].count, (NSUInteger)3);
+    XCTAssertEqual(document.queryCacheMissCount, (NSUInteger)4);
+    
+    // Results bigger than the whole cache are never kept.
+    document.queryCacheCapacity = 2;
+    [document nodesMatchingSelector:@".a"];
+    [document nodesMatchingSelector:@".a"];
+    XCTAssertEqual(document.queryCacheMissCount, (NSUInteger)6);
+    
+    // The least recently used result goes first.
+    [document firstNodeMatchingSelector:@"p"];
+    [document firstNodeMatchingSelector:@"body"];
+    [document firstNodeMatchingSelector:@"p"];
+    [document firstNodeMatchingSelector:@"head"];
+    NSUInteger misses = document.queryCacheMissCount;
+    [document firstNodeMatchingSelector:@"p"];
+    XCTAssertEqual(document.queryCacheMissCount, misses);
+    [document firstNodeMatchingSelector:@"body"];
+    XCTAssertEqual(document.queryCacheMissCount, misses + 1);
+}
+
+- (void)testQueryCacheReleasesDocument
+{
+    __weak HTMLDocument *weakDocument;
+    @autoreleasepool {
+        HTMLDocument *document = [HTMLDocument documentWithString:@"<p class=a>One<p>Two"];
+        document.queryCacheCapacity = 10;
+        [document nodesMatchingSelector:@".a"];
+        [document firstNodeMatchingSelector:@"p"];
+        [document.bodyElement nodesMatchingSelector:@"p"];
+        XCTAssertEqual(document.queryCacheMissCount, (NSUInteger)3);
+        weakDocument = document;
+    }
+    XCTAssertNil(weakDocument);
+}
+
 @end
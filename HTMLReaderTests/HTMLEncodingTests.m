@@ -135,7 +135,7 @@
                 }
             }
             
-            HTMLParser *parser = ParserWithDataAndContentType(test.testData, nil);
+            HTMLParser *parser = ParserWithDataAndContentType(test.testData, nil, nil);
             
             CFStringEncoding cfcorrectEncoding = CFStringConvertNSStringEncodingToEncoding(test.correctEncoding);
             CFStringEncoding cfparserEncoding = CFStringConvertNSStringEncodingToEncoding(parser.encoding.encoding);
@@ -185,16 +185,27 @@ static NSArray * TestsInFileAtURL(NSURL *URL)
 {
     const char neitherUTF8NorWin1252[] = "\x90";
     NSData *data = [NSData dataWithBytes:neitherUTF8NorWin1252 length:sizeof(neitherUTF8NorWin1252)];
-    HTMLParser *parser = ParserWithDataAndContentType(data, @"charset=utf-8");
+    HTMLParser *parser = ParserWithDataAndContentType(data, @"charset=utf-8", nil);
     XCTAssertNotNil(parser);
 
-    if (UsesLossyWindows1252Decoding()) {
-        XCTAssertEqual(parser.encoding.encoding, NSWindowsCP1252StringEncoding);
-        NSString *textContent = parser.document.textContent;
-        XCTAssertEqualObjects(textContent, @"\uFFFD");
-    } else {
-        XCTAssertEqual(parser.encoding.encoding, NSISOLatin1StringEncoding);
-    }
+    XCTAssertEqual(parser.encoding.encoding, NSWindowsCP1252StringEncoding);
+    NSString *textContent = parser.document.textContent;
+    XCTAssertEqualObjects(textContent, @"\u0090");
+}
+
+- (void)testSingleByteDecoding
+{
+    // Long enough to go through the eight-bytes-at-a-time path, with non-ASCII at either end.
+    const char koi8u[] = "\xAE <p>plain ascii text</p> \xBE";
+    NSData *data = [NSData dataWithBytes:koi8u length:sizeof(koi8u) - 1];
+    HTMLParser *parser = ParserWithDataAndContentType(data, @"text/html; charset=koi8-u", nil);
+    XCTAssertEqual(parser.encoding.encoding, CFStringConvertEncodingToNSStringEncoding(kCFStringEncodingKOI8_U));
+    XCTAssertEqualObjects(parser.document.textContent, @"\u045E plain ascii text \u040E");
+    
+    const char windows1255[] = "\xCA\xFF";
+    data = [NSData dataWithBytes:windows1255 length:sizeof(windows1255) - 1];
+    parser = ParserWithDataAndContentType(data, @"text/html; charset=windows-1255", nil);
+    XCTAssertEqualObjects(parser.document.textContent, @"\u05BA\uFFFD");
 }
 
 @end
@@ -0,0 +1,140 @@
+//  HTMLExtractorTests.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <XCTest/XCTest.h>
+#import "HTMLDocument.h"
+#import "HTMLExtractor.h"
+
+@interface HTMLExtractorTests : XCTestCase
+
+@end
+
+@implementation HTMLExtractorTests
+
+static NSString * const Page = @"<title>Page</title><div id=nav><a href=/>Home</a><a href=/about>About</a></div><article><h2>One</h2><p>First <a href=/one>link</a></p><p>Second</p><div><div>Nested</div></div></article><article><h2>Two</h2><p>Third <b>bold</b></p></article>";
+
+static NSArray * SerializedElements(NSArray *elements)
+{
+    return [elements valueForKey:@"serializedFragment"];
+}
+
+- (void)testMatchesWholeDocument
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:Page];
+    for (NSString *string in @[ @"article p > a", @"h2 + p", @"article > p:nth-of-type(2)", @"div", @"p:first-child", @"#nav a:not([href='/'])", @"b:empty" ]) {
+        HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:string] ]];
+        NSArray *extracted = [extractor elementsMatchedInString:Page].firstObject;
+        NSArray *expected = [document nodesMatchingSelector:string];
+        XCTAssertEqualObjects([NSSet setWithArray:SerializedElements(extracted)], [NSSet setWithArray:SerializedElements(expected)], @"%@", string);
+        XCTAssertEqual(extracted.count, expected.count, @"%@", string);
+    }
+}
+
+- (void)testFinishOrder
+{
+    HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"h2"], [HTMLSelector selectorForString:@"article"] ]];
+    NSMutableArray *order = [NSMutableArray new];
+    [extractor extractFromString:Page usingBlock:^(HTMLElement *element, NSUInteger selectorIndex, BOOL *stop) {
+        [order addObject:[NSString stringWithFormat:@"%@%@", element.tagName, @(selectorIndex)]];
+    }];
+    XCTAssertEqualObjects(order, (@[ @"h20", @"article1", @"h20", @"article1" ]));
+}
+
+- (void)testUnmatchedContentIsDropped
+{
+    HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"p"] ]];
+    NSArray *paragraphs = [extractor elementsMatchedInString:Page].firstObject;
+    XCTAssertEqualObjects([paragraphs valueForKey:@"textContent"], (@[ @"First link", @"Second", @"Third bold" ]));
+    for (HTMLElement *paragraph in paragraphs) {
+        XCTAssertNil(paragraph.parentNode);
+    }
+    
+    extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"article"], [HTMLSelector selectorForString:@"b"] ]];
+    NSArray *matches = [extractor elementsMatchedInString:Page];
+    HTMLElement *article = [matches[0] lastObject];
+    HTMLElement *bold = [matches[1] firstObject];
+    XCTAssertEqualObjects(article.serializedFragment, @"<article><h2>Two</h2><p>Third <b>bold</b></p></article>");
+    XCTAssertEqualObjects(bold.parentElement.parentElement, article);
+}
+
+- (void)testStop
+{
+    HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"h2"] ]];
+    NSMutableArray *headings = [NSMutableArray new];
+    [extractor extractFromString:Page usingBlock:^(HTMLElement *element, NSUInteger selectorIndex, BOOL *stop) {
+        [headings addObject:element.textContent];
+        *stop = YES;
+    }];
+    XCTAssertEqualObjects(headings, @[ @"One" ]);
+}
+
+- (void)testLaterSiblings
+{
+    HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"article > p:last-of-type"], [HTMLSelector selectorForString:@"a:only-child"] ]];
+    NSArray *matches = [extractor elementsMatchedInString:Page];
+    XCTAssertEqualObjects([matches[0] valueForKey:@"textContent"], (@[ @"Second", @"Third bold" ]));
+    XCTAssertEqualObjects([matches[1] valueForKey:@"textContent"], @[ @"link" ]);
+}
+
+- (void)testNamesLikeLaterSiblingPseudoClasses
+{
+    // How many children the matched element's parent has when the element is handed over shows whether the document was built first.
+    NSString *string = @"<div><p class=last-name>x</p><p data-x=only-me>y</p><p>z</p></div>";
+    NSUInteger (^siblingsWhenMatched)(NSString *) = ^(NSString *selector) {
+        __block NSUInteger count = 0;
+        HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:selector] ]];
+        [extractor extractFromString:string usingBlock:^(HTMLElement *element, NSUInteger selectorIndex, BOOL *stop) {
+            count = element.parentElement.numberOfChildren;
+        }];
+        return count;
+    };
+    XCTAssertEqual(siblingsWhenMatched(@".last-name"), (NSUInteger)1);
+    XCTAssertEqual(siblingsWhenMatched(@"[data-x=only-me]"), (NSUInteger)2);
+    XCTAssertEqual(siblingsWhenMatched(@"p:NTH-LAST-CHILD(3)"), (NSUInteger)3);
+}
+
+- (void)testMisnestedFormatting
+{
+    // The adoption agency moves the i under a copy of the b after the span comes along.
+    NSString *string = @"<b><p><i>1</i><span></span></b>";
+    HTMLDocument *document = [HTMLDocument documentWithString:string];
+    for (NSString *selector in @[ @"b > i", @"p > i", @"p i", @"body > b + p > b > span" ]) {
+        HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:selector] ]];
+        NSArray *extracted = [extractor elementsMatchedInString:string].firstObject;
+        XCTAssertEqualObjects(SerializedElements(extracted), SerializedElements([document nodesMatchingSelector:selector]), @"%@", selector);
+    }
+    
+    HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"b > i"] ]];
+    XCTAssertEqualObjects([[extractor elementsMatchedInString:string].firstObject valueForKey:@"textContent"], @[ @"1" ]);
+}
+
+- (void)testFrameset
+{
+    // Nothing so far rules out a frameset, which throws out the body and its paragraphs.
+    NSString *string = @"<p></p><p></p><frameset><frame></frameset>";
+    HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"p"], [HTMLSelector selectorForString:@"frame"] ]];
+    NSArray *matches = [extractor elementsMatchedInString:string];
+    XCTAssertEqualObjects(matches[0], @[]);
+    XCTAssertEqual([matches[1] count], (NSUInteger)1);
+    
+    // The body's class comes along before the first paragraph is done with.
+    extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"body.x p"] ]];
+    XCTAssertEqual([[extractor elementsMatchedInString:@"<p></p><p></p><body class=x>"].firstObject count], (NSUInteger)2);
+}
+
+- (void)testLateBodyAttributes
+{
+    // The documented exception: the first paragraph was matched before the body got its class.
+    NSString *string = @"<p>a</p><p>b</p><body class=x>";
+    XCTAssertEqual([[HTMLDocument documentWithString:string] nodesMatchingSelector:@"body.x p"].count, (NSUInteger)2);
+    HTMLExtractor *extractor = [[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"body.x p"] ]];
+    XCTAssertEqualObjects([[extractor elementsMatchedInString:string].firstObject valueForKey:@"textContent"], @[ @"b" ]);
+}
+
+- (void)testInvalidSelector
+{
+    XCTAssertThrowsSpecificNamed([[HTMLExtractor alloc] initWithSelectors:@[ [HTMLSelector selectorForString:@"h2..foo"] ]], NSException, NSInvalidArgumentException);
+}
+
+@end
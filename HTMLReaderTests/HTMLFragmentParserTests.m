@@ -0,0 +1,65 @@
+//  HTMLFragmentParserTests.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <XCTest/XCTest.h>
+#import "HTMLFragmentParser.h"
+#import "HTMLSelector.h"
+#import "HTMLSerialization.h"
+#import "HTMLTextNode.h"
+
+@interface HTMLFragmentParserTests : XCTestCase
+
+@end
+
+@implementation HTMLFragmentParserTests
+
+- (void)testParseString
+{
+    HTMLFragmentParser *parser = [[HTMLFragmentParser alloc] initWithContextElement:[[HTMLElement alloc] initWithTagName:@"div" attributes:nil]];
+    HTMLDocument *fragment = [parser parseString:@"Hello <b>there</b><p>friend"];
+    XCTAssertEqualObjects(fragment.serializedFragment, @"Hello <b>there</b><p>friend</p>");
+    for (HTMLNode *child in fragment.children) {
+        XCTAssertEqualObjects(child.parentNode, fragment);
+    }
+}
+
+- (void)testStateIsReset
+{
+    HTMLFragmentParser *parser = [[HTMLFragmentParser alloc] initWithContextElement:[[HTMLElement alloc] initWithTagName:@"div" attributes:nil]];
+    HTMLDocument *first = [parser parseString:@"<table><tr><td><b>unclosed <!-- and"];
+    XCTAssertTrue(parser.errors.count > 0);
+    HTMLDocument *second = [parser parseString:@"<i>fine</i>"];
+    XCTAssertEqual(parser.errors.count, (NSUInteger)0);
+    XCTAssertEqualObjects(second.serializedFragment, @"<i>fine</i>");
+    XCTAssertNotNil([first firstNodeMatchingSelector:@"td b"]);
+}
+
+- (void)testContext
+{
+    HTMLFragmentParser *title = [[HTMLFragmentParser alloc] initWithContextElement:[[HTMLElement alloc] initWithTagName:@"title" attributes:nil]];
+    XCTAssertEqualObjects([[title parseString:@"<b>not bold"].children.firstObject class], [HTMLTextNode class]);
+    XCTAssertEqualObjects([[title parseString:@"<i>still text"].children.firstObject textContent], @"<i>still text");
+    
+    HTMLFragmentParser *row = [[HTMLFragmentParser alloc] initWithContextElement:[[HTMLElement alloc] initWithTagName:@"tr" attributes:nil]];
+    XCTAssertEqualObjects([row parseString:@"<td>a<td>b"].serializedFragment, @"<td>a</td><td>b</td>");
+}
+
+- (void)testAppendingToNode
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<ul><li>Existing</ul>"];
+    HTMLElement *list = [document firstNodeMatchingSelector:@"ul"];
+    HTMLFragmentParser *parser = [[HTMLFragmentParser alloc] initWithContextElement:list];
+    [parser parseString:@"<li>One<li>Two" appendingToNode:list];
+    [parser parseString:@"<li>Three" appendingToNode:list];
+    XCTAssertEqualObjects(list.serializedFragment, @"<ul><li>Existing</li><li>One</li><li>Two</li><li>Three</li></ul>");
+    
+    HTMLElement *empty = [[HTMLElement alloc] initWithTagName:@"ul" attributes:nil];
+    [parser parseString:@"<li>Four" appendingToNode:empty];
+    HTMLNode *four = empty.children.firstObject;
+    XCTAssertEqualObjects(four.parentNode, empty);
+    XCTAssertEqual([empty indexOfChild:four], (NSUInteger)0);
+    XCTAssertEqual([document nodesMatchingSelector:@"li"].count, (NSUInteger)4);
+}
+
+@end
@@ -5,6 +5,8 @@
 #import <XCTest/XCTest.h>
 #import "HTMLComment.h"
 #import "HTMLDocument.h"
+#import "HTMLSelector.h"
+#import "HTMLSerialization.h"
 #import "HTMLTextNode.h"
 
 @interface HTMLNodeTests : XCTestCase
@@ -207,4 +209,75 @@ static NSArray *nodeChildClasses;
     XCTAssertNil(weakP);
 }
 
+- (void)testDocumentFollowsMoves
+{
+    HTMLElement *div = [[HTMLElement alloc] initWithTagName:@"div" attributes:nil];
+    HTMLElement *p = [[HTMLElement alloc] initWithTagName:@"p" attributes:nil];
+    HTMLTextNode *text = [[HTMLTextNode alloc] initWithData:@"hi"];
+    [p addChild:text];
+    [div addChild:p];
+    XCTAssertNil(text.document);
+    
+    [_document addChild:div];
+    XCTAssertEqualObjects(div.document, _document);
+    XCTAssertEqualObjects(text.document, _document);
+    XCTAssertNil(_document.document);
+    
+    HTMLDocument *other = [HTMLDocument new];
+    [other addChild:p];
+    XCTAssertEqualObjects(text.document, other);
+    XCTAssertEqual(div.numberOfChildren, (NSUInteger)0);
+    
+    [p removeFromParentNode];
+    XCTAssertNil(p.document);
+    XCTAssertNil(text.document);
+}
+
+- (void)testChildOutlivesParent
+{
+    HTMLTextNode *text;
+    @autoreleasepool {
+        HTMLDocument *document = [HTMLDocument documentWithString:@"<p>Hello"];
+        HTMLElement *p = document.bodyElement.children.firstObject;
+        text = p.children.firstObject;
+        XCTAssertEqualObjects(text.document, document);
+    }
+    XCTAssertNil(text.parentNode);
+    XCTAssertNil(text.document);
+}
+
+- (void)testDeepCopy
+{
+    NSString *string = @"<!doctype html><p class=a>Hello <b>there</b><!-- hi --><ul><li>one<li>two</ul>";
+    HTMLDocument *original = [HTMLDocument documentWithString:string];
+    NSString *serialized = original.serializedFragment;
+    for (int i = 0; i < 2; i++) {
+        if (i == 1) {
+            [original freeze];
+        }
+        HTMLDocument *copy = [original deepCopy];
+        XCTAssertFalse(copy.frozen);
+        XCTAssertEqual(copy.quirksMode, original.quirksMode);
+        XCTAssertEqualObjects(copy.serializedFragment, serialized);
+        XCTAssertEqual(copy.subtreeHash, original.subtreeHash);
+        
+        HTMLElement *p = [copy firstNodeMatchingSelector:@"p"];
+        XCTAssertEqual(p.document, copy);
+        XCTAssertEqual([copy firstNodeMatchingSelector:@"p"], p);
+        XCTAssertNotEqual(p, [original firstNodeMatchingSelector:@"p"]);
+        p[@"class"] = @"b";
+        [(HTMLTextNode *)p.children.firstObject appendString:@"again "];
+        [[copy firstNodeMatchingSelector:@"li"] removeFromParentNode];
+        XCTAssertEqualObjects(original.serializedFragment, serialized);
+        XCTAssertEqualObjects([copy firstNodeMatchingSelector:@"p"].textContent, @"Hello again there");
+        XCTAssertEqualObjects([copy firstNodeMatchingSelector:@".b"], p);
+    }
+    
+    HTMLElement *li = [original firstNodeMatchingSelector:@"li"];
+    HTMLElement *liCopy = [li deepCopy];
+    XCTAssertNil(liCopy.parentNode);
+    XCTAssertNil(liCopy.document);
+    XCTAssertEqualObjects(liCopy.textContent, @"one");
+}
+
 @end
@@ -0,0 +1,222 @@
+//  HTMLParserOptionsTests.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <XCTest/XCTest.h>
+#import "HTMLDocument.h"
+#import "HTMLSelector.h"
+#import "HTMLSerialization.h"
+#import "HTMLTextNode.h"
+
+@interface HTMLParserOptionsTests : XCTestCase
+
+@end
+
+static NSUInteger ElementDepth(HTMLNode *node)
+{
+    NSUInteger deepest = 0;
+    for (HTMLElement *child in node.childElementNodes) {
+        deepest = MAX(deepest, ElementDepth(child));
+    }
+    return [node isKindOfClass:[HTMLElement class]] ? deepest + 1 : deepest;
+}
+
+static NSString * Repeat(NSString *string, NSUInteger count)
+{
+    return [@"" stringByPaddingToLength:string.length * count withString:string startingAtIndex:0];
+}
+
+@implementation HTMLParserOptionsTests
+
+- (void)testNoLimits
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:Repeat(@"<div>", 1000) options:nil];
+    XCTAssertEqual(ElementDepth(document), (NSUInteger)1002);
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitNone);
+}
+
+- (void)testMaximumDepth
+{
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.maximumDepth = 32;
+    HTMLDocument *document = [HTMLDocument documentWithString:[Repeat(@"<div>", 1000) stringByAppendingString:@"<b>deep</b>"] options:options];
+    XCTAssertEqual(ElementDepth(document), (NSUInteger)32);
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitDepth);
+    XCTAssertEqual([document nodesMatchingSelector:@"div"].count, (NSUInteger)1000);
+    XCTAssertEqualObjects([document firstNodeMatchingSelector:@"b"].textContent, @"deep");
+    XCTAssertEqual(ElementDepth([document firstNodeMatchingSelector:@"b"].parentElement), (NSUInteger)2);
+    
+    // Misnested formatting end tags and foster parenting rearrange the tree without going through the usual insertion point.
+    for (NSString *string in @[ [Repeat(@"<b><p>", 40) stringByAppendingString:Repeat(@"</b>x", 40)],
+                                [Repeat(@"<div><i>", 20) stringByAppendingString:Repeat(@"<div></i>y", 20)],
+                                [Repeat(@"<div>", 40) stringByAppendingString:@"<table><b>x<i>y</table>"],
+                                [Repeat(@"<div>", 28) stringByAppendingString:Repeat(@"<table><td><b>x", 5)] ]) {
+        document = [HTMLDocument documentWithString:string options:options];
+        XCTAssertLessThanOrEqual(ElementDepth(document), (NSUInteger)32, @"%@", string);
+        XCTAssertTrue(document.exceededParserLimits & HTMLParserLimitDepth, @"%@", string);
+    }
+}
+
+- (void)testMaximumFormattingElements
+{
+    NSMutableString *string = [NSMutableString stringWithString:@"<p>"];
+    for (NSUInteger i = 0; i < 200; i++) {
+        [string appendFormat:@"<b id=b%@>", @(i)];
+    }
+    [string appendString:@"</p>x"];
+    
+    // Every b is reopened around the x.
+    HTMLDocument *document = [HTMLDocument documentWithString:string];
+    XCTAssertEqual([document nodesMatchingSelector:@"b"].count, (NSUInteger)400);
+    
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.maximumFormattingElements = 10;
+    document = [HTMLDocument documentWithString:string options:options];
+    XCTAssertEqual([document nodesMatchingSelector:@"b"].count, (NSUInteger)210);
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitFormattingElements);
+    XCTAssertEqualObjects([document nodesMatchingSelector:@"b"].lastObject[@"id"], @"b199");
+    XCTAssertEqualObjects(document.bodyElement.textContent, @"x");
+}
+
+- (void)testMaximumNodeCount
+{
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.maximumNodeCount = 50;
+    HTMLDocument *document = [HTMLDocument documentWithString:Repeat(@"<p>Hello <b>there</b>", 1000) options:options];
+    XCTAssertTrue(document.exceededParserLimits & HTMLParserLimitNodeCount);
+    NSUInteger nodeCount = 0;
+    for (__unused HTMLNode *node in document.treeEnumerator) nodeCount++;
+    XCTAssertLessThan(nodeCount, (NSUInteger)60);
+    XCTAssertNotNil(document.bodyElement);
+}
+
+- (void)testMaximumAttributesPerElement
+{
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.maximumAttributesPerElement = 2;
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p a=1 b=2 c=3 d=4><i x=1 y=2>" options:options];
+    XCTAssertEqualObjects([document firstNodeMatchingSelector:@"p"].attributes.allKeys, (@[ @"a", @"b" ]));
+    XCTAssertEqual([document firstNodeMatchingSelector:@"i"].attributes.count, (NSUInteger)2);
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitAttributeCount);
+}
+
+- (void)testMaximumTextLength
+{
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.maximumTextLength = 10;
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p>0123456789abcdef<p>01234 &amp; 6789abc<p>012345678\U0001F600" options:options];
+    NSArray *paragraphs = [document nodesMatchingSelector:@"p"];
+    XCTAssertEqualObjects([paragraphs[0] textContent], @"0123456789");
+    XCTAssertEqualObjects([paragraphs[1] textContent], @"01234 & 67");
+    XCTAssertEqualObjects([paragraphs[2] textContent], @"012345678");
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitTextLength);
+}
+
+- (void)testWorkBudget
+{
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.maximumTokenCount = 100;
+    HTMLDocument *document = [HTMLDocument documentWithString:Repeat(@"<b><i>x</b></i>", 1000) options:options];
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitTokenCount);
+    XCTAssertLessThan([document nodesMatchingSelector:@"b"].count, (NSUInteger)100);
+    
+    options = [HTMLParserOptions new];
+    options.maximumDuration = 1e-9;
+    document = [HTMLDocument documentWithString:Repeat(@"<b><i>x</b></i>", 1000) options:options];
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitDuration);
+}
+
+- (void)testCreatesNodesOnDemand
+{
+    NSString *string = @"<!doctype html><title>Hi</title><p class=a>one <b>two</b><!-- three --><table><tr><td>four</table><p>five<svg><circle r=1></svg><ul><li>six<li>seven</ul>";
+    HTMLDocument *expected = [HTMLDocument documentWithString:string];
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.createsNodesOnDemand = YES;
+    HTMLDocument *document = [HTMLDocument documentWithString:string options:options];
+    XCTAssertTrue(document.isFrozen);
+    XCTAssertEqualObjects(document.textContent, expected.textContent);
+    XCTAssertEqualObjects(document.serializedFragment, expected.serializedFragment);
+    
+    HTMLElement *td = [document firstNodeMatchingSelector:@"td"];
+    XCTAssertEqualObjects(td.textContent, @"four");
+    XCTAssertEqual([document firstNodeMatchingSelector:@"td"], td);
+    XCTAssertEqual(td.document, document);
+    XCTAssertEqualObjects([document firstNodeMatchingSelector:@"circle"][@"r"], @"1");
+    XCTAssertEqual([[document firstNodeMatchingSelector:@"circle"] htmlNamespace], HTMLNamespaceSVG);
+    
+    // Attributes are shared with the tape, so changing a copy must leave the original alone.
+    HTMLElement *p = [document firstNodeMatchingSelector:@".a"];
+    HTMLElement *copy = [p copy];
+    copy[@"class"] = @"b";
+    XCTAssertEqualObjects(copy[@"class"], @"b");
+    XCTAssertEqualObjects(p[@"class"], @"a");
+    XCTAssertEqualObjects([document firstNodeMatchingSelector:@".a"], p);
+    
+    // Attribute values are built as they're recorded, so nothing keeps the source string around.
+    NSString *title = Repeat(@"a long title ", 10);
+    __weak NSString *weakSource;
+    @autoreleasepool {
+        NSString *source = [NSString stringWithFormat:@"<p title='%@'>x</p><p>y", title];
+        weakSource = source;
+        document = [HTMLDocument documentWithString:source options:options];
+    }
+    XCTAssertNil(weakSource);
+    XCTAssertEqualObjects([document firstNodeMatchingSelector:@"p"][@"title"], title);
+}
+
+- (void)testDiscardedContent
+{
+    NSString *string = @"<!-- a --><p>one <b>two</b> <i>three</i></p>\n<pre>\n <b>x</b> </pre>\n<script>alert(1)</script><style>p{}</style><template><p>hidden</p></template><table> <tr> <td>four</td></tr></table>";
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.discardedContent = HTMLParserDiscardComments | HTMLParserDiscardWhitespaceText | HTMLParserDiscardScriptAndStyleText | HTMLParserDiscardTemplateContents;
+    HTMLDocument *document = [HTMLDocument documentWithString:string options:options];
+    XCTAssertEqualObjects(document.bodyElement.innerHTML, @"<p>one <b>two</b> <i>three</i></p><pre> <b>x</b> </pre><script></script><style></style><template></template><table><tbody><tr><td>four</td></tr></tbody></table>");
+    XCTAssertEqual(document.rootElement.numberOfChildren, (NSUInteger)2);
+    XCTAssertEqualObjects([document firstNodeMatchingSelector:@"p"].textContent, @"one two three");
+    
+    document = [HTMLDocument documentWithString:@"<div><span>a</span>\n<a>b</a> <!-- c --> <div> </div>\n</div>" options:options];
+    XCTAssertEqualObjects(document.bodyElement.innerHTML, @"<div><span>a</span>\n<a>b</a><div></div></div>");
+}
+
+- (void)testPartialParsing
+{
+    NSString *string = [@"<title>Hi</title><meta name=description content=yo><p>one<p>two" stringByAppendingString:Repeat(@"<b>x</b>", 1000)];
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.stopsAfterHead = YES;
+    HTMLDocument *document = [HTMLDocument documentWithString:string options:options];
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitStopCondition);
+    XCTAssertEqualObjects([document firstNodeMatchingSelector:@"title"].textContent, @"Hi");
+    XCTAssertNotNil([document firstNodeMatchingSelector:@"meta[name=description]"]);
+    XCTAssertNil([document firstNodeMatchingSelector:@"b"]);
+    
+    options = [HTMLParserOptions new];
+    options.maximumInputLength = 50;
+    document = [HTMLDocument documentWithString:string options:options];
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitInputLength);
+    XCTAssertNil([document firstNodeMatchingSelector:@"p"]);
+    
+    options = [HTMLParserOptions new];
+    options.stopTest = ^(HTMLElement *element) {
+        return [element.tagName isEqualToString:@"p"];
+    };
+    document = [HTMLDocument documentWithString:string options:options];
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitStopCondition);
+    XCTAssertEqual([document nodesMatchingSelector:@"p"].count, (NSUInteger)1);
+    XCTAssertNil([document firstNodeMatchingSelector:@"b"]);
+}
+
+- (void)testTokenizesConcurrently
+{
+    NSString *string = Repeat(@"<p>a<script>if (1 < 2) document.write('</p>')</script><textarea><b>x</b></textarea><svg><![CDATA[<i>]]></svg><title>&amp;</title><!--c-->", 200);
+    HTMLDocument *expected = [HTMLDocument documentWithString:string];
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.tokenizesConcurrently = YES;
+    HTMLDocument *document = [HTMLDocument documentWithString:string options:options];
+    XCTAssertEqualObjects(document.serializedFragment, expected.serializedFragment);
+    
+    options.maximumTokenCount = 100;
+    document = [HTMLDocument documentWithString:string options:options];
+    XCTAssertEqual(document.exceededParserLimits, HTMLParserLimitTokenCount);
+}
+
+@end
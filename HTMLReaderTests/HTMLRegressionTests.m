@@ -4,6 +4,8 @@
 
 #import "HTMLTestUtilities.h"
 #import "HTMLDocument.h"
+#import "HTMLSelector.h"
+#import "HTMLTokenizer.h"
 
 @interface HTMLRegressionTests : XCTestCase
 
@@ -29,4 +31,39 @@
     ];
 }
 
+- (void)testSignedNumericCharacterReference
+{
+    // NSScanner used to accept a leading sign here. The spec's decimal character reference start state wants an ASCII digit right after "&#" (or "&#x" for hex); anything else is an absence-of-digits parse error, and the characters are left as they are. Browsers agree: `&#+65;` shows up as is.
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p title='&#+65;&#x+41;'>&#+65; &#-65; &# 65; &#65; &#x41;"];
+    HTMLElement *p = [document firstNodeMatchingSelector:@"p"];
+    XCTAssertEqualObjects(p.textContent, @"&#+65; &#-65; &# 65; A A");
+    XCTAssertEqualObjects(p[@"title"], @"&#+65;&#x+41;");
+    
+    NSUInteger parseErrors = 0;
+    for (id token in [[HTMLTokenizer alloc] initWithString:@"&#+65;"]) {
+        if ([token isKindOfClass:[HTMLParseErrorToken class]]) {
+            parseErrors++;
+        }
+    }
+    XCTAssertEqual(parseErrors, (NSUInteger)1);
+}
+
+- (void)testCarriageReturnsInText
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p>a\r\nb\rc&amp;\r"];
+    XCTAssertEqualObjects(document.rootElement.textContent, @"a\nb\nc&\n");
+}
+
+- (void)testDeferredAttributeValues
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p a=\"x\r\ny\" b='&amp;z' c=un\0quoted d=\"one&lt;two\" e=\"\" f>"];
+    HTMLElement *p = [document firstNodeMatchingSelector:@"p"];
+    XCTAssertEqualObjects(p.attributes, (@{ @"a": @"x\ny", @"b": @"&z", @"c": @"un\uFFFDquoted", @"d": @"one<two", @"e": @"", @"f": @"" }));
+    XCTAssertEqualObjects(p[@"c"], @"un\uFFFDquoted");
+    XCTAssertEqualObjects(p.serializedFragment, @"<p a=\"x\ny\" b=\"&amp;z\" c=\"un\uFFFDquoted\" d=\"one<two\" e=\"\" f=\"\"></p>");
+    
+    [document freeze];
+    XCTAssertEqualObjects(p[@"a"], @"x\ny");
+}
+
 @end
@@ -0,0 +1,56 @@
+//  HTMLSanitizerTests.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <XCTest/XCTest.h>
+#import "HTMLSanitizer.h"
+
+@interface HTMLSanitizerTests : XCTestCase
+
+@end
+
+@implementation HTMLSanitizerTests
+
+- (void)testAllowlists
+{
+    HTMLSanitizer *sanitizer = [HTMLSanitizer new];
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<p onclick=alert(1) title=hi>Hello <blink>there</blink></p>"], @"<p title=\"hi\">Hello there</p>");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"a<script>alert(1)</script><style>p{}</style><!-- hi -->b"], @"ab");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<svg><a href=x>no</a></svg><math><mi>no</mi></math>yes"], @"yes");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<img src=cat.png alt=\"a &quot;cat&quot;\">"], @"<img src=\"cat.png\" alt=\"a &quot;cat&quot;\">");
+    
+    sanitizer.allowedElements = [NSSet setWithObject:@"b"];
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<p><b>bold</b> &lt;i&gt;</p>"], @"<b>bold</b> &lt;i&gt;");
+}
+
+- (void)testURLSchemes
+{
+    HTMLSanitizer *sanitizer = [HTMLSanitizer new];
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<a href=\"https://example.com/?a=1&amp;b=2\">x</a>"], @"<a href=\"https://example.com/?a=1&amp;b=2\">x</a>");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<a href=/relative>x</a>"], @"<a href=\"/relative\">x</a>");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<a href=javascript:alert(1)>x</a>"], @"<a>x</a>");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<a href=\" JaVa&#x09;Script&colon;alert(1)\">x</a>"], @"<a>x</a>");
+    
+    sanitizer.allowedURLSchemes = [NSSet setWithObject:@"javascript"];
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<a href=https://example.com>x</a>"], @"<a>x</a>");
+}
+
+- (void)testTreeConstruction
+{
+    HTMLSanitizer *sanitizer = [HTMLSanitizer new];
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<p>One<p>Two<ul><li>A<li>B</ul>"], @"<p>One</p><p>Two</p><ul><li>A</li><li>B</li></ul>");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<b>1<p>2</b>3</p>"], @"<b>1</b><p><b>2</b>3</p>");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<table><tr><td>in</td></tr>out<b>side</b></table>"], @"out<b>side</b><table><tbody><tr><td>in</td></tr></tbody></table>");
+    XCTAssertEqualObjects([sanitizer sanitizeString:@"<div><p>deep <i>and <b>deeper"], @"<div><p>deep <i>and <b>deeper</b></i></p></div>");
+}
+
+- (void)testContext
+{
+    HTMLSanitizer *row = [[HTMLSanitizer alloc] initWithContextElement:[[HTMLElement alloc] initWithTagName:@"tr" attributes:nil]];
+    XCTAssertEqualObjects([row sanitizeString:@"<td colspan=2 style=color:red>a<td>b"], @"<td colspan=\"2\">a</td><td>b</td>");
+    
+    HTMLSanitizer *body = [HTMLSanitizer new];
+    XCTAssertEqualObjects([body sanitizeString:@"<td>a<td>b"], @"ab");
+}
+
+@end
@@ -258,4 +258,32 @@
     XCTAssertEqualObjects([legends valueForKey:@"tagName"], (@[ @"legend", @"legend" ]));
 }
 
+- (void)testConcurrentMatching
+{
+    for (NSString *selector in @[ @"*", @"parent", @"elem", @":disabled", @"#root > :nth-child(2n+1)", @"legend + legend input", @"nope" ]) {
+        XCTAssertEqualObjects([self.testDoc concurrentNodesMatchingSelector:selector], [self.testDoc nodesMatchingSelector:selector], @"%@", selector);
+    }
+    
+    NSMutableString *string = [NSMutableString new];
+    for (NSUInteger i = 0; i < 100; i++) {
+        [string appendFormat:@"<section id=s%@><p>%@<b>bold</b></p><ul><li><b>list</b><li>item</ul></section>", @(i), @(i)];
+    }
+    HTMLDocument *document = [HTMLDocument documentWithString:string];
+    [document freeze];
+    XCTAssertEqualObjects([document concurrentNodesMatchingSelector:@"section b"], [document nodesMatchingSelector:@"section b"]);
+    XCTAssertEqualObjects(document.concurrentTextContent, document.textContent);
+    
+    HTMLElement *b = [document firstNodeMatchingSelector:@"b"];
+    XCTAssertEqualObjects([b concurrentNodesMatchingSelector:@"b"], @[ b ]);
+    XCTAssertEqualObjects(b.concurrentTextContent, @"bold");
+    
+    // A copy of a frozen document loads its children on demand, which mustn't happen on several threads at once.
+    HTMLDocument *copy = [document deepCopy];
+    XCTAssertFalse(copy.isFrozen);
+    XCTAssertEqualObjects([[copy concurrentNodesMatchingSelector:@"section b"] valueForKey:@"textContent"], [[document nodesMatchingSelector:@"section b"] valueForKey:@"textContent"]);
+    XCTAssertEqualObjects(copy.concurrentTextContent, document.textContent);
+    
+    XCTAssertThrows([self.testDoc concurrentNodesMatchingSelector:@"[id]asdf"]);
+}
+
 @end
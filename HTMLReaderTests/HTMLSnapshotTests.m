@@ -0,0 +1,93 @@
+//  HTMLSnapshotTests.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <XCTest/XCTest.h>
+#import "HTMLComment.h"
+#import "HTMLDocument+Private.h"
+#import "HTMLSelector.h"
+#import "HTMLSerialization.h"
+#import "HTMLSnapshot.h"
+
+@interface HTMLSnapshotTests : XCTestCase
+
+@end
+
+@implementation HTMLSnapshotTests
+
+- (void)testRoundTrip
+{
+    NSString *string = @"<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01//EN\" \"http://www.w3.org/TR/html4/strict.dtd\">"
+                       @"<title>Snap</title><!-- shh -->"
+                       @"<p class=a id=first>One <b class=a>two</b></p><p class=a>Three"
+                       @"<svg viewBox='0 0 1 1'><circle r=1 /></svg><math><mi>x</mi></math>";
+    HTMLDocument *original = [HTMLDocument documentWithString:string];
+    original.parsedStringEncoding = NSWindowsCP1252StringEncoding;
+    
+    NSError *error;
+    HTMLDocument *loaded = [HTMLDocument documentWithSnapshotData:original.snapshotData error:&error];
+    XCTAssertNotNil(loaded, @"%@", error);
+    XCTAssertTrue(loaded.frozen);
+    XCTAssertEqual(loaded.quirksMode, original.quirksMode);
+    XCTAssertEqual(loaded.parsedStringEncoding, original.parsedStringEncoding);
+    XCTAssertEqualObjects(loaded.serializedFragment, original.serializedFragment);
+    XCTAssertEqualObjects(loaded.documentType.publicIdentifier, @"-//W3C//DTD HTML 4.01//EN");
+    XCTAssertEqualObjects(loaded.documentType.systemIdentifier, @"http://www.w3.org/TR/html4/strict.dtd");
+    XCTAssertEqual([loaded firstNodeMatchingSelector:@"circle"].htmlNamespace, HTMLNamespaceSVG);
+    XCTAssertEqual([loaded firstNodeMatchingSelector:@"mi"].htmlNamespace, HTMLNamespaceMathML);
+    XCTAssertEqualObjects([loaded firstNodeMatchingSelector:@"p"].attributes.allKeys, (@[ @"class", @"id" ]));
+    XCTAssertEqual([loaded nodesMatchingSelector:@".a"].count, (NSUInteger)3);
+    
+    HTMLElement *b = [loaded firstNodeMatchingSelector:@"b"];
+    XCTAssertEqualObjects(b.document, loaded);
+    XCTAssertEqualObjects(b.parentElement[@"id"], @"first");
+}
+
+- (void)testEmptyDocument
+{
+    HTMLDocument *loaded = [HTMLDocument documentWithSnapshotData:[HTMLDocument new].snapshotData error:nil];
+    XCTAssertNotNil(loaded);
+    XCTAssertEqual(loaded.numberOfChildren, (NSUInteger)0);
+}
+
+- (void)testFile
+{
+    HTMLDocument *original = [HTMLDocument documentWithString:@"<p>Hello <i>there"];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    XCTAssertTrue([original.snapshotData writeToFile:path atomically:NO]);
+    
+    NSError *error;
+    HTMLDocument *loaded = [HTMLDocument documentWithContentsOfSnapshotFile:path error:&error];
+    XCTAssertEqualObjects(loaded.serializedFragment, original.serializedFragment, @"%@", error);
+    loaded = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testFrozenAfterLoading
+{
+    HTMLDocument *original = [HTMLDocument documentWithString:@"<p>Hello"];
+    HTMLDocument *loaded = [HTMLDocument documentWithSnapshotData:original.snapshotData error:nil];
+    HTMLElement *p = [loaded firstNodeMatchingSelector:@"p"];
+    XCTAssertTrue(p.frozen);
+    XCTAssertThrowsSpecificNamed([p addChild:[HTMLComment new]], NSException, NSInternalInconsistencyException);
+}
+
+- (void)testBadData
+{
+    NSError *error;
+    XCTAssertNil([HTMLDocument documentWithSnapshotData:(NSData *)[@"<p>not a snapshot" dataUsingEncoding:NSUTF8StringEncoding] error:&error]);
+    XCTAssertEqualObjects(error.domain, HTMLSnapshotErrorDomain);
+    XCTAssertEqual(error.code, HTMLSnapshotErrorNotASnapshot);
+    
+    NSMutableData *data = [[HTMLDocument documentWithString:@"<p>Hi"].snapshotData mutableCopy];
+    uint32_t version = CFSwapInt32HostToLittle(99);
+    [data replaceBytesInRange:NSMakeRange(8, sizeof(version)) withBytes:&version];
+    XCTAssertNil([HTMLDocument documentWithSnapshotData:data error:&error]);
+    XCTAssertEqual(error.code, HTMLSnapshotErrorUnsupportedVersion);
+    
+    NSData *truncated = [[HTMLDocument documentWithString:@"<p>Hi"].snapshotData subdataWithRange:NSMakeRange(0, 60)];
+    XCTAssertNil([HTMLDocument documentWithSnapshotData:truncated error:&error]);
+    XCTAssertEqual(error.code, HTMLSnapshotErrorCorrupt);
+}
+
+@end
@@ -0,0 +1,99 @@
+//  HTMLStringPoolTests.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <XCTest/XCTest.h>
+#import "HTMLDocument.h"
+#import "HTMLSelector.h"
+#import "HTMLStringPool.h"
+
+@interface HTMLStringPoolTests : XCTestCase
+
+@end
+
+@implementation HTMLStringPoolTests
+
+- (void)testInterning
+{
+    HTMLStringPool *pool = [HTMLStringPool new];
+    NSMutableString *mutable = [NSMutableString stringWithString:@"class"];
+    NSString *pooled = [pool internString:mutable];
+    XCTAssertEqualObjects(pooled, @"class");
+    [mutable appendString:@"y"];
+    XCTAssertEqualObjects(pooled, @"class");
+    XCTAssertEqual([pool internString:[@"cla" stringByAppendingString:@"ss"]], pooled);
+    XCTAssertEqual(pool.count, (NSUInteger)1);
+    
+    pool.maximumCount = 1;
+    NSString *unpooled = [pool internString:@"href"];
+    XCTAssertEqualObjects(unpooled, @"href");
+    XCTAssertEqual(pool.count, (NSUInteger)1);
+    
+    [pool removeAllStrings];
+    XCTAssertEqual(pool.count, (NSUInteger)0);
+}
+
+- (void)testSharingAmongDocuments
+{
+    HTMLStringPool *pool = [HTMLStringPool new];
+    pool.maximumValueLength = 8;
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.stringPool = pool;
+    NSString *string = @"<a rel=nofollow href=/a-long-path class=&quot;x&quot;>a</a>";
+    HTMLElement *first = [[HTMLDocument documentWithString:string options:options] firstNodeMatchingSelector:@"a"];
+    HTMLElement *second = [[HTMLDocument documentWithString:string options:options] firstNodeMatchingSelector:@"a"];
+    
+    XCTAssertEqual(first.attributes.allKeys.firstObject, second.attributes.allKeys.firstObject);
+    XCTAssertEqual(first[@"rel"], second[@"rel"]);
+    XCTAssertEqual(first[@"class"], second[@"class"]);
+    XCTAssertEqualObjects(first[@"class"], @"\"x\"");
+    XCTAssertEqualObjects(first[@"href"], @"/a-long-path");
+    
+    // Three names and the two short values.
+    XCTAssertEqual(pool.count, (NSUInteger)5);
+}
+
+- (void)testSelectors
+{
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    options.stringPool = [HTMLStringPool sharedPool];
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p id=a class=b>1<p class='b c' title>2<p class=c data-x=b>3" options:options];
+    XCTAssertEqualObjects([[document nodesMatchingSelector:@"#a"] valueForKey:@"textContent"], @[ @"1" ]);
+    XCTAssertEqualObjects([[document nodesMatchingSelector:@".b"] valueForKey:@"textContent"], (@[ @"1", @"2" ]));
+    XCTAssertEqualObjects([[document nodesMatchingSelector:@"[title]"] valueForKey:@"textContent"], @[ @"2" ]);
+    XCTAssertEqualObjects([[document nodesMatchingSelector:@"[data-x=b]"] valueForKey:@"textContent"], @[ @"3" ]);
+    XCTAssertEqualObjects([[document nodesMatchingSelector:@"[class=c]"] valueForKey:@"textContent"], @[ @"3" ]);
+    XCTAssertEqualObjects([[document nodesMatchingSelector:@"[class~='b c']"] valueForKey:@"textContent"], @[]);
+    XCTAssertEqualObjects([[document nodesMatchingSelector:@"[class~='']"] valueForKey:@"textContent"], @[]);
+    
+    HTMLStringPool *pool = [HTMLStringPool new];
+    options.stringPool = pool;
+    HTMLElement *link = [[HTMLDocument documentWithString:@"<a href=/ rel=next>" options:options] firstNodeMatchingSelector:@"a"];
+    XCTAssertEqualObjects(link[[pool internString:@"rel"]], @"next");
+    XCTAssertEqualObjects(link[@"href"], @"/");
+    
+    // Selectors leave pools alone.
+    NSUInteger sharedCount = [HTMLStringPool sharedPool].count;
+    XCTAssertEqualObjects([document nodesMatchingSelector:@"[data-unpooled~=unpooled]"], @[]);
+    XCTAssertEqual([HTMLStringPool sharedPool].count, sharedCount);
+}
+
+- (void)testConcurrentInterning
+{
+    HTMLStringPool *pool = [HTMLStringPool new];
+    NSUInteger count = 64;
+    __unsafe_unretained NSString **results = (__unsafe_unretained NSString **)calloc(count, sizeof(NSString *));
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        for (NSUInteger j = 0; j < 100; j++) {
+            [pool internString:[NSString stringWithFormat:@"value%@", @(j)]];
+        }
+        results[i] = [pool internString:[NSString stringWithFormat:@"value%@", @(7)]];
+    });
+    for (NSUInteger i = 1; i < count; i++) {
+        XCTAssertEqual(results[i], results[0]);
+    }
+    XCTAssertEqual(pool.count, (NSUInteger)100);
+    free(results);
+}
+
+@end
@@ -0,0 +1,117 @@
+//  HTMLTraversalTests.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <XCTest/XCTest.h>
+#import "HTMLDocument.h"
+#import "HTMLSelector.h"
+#import "HTMLTextNode.h"
+#import "HTMLTraversal.h"
+
+@interface HTMLTraversalTests : XCTestCase
+
+@end
+
+@implementation HTMLTraversalTests
+
+static NSString * Describe(HTMLNode *node)
+{
+    if ([node isKindOfClass:[HTMLElement class]]) {
+        return ((HTMLElement *)node).tagName;
+    } else if ([node isKindOfClass:[HTMLTextNode class]]) {
+        return ((HTMLTextNode *)node).data;
+    } else {
+        return NSStringFromClass(node.class);
+    }
+}
+
+- (void)testEnterAndLeave
+{
+    HTMLElement *div = [[HTMLDocument documentWithString:@"<div><p>one<!-- c --><p>two</div>"] firstNodeMatchingSelector:@"div"];
+    NSMutableArray *events = [NSMutableArray new];
+    BOOL completed = [div traverseNodesOfTypes:HTMLTraversalAllNodes enter:^(HTMLNode *node) {
+        [events addObject:[@"+" stringByAppendingString:Describe(node)]];
+        return HTMLTraversalContinue;
+    } leave:^(HTMLNode *node) {
+        [events addObject:[@"-" stringByAppendingString:Describe(node)]];
+        return HTMLTraversalContinue;
+    }];
+    XCTAssertTrue(completed);
+    XCTAssertEqualObjects(events, (@[ @"+div", @"+p", @"+one", @"-one", @"+HTMLComment", @"-HTMLComment", @"-p", @"+p", @"+two", @"-two", @"-p", @"-div" ]));
+}
+
+- (void)testNodeTypes
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p>one<!-- c --><b>two</b>"];
+    NSMutableArray *elements = [NSMutableArray new];
+    [document traverseNodesOfTypes:HTMLTraversalElements enter:^(HTMLNode *node) {
+        [elements addObject:Describe(node)];
+        return HTMLTraversalContinue;
+    } leave:nil];
+    XCTAssertEqualObjects(elements, (@[ @"html", @"head", @"body", @"p", @"b" ]));
+    
+    NSMutableArray *text = [NSMutableArray new];
+    [document traverseNodesOfTypes:HTMLTraversalTextNodes enter:nil leave:^(HTMLNode *node) {
+        [text addObject:Describe(node)];
+        return HTMLTraversalContinue;
+    }];
+    XCTAssertEqualObjects(text, (@[ @"one", @"two" ]));
+}
+
+- (void)testSkipChildren
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p>one<script>var x;</script><svg><text>two</text></svg><b>three</b>"];
+    NSMutableArray *text = [NSMutableArray new];
+    NSMutableArray *left = [NSMutableArray new];
+    [document traverseNodesOfTypes:HTMLTraversalElements | HTMLTraversalTextNodes enter:^(HTMLNode *node) {
+        if ([node isKindOfClass:[HTMLTextNode class]]) {
+            [text addObject:Describe(node)];
+        } else if ([Describe(node) isEqualToString:@"script"] || [Describe(node) isEqualToString:@"svg"]) {
+            return HTMLTraversalSkipChildren;
+        }
+        return HTMLTraversalContinue;
+    } leave:^(HTMLNode *node) {
+        [left addObject:Describe(node)];
+        return HTMLTraversalContinue;
+    }];
+    XCTAssertEqualObjects(text, (@[ @"one", @"three" ]));
+    XCTAssertTrue([left containsObject:@"script"]);
+    XCTAssertTrue([left containsObject:@"svg"]);
+    XCTAssertFalse([left containsObject:@"text"]);
+}
+
+- (void)testStop
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p>one<p>two<p>three"];
+    __block NSUInteger count = 0;
+    BOOL completed = [document traverseNodesOfTypes:HTMLTraversalTextNodes enter:^(HTMLNode *node) {
+        count++;
+        return [Describe(node) isEqualToString:@"two"] ? HTMLTraversalStop : HTMLTraversalContinue;
+    } leave:^(HTMLNode *node) {
+        XCTAssertNotEqualObjects(Describe(node), @"two");
+        return HTMLTraversalContinue;
+    }];
+    XCTAssertFalse(completed);
+    XCTAssertEqual(count, (NSUInteger)2);
+}
+
+static HTMLTraversalAction CountNode(HTMLNode *node, void *context)
+{
+    (*(NSUInteger *)context)++;
+    return HTMLTraversalContinue;
+}
+
+- (void)testFunction
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<p>one<!-- c --><b>two</b>"];
+    NSUInteger count = 0;
+    XCTAssertTrue(HTMLTraverseTree(document, HTMLTraversalComments | HTMLTraversalOtherNodes, CountNode, NULL, &count));
+    XCTAssertEqual(count, (NSUInteger)2);
+    
+    HTMLNode *leaf = [document firstNodeMatchingSelector:@"b"].children.firstObject;
+    count = 0;
+    XCTAssertTrue(HTMLTraverseTree(leaf, HTMLTraversalAllNodes, CountNode, CountNode, &count));
+    XCTAssertEqual(count, (NSUInteger)2);
+}
+
+@end
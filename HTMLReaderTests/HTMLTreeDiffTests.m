@@ -0,0 +1,146 @@
+//  HTMLTreeDiffTests.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <XCTest/XCTest.h>
+#import "HTMLDocument.h"
+#import "HTMLSelector.h"
+#import "HTMLTextNode.h"
+#import "HTMLTreeDiff.h"
+
+@interface HTMLTreeDiffTests : XCTestCase
+
+@end
+
+@implementation HTMLTreeDiffTests
+
+// A chain of nested divs with some text at the bottom.
+static HTMLElement * DeepTree(NSUInteger depth, NSString *text)
+{
+    HTMLElement *root = [[HTMLElement alloc] initWithTagName:@"div" attributes:nil];
+    HTMLElement *parent = root;
+    for (NSUInteger i = 1; i < depth; i++) {
+        HTMLElement *child = [[HTMLElement alloc] initWithTagName:@"div" attributes:nil];
+        [parent addChild:child];
+        parent = child;
+    }
+    [parent addChild:[[HTMLTextNode alloc] initWithData:text]];
+    return root;
+}
+
+// Takes the chain apart from the bottom, so no one release has to free the rest of it.
+static void DismantleDeepTree(HTMLNode *root)
+{
+    HTMLNode *node = root;
+    while (node.numberOfChildren > 0) {
+        node = [node childAtIndex:0];
+    }
+    while (node != root) {
+        HTMLNode *parent = node.parentNode;
+        [node removeFromParentNode];
+        node = parent;
+    }
+}
+
+- (void)testSubtreeHash
+{
+    HTMLDocument *a = [HTMLDocument documentWithString:@"<ul><li class=x id=y>One<li>Two</ul>"];
+    HTMLDocument *b = [HTMLDocument documentWithString:@"<ul><li id=y class=x>One<li>Two</ul><p>Different"];
+    XCTAssertEqual([a firstNodeMatchingSelector:@"ul"].subtreeHash, [b firstNodeMatchingSelector:@"ul"].subtreeHash);
+    XCTAssertNotEqual(a.subtreeHash, b.subtreeHash);
+    
+    NSArray *items = [a nodesMatchingSelector:@"li"];
+    XCTAssertNotEqual([items[0] subtreeHash], [items[1] subtreeHash]);
+}
+
+- (void)testSubtreeHashInvalidation
+{
+    HTMLDocument *document = [HTMLDocument documentWithString:@"<div><p>Hello <b>there</b></p></div>"];
+    uint64_t documentHash = document.subtreeHash;
+    HTMLElement *div = [document firstNodeMatchingSelector:@"div"];
+    uint64_t divHash = div.subtreeHash;
+    HTMLElement *b = [document firstNodeMatchingSelector:@"b"];
+    
+    b[@"class"] = @"loud";
+    XCTAssertNotEqual(document.subtreeHash, documentHash);
+    XCTAssertNotEqual(div.subtreeHash, divHash);
+    [b removeAttributeWithName:@"class"];
+    XCTAssertEqual(document.subtreeHash, documentHash);
+    XCTAssertEqual(div.subtreeHash, divHash);
+    
+    [(HTMLTextNode *)[b childAtIndex:0] appendString:@"!"];
+    XCTAssertNotEqual(div.subtreeHash, divHash);
+    
+    [b removeFromParentNode];
+    XCTAssertNotEqual(div.subtreeHash, divHash);
+}
+
+- (void)testIdenticalTrees
+{
+    NSString *string = @"<!doctype html><title>Same</title><p>Same";
+    HTMLDocument *a = [HTMLDocument documentWithString:string];
+    HTMLDocument *b = [HTMLDocument documentWithString:string];
+    XCTAssertEqualObjects([a changesToNode:b], @[]);
+}
+
+- (void)testChanges
+{
+    HTMLDocument *a = [HTMLDocument documentWithString:@"<nav>Menu</nav><p id=1>One<p id=2>Two<footer>Foot</footer>"];
+    HTMLDocument *b = [HTMLDocument documentWithString:@"<nav>Menu</nav><p id=1>One<p id=2 class=new>Two<p id=3>Three<footer>Foot</footer>"];
+    NSArray *changes = [a changesToNode:b];
+    
+    NSArray *types = [changes valueForKey:@"type"];
+    XCTAssertEqualObjects(types, (@[ @(HTMLTreeChangeModification), @(HTMLTreeChangeInsertion) ]));
+    
+    HTMLTreeChange *modification = changes[0];
+    XCTAssertNil([(HTMLElement *)modification.oldNode objectForKeyedSubscript:@"class"]);
+    XCTAssertEqualObjects([(HTMLElement *)modification.updatedNode objectForKeyedSubscript:@"class"], @"new");
+    
+    HTMLTreeChange *insertion = changes[1];
+    XCTAssertNil(insertion.oldNode);
+    XCTAssertEqualObjects(insertion.updatedNode.textContent, @"Three");
+}
+
+- (void)testRemovalAndTextChange
+{
+    HTMLDocument *a = [HTMLDocument documentWithString:@"<div><span>Keep</span><b>Drop</b><i>Old</i></div>"];
+    HTMLDocument *b = [HTMLDocument documentWithString:@"<div><span>Keep</span><i>New</i></div>"];
+    NSArray *changes = [a changesToNode:b];
+    
+    XCTAssertEqual(changes.count, (NSUInteger)2);
+    XCTAssertEqual([changes[0] type], HTMLTreeChangeRemoval);
+    XCTAssertEqualObjects([(HTMLElement *)[changes[0] oldNode] tagName], @"b");
+    XCTAssertEqual([changes[1] type], HTMLTreeChangeModification);
+    XCTAssertEqualObjects([(HTMLTextNode *)[changes[1] oldNode] data], @"Old");
+    XCTAssertEqualObjects([(HTMLTextNode *)[changes[1] updatedNode] data], @"New");
+}
+
+- (void)testDeepTrees
+{
+    HTMLElement *a = DeepTree(100000, @"a");
+    HTMLElement *b = DeepTree(100000, @"b");
+    HTMLElement *sameAsA = DeepTree(100000, @"a");
+    XCTAssertNotEqual(a.subtreeHash, b.subtreeHash);
+    XCTAssertEqual(a.subtreeHash, sameAsA.subtreeHash);
+    
+    NSArray *changes = [a changesToNode:b];
+    XCTAssertEqual(changes.count, (NSUInteger)1);
+    XCTAssertEqual([changes[0] type], HTMLTreeChangeModification);
+    XCTAssertEqualObjects([(HTMLTextNode *)[changes[0] updatedNode] data], @"b");
+    XCTAssertEqualObjects([a changesToNode:sameAsA], @[]);
+    
+    changes = nil;
+    DismantleDeepTree(a);
+    DismantleDeepTree(b);
+    DismantleDeepTree(sameAsA);
+}
+
+- (void)testDifferentRoots
+{
+    HTMLElement *a = [[HTMLElement alloc] initWithTagName:@"a" attributes:nil];
+    HTMLElement *b = [[HTMLElement alloc] initWithTagName:@"b" attributes:nil];
+    NSArray *types = [[a changesToNode:b] valueForKey:@"type"];
+    XCTAssertEqualObjects(types, (@[ @(HTMLTreeChangeRemoval), @(HTMLTreeChangeInsertion) ]));
+}
+
+@end
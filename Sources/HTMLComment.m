@@ -3,6 +3,8 @@
 //  Public domain. https://github.com/nolanw/HTMLReader
 
 #import "HTMLComment.h"
+#import "HTMLNode+Private.h"
+#import "HTMLString.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -23,6 +25,12 @@ NS_ASSUME_NONNULL_BEGIN
     return [self initWithData:@""];
 }
 
+- (void)setData:(NSString *)data
+{
+    WillMutateNode(self);
+    _data = [data copy];
+}
+
 - (NSString *)textContent
 {
     return self.data;
@@ -33,6 +41,11 @@ NS_ASSUME_NONNULL_BEGIN
     self.data = textContent;
 }
 
+- (uint64_t)contentHash
+{
+    return HashCombineString([super contentHash], _data);
+}
+
 #pragma mark NSCopying
 
 - (id)copyWithZone:(NSZone * __nullable)zone
@@ -3,9 +3,20 @@
 //  Public domain. https://github.com/nolanw/HTMLReader
 
 #import "HTMLDocument.h"
+@class HTMLQueryCache;
 
 @interface HTMLDocument (Private)
 
 @property (nonatomic) NSStringEncoding parsedStringEncoding;
 
+@property (copy, nonatomic) NSDictionary *parserStatistics;
+
+@property (assign, nonatomic) HTMLParserLimit exceededParserLimits;
+
+/// The cache used by selector queries, or nil if queryCacheCapacity is 0.
+@property (readonly, strong, nonatomic) HTMLQueryCache *queryCache;
+
 @end
+
+/// Called for every change to a node in the document.
+extern void DocumentDidMutate(HTMLDocument *document);
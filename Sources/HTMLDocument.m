@@ -3,17 +3,27 @@
 //  Public domain. https://github.com/nolanw/HTMLReader
 
 #import "HTMLDocument+Private.h"
+#import "HTMLNode+Private.h"
 #import "HTMLParser.h"
+#import "HTMLQueryCache.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 @implementation HTMLDocument
+{
+    HTMLQueryCache *_queryCache;
+}
 
 + (instancetype)documentWithData:(NSData *)data contentTypeHeader:(NSString * __nullable)contentType
+{
+    return [self documentWithData:data contentTypeHeader:contentType options:nil];
+}
+
++ (instancetype)documentWithData:(NSData *)data contentTypeHeader:(NSString * __nullable)contentType options:(HTMLParserOptions * __nullable)options
 {
     NSParameterAssert(data);
     
-    HTMLParser *parser = ParserWithDataAndContentType(data, contentType);
+    HTMLParser *parser = ParserWithDataAndContentType(data, contentType, options);
     return parser.document;
 }
 
@@ -25,6 +35,11 @@ NS_ASSUME_NONNULL_BEGIN
 }
 
 + (instancetype)documentWithString:(NSString *)string
+{
+    return [self documentWithString:string options:nil];
+}
+
++ (instancetype)documentWithString:(NSString *)string options:(HTMLParserOptions * __nullable)options
 {
     NSParameterAssert(string);
     
@@ -33,6 +48,7 @@ NS_ASSUME_NONNULL_BEGIN
         .confidence = Tentative
     };
     HTMLParser *parser = [[HTMLParser alloc] initWithString:string encoding:defaultEncoding context:nil];
+    parser.options = options;
     return parser.document;
 }
 
@@ -80,9 +96,65 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)setParsedStringEncoding:(NSStringEncoding)parsedStringEncoding
 {
+    WillMutateNode(self);
     _parsedStringEncoding = parsedStringEncoding;
 }
 
+- (void)setParserStatistics:(NSDictionary * __nullable)parserStatistics
+{
+    WillMutateNode(self);
+    _parserStatistics = [parserStatistics copy];
+}
+
+- (void)setExceededParserLimits:(HTMLParserLimit)exceededParserLimits
+{
+    WillMutateNode(self);
+    _exceededParserLimits = exceededParserLimits;
+}
+
+- (void)setQuirksMode:(HTMLQuirksMode)quirksMode
+{
+    WillMutateNode(self);
+    _quirksMode = quirksMode;
+}
+
+void DocumentDidMutate(HTMLDocument *document)
+{
+    document->_mutationVersion++;
+}
+
+- (NSUInteger)queryCacheCapacity
+{
+    return _queryCache.capacity;
+}
+
+- (void)setQueryCacheCapacity:(NSUInteger)queryCacheCapacity
+{
+    if (queryCacheCapacity == 0) {
+        [_queryCache removeAllResults];
+        _queryCache = nil;
+    } else if (_queryCache) {
+        _queryCache.capacity = queryCacheCapacity;
+    } else {
+        _queryCache = [[HTMLQueryCache alloc] initWithCapacity:queryCacheCapacity];
+    }
+}
+
+- (HTMLQueryCache * __nullable)queryCache
+{
+    return _queryCache;
+}
+
+- (NSUInteger)queryCacheHitCount
+{
+    return _queryCache.hitCount;
+}
+
+- (NSUInteger)queryCacheMissCount
+{
+    return _queryCache.missCount;
+}
+
 - (HTMLElement * __nullable)rootElement
 {
     return FirstNodeOfType(self.children, [HTMLElement class]);
@@ -114,6 +186,26 @@ NS_ASSUME_NONNULL_BEGIN
 	return nil;
 }
 
+- (void)freeze
+{
+    if (self.frozen) {
+        return;
+    }
+    for (HTMLNode *node in self.treeEnumerator) {
+        [node freezeStorage];
+    }
+}
+
+#pragma mark NSCopying
+
+- (id)copyWithZone:(NSZone * __nullable)zone
+{
+    HTMLDocument *copy = [super copyWithZone:zone];
+    copy->_quirksMode = _quirksMode;
+    copy->_parsedStringEncoding = _parsedStringEncoding;
+    return copy;
+}
+
 static id FirstNodeOfType(id <NSFastEnumeration> collection, Class type)
 {
     for (id node in collection) {
@@ -4,6 +4,8 @@
 
 #import "HTMLDocumentType.h"
 #import "HTMLDocument.h"
+#import "HTMLNode+Private.h"
+#import "HTMLString.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -26,6 +28,13 @@ NS_ASSUME_NONNULL_BEGIN
     return [self initWithName:@"html" publicIdentifier:nil systemIdentifier:nil];
 }
 
+- (uint64_t)contentHash
+{
+    uint64_t hash = HashCombineString([super contentHash], _name);
+    hash = HashCombineString(hash, _publicIdentifier);
+    return HashCombineString(hash, _systemIdentifier);
+}
+
 #pragma mark NSCopying
 
 - (id)copyWithZone:(NSZone * __nullable)zone
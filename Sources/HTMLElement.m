@@ -3,14 +3,28 @@
 //  Public domain. https://github.com/nolanw/HTMLReader
 
 #import "HTMLElement.h"
+#import "HTMLNode+Private.h"
 #import "HTMLOrderedDictionary.h"
 #import "HTMLSelector.h"
+#import "HTMLString.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 @implementation HTMLElement
 {
     HTMLOrderedDictionary *_attributes;
+    
+    // YES when _attributes belongs to a frozen element this one was copied from.
+    BOOL _sharesAttributes;
+}
+
+static void WillMutateAttributes(HTMLElement *element)
+{
+    WillMutateNode(element);
+    if (element->_sharesAttributes) {
+        element->_attributes = [element->_attributes copy];
+        element->_sharesAttributes = NO;
+    }
 }
 
 - (instancetype)initWithTagName:(NSString *)tagName attributes:(HTMLDictOf(NSString *, NSString *) * __nullable)attributes
@@ -19,19 +33,46 @@ NS_ASSUME_NONNULL_BEGIN
     
     if ((self = [super init])) {
         _tagName = [tagName copy];
-        _attributes = [HTMLOrderedDictionary new];
-        if (attributes) {
-            [_attributes addEntriesFromDictionary:(NSDictionary * __nonnull)attributes];
+        if ([attributes isKindOfClass:[HTMLOrderedDictionary class]]) {
+            // Keeps any deferred attribute values from the tokenizer deferred.
+            _attributes = [(HTMLOrderedDictionary *)attributes copy];
+        } else {
+            _attributes = [HTMLOrderedDictionary new];
+            if (attributes) {
+                [_attributes addEntriesFromDictionary:(NSDictionary * __nonnull)attributes];
+            }
         }
     }
     return self;
 }
 
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)initWithTagName:(NSString *)tagName sharedAttributes:(HTMLOrderedDictionary *)attributes
+{
+    NSParameterAssert(tagName);
+    NSParameterAssert(attributes);
+    
+    if ((self = [super init])) {
+        _tagName = [tagName copy];
+        _attributes = attributes;
+        _sharesAttributes = YES;
+    }
+    return self;
+}
+#pragma clang diagnostic pop
+
 - (instancetype)init
 {
     return [self initWithTagName:@"" attributes:nil];
 }
 
+HTMLOrderedDictionary * AttributesOfElement(HTMLElement *element)
+{
+    return element->_attributes;
+}
+
 - (HTMLDictOf(NSString *, NSString *) *)attributes
 {
     return [_attributes copy];
@@ -45,15 +86,23 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)setObject:(NSString *)attributeValue forKeyedSubscript:(NSString *)attributeName
 {
     NSParameterAssert(attributeValue);
-
+    
+    WillMutateAttributes(self);
     [_attributes setObject:attributeValue forKey:attributeName];
 }
 
 - (void)removeAttributeWithName:(NSString *)attributeName
 {
+    WillMutateAttributes(self);
     [_attributes removeObjectForKey:attributeName];
 }
 
+- (void)setHtmlNamespace:(HTMLNamespace)htmlNamespace
+{
+    WillMutateNode(self);
+    _htmlNamespace = htmlNamespace;
+}
+
 - (BOOL)hasClass:(NSString *)className
 {
     NSParameterAssert(className);
@@ -77,13 +126,52 @@ NS_ASSUME_NONNULL_BEGIN
     self[@"class"] = [classes componentsJoinedByString:@" "];
 }
 
+- (uint64_t)contentHash
+{
+    uint64_t hash = HashCombineString([super contentHash], _tagName);
+    hash = HashCombine(hash, (uint64_t)_htmlNamespace);
+    
+    // Attribute order doesn't matter, so each attribute is hashed separately and the results summed.
+    uint64_t attributesHash = 0;
+    for (NSString *name in _attributes) {
+        attributesHash += HashCombineString(HashCombineString(0, name), _attributes[name]);
+    }
+    return HashCombine(hash, attributesHash);
+}
+
+- (void)freezeStorage
+{
+    static HTMLOrderedDictionary *noAttributes;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        noAttributes = [HTMLOrderedDictionary new];
+    });
+    
+    [super freezeStorage];
+    
+    // Most elements have no attributes, so they can all share one (never to be mutated) dictionary. The rest get a snug copy, which builds any deferred values so the document's source string can go. Shared dictionaries never change, and whoever shared them (a frozen original, or the tape) already built their deferred values, so they stay as they are.
+    if (_sharesAttributes) {
+        return;
+    } else if (_attributes.count > 0) {
+        _attributes = [_attributes copy];
+        [_attributes resolveDeferredStrings];
+    } else {
+        _attributes = noAttributes;
+    }
+}
+
 #pragma mark NSCopying
 
 - (id)copyWithZone:(NSZone * __nullable)zone
 {
     HTMLElement *copy = [super copyWithZone:zone];
     copy->_tagName = self.tagName;
-    copy->_attributes = [_attributes copy];
+    if (self.frozen) {
+        copy->_attributes = _attributes;
+        copy->_sharesAttributes = YES;
+    } else {
+        copy->_attributes = [_attributes copy];
+    }
     return copy;
 }
 
@@ -34,5 +34,17 @@ extern BOOL IsASCIICompatibleEncoding(NSStringEncoding encoding);
 /// Returns YES if encoding is UTF16-LE or UTF16-BE.
 extern BOOL IsUTF16Encoding(NSStringEncoding encoding);
 
-/// Returns YES if Windows-1252 encoding is used even when characters are found at unused positions in the code page. (The relevant NSString API to enable this appeared in iOS 8 and Mac OS X 10.10.)
-extern BOOL UsesLossyWindows1252Decoding(void);
+/// Returns YES if encoding is one of the legacy single-byte encodings (e.g. windows-1252, ISO-8859-2, KOI8-R) that HTMLReader decodes by itself.
+extern BOOL IsSingleByteEncoding(NSStringEncoding encoding);
+
+/**
+    Decodes data in a legacy single-byte encoding exactly as specified by the WHATWG Encoding Standard, with bytes that have no mapping becoming U+FFFD REPLACEMENT CHARACTER. Much faster than NSString's decoding.
+ 
+    @return A string, or nil if encoding is not a single-byte encoding or there isn't enough memory to decode into. StringByDecodingData() falls back to NSString in either case.
+ 
+    For more information, see https://encoding.spec.whatwg.org/#single-byte-decoder
+ */
+extern NSString * StringByDecodingSingleByteData(NSData *data, NSStringEncoding encoding);
+
+/// Decodes data with HTMLReader's own decoder if it has one for encoding, otherwise with NSString. Returns nil if the data is invalid in the encoding.
+extern NSString * StringByDecodingData(NSData *data, NSStringEncoding encoding);
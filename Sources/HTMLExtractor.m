@@ -0,0 +1,284 @@
+//  HTMLExtractor.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLExtractor.h"
+#import "HTMLNode+Private.h"
+#import "HTMLParser.h"
+#import "HTMLSelector+Private.h"
+#import "HTMLTraversal.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef void (^HTMLExtractionBlock)(HTMLElement *element, NSUInteger selectorIndex, BOOL *stop);
+
+// Matches elements as the parser finishes with them, cutting down the ones whose contents nobody wants.
+@interface HTMLExtractingHandler : NSObject <HTMLFinishedElementHandler>
+
+- (instancetype)initWithSelectors:(HTMLArrayOf(HTMLSelector *) *)selectors block:(HTMLExtractionBlock)block NS_DESIGNATED_INITIALIZER;
+
+@property (readonly, assign, nonatomic) BOOL stopped;
+
+// Matches whatever the parser never said it was finished with: the last element in each subtree.
+- (void)finishDocument:(HTMLDocument *)document;
+
+@end
+
+// Calls the block for each selector that matches the element, returning YES if any did.
+static BOOL ReportMatches(HTMLArrayOf(HTMLSelector *) *selectors, HTMLElement *element, HTMLExtractionBlock block, BOOL *stop)
+{
+    BOOL matched = NO;
+    for (NSUInteger i = 0, end = selectors.count; i < end && !*stop; i++) {
+        if ([selectors[i] matchesElement:element]) {
+            matched = YES;
+            block(element, i, stop);
+        }
+    }
+    return matched;
+}
+
+// These pseudo-classes look at siblings after the element, which aren't there yet when the parser finishes with it.
+static BOOL DependsOnLaterSiblings(HTMLSelector *selector)
+{
+    static NSSet *laterSiblingPseudoClasses;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        laterSiblingPseudoClasses = [NSSet setWithObjects:@"last-child", @"only-child", @"last-of-type", @"only-of-type", @"nth-last-child", @"nth-last-of-type", nil];
+    });
+    return [selector.pseudoClasses intersectsSet:laterSiblingPseudoClasses];
+}
+
+@implementation HTMLExtractor
+{
+    BOOL _matchesAsElementsFinish;
+}
+
+- (instancetype)initWithSelectors:(HTMLArrayOf(HTMLSelector *) *)selectors
+{
+    NSParameterAssert(selectors);
+    
+    for (HTMLSelector *selector in selectors) {
+        if (selector.error) {
+            @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"Attempted to use selector with error: %@", selector.error] userInfo:nil];
+        }
+    }
+    if ((self = [super init])) {
+        _selectors = [selectors copy];
+        _matchesAsElementsFinish = YES;
+        for (HTMLSelector *selector in _selectors) {
+            if (DependsOnLaterSiblings(selector)) {
+                _matchesAsElementsFinish = NO;
+                break;
+            }
+        }
+    }
+    return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithSelectors:");
+    return nil;
+}
+#pragma clang diagnostic pop
+
+- (void)extractFromString:(NSString *)string usingBlock:(HTMLExtractionBlock)block
+{
+    NSParameterAssert(string);
+    NSParameterAssert(block);
+    
+    HTMLStringEncoding encoding = (HTMLStringEncoding){ .encoding = NSUTF8StringEncoding, .confidence = Tentative };
+    HTMLParser *parser = [[HTMLParser alloc] initWithString:string encoding:encoding context:nil];
+    HTMLParserOptions *options = [_options copy] ?: [HTMLParserOptions new];
+    options.createsNodesOnDemand = NO;
+    
+    if (!_matchesAsElementsFinish) {
+        parser.options = options;
+        HTMLDocument *document = parser.document;
+        
+        // Match on the way out of each element, so the order is the same as when matching during parsing.
+        HTMLArrayOf(HTMLSelector *) *selectors = _selectors;
+        __block BOOL stop = NO;
+        [document traverseNodesOfTypes:HTMLTraversalElements enter:nil leave:^HTMLTraversalAction(HTMLNode *node) {
+            ReportMatches(selectors, (HTMLElement *)node, block, &stop);
+            return stop ? HTMLTraversalStop : HTMLTraversalContinue;
+        }];
+        return;
+    }
+    
+    HTMLExtractingHandler *handler = [[HTMLExtractingHandler alloc] initWithSelectors:_selectors block:block];
+    BOOL (^stopTest)(HTMLElement *) = options.stopTest;
+    options.stopTest = ^BOOL(HTMLElement *element) {
+        return handler.stopped || (stopTest && stopTest(element));
+    };
+    parser.options = options;
+    parser.finishedElementHandler = handler;
+    HTMLDocument *document = parser.document;
+    parser.finishedElementHandler = nil;
+    [handler finishDocument:document];
+}
+
+- (HTMLArrayOf(HTMLArrayOf(HTMLElement *) *) *)elementsMatchedInString:(NSString *)string
+{
+    NSMutableArray *matches = [NSMutableArray arrayWithCapacity:_selectors.count];
+    for (NSUInteger i = 0, end = _selectors.count; i < end; i++) {
+        [matches addObject:[NSMutableArray new]];
+    }
+    [self extractFromString:string usingBlock:^(HTMLElement *element, NSUInteger selectorIndex, BOOL *stop) {
+        [matches[selectorIndex] addObject:element];
+    }];
+    return matches;
+}
+
+@end
+
+@implementation HTMLExtractingHandler
+{
+    HTMLArrayOf(HTMLSelector *) *_selectors;
+    HTMLExtractionBlock _block;
+    
+    // Elements that have been matched. Forgotten once their parents are matched too.
+    NSHashTable *_finishedElements;
+    
+    // Elements mapped to whether their contents are kept, because they or an ancestor match. Forgotten once their parents are matched.
+    NSMapTable *_keepsContents;
+}
+
+- (instancetype)initWithSelectors:(HTMLArrayOf(HTMLSelector *) *)selectors block:(HTMLExtractionBlock)block
+{
+    if ((self = [super init])) {
+        _selectors = selectors;
+        _block = [block copy];
+        _finishedElements = [NSHashTable hashTableWithOptions:(NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality)];
+        _keepsContents = [NSMapTable mapTableWithKeyOptions:(NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality)
+                                               valueOptions:NSPointerFunctionsStrongMemory];
+    }
+    return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithSelectors:block:");
+    return nil;
+}
+#pragma clang diagnostic pop
+
+- (BOOL)keepsContentsOfElement:(HTMLElement * __nullable)element
+{
+    // Find the nearest ancestor we've already decided on, then decide on the way back down. The chain can be long, so no recursing.
+    NSMutableArray *undecided = [NSMutableArray new];
+    BOOL keeps = NO;
+    for (HTMLElement *ancestor = element; ancestor; ancestor = ancestor.parentElement) {
+        NSNumber *decided = [_keepsContents objectForKey:ancestor];
+        if (decided) {
+            keeps = decided.boolValue;
+            break;
+        }
+        [undecided addObject:ancestor];
+    }
+    
+    // An unfinished element's tag name, attributes, ancestors, and earlier siblings are all settled. That's everything a selector here can look at, except for :empty, which an element with descendants isn't. (Attributes that a stray `<html>` or `<body>` tag adds later are the documented exception.)
+    for (HTMLElement *ancestor in undecided.reverseObjectEnumerator) {
+        if (!keeps) {
+            for (HTMLSelector *selector in _selectors) {
+                if ([selector matchesElement:ancestor]) {
+                    keeps = YES;
+                    break;
+                }
+            }
+        }
+        [_keepsContents setObject:@(keeps) forKey:ancestor];
+    }
+    return keeps;
+}
+
+- (void)finishElement:(HTMLElement *)element
+{
+    // Its children have served their purpose, which was to be matched themselves and to decide whether this element is :empty.
+    for (HTMLNode *child in ChildrenOfNode(element)) {
+        [_finishedElements removeObject:child];
+        [_keepsContents removeObjectForKey:child];
+    }
+    
+    BOOL matched = ReportMatches(_selectors, element, _block, &_stopped);
+    [_finishedElements addObject:element];
+    if (!matched && ![self keepsContentsOfElement:element.parentElement]) {
+        NSUInteger count = element.numberOfChildren;
+        if (count > 0) {
+            [[element mutableChildren] removeObjectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, count)]];
+        }
+    }
+}
+
+// The parser only says it's finished with an element once a sibling comes along, so the last element in each subtree gets finished here along with its ancestor.
+- (void)finishSubtree:(HTMLElement *)root
+{
+    typedef struct {
+        __unsafe_unretained HTMLElement *element;
+        NSUInteger nextChild;
+    } Frame;
+    
+    // Subtrees can be deep, so use a stack of our own instead of recursing. Only the element on top of the stack loses its children, so the tree keeps every element on the stack alive.
+    Frame *stack = malloc(sizeof(Frame) * 16);
+    NSUInteger depth = 1, capacity = 16;
+    stack[0] = (Frame){ .element = root, .nextChild = 0 };
+    while (depth > 0 && !_stopped) {
+        Frame *frame = &stack[depth - 1];
+        HTMLElement *element = frame->element;
+        if (frame->nextChild < element.numberOfChildren) {
+            HTMLNode *child = [element childAtIndex:frame->nextChild++];
+            if ([child isKindOfClass:[HTMLElement class]] && ![_finishedElements containsObject:child]) {
+                if (depth == capacity) {
+                    capacity *= 2;
+                    stack = reallocf(stack, sizeof(Frame) * capacity);
+                }
+                stack[depth++] = (Frame){ .element = (HTMLElement *)child, .nextChild = 0 };
+            }
+            continue;
+        }
+        depth--;
+        [self finishElement:element];
+    }
+    free(stack);
+}
+
+- (void)parserDidFinishElement:(HTMLElement *)element
+{
+    if (_stopped) return;
+    [self finishSubtree:element];
+    
+    // Text and comments before a finished element can't change anymore, and nobody wants them unless the parent's contents are kept. Anything before the previous element went when that element was finished.
+    HTMLElement *parent = element.parentElement;
+    if (!_stopped && parent && ![self keepsContentsOfElement:parent]) {
+        NSUInteger end = [parent indexOfChild:element];
+        NSUInteger start = end;
+        while (start > 0 && ![[parent childAtIndex:start - 1] isKindOfClass:[HTMLElement class]]) {
+            start--;
+        }
+        if (start < end) {
+            [[parent mutableChildren] removeObjectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(start, end - start)]];
+        }
+    }
+}
+
+- (void)finishDocument:(HTMLDocument *)document
+{
+    for (HTMLNode *node in document.children) {
+        if (_stopped) break;
+        if ([node isKindOfClass:[HTMLElement class]] && ![_finishedElements containsObject:node]) {
+            [self finishSubtree:(HTMLElement *)node];
+        }
+    }
+    [_finishedElements removeAllObjects];
+    [_keepsContents removeAllObjects];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,72 @@
+//  HTMLFragmentParser.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLFragmentParser.h"
+#import "HTMLNode+Private.h"
+#import "HTMLParser.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@implementation HTMLFragmentParser
+{
+    HTMLParser *_parser;
+}
+
+- (instancetype)initWithContextElement:(HTMLElement *)contextElement
+{
+    NSParameterAssert(contextElement);
+    
+    if ((self = [super init])) {
+        _contextElement = contextElement;
+        
+        // The encoding is ignored when parsing fragments.
+        HTMLStringEncoding encoding = (HTMLStringEncoding){ .encoding = NSUTF8StringEncoding, .confidence = Irrelevant };
+        _parser = [[HTMLParser alloc] initWithString:@"" encoding:encoding context:contextElement];
+    }
+    return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithContextElement:");
+    return nil;
+}
+#pragma clang diagnostic pop
+
+- (HTMLDocument *)parseString:(NSString *)string
+{
+    NSParameterAssert(string);
+    
+    [_parser resetWithString:string];
+    return _parser.document;
+}
+
+- (void)parseString:(NSString *)string appendingToNode:(HTMLNode *)node
+{
+    NSParameterAssert(node);
+    
+    [node takeChildrenOfNode:[self parseString:string]];
+}
+
+- (HTMLParserOptions * __nullable)options
+{
+    return _parser.options;
+}
+
+- (void)setOptions:(HTMLParserOptions * __nullable)options
+{
+    _parser.options = options;
+}
+
+- (NSArray *)errors
+{
+    return _parser.errors;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
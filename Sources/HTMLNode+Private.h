@@ -0,0 +1,80 @@
+//  HTMLNode+Private.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLElement.h"
+#import "HTMLNode.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// An HTMLNodeChildrenSource creates a node's children the first time they're needed.
+@protocol HTMLNodeChildrenSource <NSObject>
+
+/**
+    Returns the children of a node that was handed to SetLazyChildren(). Each child must have the node as its parent, and must already be frozen if the node is.
+ 
+    Called at most once per node while synchronized on the source. For frozen nodes, this can happen on any thread.
+ */
+- (HTMLOrderedSetOf(HTMLNode *) *)childrenForNode:(HTMLNode *)node identifier:(NSUInteger)identifier;
+
+@optional
+
+/// Appends the data of every text node descended from a node that was handed to SetLazyChildren(), in tree order, without creating any nodes. May be called from any thread at any time.
+- (void)appendTextOfChildrenWithIdentifier:(NSUInteger)identifier toString:(NSMutableString *)string;
+
+@end
+
+@interface HTMLNode (Private)
+
+/// Sets the node's parent, optionally skipping the parent's children bookkeeping.
+- (void)setParentNode:(HTMLNode * __nullable)parentNode updateChildren:(BOOL)updateChildren;
+
+/**
+    Moves all of a node's children to the end of the receiver's children, in order. Much faster than moving the children one at a time, especially when the receiver has no children of its own.
+ 
+    Neither node may be frozen, and the receiver must not be a descendant of node.
+ */
+- (void)takeChildrenOfNode:(HTMLNode *)node;
+
+/**
+    Swaps the node's mutable storage for compact immutable storage and marks the node as frozen. Does not recurse.
+ 
+    Subclasses that keep their own storage should override this method and call super.
+ */
+- (void)freezeStorage;
+
+/**
+    A hash of the node's own contents, not including its children. Contributes to subtreeHash.
+ 
+    Subclasses with contents should override this method, mixing their contents into the result of calling super.
+ */
+@property (readonly, assign, nonatomic) uint64_t contentHash;
+
+@end
+
+@class HTMLOrderedDictionary;
+
+@interface HTMLElement (Private)
+
+/**
+    Initializes an element that shares an attribute dictionary instead of copying it. The dictionary must never change again, and is kept as is when the element is frozen.
+ 
+    Changing the element's attributes gives it a copy of its own first.
+ */
+- (instancetype)initWithTagName:(NSString *)tagName sharedAttributes:(HTMLOrderedDictionary *)attributes;
+
+@end
+
+/// Returns the element's own attribute dictionary without copying it. Don't change it.
+extern HTMLOrderedDictionary * AttributesOfElement(HTMLElement *element);
+
+/// Defers creating a node's children until they're first needed. The identifier is passed back to the source. An unfrozen node lets go of the source once its children are created.
+extern void SetLazyChildren(HTMLNode *node, id <HTMLNodeChildrenSource> source, NSUInteger identifier);
+
+/// Returns the node's own children set without copying it. Don't hold on to it past any change to the node's children.
+extern HTMLOrderedSetOf(HTMLNode *) * ChildrenOfNode(HTMLNode *node);
+
+/// Call before changing anything about a node. Throws an NSInternalInconsistencyException if the node is frozen.
+extern void WillMutateNode(HTMLNode *node);
+
+NS_ASSUME_NONNULL_END
@@ -2,26 +2,171 @@
 //
 //  Public domain. https://github.com/nolanw/HTMLReader
 
-#import "HTMLNode.h"
-#import "HTMLDocument.h"
+#import "HTMLNode+Private.h"
+#import "HTMLDocument+Private.h"
+#import "HTMLString.h"
 #import "HTMLTextNode.h"
+#import "HTMLTraversal.h"
 #import "HTMLTreeEnumerator.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
+/// An HTMLSharedSubtree copies nodes from a subtree one level at a time, as the copies' children are needed.
+@interface HTMLSharedSubtree : NSObject <HTMLNodeChildrenSource>
+
+- (instancetype)initWithRoot:(HTMLNode *)root;
+
+@end
+
 @interface HTMLChildrenRelationshipProxy : HTMLGenericOf(NSMutableOrderedSet, HTMLNode *)
 
-- (instancetype)initWithNode:(HTMLNode *)node children:(HTMLMutableOrderedSetOf(HTMLNode *) *)children;
+- (instancetype)initWithNode:(HTMLNode *)node;
 
 @property (readonly, strong, nonatomic) HTMLNode *node;
 
-@property (readonly, strong, nonatomic) HTMLMutableOrderedSetOf(HTMLNode *) *children;
-
 @end
 
 @implementation HTMLNode
 {
-    HTMLMutableOrderedSetOf(HTMLNode *) *_children;
+    // Mutable until the node is frozen. Use Children() to read and MutableChildren() to change.
+    // nil only when children are waiting to be fetched from _childrenSource.
+    HTMLOrderedSetOf(HTMLNode *) *_children;
+    
+    id <HTMLNodeChildrenSource> _childrenSource;
+    NSUInteger _childrenSourceIdentifier;
+    
+    // Parents own their children, so these only need to be cleared when that ownership ends: a node clears its children's parent in -dealloc, and a document clears its whole tree's owner document.
+    // _ownerDocument is the document at the root of the node's tree (or nil if there isn't one), and is kept up to date whenever a subtree moves.
+    __unsafe_unretained HTMLNode *_parentNode;
+    __unsafe_unretained HTMLDocument *_ownerDocument;
+    
+    // A frozen node can be read on one thread while its parent or document is deallocated on another, which the plain pointers above can't survive. So freezing copies them into zeroing weak references, which the accessors use from then on. They never change once set, as frozen nodes don't move.
+    __weak HTMLNode *_frozenParentNode;
+    __weak HTMLDocument *_frozenOwnerDocument;
+    
+    // 0 when not yet computed. If a node's hash is cached, so are the hashes of all its descendants.
+    uint64_t _subtreeHash;
+    
+    BOOL _frozen;
+}
+
+void WillMutateNode(HTMLNode *node)
+{
+    if (node->_frozen) {
+        [NSException raise:NSInternalInconsistencyException format:@"cannot mutate %@ in a frozen document", node.class];
+    }
+    
+    // Since cached hashes only ever have cached descendants, we can stop at the first uncached ancestor.
+    for (HTMLNode *ancestor = node; ancestor && ancestor->_subtreeHash != 0; ancestor = ancestor->_parentNode) {
+        ancestor->_subtreeHash = 0;
+    }
+    
+    // The document's mutation version is how cached query results know they've gone stale.
+    HTMLDocument *document = node->_ownerDocument;
+    if (!document && [node isKindOfClass:[HTMLDocument class]]) {
+        document = (HTMLDocument *)node;
+    }
+    if (document) {
+        DocumentDidMutate(document);
+    }
+}
+
+// Lazy children are published once, from any thread, so reads and writes of _children need to be atomic.
+static inline NSOrderedSet * __nullable LoadChildren(HTMLNode *node)
+{
+    return (__bridge NSOrderedSet *)__atomic_load_n((void **)(void *)&node->_children, __ATOMIC_ACQUIRE);
+}
+
+static NSOrderedSet * FetchLazyChildren(HTMLNode *node)
+{
+    @synchronized (node->_childrenSource) {
+        NSOrderedSet *children = LoadChildren(node);
+        if (!children) {
+            // Keep the document around until the new children have frozen their references to it, in case another thread lets it go in the meantime.
+            __unused HTMLDocument * __attribute__((objc_precise_lifetime)) document = OwnerDocumentOfChildren(node);
+            
+            children = [node->_childrenSource childrenForNode:node identifier:node->_childrenSourceIdentifier];
+            children = node->_frozen ? [children copy] : [children mutableCopy];
+            
+            // The ivar takes ownership of the +1 reference. It was nil, so there's nothing to release.
+            __atomic_store_n((void **)(void *)&node->_children, (void *)CFBridgingRetain(children), __ATOMIC_RELEASE);
+            
+            // Unfrozen nodes are only used from one thread at a time, so nobody else can be waiting on the source. (Frozen nodes hang on to it, as other threads might be about to synchronize on it.)
+            if (!node->_frozen) {
+                node->_childrenSource = nil;
+            }
+        }
+        return children;
+    }
+}
+
+static inline HTMLOrderedSetOf(HTMLNode *) * Children(HTMLNode *node)
+{
+    return LoadChildren(node) ?: FetchLazyChildren(node);
+}
+
+HTMLOrderedSetOf(HTMLNode *) * ChildrenOfNode(HTMLNode *node)
+{
+    return Children(node);
+}
+
+void SetLazyChildren(HTMLNode *node, id <HTMLNodeChildrenSource> source, NSUInteger identifier)
+{
+    NSCParameterAssert(source);
+    
+    node->_children = nil;
+    node->_childrenSource = source;
+    node->_childrenSourceIdentifier = identifier;
+}
+
+static HTMLMutableOrderedSetOf(HTMLNode *) * MutableChildren(HTMLNode *node)
+{
+    WillMutateNode(node);
+    return (NSMutableOrderedSet *)Children(node);
+}
+
+// The document that a node's children belong to.
+static HTMLDocument * __nullable OwnerDocumentOfChildren(HTMLNode *node)
+{
+    HTMLDocument *document = node->_frozen ? node->_frozenOwnerDocument : node->_ownerDocument;
+    if (document) {
+        return document;
+    }
+    return [node isKindOfClass:[HTMLDocument class]] ? (HTMLDocument *)node : nil;
+}
+
+// Sets the owner document of every node in a subtree. Children that haven't been fetched yet will get theirs from their parent when they are.
+static void SetOwnerDocument(HTMLNode *root, HTMLDocument * __nullable document)
+{
+    if (root->_ownerDocument == document) {
+        return;
+    }
+    root->_ownerDocument = document;
+    if (LoadChildren(root).count == 0) {
+        return;
+    }
+    
+    // Subtrees can be deep, so use a stack of our own instead of recursing.
+    __unsafe_unretained HTMLNode **stack = NULL;
+    NSUInteger count = 0, capacity = 0;
+    HTMLNode *node = root;
+    for (;;) {
+        for (HTMLNode *child in LoadChildren(node)) {
+            if (child->_ownerDocument != document) {
+                child->_ownerDocument = document;
+                if (count == capacity) {
+                    capacity = capacity * 2 + 16;
+                    stack = (__unsafe_unretained HTMLNode **)reallocf(stack, sizeof(stack[0]) * capacity);
+                }
+                stack[count++] = child;
+            }
+        }
+        if (count == 0) {
+            break;
+        }
+        node = stack[--count];
+    }
+    free(stack);
 }
 
 - (instancetype)init
@@ -32,13 +177,26 @@ NS_ASSUME_NONNULL_BEGIN
     return self;
 }
 
-- (HTMLDocument * __nullable)document
+- (void)dealloc
 {
-    HTMLNode *currentNode = self.parentNode;
-    while (currentNode && ![currentNode isKindOfClass:[HTMLDocument class]]) {
-        currentNode = currentNode.parentNode;
+    // Children can outlive their parent (and nodes their document) if someone else is holding on to them.
+    BOOL isDocument = [self isKindOfClass:[HTMLDocument class]];
+    for (HTMLNode *child in LoadChildren(self)) {
+        child->_parentNode = nil;
+        if (isDocument) {
+            SetOwnerDocument(child, nil);
+        }
     }
-    return (HTMLDocument *)currentNode;
+}
+
+- (HTMLDocument * __nullable)document
+{
+    return _frozen ? _frozenOwnerDocument : _ownerDocument;
+}
+
+- (HTMLNode * __nullable)parentNode
+{
+    return _frozen ? _frozenParentNode : _parentNode;
 }
 
 - (void)setParentNode:(HTMLNode * __nullable)parentNode
@@ -48,8 +206,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)setParentNode:(HTMLNode * __nullable)parentNode updateChildren:(BOOL)updateChildren
 {
+    WillMutateNode(self);
     [_parentNode removeChild:self updateParentNode:NO];
     _parentNode = parentNode;
+    SetOwnerDocument(self, parentNode ? OwnerDocumentOfChildren((HTMLNode * __nonnull)parentNode) : nil);
     if (updateChildren) {
         [parentNode addChild:self updateParentNode:NO];
     }
@@ -73,7 +233,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (HTMLOrderedSetOf(HTMLNode *) *)children
 {
-    return [_children copy];
+    return [Children(self) copy];
 }
 
 // In order to quickly mutate the children set, we need to pull some shenanigans. From the Key-Value Coding Programming Guide:
@@ -90,7 +250,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (HTMLMutableOrderedSetOf(HTMLNode *) *)mutableChildren
 {
-    return [[HTMLChildrenRelationshipProxy alloc] initWithNode:self children:_children];
+    return [[HTMLChildrenRelationshipProxy alloc] initWithNode:self];
 }
 
 - (void)addChild:(HTMLNode *)child
@@ -109,25 +269,27 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (NSUInteger)numberOfChildren
 {
-    return _children.count;
+    return Children(self).count;
 }
 
 - (HTMLNode *)childAtIndex:(NSUInteger)index
 {
-    return [_children objectAtIndex:index];
+    return [Children(self) objectAtIndex:index];
 }
 
 - (NSUInteger)indexOfChild:(HTMLNode *)child
 {
-    return [_children indexOfObject:child];
+    return [Children(self) indexOfObject:child];
 }
 
 - (void)insertObject:(HTMLNode *)node inChildrenAtIndex:(NSUInteger)index
 {
-    if ([_children containsObject:node]) {
+    HTMLMutableOrderedSetOf(HTMLNode *) *children = MutableChildren(self);
+    if ([children containsObject:node]) {
         return;
     }
-    [_children insertObject:node atIndex:index];
+    WillMutateNode(node);
+    [children insertObject:node atIndex:index];
     [node setParentNode:self updateChildren:NO];
 }
 
@@ -142,15 +304,17 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)removeObjectFromChildrenAtIndex:(NSUInteger)index
 {
-    HTMLNode *node = [_children objectAtIndex:index];
-    [_children removeObjectAtIndex:index];
+    HTMLMutableOrderedSetOf(HTMLNode *) *children = MutableChildren(self);
+    HTMLNode *node = [children objectAtIndex:index];
+    [children removeObjectAtIndex:index];
     [node setParentNode:nil updateChildren:NO];
 }
 
 - (void)removeChildrenAtIndexes:(NSIndexSet *)indexes
 {
-    NSArray *nodes = [_children objectsAtIndexes:indexes];
-    [_children removeObjectsAtIndexes:indexes];
+    HTMLMutableOrderedSetOf(HTMLNode *) *children = MutableChildren(self);
+    NSArray *nodes = [children objectsAtIndexes:indexes];
+    [children removeObjectsAtIndexes:indexes];
     for (HTMLNode *node in nodes) {
         [node setParentNode:nil updateChildren:NO];
     }
@@ -158,15 +322,17 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)replaceObjectInChildrenAtIndex:(NSUInteger)index withObject:(HTMLNode *)node
 {
-    HTMLNode *old = [_children objectAtIndex:index];
-    [_children replaceObjectAtIndex:index withObject:node];
+    HTMLMutableOrderedSetOf(HTMLNode *) *children = MutableChildren(self);
+    WillMutateNode(node);
+    HTMLNode *old = [children objectAtIndex:index];
+    [children replaceObjectAtIndex:index withObject:node];
     [old setParentNode:nil updateChildren:NO];
     [node setParentNode:self updateChildren:NO];
 }
 
 - (void)addChild:(HTMLNode *)node updateParentNode:(BOOL)updateParentNode
 {
-    [_children addObject:node];
+    [MutableChildren(self) addObject:node];
     if (updateParentNode) {
         [node setParentNode:self updateChildren:NO];
     }
@@ -174,17 +340,45 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)removeChild:(HTMLNode *)node updateParentNode:(BOOL)updateParentNode
 {
-    [_children removeObject:node];
+    [MutableChildren(self) removeObject:node];
     if (updateParentNode) {
         [node setParentNode:nil updateChildren:NO];
     }
 }
 
+- (void)takeChildrenOfNode:(HTMLNode *)node
+{
+    NSParameterAssert(node);
+    
+    HTMLMutableOrderedSetOf(HTMLNode *) *taken = MutableChildren(node);
+    if (node == self || taken.count == 0) {
+        return;
+    }
+    HTMLMutableOrderedSetOf(HTMLNode *) *children = MutableChildren(self);
+    NSUInteger firstTaken = children.count;
+    
+    // A node only has one parent, so none of the taken children are already ours. When we have no children of our own, the sets can simply trade places.
+    if (firstTaken == 0) {
+        node->_children = children;
+        _children = taken;
+        children = taken;
+    } else {
+        [children unionOrderedSet:taken];
+        [taken removeAllObjects];
+    }
+    HTMLDocument *document = OwnerDocumentOfChildren(self);
+    for (NSUInteger i = firstTaken, end = children.count; i < end; i++) {
+        HTMLNode *child = [children objectAtIndex:i];
+        child->_parentNode = self;
+        SetOwnerDocument(child, document);
+    }
+}
+
 - (void)insertString:(NSString *)string atChildNodeIndex:(NSUInteger)index
 {
     NSParameterAssert(string);
     
-    id candidate = index > 0 ? [_children objectAtIndex:(index - 1)] : nil;
+    id candidate = index > 0 ? [Children(self) objectAtIndex:(index - 1)] : nil;
     HTMLTextNode *textNode;
     if ([candidate isKindOfClass:[HTMLTextNode class]]) {
         textNode = candidate;
@@ -198,7 +392,7 @@ NS_ASSUME_NONNULL_BEGIN
 - (HTMLArrayOf(HTMLElement *) *)childElementNodes
 {
 	NSMutableArray *childElements = [NSMutableArray arrayWithCapacity:self.numberOfChildren];
-	for (id node in _children) {
+	for (id node in Children(self)) {
 		if ([node isKindOfClass:[HTMLElement class]]) {
 			[childElements addObject:node];
 		}
@@ -216,15 +410,28 @@ NS_ASSUME_NONNULL_BEGIN
 	return [[HTMLTreeEnumerator alloc] initWithNode:self reversed:YES];
 }
 
-- (NSString *)textContent
+static HTMLTraversalAction AppendTextNodeData(HTMLNode *node, void *context)
 {
-    NSMutableArray *parts = [NSMutableArray new];
-    for (HTMLTextNode *node in self.treeEnumerator) {
-        if ([node isKindOfClass:[HTMLTextNode class]]) {
-            [parts addObject:node.data];
-        }
+    NSMutableString *textContent = (__bridge NSMutableString *)context;
+    if ([node isKindOfClass:[HTMLTextNode class]]) {
+        [textContent appendString:((HTMLTextNode *)node).data];
+        return HTMLTraversalContinue;
     }
-    return [parts componentsJoinedByString:@""];
+    
+    // Children that haven't been created yet might be able to give up their text without being created at all.
+    id <HTMLNodeChildrenSource> source = node->_childrenSource;
+    if (!LoadChildren(node) && [source respondsToSelector:@selector(appendTextOfChildrenWithIdentifier:toString:)]) {
+        [source appendTextOfChildrenWithIdentifier:node->_childrenSourceIdentifier toString:textContent];
+        return HTMLTraversalSkipChildren;
+    }
+    return HTMLTraversalContinue;
+}
+
+- (NSString *)textContent
+{
+    NSMutableString *textContent = [NSMutableString new];
+    HTMLTraverseTree(self, HTMLTraversalElements | HTMLTraversalTextNodes | HTMLTraversalOtherNodes, AppendTextNodeData, NULL, (__bridge void *)textContent);
+    return textContent;
 }
 
 - (void)setTextContent:(NSString *)textContent
@@ -238,10 +445,21 @@ NS_ASSUME_NONNULL_BEGIN
     }
 }
 
+- (NSString *)concurrentTextContent
+{
+    if (self.numberOfChildren == 0) {
+        return self.textContent;
+    }
+    NSArray *parts = ConcurrentlyMapTree(self, ^id __nullable (HTMLNode *node) {
+        return [node isKindOfClass:[HTMLTextNode class]] ? ((HTMLTextNode *)node).data : nil;
+    });
+    return [parts componentsJoinedByString:@""];
+}
+
 - (NSArray *)textComponents
 {
     NSMutableArray *textComponents = [NSMutableArray new];
-    for (HTMLTextNode *textNode in _children) {
+    for (HTMLTextNode *textNode in Children(self)) {
         if ([textNode isKindOfClass:[HTMLTextNode class]]) {
             [textComponents addObject:textNode.data];
         }
@@ -249,6 +467,83 @@ NS_ASSUME_NONNULL_BEGIN
     return textComponents;
 }
 
+#pragma mark Hashing
+
+- (uint64_t)subtreeHash
+{
+    // Frozen nodes can be hashed from many threads at once. They'll all compute and store the same value, so relaxed atomics are enough.
+    uint64_t hash = __atomic_load_n(&_subtreeHash, __ATOMIC_RELAXED);
+    if (hash != 0) {
+        return hash;
+    }
+    
+    // Descendants get hashed before their ancestors using an explicit stack, so a deep tree can't overflow the call stack.
+    typedef struct {
+        __unsafe_unretained HTMLNode *node;
+        NSUInteger nextChild;
+        NSUInteger numberOfChildren;
+        uint64_t hash;
+    } Frame;
+    
+    Frame *stack = malloc(sizeof(Frame) * 16);
+    NSUInteger depth = 1, capacity = 16;
+    NSUInteger numberOfChildren = self.numberOfChildren;
+    stack[0] = (Frame){ .node = self, .nextChild = 0, .numberOfChildren = numberOfChildren, .hash = HashCombine(self.contentHash, numberOfChildren) };
+    while (YES) {
+        Frame *frame = &stack[depth - 1];
+        if (frame->nextChild == frame->numberOfChildren) {
+            hash = frame->hash == 0 ? 1 : frame->hash;
+            __atomic_store_n(&frame->node->_subtreeHash, hash, __ATOMIC_RELAXED);
+            if (--depth == 0) break;
+            stack[depth - 1].hash = HashCombine(stack[depth - 1].hash, hash);
+            continue;
+        }
+        HTMLNode *child = [frame->node childAtIndex:frame->nextChild++];
+        uint64_t childHash = __atomic_load_n(&child->_subtreeHash, __ATOMIC_RELAXED);
+        if (childHash != 0) {
+            frame->hash = HashCombine(frame->hash, childHash);
+            continue;
+        }
+        if (depth == capacity) {
+            capacity *= 2;
+            stack = reallocf(stack, sizeof(Frame) * capacity);
+        }
+        numberOfChildren = child.numberOfChildren;
+        stack[depth++] = (Frame){ .node = child, .nextChild = 0, .numberOfChildren = numberOfChildren, .hash = HashCombine(child.contentHash, numberOfChildren) };
+    }
+    free(stack);
+    return hash;
+}
+
+- (uint64_t)contentHash
+{
+    return HashCombineString(0, NSStringFromClass([self class]));
+}
+
+#pragma mark Freezing
+
+- (BOOL)isFrozen
+{
+    return _frozen;
+}
+
+- (void)freezeStorage
+{
+    static NSOrderedSet *noChildren;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        noChildren = [NSOrderedSet new];
+    });
+    
+    // Copying sheds the mutable set's spare capacity, and sharing one empty set covers the many leaf nodes.
+    if (_children) {
+        _children = _children.count > 0 ? [_children copy] : noChildren;
+    }
+    _frozenParentNode = _parentNode;
+    _frozenOwnerDocument = _ownerDocument;
+    _frozen = YES;
+}
+
 #pragma mark NSCopying
 
 - (id)copyWithZone:(NSZone * __nullable)zone
@@ -256,6 +551,48 @@ NS_ASSUME_NONNULL_BEGIN
     return [[self.class allocWithZone:zone] init];
 }
 
+- (instancetype)deepCopy
+{
+    HTMLNode *copy = [self copy];
+    HTMLSharedSubtree *subtree = [[HTMLSharedSubtree alloc] initWithRoot:self];
+    SetLazyChildren(copy, subtree, (NSUInteger)(__bridge void *)self);
+    
+    // An unfrozen original could change at any time, so its copy can't wait. Enumerating the copy creates all of its descendants.
+    if (!_frozen) {
+        for (__unused HTMLNode *node in copy.treeEnumerator) {}
+    }
+    return copy;
+}
+
+@end
+
+@implementation HTMLSharedSubtree
+{
+    // Frozen descendants are kept alive by their parents, so only the root needs a strong reference.
+    HTMLNode *_root;
+}
+
+- (instancetype)initWithRoot:(HTMLNode *)root
+{
+    if ((self = [super init])) {
+        _root = root;
+    }
+    return self;
+}
+
+- (HTMLOrderedSetOf(HTMLNode *) *)childrenForNode:(HTMLNode *)node identifier:(NSUInteger)identifier
+{
+    HTMLOrderedSetOf(HTMLNode *) *originals = Children((__bridge HTMLNode *)(void *)identifier);
+    NSMutableOrderedSet *children = [NSMutableOrderedSet orderedSetWithCapacity:originals.count];
+    for (HTMLNode *original in originals) {
+        HTMLNode *child = [original copy];
+        [child setParentNode:node updateChildren:NO];
+        SetLazyChildren(child, self, (NSUInteger)(__bridge void *)original);
+        [children addObject:child];
+    }
+    return children;
+}
+
 @end
 
 /**
@@ -263,28 +600,27 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @implementation HTMLChildrenRelationshipProxy : NSMutableOrderedSet
 
-- (instancetype)initWithNode:(HTMLNode *)node children:(NSMutableOrderedSet *)children
+- (instancetype)initWithNode:(HTMLNode *)node
 {
     if ((self = [super init])) {
         _node = node;
-        _children = children;
     }
     return self;
 }
 
 - (NSUInteger)count
 {
-    return _children.count;
+    return _node.numberOfChildren;
 }
 
 - (id)objectAtIndex:(NSUInteger)index
 {
-    return [_children objectAtIndex:index];
+    return [_node childAtIndex:index];
 }
 
 - (NSUInteger)indexOfObject:(id)object
 {
-    return [_children indexOfObject:object];
+    return [_node indexOfChild:object];
 }
 
 - (void)insertObject:(id)object atIndex:(NSUInteger)index
@@ -12,7 +12,11 @@ NS_ASSUME_NONNULL_BEGIN
     #define ObjectType id
 #endif
 
-/// An HTMLOrderedDictionary is a mutable dictionary type that maintains its keys' insertion order.
+/**
+    An HTMLOrderedDictionary is a mutable dictionary type that maintains its keys' insertion order.
+ 
+    An HTMLDeferredString can be stored as an object, and the dictionary returns its string instead. Copies share deferred strings rather than building them.
+ */
 @interface HTMLGenericOf(HTMLOrderedDictionary, KeyType, ObjectType) : HTMLGenericOf(NSMutableDictionary, KeyType, ObjectType)
 
 /// Initializes an empty ordered dictionary. The capacity is a hint to help with initial memory allocation.
@@ -27,6 +31,12 @@ NS_ASSUME_NONNULL_BEGIN
 /// Returns the key at a particular index in the dictionary. Throws an exception if index is out of bounds.
 - (ObjectType)objectAtIndexedSubscript:(NSUInteger)index;
 
+/// Replaces every HTMLDeferredString with the string it stands for, so their source strings can be released. Not safe to call while other threads read the dictionary.
+- (void)resolveDeferredStrings;
+
+/// YES if looking up a key first checks for that very key object among the first few keys, before hashing it. Suits dictionaries whose keys come from an HTMLStringPool, and are often looked up with the same pooled strings. Costs a second array of the objects while set. Copies keep this setting. The default is NO.
+@property (assign, nonatomic) BOOL searchesKeysByPointer;
+
 /// Returns the key at index 0 in the dictionary, or nil if the dictionary is empty.
 @property (readonly, nonatomic) KeyType __nullable firstKey;
 
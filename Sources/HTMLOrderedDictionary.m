@@ -3,6 +3,7 @@
 //  Public domain. https://github.com/nolanw/HTMLReader
 
 #import "HTMLOrderedDictionary.h"
+#import "HTMLString.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -10,8 +11,14 @@ NS_ASSUME_NONNULL_BEGIN
 {
     CFMutableDictionaryRef _map;
     NSMutableArray *_keys;
+    
+    // Parallel to _keys, so small dictionaries can be searched by pointer without hashing. Only kept while searchesKeysByPointer is set.
+    NSMutableArray * __nullable _values;
 }
 
+// Elements rarely have more attributes than this, and comparing this many pointers is cheaper than hashing a key.
+static const NSUInteger MaximumCountForPointerSearch = 8;
+
 - (instancetype)initWithCapacity:(NSUInteger)numItems
 {
     if ((self = [super init])) {
@@ -34,7 +41,7 @@ NS_ASSUME_NONNULL_BEGIN
             
             if (!object) [NSException raise:NSInvalidArgumentException format:@"%@ object at %@ cannot be nil", NSStringFromSelector(_cmd), @(i)];
             if (!key) [NSException raise:NSInvalidArgumentException format:@"%@ key at %@ cannot be nil", NSStringFromSelector(_cmd), @(i)];
-
+            
             [self setObject:objects[i] forKey:keys[i]];
         }
     }
@@ -69,14 +76,20 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)encodeWithCoder:(NSCoder *)coder
 {
-    [coder encodeObject:(__bridge NSDictionary *)_map forKey:@"map"];
+    [coder encodeObject:[NSDictionary dictionaryWithDictionary:self] forKey:@"map"];
     [coder encodeObject:_keys forKey:@"keys"];
 }
 
 - (id)copyWithZone:(NSZone * __nullable)zone
 {
+    // Deferred strings are shared with the copy, not built now.
     HTMLOrderedDictionary *copy = [[[self class] allocWithZone:zone] initWithCapacity:self.count];
-    [copy addEntriesFromDictionary:self];
+    for (id key in _keys) {
+        CFDictionarySetValue(copy->_map, (__bridge const void *)key, CFDictionaryGetValue(_map, (__bridge const void *)key));
+    }
+    [copy->_keys addObjectsFromArray:_keys];
+    copy->_values = [_values mutableCopy];
+    copy->_searchesKeysByPointer = _searchesKeysByPointer;
     return copy;
 }
 
@@ -85,6 +98,19 @@ NS_ASSUME_NONNULL_BEGIN
     return [self copyWithZone:zone];
 }
 
+- (void)setSearchesKeysByPointer:(BOOL)searchesKeysByPointer
+{
+    _searchesKeysByPointer = searchesKeysByPointer;
+    if (!searchesKeysByPointer) {
+        _values = nil;
+    } else if (!_values) {
+        _values = [NSMutableArray arrayWithCapacity:_keys.count];
+        for (id key in _keys) {
+            [_values addObject:(__bridge id)CFDictionaryGetValue(_map, (__bridge const void *)key)];
+        }
+    }
+}
+
 - (NSUInteger)count
 {
     return _keys.count;
@@ -94,12 +120,42 @@ NS_ASSUME_NONNULL_BEGIN
 {
     NSParameterAssert(key);
     
-    return (__bridge id)CFDictionaryGetValue(_map, (__bridge const void *)key);
+    id object = nil;
+    NSUInteger count = _keys.count;
+    if (_values && count <= MaximumCountForPointerSearch) {
+        for (NSUInteger i = 0; i < count; i++) {
+            if ((__bridge void *)_keys[i] == (__bridge void *)key) {
+                object = _values[i];
+                break;
+            }
+        }
+    }
+    if (!object) {
+        object = (__bridge id)CFDictionaryGetValue(_map, (__bridge const void *)key);
+    }
+    // Not swapped in, as reading must not change the dictionary: readers on other threads may be looking at it too.
+    if ([object isKindOfClass:[HTMLDeferredString class]]) {
+        return ((HTMLDeferredString *)object).string;
+    }
+    return object;
+}
+
+- (void)resolveDeferredStrings
+{
+    for (NSUInteger i = 0, end = _keys.count; i < end; i++) {
+        id key = _keys[i];
+        id object = (__bridge id)CFDictionaryGetValue(_map, (__bridge const void *)key);
+        if ([object isKindOfClass:[HTMLDeferredString class]]) {
+            NSString *string = ((HTMLDeferredString *)object).string;
+            CFDictionarySetValue(_map, (__bridge const void *)key, (__bridge const void *)string);
+            _values[i] = string;
+        }
+    }
 }
 
 - (NSUInteger)indexOfKey:(id)key
 {
-    if ([self objectForKey:key]) {
+    if (CFDictionaryContainsKey(_map, (__bridge const void *)key)) {
         return [_keys indexOfObject:key];
     } else {
         return NSNotFound;
@@ -128,9 +184,11 @@ NS_ASSUME_NONNULL_BEGIN
 {
     if (!key) [NSException raise:NSInvalidArgumentException format:@"%@ key cannot be nil", NSStringFromSelector(_cmd)];
     
-    if ([self objectForKey:key]) {
+    if (CFDictionaryContainsKey(_map, (__bridge const void *)key)) {
         CFDictionaryRemoveValue(_map, (__bridge const void *)key);
-        [_keys removeObject:key];
+        NSUInteger index = [_keys indexOfObject:key];
+        [_keys removeObjectAtIndex:index];
+        [_values removeObjectAtIndex:index];
     }
 }
 
@@ -140,9 +198,14 @@ NS_ASSUME_NONNULL_BEGIN
     if (!key) [NSException raise:NSInvalidArgumentException format:@"%@ key cannot be nil", NSStringFromSelector(_cmd)];
     if (index > self.count) [NSException raise:NSRangeException format:@"%@ index %@ beyond count %@ of array", NSStringFromSelector(_cmd), @(index), @(self.count)];
     
-    if (![self objectForKey:key]) {
+    if (CFDictionaryContainsKey(_map, (__bridge const void *)key)) {
+        if (_values) {
+            [_values replaceObjectAtIndex:[_keys indexOfObject:key] withObject:object];
+        }
+    } else {
         key = [key copyWithZone:nil];
         [_keys insertObject:key atIndex:index];
+        [_values insertObject:object atIndex:index];
     }
     CFDictionarySetValue(_map, (__bridge const void *)key, (__bridge const void *)object);
 }
@@ -6,6 +6,25 @@
 #import "HTMLDocument.h"
 #import "HTMLElement.h"
 #import "HTMLEncoding+Private.h"
+#import "HTMLParserOptions.h"
+
+/**
+    An HTMLFinishedElementHandler hears about each element as soon as the parser is done with it, which is usually long before the parser is done with the document.
+ */
+@protocol HTMLFinishedElementHandler <NSObject>
+
+/**
+    Called once nothing more can happen to an element or its descendants, just before the parser appends a sibling after it. The element is still in the tree.
+ 
+    Not every element is reported. The last element child of a node isn't, nor is an element that misnested formatting tags (e.g. `<b><p><i></i><span></b>`) could still move elsewhere, nor is anything before the document has content that rules out a frameset; those turn up among the descendants of a reported ancestor, or in the finished document.
+ 
+    A stray later `<html>` or `<body>` start tag adds attributes to the root or body element even after its descendants were reported.
+ 
+    The handler may remove the element's descendants, replace the element with nodes that aren't elements, or remove the element and any siblings before it.
+ */
+- (void)parserDidFinishElement:(HTMLElement *)element;
+
+@end
 
 /**
     An HTMLParser turns a string into an HTMLDocument.
@@ -27,6 +46,11 @@
  */
 - (instancetype)initWithString:(NSString *)string encoding:(HTMLStringEncoding)encoding context:(HTMLElement *)context NS_DESIGNATED_INITIALIZER;
 
+/**
+    Prepares the parser to parse another string with the same encoding and context, reusing its internal storage. The previously parsed document and errors are forgotten.
+ */
+- (void)resetWithString:(NSString *)string;
+
 /// The HTML being parsed.
 @property (readonly, copy, nonatomic) NSString *string;
 
@@ -36,6 +60,12 @@
 /// Instances of NSString representing the errors encountered while parsing the document.
 @property (readonly, copy, nonatomic) NSArray *errors;
 
+/// Limits and other options for parsing. Changes have no effect once the document is created.
+@property (copy, nonatomic) HTMLParserOptions *options;
+
+/// Told about elements as the parser finishes with them, or nil. Ignored when the options say to create nodes on demand. Changes have no effect once the document is created.
+@property (strong, nonatomic) id <HTMLFinishedElementHandler> finishedElementHandler;
+
 /// The parsed document. Lazily created on first access.
 @property (readonly, strong, nonatomic) HTMLDocument *document;
 
@@ -48,5 +78,6 @@
     Returns a parser suitable for some data of an unknown string encoding.
  
     @param contentType The value of the HTTP Content-Type header associated with the data, if any.
+    @param options     Options for the returned parser, if any.
  */
-extern HTMLParser * ParserWithDataAndContentType(NSData *data, NSString *contentType);
+extern HTMLParser * ParserWithDataAndContentType(NSData *data, NSString *contentType, HTMLParserOptions *options);
@@ -5,7 +5,11 @@
 #import "HTMLParser.h"
 #import "HTMLComment.h"
 #import "HTMLDocument+Private.h"
+#import "HTMLNode+Private.h"
 #import "HTMLString.h"
+#import "HTMLTape.h"
+#import "HTMLTextNode+Private.h"
+#import "HTMLTokenPipeline.h"
 #import "HTMLTokenizer.h"
 
 @interface HTMLMarker : NSObject <NSCopying>
@@ -46,6 +50,11 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
 
 @property (readonly, strong, nonatomic) HTMLElement *currentNode;
 
+#if HTMLREADER_COLLECT_STATISTICS
+@property (readonly, copy, nonatomic) NSDictionary *statistics;
+- (void)countEncodingRestart;
+#endif
+
 @end
 
 @implementation HTMLParser
@@ -66,6 +75,38 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
     BOOL _fosterParenting;
     BOOL _done;
     BOOL _fragmentParsingAlgorithm;
+    
+    // Copied from the options when parsing starts, since they're checked so often.
+    NSUInteger _maximumDepth;
+    NSUInteger _maximumFormattingElements;
+    NSUInteger _maximumNodeCount;
+    NSUInteger _maximumTextLength;
+    NSUInteger _nodeCount;
+    HTMLParserLimit _exceededLimits;
+    HTMLParserDiscard _discardedContent;
+    BOOL _stopsAfterHead;
+    BOOL (^_stopTest)(HTMLElement *);
+    
+    // Whitespace-only text that will be dropped unless more text comes along right after it.
+    NSString *_pendingWhitespace;
+    HTMLNode *_pendingWhitespaceParent;
+    NSUInteger _pendingWhitespaceIndex;
+    NSUInteger _pendingWhitespaceSiblingCount;
+    
+    // Only when creating nodes on demand.
+    HTMLTape *_tape;
+    
+    // Either the tape or the finishedElementHandler, if any, while the document is built.
+    id <HTMLFinishedElementHandler> _elementHandler;
+    
+#if HTMLREADER_COLLECT_STATISTICS
+    NSUInteger _adoptionAgencyRunCount;
+    NSUInteger _reconstructionCount;
+    NSUInteger _fosterParentingCount;
+    NSUInteger _insertionModeResetCount;
+    NSUInteger _maximumStackDepth;
+    NSUInteger _encodingRestartCount;
+#endif
 }
 
 - (instancetype)initWithString:(NSString *)string encoding:(HTMLStringEncoding)encoding context:(HTMLElement *)context
@@ -83,19 +124,7 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
         _fragmentParsingAlgorithm = !!context;
         
         if (context) {
-            if (context.htmlNamespace == HTMLNamespaceHTML) {
-                if (StringIsEqualToAnyOf(context.tagName, @"title", @"textarea")) {
-                    _tokenizer.state = HTMLRCDATATokenizerState;
-                } else if (StringIsEqualToAnyOf(context.tagName, @"style", @"xmp", @"iframe", @"noembed", @"noframes")) {
-                    _tokenizer.state = HTMLRAWTEXTTokenizerState;
-                } else if ([context.tagName isEqualToString:@"script"]) {
-                    _tokenizer.state = HTMLScriptDataTokenizerState;
-                } else if ([context.tagName isEqualToString:@"noscript"]) {
-                    _tokenizer.state = HTMLRAWTEXTTokenizerState;
-                } else if ([context.tagName isEqualToString:@"plaintext"]) {
-                    _tokenizer.state = HTMLPLAINTEXTTokenizerState;
-                }
-            }
+            [self setTokenizerStateForContext];
             
             _encoding = (HTMLStringEncoding){
                 .encoding = NSUTF8StringEncoding,
@@ -106,6 +135,53 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
     return self;
 }
 
+- (void)setTokenizerStateForContext
+{
+    if (_context.htmlNamespace == HTMLNamespaceHTML) {
+        if (StringIsEqualToAnyOf(_context.tagName, @"title", @"textarea")) {
+            _tokenizer.state = HTMLRCDATATokenizerState;
+        } else if (StringIsEqualToAnyOf(_context.tagName, @"style", @"xmp", @"iframe", @"noembed", @"noframes")) {
+            _tokenizer.state = HTMLRAWTEXTTokenizerState;
+        } else if ([_context.tagName isEqualToString:@"script"]) {
+            _tokenizer.state = HTMLScriptDataTokenizerState;
+        } else if ([_context.tagName isEqualToString:@"noscript"]) {
+            _tokenizer.state = HTMLRAWTEXTTokenizerState;
+        } else if ([_context.tagName isEqualToString:@"plaintext"]) {
+            _tokenizer.state = HTMLPLAINTEXTTokenizerState;
+        }
+    }
+}
+
+- (void)resetWithString:(NSString *)string
+{
+    [_tokenizer resetWithString:string];
+    _insertionMode = HTMLInitialInsertionMode;
+    _originalInsertionMode = HTMLInvalidInsertionMode;
+    [_stackOfOpenElements removeAllObjects];
+    _headElementPointer = nil;
+    _formElementPointer = nil;
+    _document = nil;
+    [_errors removeAllObjects];
+    _framesetOkFlag = YES;
+    _ignoreNextTokenIfLineFeed = NO;
+    [_activeFormattingElements removeAllObjects];
+    _pendingTableCharacters = nil;
+    _fosterParenting = NO;
+    _done = NO;
+    _nodeCount = 0;
+    _exceededLimits = HTMLParserLimitNone;
+    _pendingWhitespace = nil;
+    _pendingWhitespaceParent = nil;
+    _tape = nil;
+    _elementHandler = nil;
+#if HTMLREADER_COLLECT_STATISTICS
+    _adoptionAgencyRunCount = _reconstructionCount = _fosterParentingCount = _insertionModeResetCount = _maximumStackDepth = _encodingRestartCount = 0;
+#endif
+    if (_context) {
+        [self setTokenizerStateForContext];
+    }
+}
+
 - (instancetype)init
 {
     return [self initWithString:@"" encoding:(HTMLStringEncoding){.encoding = NSUTF8StringEncoding, .confidence = Tentative} context:nil];
@@ -116,9 +192,33 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
     return _tokenizer.string;
 }
 
+// Often enough to keep temporaries from piling up, rarely enough that draining costs next to nothing.
+static const NSUInteger TokensPerAutoreleasePool = 256;
+
 - (HTMLDocument *)document
 {
     if (_document) return _document;
+    NSUInteger maximumInputLength = _options.maximumInputLength;
+    if (maximumInputLength > 0 && self.string.length > maximumInputLength) {
+        // Cutting the input short up front means the rest is never even tokenized. Don't split a surrogate pair.
+        NSRange cut = [self.string rangeOfComposedCharacterSequenceAtIndex:maximumInputLength];
+        [_tokenizer resetWithString:[self.string substringToIndex:cut.location]];
+        if (_context) {
+            [self setTokenizerStateForContext];
+        }
+        _exceededLimits |= HTMLParserLimitInputLength;
+    }
+    _stopsAfterHead = _options.stopsAfterHead && !_fragmentParsingAlgorithm;
+    _stopTest = _options.stopTest;
+    _maximumDepth = _options.maximumDepth;
+    _maximumFormattingElements = _options.maximumFormattingElements;
+    _maximumNodeCount = _options.maximumNodeCount;
+    _maximumTextLength = _options.maximumTextLength;
+    _tokenizer.maximumAttributesPerTag = _options.maximumAttributesPerElement;
+    _tokenizer.stringPool = _options.stringPool;
+    _discardedContent = _options.discardedContent;
+    _tape = _options.createsNodesOnDemand && !_fragmentParsingAlgorithm ? [HTMLTape new] : nil;
+    _elementHandler = _tape ?: _finishedElementHandler;
     _document = [HTMLDocument new];
     if (_fragmentParsingAlgorithm) {
         HTMLElement *root = [[HTMLElement alloc] initWithTagName:@"html" attributes:nil];
@@ -134,21 +234,82 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
         }
         _formElementPointer = (HTMLElement *)nearestForm;
     }
-    for (id token in _tokenizer) {
-        if (_done) break;
-        [self processToken:token];
+    NSUInteger maximumTokenCount = _options.maximumTokenCount;
+    CFAbsoluteTime deadline = _options.maximumDuration > 0 ? CFAbsoluteTimeGetCurrent() + _options.maximumDuration : 0;
+    NSUInteger tokenCount = 0;
+    HTMLTokenPipeline *pipeline = _options.tokenizesConcurrently ? [[HTMLTokenPipeline alloc] initWithTokenizer:_tokenizer] : nil;
+    NSEnumerator *tokens = pipeline ?: _tokenizer;
+    BOOL more = YES;
+    while (more) {
+        // Tokens and the temporaries made while tokenizing and building the tree would otherwise pile up until the caller's autorelease pool drains, which for a big page means peak memory far above the size of the finished document.
+        @autoreleasepool {
+            for (NSUInteger i = 0; i < TokensPerAutoreleasePool; i++) {
+                id token = [tokens nextObject];
+                if (!token || _done) {
+                    more = NO;
+                    break;
+                }
+                tokenCount++;
+                if (maximumTokenCount > 0 && tokenCount > maximumTokenCount) {
+                    _exceededLimits |= HTMLParserLimitTokenCount;
+                    more = NO;
+                    break;
+                }
+                if (deadline > 0 && tokenCount % 256 == 0 && CFAbsoluteTimeGetCurrent() > deadline) {
+                    _exceededLimits |= HTMLParserLimitDuration;
+                    more = NO;
+                    break;
+                }
+                [self processToken:token];
+            }
+        }
     }
+    [pipeline stop];
+    
+    // Hitting a limit stops the loop early, and the document is finished as though the input ended there.
     [self processToken:[HTMLEOFToken new]];
     if (_context) {
-        HTMLNode *root = [_document.children objectAtIndex:0];
-        NSMutableOrderedSet *documentChildren = [_document mutableChildren];
-        [documentChildren removeAllObjects];
-        [documentChildren addObjectsFromArray:root.children.array];
+        HTMLNode *root = [_document childAtIndex:0];
+        [[_document mutableChildren] removeAllObjects];
+        [_document takeChildrenOfNode:root];
     }
     _document.parsedStringEncoding = self.encoding.encoding;
+    if (_tokenizer.droppedAttributes) {
+        _exceededLimits |= HTMLParserLimitAttributeCount;
+    }
+    _document.exceededParserLimits = _exceededLimits;
+#if HTMLREADER_COLLECT_STATISTICS
+    _document.parserStatistics = self.statistics;
+#endif
+    _pendingWhitespace = nil;
+    _pendingWhitespaceParent = nil;
+    _stopTest = nil;
+    _elementHandler = nil;
+    [_tape finishDocument:_document];
+    _tape = nil;
     return _document;
 }
 
+#if HTMLREADER_COLLECT_STATISTICS
+- (NSDictionary *)statistics
+{
+    NSMutableDictionary *statistics = [_tokenizer.statistics mutableCopy];
+    [statistics addEntriesFromDictionary:@{ @"adoptionAgencyRuns": @(_adoptionAgencyRunCount),
+                                            @"activeFormattingElementReconstructions": @(_reconstructionCount),
+                                            @"fosterParentedInsertions": @(_fosterParentingCount),
+                                            @"insertionModeResets": @(_insertionModeResetCount),
+                                            @"maximumStackDepth": @(_maximumStackDepth),
+                                            @"parseErrors": @(_errors.count),
+                                            @"encodingRestarts": @(_encodingRestartCount) }];
+    return statistics;
+}
+
+- (void)countEncodingRestart
+{
+    _encodingRestartCount++;
+}
+#endif
+
 - (NSArray *)errors
 {
     return [_errors copy];
@@ -501,9 +662,13 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
         [self followGenericRawTextElementParsingAlgorithmForToken:token];
     } else if ([token.tagName isEqualToString:@"script"]) {
         NSUInteger index;
-        HTMLNode *adjustedInsertionLocation = [self appropriatePlaceForInsertingANodeIndex:&index];
+        HTMLNode *adjustedInsertionLocation = [self appropriatePlaceForInsertingANodeWithOverrideTarget:[self depthLimitedTarget:self.currentNode] index:&index];
+        adjustedInsertionLocation = [self depthLimitedParent:adjustedInsertionLocation index:&index];
         HTMLElement *script = [self createElementForToken:token];
-        [[adjustedInsertionLocation mutableChildren] insertObject:script atIndex:index];
+        [self insertPendingWhitespaceBeforeElement:script inNode:adjustedInsertionLocation atIndex:&index];
+        if (![self discardsChildrenOfNode:adjustedInsertionLocation]) {
+            [[adjustedInsertionLocation mutableChildren] insertObject:script atIndex:index];
+        }
         [_stackOfOpenElements addObject:script];
         _tokenizer.state = HTMLScriptDataTokenizerState;
         [self switchInsertionMode:HTMLTextInsertionMode];
@@ -625,18 +790,27 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
 
 #pragma mark The "in body" insertion mode
 
+static NSCharacterSet * NonWhitespaceCharacterSet(void)
+{
+    static NSCharacterSet *set;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        set = [[NSCharacterSet characterSetWithCharactersInString:@"\t\n\f\r "] invertedSet];
+    });
+    return set;
+}
+
 - (void)inBodyInsertionModeHandleCharacterToken:(HTMLCharacterToken *)token
 {
     NSUInteger startingLength = token.string.length;
-    NSString *string = [token.string stringByReplacingOccurrencesOfString:@"\0" withString:@""];
+    NSString *string = StringByReplacingNullCharacters(token.string, @"");
     for (NSUInteger i = 0, end = startingLength - string.length; i < end; i++) {
         [self addParseError:@"Ignoring U+0000 NULL in <body>"];
     }
     if (string.length == 0) return;
     [self reconstructTheActiveFormattingElements];
     [self insertString:string];
-    NSCharacterSet *nonWhitespaceSet = [[NSCharacterSet characterSetWithCharactersInString:@"\t\n\f\r "] invertedSet];
-    if ([string rangeOfCharacterFromSet:nonWhitespaceSet].location != NSNotFound) {
+    if ([string rangeOfCharacterFromSet:NonWhitespaceCharacterSet()].location != NSNotFound) {
         _framesetOkFlag = NO;
     }
 }
@@ -1141,6 +1315,7 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
 // Returns NO if the parser should "act as described in the 'any other end tag' entry below".
 - (BOOL)runAdoptionAgencyAlgorithmForTagName:(NSString *)tagName
 {
+    HTMLCountStatistic(_adoptionAgencyRunCount++);
     for (NSInteger outerLoopCounter = 0; outerLoopCounter < 8; outerLoopCounter++) {
         HTMLElement *formattingElement;
         for (HTMLElement *element in _activeFormattingElements.reverseObjectEnumerator) {
@@ -1151,7 +1326,7 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
             }
         }
         if (!formattingElement) return NO;
-        if (![_stackOfOpenElements containsObject:formattingElement]) {
+        if (![self stackOfOpenElementsContainsElement:formattingElement]) {
             [self addParseError:@"Adoption agency formatting element missing from stack"];
             [self removeElementFromListOfActiveFormattingElements:formattingElement];
             return YES;
@@ -1181,15 +1356,29 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
             [self removeElementFromListOfActiveFormattingElements:formattingElement];
             return YES;
         }
-        HTMLElement *commonAncestor = [_stackOfOpenElements objectAtIndex:[_stackOfOpenElements indexOfObject:formattingElement] - 1];
+        NSUInteger formattingElementIndex = [_stackOfOpenElements indexOfObjectIdenticalTo:formattingElement];
+        NSUInteger furthestBlockIndex = [_stackOfOpenElements indexOfObjectIdenticalTo:furthestBlock];
+        HTMLElement *commonAncestor = [_stackOfOpenElements objectAtIndex:formattingElementIndex - 1];
+        
+        // At most three clones go between the common ancestor and the furthest block. If that could nest anything too deeply, close the formatting element as though there were no furthest block.
+        if (_maximumDepth > 0 && ![self adoptionFitsMaximumDepthWithFurthestBlock:furthestBlock commonAncestor:commonAncestor clones:MIN((NSUInteger)3, furthestBlockIndex - formattingElementIndex - 1)]) {
+            _exceededLimits |= HTMLParserLimitDepth;
+            [_stackOfOpenElements removeObjectsInRange:NSMakeRange(formattingElementIndex, _stackOfOpenElements.count - formattingElementIndex)];
+            [self removeElementFromListOfActiveFormattingElements:formattingElement];
+            return YES;
+        }
+        
         HTMLElement *beforeBookmark, *afterBookmark; {
             NSUInteger bookmark = [_activeFormattingElements indexOfObject:formattingElement];
             if (bookmark > 0) beforeBookmark = [_activeFormattingElements objectAtIndex:bookmark - 1];
             if ((bookmark + 1) < _activeFormattingElements.count) afterBookmark = [_activeFormattingElements objectAtIndex:bookmark + 1];
         }
         HTMLElement *node = furthestBlock, *lastNode = furthestBlock;
-        NSUInteger nodeIndex = [_stackOfOpenElements indexOfObject:node];
+        NSUInteger nodeIndex = furthestBlockIndex;
         NSInteger innerLoopCounter = 0;
+        
+        // Nodes come off the stack all at once after the loop, as one at a time is quadratic when many are open between the formatting element and the furthest block. Meanwhile the loop only looks further down the stack, where nothing moves.
+        NSMutableIndexSet *removedFromStack = [NSMutableIndexSet new];
         while (YES) {
             innerLoopCounter += 1;
 
@@ -1203,18 +1392,18 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
             }
             
             if (![_activeFormattingElements containsObject:node]) {
-                [_stackOfOpenElements removeObject:node];
+                [removedFromStack addIndex:nodeIndex];
                 continue;
             }
 
             {
                 HTMLElement *clone = [node copy];
+                [self didCreateNode];
                 [_activeFormattingElements replaceObjectAtIndex:[_activeFormattingElements indexOfObject:node]
                                                      withObject:clone];
                 if (beforeBookmark == node) beforeBookmark = clone;
                 if (afterBookmark == node) afterBookmark = clone;
-                [_stackOfOpenElements replaceObjectAtIndex:[_stackOfOpenElements indexOfObject:node]
-                                                withObject:clone];
+                [_stackOfOpenElements replaceObjectAtIndex:nodeIndex withObject:clone];
                 node = clone;
             }
 
@@ -1229,14 +1418,18 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
             
             lastNode = node;
         }
+        [_stackOfOpenElements removeObjectsAtIndexes:removedFromStack];
         
         [self insertNode:lastNode atAppropriatePlaceWithOverrideTarget:commonAncestor];
         
         HTMLElement *formattingClone = [formattingElement copy];
+        [self didCreateNode];
         
         [formattingClone.mutableChildren addObjectsFromArray:furthestBlock.children.array];
         
-        [furthestBlock.mutableChildren addObject:formattingClone];
+        if (![self discardsChildrenOfNode:furthestBlock]) {
+            [furthestBlock.mutableChildren addObject:formattingClone];
+        }
 
         [self removeElementFromListOfActiveFormattingElements:formattingElement];
         NSUInteger proposedBookmark = NSNotFound;
@@ -1266,6 +1459,60 @@ typedef NS_ENUM(NSInteger, HTMLInsertionMode)
     return YES;
 }
 
+// The number of elements from the node up to the root, counting the node itself if it's an element.
+static NSUInteger ElementDepthOfNode(HTMLNode *node)
+{
+    NSUInteger depth = 0;
+    for (HTMLNode *ancestor = node; [ancestor isKindOfClass:[HTMLElement class]]; ancestor = ancestor.parentNode) {
+        depth++;
+    }
+    return depth;
+}
+
+// The number of levels of elements below the node, counting its child elements as one, or limit if there are at least that many.
+static NSUInteger ElementHeightOfNode(HTMLNode *root, NSUInteger limit)
+{
+    typedef struct {
+        __unsafe_unretained HTMLNode *node;
+        NSUInteger nextChild;
+    } Frame;
+    
+    NSUInteger height = 0;
+    Frame *stack = malloc(sizeof(Frame) * 16);
+    NSUInteger depth = 1, capacity = 16;
+    stack[0] = (Frame){ .node = root, .nextChild = 0 };
+    while (depth > 0 && height < limit) {
+        Frame *frame = &stack[depth - 1];
+        if (frame->nextChild == frame->node.numberOfChildren) {
+            depth--;
+            continue;
+        }
+        HTMLNode *child = [frame->node childAtIndex:frame->nextChild++];
+        if (![child isKindOfClass:[HTMLElement class]]) continue;
+        height = MAX(height, depth);
+        if (depth == capacity) {
+            capacity *= 2;
+            stack = reallocf(stack, sizeof(Frame) * capacity);
+        }
+        stack[depth++] = (Frame){ .node = child, .nextChild = 0 };
+    }
+    free(stack);
+    return MIN(height, limit);
+}
+
+// The adoption agency moves the furthest block under the common ancestor, with some clones in between, then moves the furthest block's children into one more clone.
+- (BOOL)adoptionFitsMaximumDepthWithFurthestBlock:(HTMLElement *)furthestBlock commonAncestor:(HTMLElement *)commonAncestor clones:(NSUInteger)clones
+{
+    NSUInteger index;
+    HTMLNode *parent = [self appropriatePlaceForInsertingANodeWithOverrideTarget:commonAncestor index:&index countingStatistics:NO];
+    NSUInteger formattingCloneDepth = ElementDepthOfNode(parent) + clones + 2;
+    
+    // Everything under the furthest block is within the maximum depth already. So when its children end up no deeper than they are now, which is usual, there's no need to look at them.
+    if (formattingCloneDepth <= ElementDepthOfNode(furthestBlock)) return YES;
+    if (formattingCloneDepth > _maximumDepth) return NO;
+    return formattingCloneDepth + ElementHeightOfNode(furthestBlock, _maximumDepth) <= _maximumDepth;
+}
+
 static BOOL IsSpecialElement(HTMLElement *element)
 {
     if (element.htmlNamespace == HTMLNamespaceHTML) {
@@ -1283,6 +1530,12 @@ static BOOL IsSpecialElement(HTMLElement *element)
 
 - (void)textInsertionModeHandleCharacterToken:(HTMLCharacterToken *)token
 {
+    if (_discardedContent & HTMLParserDiscardScriptAndStyleText) {
+        HTMLElement *currentNode = self.currentNode;
+        if (currentNode.htmlNamespace == HTMLNamespaceHTML && StringIsEqualToAnyOf(currentNode.tagName, @"script", @"style")) {
+            return;
+        }
+    }
     [self insertString:token.string];
 }
 
@@ -1425,7 +1678,7 @@ static BOOL IsSpecialElement(HTMLElement *element)
 - (void)inTableTextInsertionModeHandleCharacterToken:(HTMLCharacterToken *)token
 {
     NSUInteger startingLength = token.string.length;
-    NSString *string = [token.string stringByReplacingOccurrencesOfString:@"\0" withString:@""];
+    NSString *string = StringByReplacingNullCharacters(token.string, @"");
     for (NSUInteger i = 0, end = startingLength - string.length; i < end; i++) {
         [self addParseError:@"Ignoring U+0000 NULL in <table> text"];
     }
@@ -1434,8 +1687,7 @@ static BOOL IsSpecialElement(HTMLElement *element)
 
 - (void)inTableTextInsertionModeHandleAnythingElse:(id)token
 {
-    NSCharacterSet *nonWhitespaceSet = [[NSCharacterSet characterSetWithCharactersInString:@" \t\n\f\r"] invertedSet];
-    if ([_pendingTableCharacters rangeOfCharacterFromSet:nonWhitespaceSet].location != NSNotFound) {
+    if ([_pendingTableCharacters rangeOfCharacterFromSet:NonWhitespaceCharacterSet()].location != NSNotFound) {
         HTMLCharacterToken *characterToken = [[HTMLCharacterToken alloc] initWithString:_pendingTableCharacters];
         [self inTableInsertionModeHandleAnythingElse:characterToken];
     } else {
@@ -1827,7 +2079,7 @@ static BOOL IsSpecialElement(HTMLElement *element)
 - (void)inSelectInsertionModeHandleCharacterToken:(HTMLCharacterToken *)token
 {
     NSUInteger startingLength = token.string.length;
-    NSString *string = [token.string stringByReplacingOccurrencesOfString:@"\0" withString:@""];
+    NSString *string = StringByReplacingNullCharacters(token.string, @"");
     for (NSUInteger i = 0, end = startingLength - string.length; i < end; i++) {
         [self addParseError:@"Ignoring U+0000 NULL in <select>"];
     }
@@ -2264,7 +2516,7 @@ static BOOL IsSpecialElement(HTMLElement *element)
             _framesetOkFlag = NO;
         }
     }
-    [self insertString:[token.string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
+    [self insertString:StringByReplacingNullCharacters(token.string, @"\uFFFD")];
 }
 
 - (void)foreignContentInsertionModeHandleCommentToken:(HTMLCommentToken *)token
@@ -2327,110 +2579,126 @@ static void AdjustMathMLAttributesForToken(HTMLStartTagToken *token)
 
 static void FixSVGTagNameCaseForToken(HTMLStartTagToken *token)
 {
-    NSDictionary *names = @{
-        @"altglyph": @"altGlyph",
-        @"altglyphdef": @"altGlyphDef",
-        @"altglyphitem": @"altGlyphItem",
-        @"animatecolor": @"animateColor",
-        @"animatemotion": @"animateMotion",
-        @"animatetransform": @"animateTransform",
-        @"clippath": @"clipPath",
-        @"feblend": @"feBlend",
-        @"fecolormatrix": @"feColorMatrix",
-        @"fecomponenttransfer": @"feComponentTransfer",
-        @"fecomposite": @"feComposite",
-        @"feconvolvematrix": @"feConvolveMatrix",
-        @"fediffuselighting": @"feDiffuseLighting",
-        @"fedisplacementmap": @"feDisplacementMap",
-        @"fedistantlight": @"feDistantLight",
-        @"feflood": @"feFlood",
-        @"fefunca": @"feFuncA",
-        @"fefuncb": @"feFuncB",
-        @"fefuncg": @"feFuncG",
-        @"fefuncr": @"feFuncR",
-        @"fegaussianblur": @"feGaussianBlur",
-        @"feimage": @"feImage",
-        @"femerge": @"feMerge",
-        @"femergenode": @"feMergeNode",
-        @"femorphology": @"feMorphology",
-        @"feoffset": @"feOffset",
-        @"fepointlight": @"fePointLight",
-        @"fespecularlighting": @"feSpecularLighting",
-        @"fespotlight": @"feSpotLight",
-        @"fetile": @"feTile",
-        @"feturbulence": @"feTurbulence",
-        @"foreignobject": @"foreignObject",
-        @"glyphref": @"glyphRef",
-        @"lineargradient": @"linearGradient",
-        @"radialgradient": @"radialGradient",
-        @"textpath": @"textPath",
-    };
+    static NSDictionary *names;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        names = @{
+            @"altglyph": @"altGlyph",
+            @"altglyphdef": @"altGlyphDef",
+            @"altglyphitem": @"altGlyphItem",
+            @"animatecolor": @"animateColor",
+            @"animatemotion": @"animateMotion",
+            @"animatetransform": @"animateTransform",
+            @"clippath": @"clipPath",
+            @"feblend": @"feBlend",
+            @"fecolormatrix": @"feColorMatrix",
+            @"fecomponenttransfer": @"feComponentTransfer",
+            @"fecomposite": @"feComposite",
+            @"feconvolvematrix": @"feConvolveMatrix",
+            @"fediffuselighting": @"feDiffuseLighting",
+            @"fedisplacementmap": @"feDisplacementMap",
+            @"fedistantlight": @"feDistantLight",
+            @"feflood": @"feFlood",
+            @"fefunca": @"feFuncA",
+            @"fefuncb": @"feFuncB",
+            @"fefuncg": @"feFuncG",
+            @"fefuncr": @"feFuncR",
+            @"fegaussianblur": @"feGaussianBlur",
+            @"feimage": @"feImage",
+            @"femerge": @"feMerge",
+            @"femergenode": @"feMergeNode",
+            @"femorphology": @"feMorphology",
+            @"feoffset": @"feOffset",
+            @"fepointlight": @"fePointLight",
+            @"fespecularlighting": @"feSpecularLighting",
+            @"fespotlight": @"feSpotLight",
+            @"fetile": @"feTile",
+            @"feturbulence": @"feTurbulence",
+            @"foreignobject": @"foreignObject",
+            @"glyphref": @"glyphRef",
+            @"lineargradient": @"linearGradient",
+            @"radialgradient": @"radialGradient",
+            @"textpath": @"textPath",
+        };
+    });
     NSString *replacement = [names objectForKey:token.tagName];
     if (replacement) token.tagName = replacement;
 }
 
 static void AdjustSVGAttributesForToken(HTMLStartTagToken *token)
 {
-    NSDictionary *names = @{
-        @"attributename": @"attributeName",
-        @"attributetype": @"attributeType",
-        @"basefrequency": @"baseFrequency",
-        @"baseprofile": @"baseProfile",
-        @"calcmode": @"calcMode",
-        @"clippathunits": @"clipPathUnits",
-        @"diffuseconstant": @"diffuseConstant",
-        @"edgemode": @"edgeMode",
-        @"filterunits": @"filterUnits",
-        @"glyphref": @"glyphRef",
-        @"gradienttransform": @"gradientTransform",
-        @"gradientunits": @"gradientUnits",
-        @"kernelmatrix": @"kernelMatrix",
-        @"kernelunitlength": @"kernelUnitLength",
-        @"keypoints": @"keyPoints",
-        @"keysplines": @"keySplines",
-        @"keytimes": @"keyTimes",
-        @"lengthadjust": @"lengthAdjust",
-        @"limitingconeangle": @"limitingConeAngle",
-        @"markerheight": @"markerHeight",
-        @"markerunits": @"markerUnits",
-        @"markerwidth": @"markerWidth",
-        @"maskcontentunits": @"maskContentUnits",
-        @"maskunits": @"maskUnits",
-        @"numoctaves": @"numOctaves",
-        @"pathlength": @"pathLength",
-        @"patterncontentunits": @"patternContentUnits",
-        @"patterntransform": @"patternTransform",
-        @"patternunits": @"patternUnits",
-        @"pointsatx": @"pointsAtX",
-        @"pointsaty": @"pointsAtY",
-        @"pointsatz": @"pointsAtZ",
-        @"preservealpha": @"preserveAlpha",
-        @"preserveaspectratio": @"preserveAspectRatio",
-        @"primitiveunits": @"primitiveUnits",
-        @"refx": @"refX",
-        @"refy": @"refY",
-        @"repeatcount": @"repeatCount",
-        @"repeatdur": @"repeatDur",
-        @"requiredextensions": @"requiredExtensions",
-        @"requiredfeatures": @"requiredFeatures",
-        @"specularconstant": @"specularConstant",
-        @"specularexponent": @"specularExponent",
-        @"spreadmethod": @"spreadMethod",
-        @"startoffset": @"startOffset",
-        @"stddeviation": @"stdDeviation",
-        @"stitchtiles": @"stitchTiles",
-        @"surfacescale": @"surfaceScale",
-        @"systemlanguage": @"systemLanguage",
-        @"tablevalues": @"tableValues",
-        @"targetx": @"targetX",
-        @"targety": @"targetY",
-        @"textlength": @"textLength",
-        @"viewbox": @"viewBox",
-        @"viewtarget": @"viewTarget",
-        @"xchannelselector": @"xChannelSelector",
-        @"ychannelselector": @"yChannelSelector",
-        @"zoomandpan": @"zoomAndPan",
-    };
+    static NSDictionary *names;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        names = @{
+            @"attributename": @"attributeName",
+            @"attributetype": @"attributeType",
+            @"basefrequency": @"baseFrequency",
+            @"baseprofile": @"baseProfile",
+            @"calcmode": @"calcMode",
+            @"clippathunits": @"clipPathUnits",
+            @"diffuseconstant": @"diffuseConstant",
+            @"edgemode": @"edgeMode",
+            @"filterunits": @"filterUnits",
+            @"glyphref": @"glyphRef",
+            @"gradienttransform": @"gradientTransform",
+            @"gradientunits": @"gradientUnits",
+            @"kernelmatrix": @"kernelMatrix",
+            @"kernelunitlength": @"kernelUnitLength",
+            @"keypoints": @"keyPoints",
+            @"keysplines": @"keySplines",
+            @"keytimes": @"keyTimes",
+            @"lengthadjust": @"lengthAdjust",
+            @"limitingconeangle": @"limitingConeAngle",
+            @"markerheight": @"markerHeight",
+            @"markerunits": @"markerUnits",
+            @"markerwidth": @"markerWidth",
+            @"maskcontentunits": @"maskContentUnits",
+            @"maskunits": @"maskUnits",
+            @"numoctaves": @"numOctaves",
+            @"pathlength": @"pathLength",
+            @"patterncontentunits": @"patternContentUnits",
+            @"patterntransform": @"patternTransform",
+            @"patternunits": @"patternUnits",
+            @"pointsatx": @"pointsAtX",
+            @"pointsaty": @"pointsAtY",
+            @"pointsatz": @"pointsAtZ",
+            @"preservealpha": @"preserveAlpha",
+            @"preserveaspectratio": @"preserveAspectRatio",
+            @"primitiveunits": @"primitiveUnits",
+            @"refx": @"refX",
+            @"refy": @"refY",
+            @"repeatcount": @"repeatCount",
+            @"repeatdur": @"repeatDur",
+            @"requiredextensions": @"requiredExtensions",
+            @"requiredfeatures": @"requiredFeatures",
+            @"specularconstant": @"specularConstant",
+            @"specularexponent": @"specularExponent",
+            @"spreadmethod": @"spreadMethod",
+            @"startoffset": @"startOffset",
+            @"stddeviation": @"stdDeviation",
+            @"stitchtiles": @"stitchTiles",
+            @"surfacescale": @"surfaceScale",
+            @"systemlanguage": @"systemLanguage",
+            @"tablevalues": @"tableValues",
+            @"targetx": @"targetX",
+            @"targety": @"targetY",
+            @"textlength": @"textLength",
+            @"viewbox": @"viewBox",
+            @"viewtarget": @"viewTarget",
+            @"xchannelselector": @"xChannelSelector",
+            @"ychannelselector": @"yChannelSelector",
+            @"zoomandpan": @"zoomAndPan",
+        };
+    });
+    BOOL renames = NO;
+    for (NSString *name in token.attributes) {
+        if ([names objectForKey:name]) {
+            renames = YES;
+            break;
+        }
+    }
+    if (!renames) return;
     HTMLOrderedDictionary *newAttributes = [HTMLOrderedDictionary new];
     [token.attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *value, BOOL *stop) {
         NSString *newName = [names objectForKey:name] ?: name;
@@ -2470,6 +2738,8 @@ static void AdjustForeignAttributesForToken(HTMLStartTagToken *token)
 
 - (void)processToken:(id)token
 {
+    // Elements are only pushed while processing a token, so checking between tokens catches the deepest point.
+    HTMLCountStatistic(_maximumStackDepth = MAX(_maximumStackDepth, _stackOfOpenElements.count));
     if (^(HTMLElement *node){
         if (!node) return YES;
         if (node.htmlNamespace == HTMLNamespaceHTML) return YES;
@@ -2894,23 +3164,15 @@ static BOOL IsHTMLIntegrationPoint(HTMLElement *node)
 
 - (HTMLElement *)elementInScopeWithTagNameInArray:(NSArray *)tagNames
 {
-    return [self elementInScopeWithTagNameInArray:tagNames additionalElementTypes:nil];
+    return [self elementInSpecificScopeWithTagNameInArray:tagNames elementTypes:ScopeElementTypes()];
 }
 
 - (HTMLElement *)elementInButtonScopeWithTagName:(NSString *)tagName
 {
-    return [self elementInScopeWithTagNameInArray:@[ tagName ]
-                           additionalElementTypes:@[ @"button" ]];
-}
-
-- (HTMLElement *)elementInScopeWithTagNameInArray:(NSArray *)tagNames
-                               additionalElementTypes:(NSArray *)additionalElementTypes
-{
-    NSDictionary *elementTypes = ElementTypesForSpecificScope(additionalElementTypes);
-    return [self elementInSpecificScopeWithTagNameInArray:tagNames elementTypes:elementTypes];
+    return [self elementInSpecificScopeWithTagNameInArray:@[ tagName ] elementTypes:ButtonScopeElementTypes()];
 }
 
-static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTMLElements)
+static NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTMLElements)
 {
     if (!additionalHTMLElements) additionalHTMLElements = @[];
     NSArray *html = [@[ @"applet", @"caption", @"html", @"table", @"td", @"th",
@@ -2922,6 +3184,47 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
     };
 }
 
+// Scopes are checked all the time while building the tree, so each kind builds its element types just once.
+static NSDictionary * ScopeElementTypes(void)
+{
+    static NSDictionary *elementTypes;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        elementTypes = ElementTypesForSpecificScope(nil);
+    });
+    return elementTypes;
+}
+
+static NSDictionary * ButtonScopeElementTypes(void)
+{
+    static NSDictionary *elementTypes;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        elementTypes = ElementTypesForSpecificScope(@[ @"button" ]);
+    });
+    return elementTypes;
+}
+
+static NSDictionary * ListItemScopeElementTypes(void)
+{
+    static NSDictionary *elementTypes;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        elementTypes = ElementTypesForSpecificScope(@[ @"ol", @"ul" ]);
+    });
+    return elementTypes;
+}
+
+static NSDictionary * TableScopeElementTypes(void)
+{
+    static NSDictionary *elementTypes;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        elementTypes = @{ @(HTMLNamespaceHTML): @[ @"html", @"table" ] };
+    });
+    return elementTypes;
+}
+
 - (HTMLElement *)elementInSpecificScopeWithTagNameInArray:(NSArray *)tagNames
                                              elementTypes:(NSDictionary *)elementTypes
 {
@@ -2955,20 +3258,17 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
 
 - (HTMLElement *)elementInTableScopeWithTagNameInArray:(NSArray *)tagNames
 {
-    NSDictionary *elementTypes = @{ @(HTMLNamespaceHTML): @[ @"html", @"table" ] };
-    return [self elementInSpecificScopeWithTagNameInArray:tagNames elementTypes:elementTypes];
+    return [self elementInSpecificScopeWithTagNameInArray:tagNames elementTypes:TableScopeElementTypes()];
 }
 
 - (HTMLElement *)elementInTableScopeWithTagNameInArray:(NSArray *)tagNames namespace:(HTMLNamespace)namespace
 {
-    NSDictionary *elementTypes = @{ @(HTMLNamespaceHTML): @[ @"html", @"table" ] };
-    return [self elementInSpecificScopeWithTagNameInArray:tagNames elementTypes:elementTypes namespace:namespace];
+    return [self elementInSpecificScopeWithTagNameInArray:tagNames elementTypes:TableScopeElementTypes() namespace:namespace];
 }
 
 - (HTMLElement *)elementInListItemScopeWithTagName:(NSString *)tagName
 {
-    return [self elementInScopeWithTagNameInArray:@[ tagName ]
-                           additionalElementTypes:@[ @"ol", @"ul" ]];
+    return [self elementInSpecificScopeWithTagNameInArray:@[ tagName ] elementTypes:ListItemScopeElementTypes()];
 }
 
 - (HTMLElement *)selectElementInSelectScope
@@ -2984,7 +3284,7 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
 
 - (BOOL)isElementInScope:(HTMLElement *)element
 {
-    NSDictionary *elementTypes = ElementTypesForSpecificScope(nil);
+    NSDictionary *elementTypes = ScopeElementTypes();
     for (HTMLElement *node in _stackOfOpenElements.reverseObjectEnumerator) {
         if ([node isEqual:element]) return YES;
         if ([[elementTypes objectForKey:@(node.htmlNamespace)] containsObject:node.tagName]) return NO;
@@ -3001,14 +3301,51 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
 
 - (void)insertComment:(NSString *)data inNode:(HTMLNode *)node
 {
+    if (_discardedContent & HTMLParserDiscardComments) return;
     NSUInteger index;
     if (node) {
         index = node.numberOfChildren;
     } else {
         node = [self appropriatePlaceForInsertingANodeIndex:&index];
     }
+    if ([self discardsChildrenOfNode:node]) return;
     HTMLComment *comment = [[HTMLComment alloc] initWithData:data];
     [[node mutableChildren] insertObject:comment atIndex:index];
+    [self didCreateNode];
+}
+
+- (void)didCreateNode
+{
+    _nodeCount++;
+    if (_maximumNodeCount > 0 && _nodeCount >= _maximumNodeCount) {
+        _exceededLimits |= HTMLParserLimitNodeCount;
+        _done = YES;
+    }
+}
+
+// Elements that would be nested too deeply go alongside the deepest allowed elements instead. Other nodes can still go in the deepest elements.
+- (HTMLElement *)depthLimitedTarget:(HTMLElement *)target
+{
+    if (_maximumDepth > 0 && _stackOfOpenElements.count >= _maximumDepth) {
+        _exceededLimits |= HTMLParserLimitDepth;
+        return [_stackOfOpenElements objectAtIndex:MAX(_maximumDepth, 2) - 2];
+    }
+    return target;
+}
+
+// Foster parenting can put an element somewhere other than where the stack of open elements suggests, so the place itself gets checked too. Elements that would still be too deep go at the end of the nearest ancestor where they fit.
+- (HTMLNode *)depthLimitedParent:(HTMLNode *)parent index:(inout NSUInteger *)index
+{
+    if (_maximumDepth == 0) return parent;
+    NSUInteger depth = ElementDepthOfNode(parent);
+    if (depth < _maximumDepth) return parent;
+    _exceededLimits |= HTMLParserLimitDepth;
+    while (depth >= _maximumDepth && [parent.parentNode isKindOfClass:[HTMLElement class]]) {
+        parent = parent.parentNode;
+        depth--;
+    }
+    *index = parent.numberOfChildren;
+    return parent;
 }
 
 - (HTMLNode *)appropriatePlaceForInsertingANodeIndex:(out NSUInteger *)index
@@ -3018,9 +3355,20 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
 
 - (HTMLNode *)appropriatePlaceForInsertingANodeWithOverrideTarget:(HTMLElement *)overrideTarget
                                                             index:(out NSUInteger *)index
+{
+    return [self appropriatePlaceForInsertingANodeWithOverrideTarget:overrideTarget index:index countingStatistics:YES];
+}
+
+// Statistics are only counted when a node is actually going in.
+- (HTMLNode *)appropriatePlaceForInsertingANodeWithOverrideTarget:(HTMLElement *)overrideTarget
+                                                            index:(out NSUInteger *)index
+                                               countingStatistics:(BOOL)countingStatistics
 {
     HTMLElement *target = overrideTarget ?: self.currentNode;
     if (_fosterParenting && StringIsEqualToAnyOf(target.tagName, @"table", @"tbody", @"tfoot", @"thead", @"tr")) {
+        if (countingStatistics) {
+            HTMLCountStatistic(_fosterParentingCount++);
+        }
         HTMLElement *lastTable;
         for (HTMLElement *element in _stackOfOpenElements.reverseObjectEnumerator) {
             if ([element.tagName isEqualToString:@"table"]) {
@@ -3053,6 +3401,10 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
         _originalInsertionMode = _insertionMode;
     }
     _insertionMode = insertionMode;
+    if (_stopsAfterHead && (insertionMode == HTMLAfterHeadInsertionMode || insertionMode == HTMLInBodyInsertionMode)) {
+        _exceededLimits |= HTMLParserLimitStopCondition;
+        _done = YES;
+    }
 }
 
 - (HTMLElement *)createElementForToken:(id)token
@@ -3064,6 +3416,11 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
 {
     HTMLElement *element = [[HTMLElement alloc] initWithTagName:token.tagName attributes:token.attributes];
     element.htmlNamespace = namespace;
+    if (_stopTest && _stopTest(element)) {
+        _exceededLimits |= HTMLParserLimitStopCondition;
+        _done = YES;
+    }
+    [self didCreateNode];
     return element;
 }
 
@@ -3077,17 +3434,162 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
 - (void)insertElement:(HTMLElement *)element
 {
     NSUInteger index;
-    HTMLNode *adjustedInsertionLocation = [self appropriatePlaceForInsertingANodeIndex:&index];
-    [[adjustedInsertionLocation mutableChildren] insertObject:element atIndex:index];
+    HTMLNode *adjustedInsertionLocation = [self appropriatePlaceForInsertingANodeWithOverrideTarget:[self depthLimitedTarget:self.currentNode] index:&index];
+    adjustedInsertionLocation = [self depthLimitedParent:adjustedInsertionLocation index:&index];
+    [self insertPendingWhitespaceBeforeElement:element inNode:adjustedInsertionLocation atIndex:&index];
+    if (_elementHandler && adjustedInsertionLocation == self.currentNode && index == adjustedInsertionLocation.numberOfChildren) {
+        [self finishLastElementInCurrentNode];
+        
+        // The handler may have taken some children away.
+        index = adjustedInsertionLocation.numberOfChildren;
+    }
+    if (![self discardsChildrenOfNode:adjustedInsertionLocation]) {
+        [[adjustedInsertionLocation mutableChildren] insertObject:element atIndex:index];
+    }
     [_stackOfOpenElements addObject:element];
 }
 
+// A discarded template's descendants still go on the stack of open elements, so the tree around them is built as usual, but they never make it into the document.
+- (BOOL)discardsChildrenOfNode:(HTMLNode *)node
+{
+    if (!(_discardedContent & HTMLParserDiscardTemplateContents) || ![node isKindOfClass:[HTMLElement class]]) return NO;
+    HTMLElement *element = (HTMLElement *)node;
+    return element.htmlNamespace == HTMLNamespaceHTML && [element.tagName isEqualToString:@"template"];
+}
+
+static BOOL IsWhitespaceOnly(NSString *string)
+{
+    CFStringInlineBuffer buffer;
+    CFIndex length = CFStringGetLength((__bridge CFStringRef)string);
+    CFStringInitInlineBuffer((__bridge CFStringRef)string, &buffer, CFRangeMake(0, length));
+    for (CFIndex i = 0; i < length; i++) {
+        if (!is_whitespace(CFStringGetCharacterFromInlineBuffer(&buffer, i))) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+// Whitespace between these is rendered. Foreign elements count, as SVG text runs mind their spaces too.
+static BOOL IsPhrasingElement(HTMLElement *element)
+{
+    if (element.htmlNamespace != HTMLNamespaceHTML) return YES;
+    return StringIsEqualToAnyOf(element.tagName, @"a", @"abbr", @"area", @"audio", @"b", @"bdi", @"bdo", @"big", @"br", @"button", @"canvas", @"cite", @"code", @"data", @"datalist", @"del", @"dfn", @"em", @"embed", @"font", @"i", @"iframe", @"img", @"input", @"ins", @"kbd", @"label", @"map", @"mark", @"meter", @"nobr", @"object", @"output", @"picture", @"progress", @"q", @"ruby", @"s", @"samp", @"script", @"select", @"small", @"span", @"strike", @"strong", @"sub", @"sup", @"textarea", @"time", @"tt", @"u", @"var", @"video", @"wbr");
+}
+
+static BOOL IsInsidePreformattedElement(HTMLNode *node)
+{
+    for (HTMLElement *element = (HTMLElement *)node; [element isKindOfClass:[HTMLElement class]]; element = element.parentElement) {
+        if (element.htmlNamespace == HTMLNamespaceHTML && StringIsEqualToAnyOf(element.tagName, @"pre", @"listing", @"textarea")) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// The adoption agency algorithm moves the children of a special element below a formatting element on the stack of open elements, and moves the special element too, so everything under it gets new ancestors.
+- (BOOL)adoptionAgencyCanMoveChildrenOfCurrentNode
+{
+    NSUInteger formattingIndex = NSNotFound;
+    for (HTMLElement *element in _activeFormattingElements) {
+        NSUInteger index = [_stackOfOpenElements indexOfObjectIdenticalTo:element];
+        if (index < formattingIndex) {
+            formattingIndex = index;
+        }
+    }
+    if (formattingIndex == NSNotFound) return NO;
+    for (NSUInteger i = formattingIndex + 1, end = _stackOfOpenElements.count; i < end; i++) {
+        if (IsSpecialElement([_stackOfOpenElements objectAtIndex:i])) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// Call just before appending an element to the current node. The current node's most recent element child was closed by now, and since things only ever get added to the current node (or, when foster parenting, just before a table), nothing will change in that child's subtree again. The head element is the exception, as it can be reopened. So is any child the adoption agency algorithm might yet move, or that a frameset might yet replace; it's left for the handler to find under an ancestor that gets finished.
+- (void)finishLastElementInCurrentNode
+{
+    if ([self adoptionAgencyCanMoveChildrenOfCurrentNode]) return;
+    
+    // Until the frameset-ok flag is cleared, a frameset start tag can still throw out the body and everything in it.
+    if (_framesetOkFlag && !_context) return;
+    
+    HTMLOrderedSetOf(HTMLNode *) *children = ChildrenOfNode(self.currentNode);
+    for (NSUInteger i = children.count; i-- > 0; ) {
+        HTMLElement *child = [children objectAtIndex:i];
+        if (![child isKindOfClass:[HTMLElement class]]) continue;
+        if (child != _headElementPointer && [_stackOfOpenElements indexOfObjectIdenticalTo:child] == NSNotFound) {
+            [_elementHandler parserDidFinishElement:child];
+        }
+        return;
+    }
+}
+
 - (void)insertString:(NSString *)string
 {
     NSUInteger index;
     HTMLNode *adjustedInsertionLocation = [self appropriatePlaceForInsertingANodeIndex:&index];
-    if (![adjustedInsertionLocation isKindOfClass:[HTMLDocument class]]) {
-        [adjustedInsertionLocation insertString:string atChildNodeIndex:index];
+    if ([adjustedInsertionLocation isKindOfClass:[HTMLDocument class]] || [self discardsChildrenOfNode:adjustedInsertionLocation]) {
+        return;
+    }
+    if (_discardedContent & HTMLParserDiscardWhitespaceText) {
+        // Whitespace is held back until it's clear whether it's a text node of its own. If more text lands right after it, or it ends up between two inline elements, it's kept.
+        if (_pendingWhitespace) {
+            if (adjustedInsertionLocation == _pendingWhitespaceParent && index == _pendingWhitespaceIndex && adjustedInsertionLocation.numberOfChildren == _pendingWhitespaceSiblingCount) {
+                string = [_pendingWhitespace stringByAppendingString:string];
+            }
+            _pendingWhitespace = nil;
+            _pendingWhitespaceParent = nil;
+        }
+        BOOL appending = index > 0 && [[adjustedInsertionLocation childAtIndex:index - 1] isKindOfClass:[HTMLTextNode class]];
+        if (!appending && _insertionMode != HTMLTextInsertionMode && IsWhitespaceOnly(string) && !IsInsidePreformattedElement(adjustedInsertionLocation)) {
+            _pendingWhitespace = string;
+            _pendingWhitespaceParent = adjustedInsertionLocation;
+            _pendingWhitespaceIndex = index;
+            _pendingWhitespaceSiblingCount = adjustedInsertionLocation.numberOfChildren;
+            return;
+        }
+    }
+    [self insertString:string inNode:adjustedInsertionLocation atIndex:index];
+}
+
+- (void)insertString:(NSString *)string inNode:(HTMLNode *)adjustedInsertionLocation atIndex:(NSUInteger)index
+{
+    if (_maximumTextLength > 0 || _maximumNodeCount > 0) {
+        id previousSibling = index > 0 ? [adjustedInsertionLocation childAtIndex:index - 1] : nil;
+        BOOL appending = [previousSibling isKindOfClass:[HTMLTextNode class]];
+        NSUInteger existingLength = appending ? [(HTMLTextNode *)previousSibling length] : 0;
+        if (_maximumTextLength > 0 && existingLength + string.length > _maximumTextLength) {
+            _exceededLimits |= HTMLParserLimitTextLength;
+            if (existingLength >= _maximumTextLength) return;
+            
+            // Don't split a surrogate pair.
+            NSRange cut = [string rangeOfComposedCharacterSequenceAtIndex:_maximumTextLength - existingLength];
+            string = [string substringToIndex:cut.location];
+            if (string.length == 0) return;
+        }
+        if (!appending) {
+            [self didCreateNode];
+        }
+    }
+    [adjustedInsertionLocation insertString:string atChildNodeIndex:index];
+}
+
+// Call just before inserting an element. Held-back whitespace between two inline elements, like the space in `<b>one</b> <i>two</i>`, is part of the text and goes in after all.
+- (void)insertPendingWhitespaceBeforeElement:(HTMLElement *)element inNode:(HTMLNode *)parent atIndex:(inout NSUInteger *)index
+{
+    if (!_pendingWhitespace) return;
+    NSString *whitespace = _pendingWhitespace;
+    BOOL samePlace = parent == _pendingWhitespaceParent && *index == _pendingWhitespaceIndex && parent.numberOfChildren == _pendingWhitespaceSiblingCount;
+    _pendingWhitespace = nil;
+    _pendingWhitespaceParent = nil;
+    if (!samePlace || *index == 0 || !IsPhrasingElement(element)) return;
+    
+    HTMLElement *previousSibling = (HTMLElement *)[parent childAtIndex:*index - 1];
+    if ([previousSibling isKindOfClass:[HTMLElement class]] && IsPhrasingElement(previousSibling)) {
+        NSUInteger count = parent.numberOfChildren;
+        [self insertString:whitespace inNode:parent atIndex:*index];
+        *index += parent.numberOfChildren - count;
     }
 }
 
@@ -3095,18 +3597,32 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
 {
     NSUInteger i;
     HTMLNode *parent = [self appropriatePlaceForInsertingANodeWithOverrideTarget:overrideTarget index:&i];
+    if ([self discardsChildrenOfNode:parent]) {
+        [node removeFromParentNode];
+        return;
+    }
     [[parent mutableChildren] insertObject:node atIndex:i];
 }
 
 - (void)insertForeignElementForToken:(id)token inNamespace:(HTMLNamespace)namespace
 {
     HTMLElement *element = [self createElementForToken:token inNamespace:namespace];
-    [[self.currentNode mutableChildren] addObject:element];
+    HTMLElement *target = [self depthLimitedTarget:self.currentNode];
+    NSUInteger index = target.numberOfChildren;
+    target = (HTMLElement *)[self depthLimitedParent:target index:&index];
+    [self insertPendingWhitespaceBeforeElement:element inNode:target atIndex:&index];
+    if (_elementHandler && target == self.currentNode) {
+        [self finishLastElementInCurrentNode];
+    }
+    if (![self discardsChildrenOfNode:target]) {
+        [[target mutableChildren] addObject:element];
+    }
     [_stackOfOpenElements addObject:element];
 }
 
 - (void)resetInsertionModeAppropriately
 {
+    HTMLCountStatistic(_insertionModeResetCount++);
     BOOL last = NO;
     HTMLElement *node = self.currentNode;
     for (;;) {
@@ -3192,6 +3708,27 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
         }
     }
     [_activeFormattingElements addObject:element];
+    
+    // Reconstructing and adopting look through the whole list since the last marker, so forget the oldest entry if it's getting too long.
+    if (_maximumFormattingElements > 0) {
+        NSUInteger first = _activeFormattingElements.count;
+        while (first > 0 && ![[_activeFormattingElements objectAtIndex:first - 1] isEqual:[HTMLMarker marker]]) {
+            first--;
+        }
+        if (_activeFormattingElements.count - first > _maximumFormattingElements) {
+            [_activeFormattingElements removeObjectAtIndex:first];
+            _exceededLimits |= HTMLParserLimitFormattingElements;
+        }
+    }
+}
+
+// Open formatting elements are usually near the top of the stack, so look there first.
+- (BOOL)stackOfOpenElementsContainsElement:(HTMLElement *)element
+{
+    for (NSUInteger i = _stackOfOpenElements.count; i-- > 0; ) {
+        if ([_stackOfOpenElements objectAtIndex:i] == element) return YES;
+    }
+    return NO;
 }
 
 - (void)pushMarkerOnToListOfActiveFormattingElements
@@ -3208,13 +3745,14 @@ static inline NSDictionary * ElementTypesForSpecificScope(NSArray *additionalHTM
 {
     if (_activeFormattingElements.count == 0) return;
     if ([_activeFormattingElements.lastObject isEqual:[HTMLMarker marker]]) return;
-    if ([_stackOfOpenElements containsObject:(id __nonnull)_activeFormattingElements.lastObject]) return;
+    if ([self stackOfOpenElementsContainsElement:(id __nonnull)_activeFormattingElements.lastObject]) return;
+    HTMLCountStatistic(_reconstructionCount++);
     NSUInteger entryIndex = _activeFormattingElements.count - 1;
 rewind:
     if (entryIndex == 0) goto create;
     entryIndex--;
     if (!([[_activeFormattingElements objectAtIndex:entryIndex] isEqual:[HTMLMarker marker]] ||
-          [_stackOfOpenElements containsObject:[_activeFormattingElements objectAtIndex:entryIndex]]))
+          [self stackOfOpenElementsContainsElement:[_activeFormattingElements objectAtIndex:entryIndex]]))
     {
         goto rewind;
     }
@@ -3328,19 +3866,24 @@ static HTMLMarker *instance = nil;
 
 @end
 
-HTMLParser * ParserWithDataAndContentType(NSData *data, NSString *contentType)
+HTMLParser * ParserWithDataAndContentType(NSData *data, NSString *contentType, HTMLParserOptions *options)
 {
     NSString *initialString;
     HTMLStringEncoding initialEncoding = DeterminedStringEncodingForData(data, contentType, &initialString);
     HTMLParser *initialParser = [[HTMLParser alloc] initWithString:initialString encoding:initialEncoding context:nil];
+    initialParser.options = options;
     __block HTMLParser *finalParser;
     initialParser.changeEncoding = ^(HTMLStringEncoding newEncoding) {
-        NSString *correctedString = [[NSString alloc] initWithData:data encoding:newEncoding.encoding];
+        NSString *correctedString = StringByDecodingData(data, newEncoding.encoding);
         if (correctedString) {
             finalParser = [[HTMLParser alloc] initWithString:correctedString encoding:newEncoding context:nil];
         } else {
             finalParser = [[HTMLParser alloc] initWithString:initialString encoding:initialEncoding context:nil];
         }
+        finalParser.options = options;
+#if HTMLREADER_COLLECT_STATISTICS
+        [finalParser countEncodingRestart];
+#endif
     };
     [initialParser document];
     return finalParser ?: initialParser;
@@ -0,0 +1,33 @@
+//  HTMLParserOptions.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLParserOptions.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@implementation HTMLParserOptions
+
+- (id)copyWithZone:(NSZone * __nullable)zone
+{
+    HTMLParserOptions *copy = [[self.class allocWithZone:zone] init];
+    copy->_maximumDepth = _maximumDepth;
+    copy->_maximumFormattingElements = _maximumFormattingElements;
+    copy->_maximumNodeCount = _maximumNodeCount;
+    copy->_maximumAttributesPerElement = _maximumAttributesPerElement;
+    copy->_maximumTextLength = _maximumTextLength;
+    copy->_maximumTokenCount = _maximumTokenCount;
+    copy->_maximumDuration = _maximumDuration;
+    copy->_maximumInputLength = _maximumInputLength;
+    copy->_stopsAfterHead = _stopsAfterHead;
+    copy->_stopTest = _stopTest;
+    copy->_discardedContent = _discardedContent;
+    copy->_createsNodesOnDemand = _createsNodesOnDemand;
+    copy->_tokenizesConcurrently = _tokenizesConcurrently;
+    copy->_stringPool = _stringPool;
+    return copy;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,21 @@
+//  HTMLParserStatistics.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <Foundation/Foundation.h>
+
+/**
+    Define HTMLREADER_COLLECT_STATISTICS to 1 when building HTMLReader to have the tokenizer and parser count what they do; see -[HTMLDocument parserStatistics].
+ 
+    When it's 0 (the default), the counters don't exist and counting compiles to nothing. To build and test with it from the command line, pass `GCC_PREPROCESSOR_DEFINITIONS='$(inherited) HTMLREADER_COLLECT_STATISTICS=1'` to xcodebuild, as one of the CI runs does.
+ */
+#ifndef HTMLREADER_COLLECT_STATISTICS
+    #define HTMLREADER_COLLECT_STATISTICS 0
+#endif
+
+#if HTMLREADER_COLLECT_STATISTICS
+    /// Evaluates the expression (typically an increment) only when collecting statistics.
+    #define HTMLCountStatistic(expression) ((void)(expression))
+#else
+    #define HTMLCountStatistic(expression) do {} while (0)
+#endif
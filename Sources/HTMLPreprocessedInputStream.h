@@ -11,10 +11,22 @@
     For more information, see http://www.whatwg.org/specs/web-apps/current-work/multipage/parsing.html#preprocessing-the-input-stream
  */
 @interface HTMLPreprocessedInputStream : NSObject
+{
+    // Visible to HTMLConsumeNextInputCharacter() so the common case can be inlined into the tokenizer.
+    @package
+    const unichar *_characters;
+    NSUInteger _length;
+    NSUInteger _scanLocation;
+    BOOL _reconsume;
+    UTF32Char _currentInputCharacter;
+}
 
 /// Initializes a stream.
 - (instancetype)initWithString:(NSString *)string NS_DESIGNATED_INITIALIZER;
 
+/// Starts over with a new string, as if the stream had just been initialized with it. The error block is kept.
+- (void)resetWithString:(NSString *)string;
+
 /// The string backing an input stream.
 @property (readonly, copy, nonatomic) NSString *string;
 
@@ -37,6 +49,15 @@
  */
 - (NSString *)consumeCharactersUpToFirstPassingTest:(BOOL(^)(UTF32Char character))test;
 
+/**
+    Does the same as -consumeCharactersUpToFirstPassingTest:, except no string is built. Must not be called when the current input character is to be reconsumed.
+ 
+    @param preprocessed On return, YES if any consumed character differs from the underlying string's (i.e. a carriage return was converted), otherwise NO.
+ 
+    @return The range of the underlying string that held the consumed characters.
+ */
+- (NSRange)skipCharactersUpToFirstPassingTest:(BOOL(^)(UTF32Char character))test preprocessed:(out BOOL *)preprocessed;
+
 /**
     Consumes characters matching hexadecimal digits.
  
@@ -67,8 +88,8 @@
  */
 - (NSString *)nextUnprocessedCharactersWithMaximumLength:(NSUInteger)length;
 
-/// Returns a scanner for the stream's unprocessed characters whose scan location is set to the stream's current location.
-- (NSScanner *)unprocessedScanner;
+/// Returns, but does not consume, the UTF-16 code unit at some offset from the stream's current location. The character is not preprocessed and no parse errors are emitted. Returns EOF past the end of the stream.
+- (UTF32Char)unprocessedCharacterAtOffset:(NSUInteger)offset;
 
 /// Returns the next input character and moves scanLocation ahead, emitting parse errors as appropriate. If a stream is fully consumed, returns EOF.
 - (UTF32Char)consumeNextInputCharacter;
@@ -87,3 +108,17 @@
 @property (copy, nonatomic) void (^errorBlock)(NSString *error);
 
 @end
+
+/// Does the same as -consumeNextInputCharacter, but ordinary characters (which need no preprocessing) are handled without sending any messages.
+static inline UTF32Char HTMLConsumeNextInputCharacter(HTMLPreprocessedInputStream *stream)
+{
+    if (!stream->_reconsume && stream->_scanLocation < stream->_length) {
+        unichar c = stream->_characters[stream->_scanLocation];
+        if ((c >= 0x20 && c < 0x7F) || c == '\n' || c == '\t') {
+            stream->_scanLocation++;
+            stream->_currentInputCharacter = c;
+            return c;
+        }
+    }
+    return [stream consumeNextInputCharacter];
+}
@@ -7,17 +7,14 @@
 
 @implementation HTMLPreprocessedInputStream
 {
-    NSUInteger _scanLocation;
-    CFStringInlineBuffer _buffer;
-    BOOL _reconsume;
-    UTF32Char _currentInputCharacter;
+    // Only set when the string can't hand over its characters directly.
+    unichar *_ownedCharacters;
 }
 
 - (instancetype)initWithString:(NSString *)string
 {
     if ((self = [super init])) {
-        _string = [string copy];
-        CFStringInitInlineBuffer((__bridge CFStringRef)_string, &_buffer, CFRangeMake(0, _string.length));
+        [self resetWithString:string];
     }
     return self;
 }
@@ -27,29 +24,80 @@
     return [self initWithString:@""];
 }
 
+- (void)dealloc
+{
+    free(_ownedCharacters);
+}
+
+- (void)resetWithString:(NSString *)string
+{
+    _string = [string copy];
+    _length = _string.length;
+    free(_ownedCharacters);
+    _ownedCharacters = NULL;
+    _characters = CFStringGetCharactersPtr((__bridge CFStringRef)_string);
+    if (!_characters && _length > 0) {
+        _ownedCharacters = malloc(sizeof(unichar) * _length);
+        [_string getCharacters:_ownedCharacters range:NSMakeRange(0, _length)];
+        _characters = _ownedCharacters;
+    }
+    _scanLocation = 0;
+    _reconsume = NO;
+    _currentInputCharacter = 0;
+}
+
+static inline unichar ASCIILowercase(unichar c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
 - (BOOL)consumeString:(NSString *)string matchingCase:(BOOL)caseSensitive
 {
-    NSScanner *scanner = [self unprocessedScanner];
-    scanner.caseSensitive = caseSensitive;
-    BOOL ok = [scanner scanString:string intoString:nil];
-    if (ok) {
-        _scanLocation = scanner.scanLocation;
+    NSUInteger length = string.length;
+    if (length > _length - _scanLocation) return NO;
+    const unichar *input = _characters + _scanLocation;
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar expected = [string characterAtIndex:i];
+        unichar actual = input[i];
+        if (caseSensitive ? actual != expected : ASCIILowercase(actual) != ASCIILowercase(expected)) {
+            return NO;
+        }
     }
-    return ok;
+    _scanLocation += length;
+    return YES;
 }
 
 - (NSString *)consumeCharactersUpToFirstPassingTest:(BOOL(^)(UTF32Char character))test
 {
     NSMutableString *consumed = [NSMutableString new];
+    
+    // Runs of characters that came straight from the input (no reconsumed character, no carriage return folding) are appended in one go.
+    NSUInteger runStart = NSNotFound, location;
     for (;;) {
-        UTF32Char c = [self consumeNextInputCharacter];
+        BOOL verbatim = !_reconsume;
+        location = _scanLocation;
+        UTF32Char c = HTMLConsumeNextInputCharacter(self);
         if (c == (UTF32Char)EOF) break;
         if (test(c)) {
             [self reconsumeCurrentInputCharacter];
             break;
         }
-        AppendLongCharacter(consumed, c);
+        if (verbatim && _characters[location] != '\r') {
+            if (runStart == NSNotFound) {
+                runStart = location;
+            }
+        } else {
+            if (runStart != NSNotFound) {
+                CFStringAppendCharacters((__bridge CFMutableStringRef)consumed, _characters + runStart, (CFIndex)(location - runStart));
+                runStart = NSNotFound;
+            }
+            AppendLongCharacter(consumed, c);
+        }
     }
+    if (runStart != NSNotFound) {
+        CFStringAppendCharacters((__bridge CFMutableStringRef)consumed, _characters + runStart, (CFIndex)(location - runStart));
+    }
+    
     if (consumed.length > 0) {
         return consumed;
     } else {
@@ -57,43 +105,78 @@
     }
 }
 
+- (NSRange)skipCharactersUpToFirstPassingTest:(BOOL(^)(UTF32Char character))test preprocessed:(out BOOL *)preprocessed
+{
+    NSParameterAssert(!_reconsume);
+    
+    NSUInteger start = _scanLocation, location;
+    BOOL sawCarriageReturn = NO;
+    for (;;) {
+        location = _scanLocation;
+        UTF32Char c = HTMLConsumeNextInputCharacter(self);
+        if (c == (UTF32Char)EOF) break;
+        if (test(c)) {
+            [self reconsumeCurrentInputCharacter];
+            break;
+        }
+        if (_characters[location] == '\r') {
+            sawCarriageReturn = YES;
+        }
+    }
+    if (preprocessed) {
+        *preprocessed = sawCarriageReturn;
+    }
+    return NSMakeRange(start, location - start);
+}
+
+static inline int HexDigitValue(unichar c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
 - (BOOL)consumeHexInt:(out unsigned int *)number
 {
-    // NSScanner's -scanHexInt: allows for a leading "0x" or "0X", while the HTML spec does not.
-    NSCharacterSet *hexSet = [NSCharacterSet characterSetWithCharactersInString:@"0123456789ABCDEFabcdef"];
-    BOOL justHexDigits = [[self unprocessedScanner] scanCharactersFromSet:hexSet intoString:nil];
-    if (!justHexDigits) return NO;
-    NSScanner *scanner = [self unprocessedScanner];
-    BOOL ok = [scanner scanHexInt:number];
-    if (ok) {
-        _scanLocation = scanner.scanLocation;
+    // Unlike NSScanner's -scanHexInt:, no leading "0x" is allowed. Values too large for an unsigned int saturate.
+    NSUInteger location = _scanLocation;
+    unsigned int value = 0;
+    int digit;
+    while (location < _length && (digit = HexDigitValue(_characters[location])) >= 0) {
+        value = value > (UINT_MAX - (unsigned int)digit) / 16 ? UINT_MAX : value * 16 + (unsigned int)digit;
+        location++;
+    }
+    if (location == _scanLocation) return NO;
+    _scanLocation = location;
+    if (number) {
+        *number = value;
     }
-    return ok;
+    return YES;
 }
 
-- (BOOL)consumeUnsignedInt:(out unsigned int *)outNumber
+- (BOOL)consumeUnsignedInt:(out unsigned int *)number
 {
-    NSScanner *scanner = [self unprocessedScanner];
-    long long number;
-    BOOL ok = [scanner scanLongLong:&number];
-    if (!ok || number < 0) return NO;
-    _scanLocation = scanner.scanLocation;
-    if (outNumber) {
-        if (number > (long long)UINT_MAX) {
-            *outNumber = UINT_MAX;
-        } else {
-            *outNumber = (unsigned int)number;
-        }
+    // Digits only: no sign or whitespace, as the spec's decimal character reference start state requires. Values too large for an unsigned int saturate.
+    NSUInteger location = _scanLocation;
+    unsigned int value = 0;
+    while (location < _length && _characters[location] >= '0' && _characters[location] <= '9') {
+        unsigned int digit = _characters[location] - '0';
+        value = value > (UINT_MAX - digit) / 10 ? UINT_MAX : value * 10 + digit;
+        location++;
+    }
+    if (location == _scanLocation) return NO;
+    _scanLocation = location;
+    if (number) {
+        *number = value;
     }
-    return ok;
+    return YES;
 }
 
-- (NSScanner *)unprocessedScanner
+- (UTF32Char)unprocessedCharacterAtOffset:(NSUInteger)offset
 {
-    NSScanner *scanner = [NSScanner scannerWithString:_string];
-    scanner.charactersToBeSkipped = nil;
-    scanner.scanLocation = _scanLocation;
-    return scanner;
+    if (offset >= _length - _scanLocation) return (UTF32Char)EOF;
+    return _characters[_scanLocation + offset];
 }
 
 - (UTF32Char)nextInputCharacter
@@ -115,14 +198,15 @@
         return _currentInputCharacter;
     }
     NSUInteger advance = 0;
-    UTF32Char c = CFStringGetCharacterFromInlineBuffer(&_buffer, _scanLocation + advance);
-    if (c == 0 && _scanLocation + advance >= _string.length) {
-        c = EOF;
-    } else {
+    UTF32Char c;
+    if (_scanLocation < _length) {
+        c = _characters[_scanLocation];
         advance++;
+    } else {
+        c = EOF;
     }
     if (CFStringIsSurrogateHighCharacter(c)) {
-        unichar low = CFStringGetCharacterFromInlineBuffer(&_buffer, _scanLocation + advance);
+        unichar low = _scanLocation + advance < _length ? _characters[_scanLocation + advance] : 0;
         if (CFStringIsSurrogateLowCharacter(low)) {
             advance++;
             unichar high = c;
@@ -138,7 +222,7 @@
         }
     } else if (c == '\r') {
         c = '\n';
-        if (CFStringGetCharacterFromInlineBuffer(&_buffer, _scanLocation + advance) == '\n') {
+        if (_scanLocation + advance < _length && _characters[_scanLocation + advance] == '\n') {
             advance++;
         }
     }
@@ -157,8 +241,8 @@
 - (NSString *)nextUnprocessedCharactersWithMaximumLength:(NSUInteger)length
 {
     NSRange range = NSMakeRange(_scanLocation, length);
-    if (NSMaxRange(range) > _string.length) {
-        range.length = _string.length - range.location;
+    if (NSMaxRange(range) > _length) {
+        range.length = _length - range.location;
     }
     if (range.length > 0) {
         return [_string substringWithRange:range];
@@ -0,0 +1,45 @@
+//  HTMLQueryCache.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLSupport.h"
+@class HTMLNode;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+    An HTMLQueryCache remembers the results of selector queries against a document, forgetting the least recently used results once it's full. Every result is tied to a mutation version of the document, and the whole cache is emptied as soon as it sees a different version.
+ 
+    All methods are safe to call from multiple threads at once.
+ */
+@interface HTMLQueryCache : NSObject
+
+/// Initializes a cache that holds up to capacity worth of results.
+- (instancetype)initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+/// The most results the cache will hold, counting each element in a result (and each result with no elements) as one. Lowering the capacity forgets results as needed.
+@property (assign, nonatomic) NSUInteger capacity;
+
+/// The number of lookups that found a result.
+@property (readonly, assign, nonatomic) NSUInteger hitCount;
+
+/// The number of lookups that had to compute a result.
+@property (readonly, assign, nonatomic) NSUInteger missCount;
+
+/**
+    Returns the remembered result of a query, or computes, remembers, and returns the result.
+ 
+    @param selector The selector string.
+    @param scope    The node the query was sent to.
+    @param first    YES for the first matching element, NO for all matching elements.
+    @param version  The document's current mutation version.
+    @param compute  Called without holding any lock when there's no result to return. Returns an element or nil when first is YES, otherwise an array of elements.
+ */
+- (id __nullable)resultForSelector:(NSString *)selector scope:(HTMLNode *)scope first:(BOOL)first version:(NSUInteger)version compute:(id __nullable (^)(void))compute;
+
+/// Forgets all results. Does not reset hitCount or missCount.
+- (void)removeAllResults;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,213 @@
+//  HTMLQueryCache.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLQueryCache.h"
+#import "HTMLNode.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface HTMLQueryCacheKey : NSObject <NSCopying>
+
+@property (readonly, copy, nonatomic) NSString *selector;
+// Not retained, as the scope is often the document that owns the cache. A scope is only ever compared by pointer. Removing a node from the document changes the document's version, so the cache is emptied before a later node at the same address could be mistaken for it.
+@property (readonly, unsafe_unretained, nonatomic) HTMLNode *scope;
+@property (readonly, assign, nonatomic) BOOL first;
+
+@end
+
+@implementation HTMLQueryCacheKey
+
+- (instancetype)initWithSelector:(NSString *)selector scope:(HTMLNode *)scope first:(BOOL)first
+{
+    if ((self = [super init])) {
+        _selector = [selector copy];
+        _scope = scope;
+        _first = first;
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone * __nullable)zone
+{
+    return self;
+}
+
+- (BOOL)isEqual:(id)other
+{
+    if (![other isKindOfClass:[HTMLQueryCacheKey class]]) {
+        return NO;
+    }
+    HTMLQueryCacheKey *key = other;
+    return _scope == key->_scope && _first == key->_first && [_selector isEqualToString:key->_selector];
+}
+
+- (NSUInteger)hash
+{
+    return _selector.hash ^ ((NSUInteger)(__bridge void *)_scope >> 4) ^ _first;
+}
+
+@end
+
+// Entries form a doubly linked list from most to least recently used. The dictionary owns them.
+@interface HTMLQueryCacheEntry : NSObject
+{
+    @package
+    HTMLQueryCacheKey *_key;
+    id _result;
+    NSUInteger _cost;
+    __unsafe_unretained HTMLQueryCacheEntry *_previous;
+    __unsafe_unretained HTMLQueryCacheEntry *_next;
+}
+
+@end
+
+@implementation HTMLQueryCacheEntry
+
+@end
+
+@implementation HTMLQueryCache
+{
+    NSMutableDictionary *_entries;
+    __unsafe_unretained HTMLQueryCacheEntry *_mostRecent;
+    __unsafe_unretained HTMLQueryCacheEntry *_leastRecent;
+    NSUInteger _totalCost;
+    NSUInteger _version;
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+{
+    if ((self = [super init])) {
+        _capacity = capacity;
+        _entries = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithCapacity:");
+    return nil;
+}
+#pragma clang diagnostic pop
+
+- (void)setCapacity:(NSUInteger)capacity
+{
+    @synchronized (self) {
+        _capacity = capacity;
+        EvictToCapacity(self, capacity);
+    }
+}
+
+- (NSUInteger)hitCount
+{
+    @synchronized (self) {
+        return _hitCount;
+    }
+}
+
+- (NSUInteger)missCount
+{
+    @synchronized (self) {
+        return _missCount;
+    }
+}
+
+static void Unlink(HTMLQueryCache *cache, HTMLQueryCacheEntry *entry)
+{
+    if (entry->_previous) {
+        entry->_previous->_next = entry->_next;
+    } else {
+        cache->_mostRecent = entry->_next;
+    }
+    if (entry->_next) {
+        entry->_next->_previous = entry->_previous;
+    } else {
+        cache->_leastRecent = entry->_previous;
+    }
+    entry->_previous = entry->_next = nil;
+}
+
+static void LinkAsMostRecent(HTMLQueryCache *cache, HTMLQueryCacheEntry *entry)
+{
+    entry->_next = cache->_mostRecent;
+    if (cache->_mostRecent) {
+        cache->_mostRecent->_previous = entry;
+    } else {
+        cache->_leastRecent = entry;
+    }
+    cache->_mostRecent = entry;
+}
+
+static void EvictToCapacity(HTMLQueryCache *cache, NSUInteger capacity)
+{
+    while (cache->_totalCost > capacity && cache->_leastRecent) {
+        HTMLQueryCacheEntry *entry = cache->_leastRecent;
+        Unlink(cache, entry);
+        cache->_totalCost -= entry->_cost;
+        [cache->_entries removeObjectForKey:entry->_key];
+    }
+}
+
+static void RemoveAllEntries(HTMLQueryCache *cache)
+{
+    cache->_mostRecent = cache->_leastRecent = nil;
+    cache->_totalCost = 0;
+    [cache->_entries removeAllObjects];
+}
+
+- (id __nullable)resultForSelector:(NSString *)selector scope:(HTMLNode *)scope first:(BOOL)first version:(NSUInteger)version compute:(id __nullable (^)(void))compute
+{
+    NSParameterAssert(selector);
+    NSParameterAssert(scope);
+    NSParameterAssert(compute);
+    
+    HTMLQueryCacheKey *key = [[HTMLQueryCacheKey alloc] initWithSelector:selector scope:scope first:first];
+    @synchronized (self) {
+        if (version != _version) {
+            RemoveAllEntries(self);
+            _version = version;
+        }
+        HTMLQueryCacheEntry *entry = _entries[key];
+        if (entry) {
+            _hitCount++;
+            Unlink(self, entry);
+            LinkAsMostRecent(self, entry);
+            return entry->_result == [NSNull null] ? nil : entry->_result;
+        }
+        _missCount++;
+    }
+    
+    // Queries can take a while, so other threads are free to use the cache in the meantime.
+    // Callers share results, so none of them get to change one.
+    id result = first ? compute() : [compute() copy];
+    
+    NSUInteger cost = first ? 1 : MAX([(NSArray *)result count], (NSUInteger)1);
+    @synchronized (self) {
+        if (version == _version && cost <= _capacity && !_entries[key]) {
+            HTMLQueryCacheEntry *entry = [HTMLQueryCacheEntry new];
+            entry->_key = key;
+            entry->_result = result ?: [NSNull null];
+            entry->_cost = cost;
+            EvictToCapacity(self, _capacity - cost);
+            _entries[key] = entry;
+            LinkAsMostRecent(self, entry);
+            _totalCost += cost;
+        }
+    }
+    return result;
+}
+
+- (void)removeAllResults
+{
+    @synchronized (self) {
+        RemoveAllEntries(self);
+    }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
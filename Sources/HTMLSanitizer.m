@@ -0,0 +1,259 @@
+//  HTMLSanitizer.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLSanitizer.h"
+#import "HTMLNode+Private.h"
+#import "HTMLParser.h"
+#import "HTMLSerialization+Private.h"
+#import "HTMLTextNode.h"
+#import "HTMLTraversal.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Stands in for a finished element once it's been sanitized, so the element's nodes can go.
+@interface HTMLSanitizedMarkup : HTMLNode
+
+@property (copy, nonatomic) NSString *markup;
+
+@end
+
+@implementation HTMLSanitizedMarkup
+
+@end
+
+// Sanitizes elements as the parser finishes with them, writing finished top-level elements (and everything before them) straight to the output.
+@interface HTMLSanitizingWriter : NSObject <HTMLFinishedElementHandler>
+
+- (instancetype)initWithSanitizer:(HTMLSanitizer *)sanitizer NS_DESIGNATED_INITIALIZER;
+
+@property (readonly, strong, nonatomic) NSMutableString *output;
+
+@end
+
+@interface HTMLSanitizer ()
+
+- (void)appendSanitizedNode:(HTMLNode *)node toString:(NSMutableString *)output;
+
+@end
+
+@implementation HTMLSanitizer
+{
+    HTMLParser *_parser;
+}
+
+- (instancetype)initWithContextElement:(HTMLElement *)contextElement
+{
+    NSParameterAssert(contextElement);
+    
+    if ((self = [super init])) {
+        _contextElement = contextElement;
+        _allowedElements = [NSSet setWithObjects:@"a", @"abbr", @"b", @"blockquote", @"br", @"caption", @"cite", @"code", @"dd", @"del", @"dfn", @"div", @"dl", @"dt", @"em", @"h1", @"h2", @"h3", @"h4", @"h5", @"h6", @"hr", @"i", @"img", @"ins", @"kbd", @"li", @"mark", @"ol", @"p", @"pre", @"q", @"s", @"samp", @"small", @"span", @"strong", @"sub", @"sup", @"table", @"tbody", @"td", @"tfoot", @"th", @"thead", @"tr", @"u", @"ul", @"var", nil];
+        _removedElements = [NSSet setWithObjects:@"applet", @"embed", @"frame", @"frameset", @"iframe", @"math", @"noembed", @"noframes", @"noscript", @"object", @"plaintext", @"script", @"style", @"svg", @"template", @"xmp", nil];
+        _allowedAttributes = [NSSet setWithObjects:@"alt", @"cite", @"colspan", @"datetime", @"dir", @"headers", @"height", @"href", @"lang", @"rowspan", @"scope", @"src", @"title", @"width", nil];
+        _URLAttributes = [NSSet setWithObjects:@"action", @"background", @"cite", @"formaction", @"href", @"longdesc", @"poster", @"src", nil];
+        _allowedURLSchemes = [NSSet setWithObjects:@"http", @"https", @"mailto", nil];
+        
+        // The encoding is ignored when parsing fragments.
+        HTMLStringEncoding encoding = (HTMLStringEncoding){ .encoding = NSUTF8StringEncoding, .confidence = Irrelevant };
+        _parser = [[HTMLParser alloc] initWithString:@"" encoding:encoding context:contextElement];
+    }
+    return self;
+}
+
+- (instancetype)init
+{
+    return [self initWithContextElement:[[HTMLElement alloc] initWithTagName:@"body" attributes:nil]];
+}
+
+- (NSString *)sanitizeString:(NSString *)string
+{
+    NSParameterAssert(string);
+    
+    // Content that's going to be left out anyway needn't be built in the first place.
+    HTMLParserOptions *options = [HTMLParserOptions new];
+    HTMLParserDiscard discarded = HTMLParserDiscardComments;
+    if ([_removedElements containsObject:@"script"] && [_removedElements containsObject:@"style"]) {
+        discarded |= HTMLParserDiscardScriptAndStyleText;
+    }
+    if ([_removedElements containsObject:@"template"]) {
+        discarded |= HTMLParserDiscardTemplateContents;
+    }
+    options.discardedContent = discarded;
+    _parser.options = options;
+    
+    HTMLSanitizingWriter *writer = [[HTMLSanitizingWriter alloc] initWithSanitizer:self];
+    _parser.finishedElementHandler = writer;
+    [_parser resetWithString:string];
+    HTMLDocument *document = _parser.document;
+    _parser.finishedElementHandler = nil;
+    
+    NSMutableString *output = writer.output;
+    for (HTMLNode *node in document.children) {
+        [self appendSanitizedNode:node toString:output];
+    }
+    [_parser resetWithString:@""];
+    return output;
+}
+
+#pragma mark Sanitizing
+
+static BOOL IsAllowedElement(HTMLSanitizer *sanitizer, HTMLElement *element)
+{
+    return (element.htmlNamespace == HTMLNamespaceHTML
+            && [sanitizer->_allowedElements containsObject:element.tagName]
+            && ![sanitizer->_removedElements containsObject:element.tagName]);
+}
+
+// Finds the scheme the way a browser's URL parser would: leading C0 controls and spaces are skipped, as are tabs and newlines anywhere. Returns nil for a relative URL.
+static NSString * __nullable LowercaseSchemeOfURL(NSString *URL)
+{
+    NSUInteger length = URL.length;
+    CFStringInlineBuffer buffer;
+    CFStringInitInlineBuffer((__bridge CFStringRef)URL, &buffer, CFRangeMake(0, length));
+    NSMutableString *scheme = [NSMutableString new];
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar c = CFStringGetCharacterFromInlineBuffer(&buffer, i);
+        if (c == '\t' || c == '\n' || c == '\r' || (scheme.length == 0 && c <= ' ')) {
+            continue;
+        } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+            [scheme appendFormat:@"%C", (unichar)(c | 0x20)];
+        } else if (scheme.length > 0 && ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.')) {
+            [scheme appendFormat:@"%C", c];
+        } else if (c == ':' && scheme.length > 0) {
+            return scheme;
+        } else {
+            return nil;
+        }
+    }
+    return nil;
+}
+
+static void AppendSanitizedStartTag(HTMLSanitizer *sanitizer, HTMLElement *element, NSMutableString *output)
+{
+    [output appendString:@"<"];
+    [output appendString:element.tagName];
+    [element.attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *value, BOOL *stop) {
+        if (![sanitizer->_allowedAttributes containsObject:name]) return;
+        if ([sanitizer->_URLAttributes containsObject:name]) {
+            NSString *scheme = LowercaseSchemeOfURL(value);
+            if (scheme && ![sanitizer->_allowedURLSchemes containsObject:scheme]) return;
+        }
+        [output appendString:@" "];
+        [output appendString:name];
+        [output appendString:@"=\""];
+        AppendEscapedString(output, value, YES);
+        [output appendString:@"\""];
+    }];
+    [output appendString:@">"];
+    AppendLeadingNewlineIfNeeded(element, output);
+}
+
+typedef struct {
+    __unsafe_unretained HTMLSanitizer *sanitizer;
+    __unsafe_unretained NSMutableString *output;
+} SanitizingContext;
+
+static HTMLTraversalAction EnterNode(HTMLNode *node, void *context)
+{
+    SanitizingContext *sanitizing = context;
+    HTMLSanitizer *sanitizer = sanitizing->sanitizer;
+    NSMutableString *output = sanitizing->output;
+    if ([node isKindOfClass:[HTMLElement class]]) {
+        HTMLElement *element = (HTMLElement *)node;
+        if ([sanitizer->_removedElements containsObject:element.tagName]) {
+            return HTMLTraversalSkipChildren;
+        } else if (IsAllowedElement(sanitizer, element)) {
+            AppendSanitizedStartTag(sanitizer, element, output);
+            return IsVoidElement(element) ? HTMLTraversalSkipChildren : HTMLTraversalContinue;
+        } else {
+            // Leave out the element but keep its contents.
+            return HTMLTraversalContinue;
+        }
+    } else if ([node isKindOfClass:[HTMLTextNode class]]) {
+        HTMLElement *parent = node.parentElement;
+        NSString *data = ((HTMLTextNode *)node).data;
+        
+        // Raw text is only safe in the element that made it raw. Anywhere else it could close the element or start a tag.
+        if (parent && IsRawTextElement(parent) && IsAllowedElement(sanitizer, parent)) {
+            [output appendString:data];
+        } else {
+            AppendEscapedString(output, data, NO);
+        }
+    } else if ([node isKindOfClass:[HTMLSanitizedMarkup class]]) {
+        [output appendString:((HTMLSanitizedMarkup *)node).markup];
+    }
+    return HTMLTraversalSkipChildren;
+}
+
+static HTMLTraversalAction LeaveNode(HTMLNode *node, void *context)
+{
+    SanitizingContext *sanitizing = context;
+    if ([node isKindOfClass:[HTMLElement class]] && IsAllowedElement(sanitizing->sanitizer, (HTMLElement *)node) && !IsVoidElement((HTMLElement *)node)) {
+        NSMutableString *output = sanitizing->output;
+        [output appendString:@"</"];
+        [output appendString:((HTMLElement *)node).tagName];
+        [output appendString:@">"];
+    }
+    return HTMLTraversalContinue;
+}
+
+- (void)appendSanitizedNode:(HTMLNode *)node toString:(NSMutableString *)output
+{
+    SanitizingContext context = { .sanitizer = self, .output = output };
+    HTMLTraverseTree(node, HTMLTraversalAllNodes, EnterNode, LeaveNode, &context);
+}
+
+@end
+
+@implementation HTMLSanitizingWriter
+{
+    HTMLSanitizer *_sanitizer;
+}
+
+- (instancetype)initWithSanitizer:(HTMLSanitizer *)sanitizer
+{
+    if ((self = [super init])) {
+        _sanitizer = sanitizer;
+        _output = [NSMutableString new];
+    }
+    return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithSanitizer:");
+    return nil;
+}
+#pragma clang diagnostic pop
+
+- (void)parserDidFinishElement:(HTMLElement *)element
+{
+    HTMLNode *parent = element.parentNode;
+    NSUInteger index = [parent indexOfChild:element];
+    if ([parent.parentNode isKindOfClass:[HTMLDocument class]]) {
+        // A finished top-level element means the parser is back at the top, so nothing before the element can change anymore either.
+        for (NSUInteger i = 0; i <= index; i++) {
+            [_sanitizer appendSanitizedNode:[parent childAtIndex:i] toString:_output];
+        }
+        [[parent mutableChildren] removeObjectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, index + 1)]];
+    } else {
+        // The element's parent is still open, so its markup waits with the parent's other children.
+        NSMutableString *markup = [NSMutableString new];
+        [_sanitizer appendSanitizedNode:element toString:markup];
+        if (markup.length > 0) {
+            HTMLSanitizedMarkup *placeholder = [HTMLSanitizedMarkup new];
+            placeholder.markup = markup;
+            [[parent mutableChildren] replaceObjectAtIndex:index withObject:placeholder];
+        } else {
+            [[parent mutableChildren] removeObjectAtIndex:index];
+        }
+    }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
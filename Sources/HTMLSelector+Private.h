@@ -0,0 +1,16 @@
+//  HTMLSelector+Private.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLSelector.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface HTMLSelector (Private)
+
+/// The lowercased names of the pseudo-classes the selector uses (e.g. `last-child` or `not`), including those inside :not(). Empty if the selector has none.
+@property (readonly, copy, nonatomic) HTMLSetOf(NSString *) *pseudoClasses;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -4,16 +4,20 @@
 
 // Implements CSS Selectors Level 3 http://www.w3.org/TR/css3-selectors/ with some pointers from CSS Syntax Module Level 3 http://www.w3.org/TR/2014/CR-css-syntax-3-20140220/
 
-#import "HTMLSelector.h"
+#import "HTMLSelector+Private.h"
+#import "HTMLDocument+Private.h"
+#import "HTMLQueryCache.h"
 #import "HTMLString.h"
 #import "HTMLTextNode.h"
+#import "HTMLTraversal.h"
+#import "HTMLTreeEnumerator.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 typedef BOOL (^HTMLSelectorPredicate)(HTMLElement *node);
 typedef HTMLSelectorPredicate HTMLSelectorPredicateGen;
 
-static HTMLSelectorPredicate SelectorFunctionForString(NSString *selectorString, NSError **error);
+static HTMLSelectorPredicate SelectorFunctionForString(NSString *selectorString, NSMutableSet *pseudoClasses, NSError **error);
 
 static NSError * ParseError(NSString *reason, NSString *string, NSUInteger position)
 {
@@ -455,12 +459,16 @@ static NSString * __nullable scanFunctionInterior(NSScanner *scanner, NSError **
 
 static __nullable HTMLSelectorPredicateGen scanPredicateFromPseudoClass(NSScanner *scanner,
                                                                         HTMLSelectorPredicate typePredicate,
+                                                                        NSMutableSet *pseudoClasses,
                                                                         NSError ** __nullable error)
 {
 	NSString *pseudo = scanIdentifier(scanner, error);
 	
 	// Case-insensitively look for pseudo classes
 	pseudo = [pseudo lowercaseString];
+    if (pseudo) {
+        [pseudoClasses addObject:pseudo];
+    }
 	
 	static NSDictionary *simplePseudos = nil;
 	static dispatch_once_t onceToken;
@@ -525,7 +533,7 @@ static __nullable HTMLSelectorPredicateGen scanPredicateFromPseudoClass(NSScanne
 	}
 	else if ([pseudo isEqualToString:@"not"]) {
 		NSString *toNegateString = scanFunctionInterior(scanner, error);
-		HTMLSelectorPredicate toNegate = SelectorFunctionForString(toNegateString, error);
+		HTMLSelectorPredicate toNegate = SelectorFunctionForString(toNegateString, pseudoClasses, error);
 		return negatePredicate(toNegate);
 	}
 	
@@ -724,7 +732,7 @@ HTMLSelectorPredicateGen scanTagPredicate(NSScanner *scanner, NSError ** __nulla
 }
 
 
-__nullable HTMLSelectorPredicateGen scanPredicate(NSScanner *scanner, HTMLSelectorPredicate inputPredicate, NSError **error)
+__nullable HTMLSelectorPredicateGen scanPredicate(NSScanner *scanner, HTMLSelectorPredicate inputPredicate, NSMutableSet *pseudoClasses, NSError **error)
 {
 	HTMLSelectorPredicate tagPredicate = scanTagPredicate(scanner, error);
 	
@@ -741,7 +749,7 @@ __nullable HTMLSelectorPredicateGen scanPredicate(NSScanner *scanner, HTMLSelect
 		// Pseudo and attribute
 		if ([modifier isEqualToString:@":"]) {
 			inputPredicate = bothCombinatorPredicate(inputPredicate,
-													 scanPredicateFromPseudoClass(scanner, inputPredicate, error));
+													 scanPredicateFromPseudoClass(scanner, inputPredicate, pseudoClasses, error));
 		} else if ([modifier isEqualToString:@"::"]) {
 			// We don't support *any* pseudo-elements.
 			*error = ParseError(@"Pseudo elements unsupported", scanner.string, scanner.scanLocation - modifier.length);
@@ -803,7 +811,8 @@ __nullable HTMLSelectorPredicateGen scanPredicate(NSScanner *scanner, HTMLSelect
 	}
 }
 
-static __nullable HTMLSelectorPredicate SelectorFunctionForString(NSString *selectorString, NSError ** __nullable error)
+// Adds the name of every pseudo-class used, including inside :not(), to pseudoClasses.
+static __nullable HTMLSelectorPredicate SelectorFunctionForString(NSString *selectorString, NSMutableSet *pseudoClasses, NSError ** __nullable error)
 {
 	// Trim non-functional whitespace
 	selectorString = [selectorString stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
@@ -824,7 +833,7 @@ static __nullable HTMLSelectorPredicate SelectorFunctionForString(NSString *sele
         HTMLSelectorPredicate lastPredicate = nil;
         
         do {
-            lastPredicate = scanPredicate(scanner, lastPredicate, error);
+            lastPredicate = scanPredicate(scanner, lastPredicate, pseudoClasses, error);
         } while (lastPredicate && ![scanner isAtEnd] && [scanner.string characterAtIndex:scanner.scanLocation] != ',' && !*error);
         
         if (*error) {
@@ -860,6 +869,9 @@ static __nullable HTMLSelectorPredicate SelectorFunctionForString(NSString *sele
 @end
 
 @implementation HTMLSelector
+{
+    NSSet *_pseudoClasses;
+}
 
 + (instancetype)selectorForString:(NSString *)selectorString
 {
@@ -875,8 +887,10 @@ static __nullable HTMLSelectorPredicate SelectorFunctionForString(NSString *sele
     if ((self = [super init])) {
         _string = [selectorString copy];
         NSError *error;
-        _predicate = SelectorFunctionForString(selectorString, &error);
+        NSMutableSet *pseudoClasses = [NSMutableSet new];
+        _predicate = SelectorFunctionForString(selectorString, pseudoClasses, &error);
         _error = error;
+        _pseudoClasses = [pseudoClasses copy];
     }
     return self;
 }
@@ -893,6 +907,11 @@ static __nullable HTMLSelectorPredicate SelectorFunctionForString(NSString *sele
     return self.predicate(element);
 }
 
+- (NSSet *)pseudoClasses
+{
+    return _pseudoClasses;
+}
+
 - (NSString *)description
 {
     if (self.error) {
@@ -922,33 +941,89 @@ NSString * const HTMLSelectorLocationErrorKey = @"HTMLSelectorLocation";
     return [self firstNodeMatchingParsedSelector:[HTMLSelector selectorForString:selectorString]];
 }
 
-- (HTMLArrayOf(HTMLElement *) *)nodesMatchingParsedSelector:(HTMLSelector *)selector
+static void ThrowIfSelectorHasError(HTMLSelector *selector)
 {
     if (selector.error) {
         @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"Attempted to use selector with error: %@", selector.error] userInfo:nil];
     }
+}
+
+// Runs the query through the document's query cache, if it has one.
+static id __nullable CachedQuery(HTMLNode *scope, HTMLSelector *selector, BOOL first, id __nullable (^query)(void))
+{
+    HTMLDocument *document = [scope isKindOfClass:[HTMLDocument class]] ? (HTMLDocument *)scope : scope.document;
+    HTMLQueryCache *cache = document.queryCache;
+    if (!cache) {
+        return query();
+    }
+    return [cache resultForSelector:selector.string scope:scope first:first version:document.mutationVersion compute:query];
+}
+
+typedef struct {
+    __unsafe_unretained HTMLSelector *selector;
+    __unsafe_unretained NSMutableArray *matches;
+    __unsafe_unretained HTMLElement *firstMatch;
+} MatchContext;
+
+static HTMLTraversalAction CollectMatch(HTMLNode *node, void *context)
+{
+    MatchContext *match = context;
+    if ([match->selector matchesElement:(HTMLElement *)node]) {
+        [match->matches addObject:node];
+    }
+    return HTMLTraversalContinue;
+}
+
+static HTMLTraversalAction FindFirstMatch(HTMLNode *node, void *context)
+{
+    MatchContext *match = context;
+    if ([match->selector matchesElement:(HTMLElement *)node]) {
+        match->firstMatch = (HTMLElement *)node;
+        return HTMLTraversalStop;
+    }
+    return HTMLTraversalContinue;
+}
+
+- (HTMLArrayOf(HTMLElement *) *)nodesMatchingParsedSelector:(HTMLSelector *)selector
+{
+    ThrowIfSelectorHasError(selector);
     
-	NSMutableArray *ret = [NSMutableArray new];
-	for (HTMLElement *node in self.treeEnumerator) {
-		if ([node isKindOfClass:[HTMLElement class]] && [selector matchesElement:node]) {
-			[ret addObject:node];
-		}
-	}
-	return ret;
+    return CachedQuery(self, selector, NO, ^{
+        NSMutableArray *ret = [NSMutableArray new];
+        MatchContext context = { .selector = selector, .matches = ret };
+        HTMLTraverseTree(self, HTMLTraversalElements, CollectMatch, NULL, &context);
+        return ret;
+    });
 }
 
 - (HTMLElement * __nullable)firstNodeMatchingParsedSelector:(HTMLSelector *)selector
 {
-    if (selector.error) {
-        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"Attempted to use selector with error: %@", selector.error] userInfo:nil];
-    }
+    ThrowIfSelectorHasError(selector);
     
-    for (HTMLElement *node in self.treeEnumerator) {
-        if ([node isKindOfClass:[HTMLElement class]] && [selector matchesElement:node]) {
-            return node;
-        }
-    }
-    return nil;
+    return CachedQuery(self, selector, YES, ^id __nullable {
+        MatchContext context = { .selector = selector };
+        HTMLTraverseTree(self, HTMLTraversalElements, FindFirstMatch, NULL, &context);
+        return context.firstMatch;
+    });
+}
+
+- (HTMLArrayOf(HTMLElement *) *)concurrentNodesMatchingParsedSelector:(HTMLSelector *)selector
+{
+    ThrowIfSelectorHasError(selector);
+    
+    return CachedQuery(self, selector, NO, ^{
+        return ConcurrentlyMapTree(self, ^id __nullable (HTMLNode *node) {
+            if ([node isKindOfClass:[HTMLElement class]] && [selector matchesElement:(HTMLElement *)node]) {
+                return node;
+            }
+            return nil;
+        });
+    });
+}
+
+- (HTMLArrayOf(HTMLElement *) *)concurrentNodesMatchingSelector:(NSString *)selectorString
+{
+    return [self concurrentNodesMatchingParsedSelector:[HTMLSelector selectorForString:selectorString]];
 }
 
 @end
@@ -0,0 +1,21 @@
+//  HTMLSerialization+Private.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLElement.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Appends string with &, no-break space, and either " (in attribute values) or < and > (in text) escaped.
+extern void AppendEscapedString(NSMutableString *output, NSString *string, BOOL inAttribute);
+
+/// Whether the element never has an end tag.
+extern BOOL IsVoidElement(HTMLElement *element);
+
+/// Whether text in the element is serialized without escaping.
+extern BOOL IsRawTextElement(HTMLElement * __nullable element);
+
+/// Appends a line feed if the element is one whose start tag swallows the first line feed of its text, and its text starts with one.
+extern void AppendLeadingNewlineIfNeeded(HTMLElement *element, NSMutableString *string);
+
+NS_ASSUME_NONNULL_END
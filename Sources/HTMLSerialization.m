@@ -2,42 +2,181 @@
 //
 //  Public domain. https://github.com/nolanw/HTMLReader
 
-#import "HTMLSerialization.h"
+#import "HTMLSerialization+Private.h"
 #import "HTMLComment.h"
 #import "HTMLDocument.h"
 #import "HTMLDocumentType.h"
 #import "HTMLElement.h"
 #import "HTMLString.h"
 #import "HTMLTextNode.h"
+#import "HTMLTraversal.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
-@implementation HTMLNode (Serialization)
+void AppendEscapedString(NSMutableString *output, NSString *string, BOOL inAttribute)
+{
+    NSUInteger length = string.length;
+    CFStringInlineBuffer buffer;
+    CFStringInitInlineBuffer((__bridge CFStringRef)string, &buffer, CFRangeMake(0, length));
+    NSUInteger runStart = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        NSString *replacement;
+        switch (CFStringGetCharacterFromInlineBuffer(&buffer, i)) {
+            case '&': replacement = @"&amp;"; break;
+            case 0xA0: replacement = @"&nbsp;"; break;
+            case '"': replacement = inAttribute ? @"&quot;" : nil; break;
+            case '<': replacement = inAttribute ? nil : @"&lt;"; break;
+            case '>': replacement = inAttribute ? nil : @"&gt;"; break;
+            default: replacement = nil; break;
+        }
+        if (replacement) {
+            if (i > runStart) {
+                [output appendString:[string substringWithRange:NSMakeRange(runStart, i - runStart)]];
+            }
+            [output appendString:replacement];
+            runStart = i + 1;
+        }
+    }
+    if (runStart == 0) {
+        [output appendString:string];
+    } else if (runStart < length) {
+        [output appendString:[string substringFromIndex:runStart]];
+    }
+}
 
-- (NSString *)recursiveDescription
+BOOL IsVoidElement(HTMLElement *element)
+{
+    return StringIsEqualToAnyOf(element.tagName, @"area", @"base", @"basefont", @"bgsound", @"br", @"col", @"embed", @"frame", @"hr", @"img", @"input", @"keygen", @"link", @"menuitem", @"meta", @"param", @"source", @"track", @"wbr");
+}
+
+BOOL IsRawTextElement(HTMLElement * __nullable element)
+{
+    return StringIsEqualToAnyOf(element.tagName, @"style", @"script", @"xmp", @"iframe", @"noembed", @"noframes", @"plaintext", @"noscript");
+}
+
+void AppendLeadingNewlineIfNeeded(HTMLElement *element, NSMutableString *string)
+{
+    if (StringIsEqualToAnyOf(element.tagName, @"pre", @"textarea", @"listing")) {
+        HTMLNode *firstChild = element.numberOfChildren > 0 ? [element childAtIndex:0] : nil;
+        if ([firstChild isKindOfClass:[HTMLTextNode class]] && [((HTMLTextNode *)firstChild).data hasPrefix:@"\n"]) {
+            [string appendString:@"\n"];
+        }
+    }
+}
+
+static void AppendStartTag(HTMLElement *element, NSMutableString *string)
+{
+    [string appendString:@"<"];
+    [string appendString:element.tagName];
+    [element.attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *value, BOOL *stop) {
+        if ([name isEqualToString:@"xmlns:xmlns"]) {
+            name = @"xmlns";
+        }
+        if (![value isKindOfClass:[NSString class]]) {
+            value = value.description;
+        }
+        [string appendString:@" "];
+        [string appendString:name];
+        [string appendString:@"=\""];
+        AppendEscapedString(string, value, YES);
+        [string appendString:@"\""];
+    }];
+    [string appendString:@">"];
+    AppendLeadingNewlineIfNeeded(element, string);
+}
+
+static void AppendText(HTMLTextNode *textNode, NSMutableString *string)
+{
+    if (IsRawTextElement(textNode.parentElement)) {
+        [string appendString:textNode.data];
+    } else {
+        AppendEscapedString(string, textNode.data, NO);
+    }
+}
+
+typedef struct {
+    __unsafe_unretained NSMutableString *string;
+    
+    // Only the children of this node are serialized, or nil to include the root.
+    __unsafe_unretained HTMLNode * __nullable excludedRoot;
+} SerializationContext;
+
+static HTMLTraversalAction EnterNode(HTMLNode *node, void *context)
+{
+    SerializationContext *serialization = context;
+    NSMutableString *string = serialization->string;
+    if (node == serialization->excludedRoot || [node isKindOfClass:[HTMLDocument class]]) {
+        return HTMLTraversalContinue;
+    } else if ([node isKindOfClass:[HTMLElement class]]) {
+        AppendStartTag((HTMLElement *)node, string);
+        return IsVoidElement((HTMLElement *)node) ? HTMLTraversalSkipChildren : HTMLTraversalContinue;
+    } else if ([node isKindOfClass:[HTMLTextNode class]]) {
+        AppendText((HTMLTextNode *)node, string);
+    } else {
+        [string appendString:node.serializedFragment];
+    }
+    return HTMLTraversalSkipChildren;
+}
+
+static HTMLTraversalAction LeaveNode(HTMLNode *node, void *context)
+{
+    SerializationContext *serialization = context;
+    if (node != serialization->excludedRoot && [node isKindOfClass:[HTMLElement class]] && !IsVoidElement((HTMLElement *)node)) {
+        NSMutableString *string = serialization->string;
+        [string appendString:@"</"];
+        [string appendString:((HTMLElement *)node).tagName];
+        [string appendString:@">"];
+    }
+    return HTMLTraversalContinue;
+}
+
+// Serializes the whole subtree in one pass into one string, rather than building and joining a string per node.
+static NSString * SerializeSubtree(HTMLNode *node, BOOL includeRoot)
 {
     NSMutableString *string = [NSMutableString new];
-    RecursiveDescriptionHelper(self, string, 0);
+    SerializationContext context = { .string = string, .excludedRoot = includeRoot ? nil : node };
+    HTMLTraverseTree(node, HTMLTraversalAllNodes, EnterNode, LeaveNode, &context);
     return string;
 }
 
-static void RecursiveDescriptionHelper(HTMLNode *self, NSMutableString *string, NSInteger indentLevel)
+typedef struct {
+    __unsafe_unretained NSMutableString *string;
+    NSUInteger indentLevel;
+} DescriptionContext;
+
+static HTMLTraversalAction EnterDescribedNode(HTMLNode *node, void *context)
 {
-    if (indentLevel > 0) {
-        [string appendString:[@"\n|" stringByPaddingToLength:indentLevel * 4 + 2
-                                                  withString:@" "
-                                             startingAtIndex:0]];
-    }
-    [string appendString:self.description];
-    for (HTMLNode *node in self.children) {
-        RecursiveDescriptionHelper(node, string, indentLevel + 1);
+    DescriptionContext *description = context;
+    if (description->indentLevel > 0) {
+        [description->string appendString:[@"\n|" stringByPaddingToLength:description->indentLevel * 4 + 2
+                                                                withString:@" "
+                                                           startingAtIndex:0]];
     }
+    [description->string appendString:node.description];
+    description->indentLevel++;
+    return HTMLTraversalContinue;
+}
+
+static HTMLTraversalAction LeaveDescribedNode(HTMLNode *node, void *context)
+{
+    ((DescriptionContext *)context)->indentLevel--;
+    return HTMLTraversalContinue;
+}
+
+@implementation HTMLNode (Serialization)
+
+- (NSString *)recursiveDescription
+{
+    // A traversal rather than recursion, so a deeply nested tree can't exhaust the stack.
+    NSMutableString *string = [NSMutableString new];
+    DescriptionContext context = { .string = string, .indentLevel = 0 };
+    HTMLTraverseTree(self, HTMLTraversalAllNodes, EnterDescribedNode, LeaveDescribedNode, &context);
+    return string;
 }
 
 - (NSString *)innerHTML
 {
-    NSArray *fragments = [self.children.array valueForKey:@"serializedFragment"];
-    return [fragments componentsJoinedByString:@""];
+    return SerializeSubtree(self, NO);
 }
 
 - (NSString *)serializedFragment
@@ -70,7 +209,7 @@ static void RecursiveDescriptionHelper(HTMLNode *self, NSMutableString *string,
 
 - (NSString *)serializedFragment
 {
-    return self.innerHTML;
+    return SerializeSubtree(self, NO);
 }
 
 @end
@@ -134,45 +273,7 @@ static void RecursiveDescriptionHelper(HTMLNode *self, NSMutableString *string,
 
 - (NSString *)serializedFragment
 {
-    NSMutableString *fragment = [NSMutableString new];
-    [fragment appendFormat:@"<%@", self.tagName];
-    
-    [self.attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *value, BOOL *stop) {
-        if ([name isEqualToString:@"xmlns:xmlns"]) {
-            name = @"xmlns";
-        }
-        if (![value isKindOfClass:[NSString class]]) {
-            value = value.description;
-        }
-        NSMutableString *escapedValue = [value mutableCopy];
-        void (^replace)(id, id) = ^(NSString *search, NSString *replace) {
-            NSRange range = NSMakeRange(0, escapedValue.length);
-            [escapedValue replaceOccurrencesOfString:search withString:replace options:0 range:range];
-        };
-        replace(@"&", @"&amp;");
-        replace(@"\u00A0", @"&nbsp;");
-        replace(@"\"", @"&quot;");
-        [fragment appendFormat:@" %@=\"%@\"", name, escapedValue];
-    }];
-
-    [fragment appendString:@">"];
-    
-    if (StringIsEqualToAnyOf(self.tagName, @"area", @"base", @"basefont", @"bgsound", @"br", @"col", @"embed", @"frame", @"hr", @"img", @"input", @"keygen", @"link", @"menuitem", @"meta", @"param", @"source", @"track", @"wbr")) {
-        return fragment;
-    }
-    
-    if (StringIsEqualToAnyOf(self.tagName, @"pre", @"textarea", @"listing")) {
-        if ([self.children.firstObject isKindOfClass:[HTMLTextNode class]]) {
-            HTMLTextNode *textNode = (HTMLTextNode *)self.children.firstObject;
-            if ([textNode.data hasPrefix:@"\n"]) {
-                [fragment appendString:@"\n"];
-            }
-        }
-    }
-    
-    [fragment appendString:self.innerHTML];
-    [fragment appendFormat:@"</%@>", self.tagName];
-    return fragment;
+    return SerializeSubtree(self, YES);
 }
 
 @end
@@ -190,16 +291,9 @@ static void RecursiveDescriptionHelper(HTMLNode *self, NSMutableString *string,
 
 - (NSString *)serializedFragment
 {
-    NSString *parentTagName = self.parentElement.tagName;
-    if (StringIsEqualToAnyOf(parentTagName, @"style", @"script", @"xmp", @"iframe", @"noembed", @"noframes", @"plaintext", @"noscript")) {
-        return self.data;
-    } else {
-        NSString *escaped = [self.data stringByReplacingOccurrencesOfString:@"&" withString:@"&amp;"];
-        escaped = [escaped stringByReplacingOccurrencesOfString:@"\u00A0" withString:@"&nbsp;"];
-        escaped = [escaped stringByReplacingOccurrencesOfString:@"<" withString:@"&lt;"];
-        escaped = [escaped stringByReplacingOccurrencesOfString:@">" withString:@"&gt;"];
-        return escaped;
-    }
+    NSMutableString *string = [NSMutableString new];
+    AppendText(self, string);
+    return string;
 }
 
 @end
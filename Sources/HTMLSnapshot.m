@@ -0,0 +1,471 @@
+//  HTMLSnapshot.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLSnapshot.h"
+#import "HTMLComment.h"
+#import "HTMLDocument+Private.h"
+#import "HTMLNode+Private.h"
+#import "HTMLOrderedDictionary.h"
+#import "HTMLTextNode.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+NSString * const HTMLSnapshotErrorDomain = @"HTMLSnapshotErrorDomain";
+
+// A snapshot is a header followed by four tables. All integers are unsigned and little-endian, and all offsets are from the start of the snapshot.
+//
+// Header (56 bytes):
+//     "HTMLSNAP", uint32 version, uint32 quirks mode, uint64 parsed string encoding,
+//     uint32 string count, uint32 string table offset, uint32 string data offset, uint32 string data length,
+//     uint32 node count, uint32 node table offset, uint32 attribute count, uint32 attribute table offset
+//
+// String table: for each string, uint32 offset into string data, uint32 length in bytes. Strings are UTF-8 and appear only once.
+//
+// Node table: for each node, uint32 kind, uint32 namespace, uint32 string index, uint32 first attribute index, uint32 attribute count, uint32 first child index, uint32 child count.
+//     Nodes are in breadth-first order, so each node's children are adjacent and come after the node. The document is node 0.
+//     An element's string is its tag name; text's and comments' is their data. A document type's string is its name, and its one "attribute" is the pair (public identifier, system identifier).
+//
+// Attribute table: for each attribute, uint32 name string index, uint32 value string index.
+
+static const char Magic[8] = {'H', 'T', 'M', 'L', 'S', 'N', 'A', 'P'};
+static const uint32_t CurrentVersion = 1;
+
+typedef NS_ENUM(uint32_t, NodeKind)
+{
+    NodeKindDocument,
+    NodeKindDocumentType,
+    NodeKindElement,
+    NodeKindText,
+    NodeKindComment,
+};
+
+typedef struct {
+    uint32_t kind;
+    uint32_t htmlNamespace;
+    uint32_t string;
+    uint32_t firstAttribute;
+    uint32_t attributeCount;
+    uint32_t firstChild;
+    uint32_t childCount;
+} NodeRecord;
+
+enum {
+    HeaderLength = 56,
+    StringRecordLength = 8,
+    NodeRecordLength = 28,
+    AttributeRecordLength = 8,
+};
+
+static void AppendUInt32(NSMutableData *data, uint32_t value)
+{
+    value = CFSwapInt32HostToLittle(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void AppendUInt64(NSMutableData *data, uint64_t value)
+{
+    value = CFSwapInt64HostToLittle(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static uint32_t ReadUInt32(const uint8_t *bytes, NSUInteger offset)
+{
+    uint32_t value;
+    memcpy(&value, bytes + offset, sizeof(value));
+    return CFSwapInt32LittleToHost(value);
+}
+
+static uint64_t ReadUInt64(const uint8_t *bytes, NSUInteger offset)
+{
+    uint64_t value;
+    memcpy(&value, bytes + offset, sizeof(value));
+    return CFSwapInt64LittleToHost(value);
+}
+
+static uint32_t CheckedUInt32(NSUInteger value)
+{
+    if (value > UINT32_MAX) {
+        [NSException raise:NSInvalidArgumentException format:@"document is too large for a snapshot"];
+    }
+    return (uint32_t)value;
+}
+
+#pragma mark - Writing
+
+@interface HTMLSnapshotWriter : NSObject
+
+- (NSData *)snapshotOfDocument:(HTMLDocument *)document;
+
+@end
+
+@implementation HTMLSnapshotWriter
+{
+    NSMutableDictionary *_stringIndexes;
+    NSMutableData *_stringTable;
+    NSMutableData *_stringData;
+}
+
+- (instancetype)init
+{
+    if ((self = [super init])) {
+        _stringIndexes = [NSMutableDictionary new];
+        _stringTable = [NSMutableData new];
+        _stringData = [NSMutableData new];
+    }
+    return self;
+}
+
+- (uint32_t)indexOfString:(NSString *)string
+{
+    NSNumber *existing = _stringIndexes[string];
+    if (existing) {
+        return existing.unsignedIntValue;
+    }
+    
+    uint32_t index = CheckedUInt32(_stringIndexes.count);
+    NSData *UTF8 = [string dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+    AppendUInt32(_stringTable, CheckedUInt32(_stringData.length));
+    AppendUInt32(_stringTable, CheckedUInt32(UTF8.length));
+    [_stringData appendData:UTF8];
+    _stringIndexes[string] = @(index);
+    return index;
+}
+
+- (NSData *)snapshotOfDocument:(HTMLDocument *)document
+{
+    NSMutableData *nodeTable = [NSMutableData new];
+    NSMutableData *attributeTable = [NSMutableData new];
+    
+    // Breadth-first, so each node's children are adjacent.
+    NSMutableArray *queue = [NSMutableArray arrayWithObject:document];
+    for (NSUInteger i = 0; i < queue.count; i++) {
+        HTMLNode *node = queue[i];
+        NodeRecord record = {0};
+        record.firstAttribute = CheckedUInt32(attributeTable.length / AttributeRecordLength);
+        if ([node isKindOfClass:[HTMLDocument class]]) {
+            if (i != 0) {
+                [NSException raise:NSInvalidArgumentException format:@"cannot snapshot a document within a document"];
+            }
+            record.kind = NodeKindDocument;
+        } else if ([node isKindOfClass:[HTMLDocumentType class]]) {
+            HTMLDocumentType *doctype = (HTMLDocumentType *)node;
+            record.kind = NodeKindDocumentType;
+            record.string = [self indexOfString:doctype.name];
+            AppendUInt32(attributeTable, [self indexOfString:doctype.publicIdentifier ?: @""]);
+            AppendUInt32(attributeTable, [self indexOfString:doctype.systemIdentifier ?: @""]);
+            record.attributeCount = 1;
+        } else if ([node isKindOfClass:[HTMLElement class]]) {
+            HTMLElement *element = (HTMLElement *)node;
+            record.kind = NodeKindElement;
+            record.htmlNamespace = (uint32_t)element.htmlNamespace;
+            record.string = [self indexOfString:element.tagName];
+            HTMLOrderedDictionary *attributes = (HTMLOrderedDictionary *)element.attributes;
+            for (NSString *name in attributes) {
+                AppendUInt32(attributeTable, [self indexOfString:name]);
+                AppendUInt32(attributeTable, [self indexOfString:attributes[name]]);
+            }
+            record.attributeCount = CheckedUInt32(attributes.count);
+        } else if ([node isKindOfClass:[HTMLTextNode class]]) {
+            record.kind = NodeKindText;
+            record.string = [self indexOfString:((HTMLTextNode *)node).data];
+        } else if ([node isKindOfClass:[HTMLComment class]]) {
+            record.kind = NodeKindComment;
+            record.string = [self indexOfString:((HTMLComment *)node).data];
+        } else {
+            [NSException raise:NSInvalidArgumentException format:@"cannot snapshot node of class %@", node.class];
+        }
+        
+        NSUInteger childCount = node.numberOfChildren;
+        record.firstChild = CheckedUInt32(queue.count);
+        record.childCount = CheckedUInt32(childCount);
+        for (NSUInteger j = 0; j < childCount; j++) {
+            [queue addObject:[node childAtIndex:j]];
+        }
+        
+        AppendUInt32(nodeTable, record.kind);
+        AppendUInt32(nodeTable, record.htmlNamespace);
+        AppendUInt32(nodeTable, record.string);
+        AppendUInt32(nodeTable, record.firstAttribute);
+        AppendUInt32(nodeTable, record.attributeCount);
+        AppendUInt32(nodeTable, record.firstChild);
+        AppendUInt32(nodeTable, record.childCount);
+    }
+    
+    NSUInteger stringTableOffset = HeaderLength;
+    NSUInteger nodeTableOffset = stringTableOffset + _stringTable.length;
+    NSUInteger attributeTableOffset = nodeTableOffset + nodeTable.length;
+    NSUInteger stringDataOffset = attributeTableOffset + attributeTable.length;
+    CheckedUInt32(stringDataOffset + _stringData.length);
+    
+    NSMutableData *snapshot = [NSMutableData dataWithCapacity:stringDataOffset + _stringData.length];
+    [snapshot appendBytes:Magic length:sizeof(Magic)];
+    AppendUInt32(snapshot, CurrentVersion);
+    AppendUInt32(snapshot, (uint32_t)document.quirksMode);
+    AppendUInt64(snapshot, document.parsedStringEncoding);
+    AppendUInt32(snapshot, CheckedUInt32(_stringIndexes.count));
+    AppendUInt32(snapshot, (uint32_t)stringTableOffset);
+    AppendUInt32(snapshot, (uint32_t)stringDataOffset);
+    AppendUInt32(snapshot, (uint32_t)_stringData.length);
+    AppendUInt32(snapshot, CheckedUInt32(queue.count));
+    AppendUInt32(snapshot, (uint32_t)nodeTableOffset);
+    AppendUInt32(snapshot, (uint32_t)(attributeTable.length / AttributeRecordLength));
+    AppendUInt32(snapshot, (uint32_t)attributeTableOffset);
+    NSAssert(snapshot.length == HeaderLength, @"snapshot header is the wrong length");
+    [snapshot appendData:_stringTable];
+    [snapshot appendData:nodeTable];
+    [snapshot appendData:attributeTable];
+    [snapshot appendData:_stringData];
+    return snapshot;
+}
+
+@end
+
+#pragma mark - Reading
+
+@interface HTMLSnapshotReader : NSObject <HTMLNodeChildrenSource>
+
+- (instancetype __nullable)initWithData:(NSData *)data error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+- (HTMLDocument *)documentOfClass:(Class)documentClass;
+
+@end
+
+static NSError * SnapshotError(HTMLSnapshotErrorCode code, NSString *failureReason)
+{
+    return [NSError errorWithDomain:HTMLSnapshotErrorDomain code:code userInfo:@{ NSLocalizedFailureReasonErrorKey: failureReason }];
+}
+
+static void RaiseCorrupt(NSString *reason)
+{
+    [NSException raise:NSInternalInconsistencyException format:@"corrupt snapshot: %@", reason];
+}
+
+@implementation HTMLSnapshotReader
+{
+    NSData *_data;
+    const uint8_t *_bytes;
+    HTMLQuirksMode _quirksMode;
+    NSStringEncoding _parsedStringEncoding;
+    uint32_t _stringCount, _stringTableOffset, _stringDataOffset, _stringDataLength;
+    uint32_t _nodeCount, _nodeTableOffset;
+    uint32_t _attributeCount, _attributeTableOffset;
+    
+    // Strings are decoded once, on first use. Only touched while synchronized on self.
+    CFStringRef __nullable *_strings;
+}
+
+- (instancetype __nullable)initWithData:(NSData *)data error:(NSError **)error
+{
+    NSParameterAssert(data);
+    
+    if (!(self = [super init])) {
+        return nil;
+    }
+    
+    _data = data;
+    _bytes = data.bytes;
+    NSUInteger length = data.length;
+    
+    if (length < HeaderLength || memcmp(_bytes, Magic, sizeof(Magic)) != 0) {
+        if (error) *error = SnapshotError(HTMLSnapshotErrorNotASnapshot, @"Data does not begin with a snapshot header");
+        return nil;
+    }
+    uint32_t version = ReadUInt32(_bytes, 8);
+    if (version != CurrentVersion) {
+        if (error) *error = SnapshotError(HTMLSnapshotErrorUnsupportedVersion, [NSString stringWithFormat:@"Snapshot version %@ is not supported", @(version)]);
+        return nil;
+    }
+    _quirksMode = (HTMLQuirksMode)ReadUInt32(_bytes, 12);
+    _parsedStringEncoding = (NSStringEncoding)ReadUInt64(_bytes, 16);
+    _stringCount = ReadUInt32(_bytes, 24);
+    _stringTableOffset = ReadUInt32(_bytes, 28);
+    _stringDataOffset = ReadUInt32(_bytes, 32);
+    _stringDataLength = ReadUInt32(_bytes, 36);
+    _nodeCount = ReadUInt32(_bytes, 40);
+    _nodeTableOffset = ReadUInt32(_bytes, 44);
+    _attributeCount = ReadUInt32(_bytes, 48);
+    _attributeTableOffset = ReadUInt32(_bytes, 52);
+    
+    // 64-bit arithmetic cannot overflow here, as every term is at most 32 bits.
+    BOOL fits = ((uint64_t)_stringTableOffset + (uint64_t)_stringCount * StringRecordLength <= length
+                 && (uint64_t)_stringDataOffset + _stringDataLength <= length
+                 && (uint64_t)_nodeTableOffset + (uint64_t)_nodeCount * NodeRecordLength <= length
+                 && (uint64_t)_attributeTableOffset + (uint64_t)_attributeCount * AttributeRecordLength <= length);
+    if (!fits || _nodeCount == 0 || [self recordForNodeAtIndex:0].kind != NodeKindDocument) {
+        if (error) *error = SnapshotError(HTMLSnapshotErrorCorrupt, @"Snapshot tables do not fit in the data");
+        return nil;
+    }
+    
+    _strings = calloc(_stringCount, sizeof(_strings[0]));
+    return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithData:error:");
+    return nil;
+}
+#pragma clang diagnostic pop
+
+- (void)dealloc
+{
+    for (uint32_t i = 0; i < _stringCount; i++) {
+        if (_strings[i]) CFRelease(_strings[i]);
+    }
+    free(_strings);
+}
+
+- (NodeRecord)recordForNodeAtIndex:(uint32_t)index
+{
+    if (index >= _nodeCount) RaiseCorrupt(@"node index out of bounds");
+    NSUInteger offset = _nodeTableOffset + (NSUInteger)index * NodeRecordLength;
+    return (NodeRecord){
+        .kind = ReadUInt32(_bytes, offset),
+        .htmlNamespace = ReadUInt32(_bytes, offset + 4),
+        .string = ReadUInt32(_bytes, offset + 8),
+        .firstAttribute = ReadUInt32(_bytes, offset + 12),
+        .attributeCount = ReadUInt32(_bytes, offset + 16),
+        .firstChild = ReadUInt32(_bytes, offset + 20),
+        .childCount = ReadUInt32(_bytes, offset + 24),
+    };
+}
+
+- (NSString *)stringAtIndex:(uint32_t)index
+{
+    if (index >= _stringCount) RaiseCorrupt(@"string index out of bounds");
+    if (!_strings[index]) {
+        NSUInteger record = _stringTableOffset + (NSUInteger)index * StringRecordLength;
+        uint32_t offset = ReadUInt32(_bytes, record);
+        uint32_t length = ReadUInt32(_bytes, record + 4);
+        if ((uint64_t)offset + length > _stringDataLength) RaiseCorrupt(@"string out of bounds");
+        CFStringRef string = CFStringCreateWithBytes(nil, _bytes + _stringDataOffset + offset, length, kCFStringEncodingUTF8, false);
+        if (!string) RaiseCorrupt(@"string is not UTF-8");
+        _strings[index] = string;
+    }
+    return (__bridge NSString *)(CFStringRef)_strings[index];
+}
+
+- (void)getAttributeAtIndex:(uint32_t)index name:(NSString * __autoreleasing *)name value:(NSString * __autoreleasing *)value
+{
+    if (index >= _attributeCount) RaiseCorrupt(@"attribute index out of bounds");
+    NSUInteger offset = _attributeTableOffset + (NSUInteger)index * AttributeRecordLength;
+    *name = [self stringAtIndex:ReadUInt32(_bytes, offset)];
+    *value = [self stringAtIndex:ReadUInt32(_bytes, offset + 4)];
+}
+
+- (HTMLNode *)nodeAtIndex:(uint32_t)index parentNode:(HTMLNode *)parentNode
+{
+    NodeRecord record = [self recordForNodeAtIndex:index];
+    if ((uint64_t)record.firstAttribute + record.attributeCount > _attributeCount) RaiseCorrupt(@"attributes out of bounds");
+    
+    HTMLNode *node;
+    switch ((NodeKind)record.kind) {
+        case NodeKindDocumentType: {
+            NSString *publicIdentifier, *systemIdentifier;
+            if (record.attributeCount != 1) RaiseCorrupt(@"document type needs exactly one attribute");
+            [self getAttributeAtIndex:record.firstAttribute name:&publicIdentifier value:&systemIdentifier];
+            node = [[HTMLDocumentType alloc] initWithName:[self stringAtIndex:record.string] publicIdentifier:publicIdentifier systemIdentifier:systemIdentifier];
+            break;
+        }
+        
+        case NodeKindElement: {
+            HTMLOrderedDictionary *attributes = [[HTMLOrderedDictionary alloc] initWithCapacity:record.attributeCount];
+            for (uint32_t i = 0; i < record.attributeCount; i++) {
+                NSString *name, *value;
+                [self getAttributeAtIndex:record.firstAttribute + i name:&name value:&value];
+                attributes[name] = value;
+            }
+            HTMLElement *element = [[HTMLElement alloc] initWithTagName:[self stringAtIndex:record.string] attributes:attributes];
+            if (record.htmlNamespace > HTMLNamespaceSVG) RaiseCorrupt(@"unknown namespace");
+            element.htmlNamespace = (HTMLNamespace)record.htmlNamespace;
+            node = element;
+            break;
+        }
+        
+        case NodeKindText:
+            node = [[HTMLTextNode alloc] initWithData:[self stringAtIndex:record.string]];
+            break;
+        
+        case NodeKindComment:
+            node = [[HTMLComment alloc] initWithData:[self stringAtIndex:record.string]];
+            break;
+        
+        case NodeKindDocument:
+        default:
+            RaiseCorrupt(@"unexpected node kind");
+            return nil;
+    }
+    
+    [node setParentNode:parentNode updateChildren:NO];
+    [self freezeNode:node atIndex:index record:record];
+    return node;
+}
+
+- (void)freezeNode:(HTMLNode *)node atIndex:(uint32_t)index record:(NodeRecord)record
+{
+    [node freezeStorage];
+    if (record.childCount > 0) {
+        // Requiring children to come later rules out cycles.
+        if (record.firstChild <= index || (uint64_t)record.firstChild + record.childCount > _nodeCount) RaiseCorrupt(@"children out of bounds");
+        SetLazyChildren(node, self, index);
+    }
+}
+
+- (HTMLDocument *)documentOfClass:(Class)documentClass
+{
+    HTMLDocument *document = [documentClass new];
+    document.quirksMode = _quirksMode;
+    document.parsedStringEncoding = _parsedStringEncoding;
+    [self freezeNode:document atIndex:0 record:[self recordForNodeAtIndex:0]];
+    return document;
+}
+
+#pragma mark HTMLNodeChildrenSource
+
+- (HTMLOrderedSetOf(HTMLNode *) *)childrenForNode:(HTMLNode *)node identifier:(NSUInteger)identifier
+{
+    NodeRecord record = [self recordForNodeAtIndex:(uint32_t)identifier];
+    NSMutableArray *children = [NSMutableArray arrayWithCapacity:record.childCount];
+    for (uint32_t i = 0; i < record.childCount; i++) {
+        [children addObject:[self nodeAtIndex:record.firstChild + i parentNode:node]];
+    }
+    return [NSOrderedSet orderedSetWithArray:children];
+}
+
+@end
+
+#pragma mark - HTMLDocument (HTMLSnapshot)
+
+@implementation HTMLDocument (HTMLSnapshot)
+
+- (NSData *)snapshotData
+{
+    return [[HTMLSnapshotWriter new] snapshotOfDocument:self];
+}
+
++ (nullable instancetype)documentWithSnapshotData:(NSData *)data error:(NSError **)error
+{
+    NSParameterAssert(data);
+    
+    HTMLSnapshotReader *reader = [[HTMLSnapshotReader alloc] initWithData:data error:error];
+    return [reader documentOfClass:self];
+}
+
++ (nullable instancetype)documentWithContentsOfSnapshotFile:(NSString *)path error:(NSError **)error
+{
+    NSParameterAssert(path);
+    
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:error];
+    if (!data) {
+        return nil;
+    }
+    return [self documentWithSnapshotData:data error:error];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -25,6 +25,14 @@ extern void EnumerateLongCharacters(NSString *self, void (^block)(UTF32Char char
 /// Returns a string consisting solely of the character.
 extern NSString * StringWithLongCharacter(UTF32Char character);
 
+/**
+    Returns a string with every U+0000 NULL character replaced. When there's nothing to replace, which is almost always, the string itself is returned rather than a copy.
+ 
+    @param self The string, or nil.
+    @param replacement What goes in place of each U+0000 NULL character.
+ */
+extern NSString * StringByReplacingNullCharacters(NSString *self, NSString *replacement);
+
 /**
     Whether or not the character is a whitespace character.
  
@@ -39,6 +47,42 @@ extern BOOL is_whitespace(UTF32Char c);
  */
 extern BOOL is_undefined_or_disallowed(UTF32Char c);
 
+/**
+    Mixes a value into a running 64-bit hash. Not suitable for cryptographic purposes.
+ */
+static inline uint64_t HashCombine(uint64_t hash, uint64_t value)
+{
+    hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    hash *= 0xFF51AFD7ED558CCDULL;
+    return hash ^ (hash >> 33);
+}
+
+/**
+    Mixes a string's UTF-16 code units into a running 64-bit hash. Equal strings always mix the same way, regardless of their class or internal representation.
+ */
+extern uint64_t HashCombineString(uint64_t hash, NSString *string);
+
+/**
+    An HTMLDeferredString stands in for a string that is cut out of a larger string only when first needed. HTMLOrderedDictionary returns the deferred string's string whenever it's asked for an object, so attribute values that are never read are never built. The dictionary keeps the deferred string itself, which builds its string once and holds on to it.
+ 
+    The whole source string is kept alive for as long as the deferred string is, even once its string has been built. -[HTMLOrderedDictionary resolveDeferredStrings] (done by -[HTMLDocument freeze]) lets it go.
+ */
+@interface HTMLDeferredString : NSObject
+
+/**
+    Initializes a deferred string.
+ 
+    @param source The string that holds the characters.
+    @param range The characters of source that make up the string.
+    @param preprocess YES if carriage returns need converting to line feeds and U+0000 NULL characters to U+FFFD REPLACEMENT CHARACTER, the way the tokenizer would have.
+ */
+- (instancetype)initWithSource:(NSString *)source range:(NSRange)range preprocess:(BOOL)preprocess NS_DESIGNATED_INITIALIZER;
+
+/// The string, which is built on first access. Safe to call from multiple threads.
+@property (readonly, copy, nonatomic) NSString *string;
+
+@end
+
 /// @return YES if the first parameter is equal to any subsequent parameter, otherwise NO.
 #define StringIsEqualToAnyOf(search, ...) ({ \
     NSString *s = (search); \
@@ -46,6 +46,40 @@ NSString * StringWithLongCharacter(UTF32Char character)
     }
 }
 
+NSString * StringByReplacingNullCharacters(NSString *self, NSString *replacement)
+{
+    NSUInteger length = self.length;
+    CFStringInlineBuffer buffer;
+    CFStringInitInlineBuffer((__bridge CFStringRef)self, &buffer, CFRangeMake(0, length));
+    for (NSUInteger i = 0; i < length; i++) {
+        if (CFStringGetCharacterFromInlineBuffer(&buffer, i) == '\0') {
+            return [self stringByReplacingOccurrencesOfString:@"\0" withString:replacement];
+        }
+    }
+    return self;
+}
+
+uint64_t HashCombineString(uint64_t hash, NSString *string)
+{
+    NSUInteger length = string.length;
+    hash = HashCombine(hash, length);
+    
+    // Pack four code units into each mix.
+    unichar buffer[256];
+    for (NSUInteger start = 0; start < length; start += sizeof(buffer) / sizeof(buffer[0])) {
+        NSUInteger count = MIN(length - start, sizeof(buffer) / sizeof(buffer[0]));
+        [string getCharacters:buffer range:NSMakeRange(start, count)];
+        NSUInteger i = 0;
+        for (; i + 4 <= count; i += 4) {
+            hash = HashCombine(hash, (uint64_t)buffer[i] | (uint64_t)buffer[i + 1] << 16 | (uint64_t)buffer[i + 2] << 32 | (uint64_t)buffer[i + 3] << 48);
+        }
+        for (; i < count; i++) {
+            hash = HashCombine(hash, buffer[i]);
+        }
+    }
+    return hash;
+}
+
 BOOL is_whitespace(UTF32Char c)
 {
     return c == '\t' || c == '\n' || c == '\f' || c == ' ';
@@ -93,3 +127,69 @@ BOOL is_undefined_or_disallowed(UTF32Char c)
             c == 0x10FFFE ||
             c == 0x10FFFF);
 }
+
+@interface HTMLDeferredString ()
+
+@property (atomic, copy) NSString *resolvedString;
+
+@end
+
+@implementation HTMLDeferredString
+{
+    NSString *_source;
+    NSRange _range;
+    BOOL _preprocess;
+}
+
+- (instancetype)initWithSource:(NSString *)source range:(NSRange)range preprocess:(BOOL)preprocess
+{
+    NSParameterAssert(source);
+    
+    if ((self = [super init])) {
+        _source = source;
+        _range = range;
+        _preprocess = preprocess;
+    }
+    return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithSource:range:preprocess:");
+    return nil;
+}
+#pragma clang diagnostic pop
+
+- (NSString *)string
+{
+    // The atomic getter is much cheaper than taking the lock, and after the first access it's all we need.
+    NSString *string = self.resolvedString;
+    if (string) return string;
+    
+    @synchronized (self) {
+        string = self.resolvedString;
+        if (!string) {
+            string = [_source substringWithRange:_range];
+            if (_preprocess) {
+                NSMutableString *mutableString = [string mutableCopy];
+                [mutableString replaceOccurrencesOfString:@"\r\n" withString:@"\n" options:NSLiteralSearch range:NSMakeRange(0, mutableString.length)];
+                [mutableString replaceOccurrencesOfString:@"\r" withString:@"\n" options:NSLiteralSearch range:NSMakeRange(0, mutableString.length)];
+                [mutableString replaceOccurrencesOfString:@"\0" withString:@"\uFFFD" options:NSLiteralSearch range:NSMakeRange(0, mutableString.length)];
+                string = mutableString;
+            }
+            self.resolvedString = string;
+            _source = nil;
+        }
+    }
+    return string;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: %p %@>", self.class, self, self.string];
+}
+
+@end
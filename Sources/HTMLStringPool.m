@@ -0,0 +1,85 @@
+//  HTMLStringPool.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLStringPool.h"
+#import <pthread.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@implementation HTMLStringPool
+{
+    // Most lookups find a string that's already there, so they only need to read.
+    pthread_rwlock_t _lock;
+    CFMutableSetRef _strings;
+}
+
++ (instancetype)sharedPool
+{
+    static HTMLStringPool *sharedPool;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedPool = [self new];
+    });
+    return sharedPool;
+}
+
+- (instancetype)init
+{
+    if ((self = [super init])) {
+        pthread_rwlock_init(&_lock, NULL);
+        _strings = CFSetCreateMutable(nil, 0, &kCFTypeSetCallBacks);
+        _maximumValueLength = 32;
+        _maximumCount = 65536;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    CFRelease(_strings);
+    pthread_rwlock_destroy(&_lock);
+}
+
+- (NSString *)internString:(NSString *)string
+{
+    NSParameterAssert(string);
+    
+    pthread_rwlock_rdlock(&_lock);
+    NSString *pooled = (__bridge NSString *)CFSetGetValue(_strings, (__bridge const void *)string);
+    pthread_rwlock_unlock(&_lock);
+    if (pooled) return pooled;
+    
+    NSString *copy = [string copy];
+    pthread_rwlock_wrlock(&_lock);
+    
+    // Someone else may have added it while the lock was let go.
+    pooled = (__bridge NSString *)CFSetGetValue(_strings, (__bridge const void *)copy);
+    if (!pooled) {
+        pooled = copy;
+        if (_maximumCount == 0 || (NSUInteger)CFSetGetCount(_strings) < _maximumCount) {
+            CFSetAddValue(_strings, (__bridge const void *)copy);
+        }
+    }
+    pthread_rwlock_unlock(&_lock);
+    return pooled;
+}
+
+- (NSUInteger)count
+{
+    pthread_rwlock_rdlock(&_lock);
+    NSUInteger count = CFSetGetCount(_strings);
+    pthread_rwlock_unlock(&_lock);
+    return count;
+}
+
+- (void)removeAllStrings
+{
+    pthread_rwlock_wrlock(&_lock);
+    CFSetRemoveAllValues(_strings);
+    pthread_rwlock_unlock(&_lock);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
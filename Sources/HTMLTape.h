@@ -0,0 +1,30 @@
+//  HTMLTape.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLDocument.h"
+#import "HTMLNode+Private.h"
+#import "HTMLParser.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+    An HTMLTape records finished parts of a tree as a flat array of plain C structs, then creates their nodes only when something asks for them.
+ 
+    During parsing, each element is recorded once it can no longer change, and its descendants are let go. When parsing is done, the document is frozen and its nodes come back one level at a time as they're navigated to. Once created, a node stays put, so its identity is stable.
+ */
+@interface HTMLTape : NSObject <HTMLFinishedElementHandler, HTMLNodeChildrenSource>
+
+/**
+    Records the descendants of an element that the parser is finished with, then removes them from the element.
+ 
+    The element itself is recorded whenever its parent is, and it must not have any children added or removed in the meantime.
+ */
+- (void)parserDidFinishElement:(HTMLElement *)element;
+
+/// Records whatever remains of the document, then freezes it and makes it load its children from the tape.
+- (void)finishDocument:(HTMLDocument *)document;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,290 @@
+//  HTMLTape.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLTape.h"
+#import "HTMLComment.h"
+#import "HTMLDocumentType.h"
+#import "HTMLElement.h"
+#import "HTMLOrderedDictionary.h"
+#import "HTMLTextNode+Private.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(uint8_t, TapeNodeKind)
+{
+    TapeNodeKindElement,
+    TapeNodeKindText,
+    TapeNodeKindComment,
+    TapeNodeKindDocumentType,
+};
+
+typedef struct {
+    TapeNodeKind kind;
+    uint8_t htmlNamespace;
+    
+    // Index in _objects of the node's first object: an element's tag name (then attributes), text or comment data, or a document type's name (then public and system identifiers).
+    NSUInteger object;
+    
+    // Index in _childRanges, or NSNotFound for no children.
+    NSUInteger children;
+} TapeRecord;
+
+@implementation HTMLTape
+{
+    // Each node's children are adjacent, and are always recorded before the node itself.
+    TapeRecord *_records;
+    NSUInteger _recordCount, _recordCapacity;
+    
+    NSRange *_childRanges;
+    NSUInteger _childRangeCount, _childRangeCapacity;
+    
+    NSMutableArray *_objects;
+    
+    // Elements whose children have been recorded, mapped to the index of their range in _childRanges. Cleared out as their parents get recorded.
+    NSMapTable *_finishedElements;
+    
+    // Records waiting for their siblings to be recorded, so they can all go in _records together.
+    TapeRecord *_pending;
+    NSUInteger _pendingCount, _pendingCapacity;
+}
+
+- (instancetype)init
+{
+    if ((self = [super init])) {
+        _objects = [NSMutableArray new];
+        _finishedElements = [NSMapTable mapTableWithKeyOptions:(NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality)
+                                                  valueOptions:NSPointerFunctionsStrongMemory];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_records);
+    free(_childRanges);
+    free(_pending);
+}
+
+#pragma mark Recording
+
+static void AppendRecord(TapeRecord **records, NSUInteger *count, NSUInteger *capacity, TapeRecord record)
+{
+    if (*count == *capacity) {
+        *capacity = *capacity * 2 + 64;
+        *records = reallocf(*records, sizeof(TapeRecord) * *capacity);
+    }
+    (*records)[(*count)++] = record;
+}
+
+- (NSUInteger)addObject:(id)object
+{
+    [_objects addObject:object];
+    return _objects.count - 1;
+}
+
+- (TapeRecord)recordForNode:(HTMLNode *)node children:(NSUInteger)children
+{
+    TapeRecord record = { .children = children };
+    if ([node isKindOfClass:[HTMLElement class]]) {
+        HTMLElement *element = (HTMLElement *)node;
+        record.kind = TapeNodeKindElement;
+        record.htmlNamespace = (uint8_t)element.htmlNamespace;
+        record.object = [self addObject:element.tagName];
+        // The element is on its way out, so its dictionary can be kept as is rather than copied. Nothing changes a finished element's attributes. Elements created from the tape never freeze the dictionary themselves, so deferred values are built now to let the source string go.
+        HTMLOrderedDictionary *attributes = AttributesOfElement(element);
+        [attributes resolveDeferredStrings];
+        [self addObject:attributes.count > 0 ? attributes : [NSNull null]];
+    } else if ([node isKindOfClass:[HTMLTextNode class]]) {
+        record.kind = TapeNodeKindText;
+        // The one copy: the node's text is mutable until now. Nodes created from the tape share it.
+        record.object = [self addObject:((HTMLTextNode *)node).data];
+    } else if ([node isKindOfClass:[HTMLComment class]]) {
+        record.kind = TapeNodeKindComment;
+        record.object = [self addObject:((HTMLComment *)node).data];
+    } else if ([node isKindOfClass:[HTMLDocumentType class]]) {
+        HTMLDocumentType *doctype = (HTMLDocumentType *)node;
+        record.kind = TapeNodeKindDocumentType;
+        record.object = [self addObject:doctype.name];
+        [self addObject:doctype.publicIdentifier ?: [NSNull null]];
+        [self addObject:doctype.systemIdentifier ?: [NSNull null]];
+    } else {
+        [NSException raise:NSInvalidArgumentException format:@"cannot record node of class %@", node.class];
+    }
+    return record;
+}
+
+// Moves the pending records from start onward into _records, returning the index of their range in _childRanges (or NSNotFound if there are none).
+- (NSUInteger)flushPendingRecordsFromIndex:(NSUInteger)start
+{
+    NSUInteger count = _pendingCount - start;
+    if (count == 0) {
+        return NSNotFound;
+    }
+    NSUInteger first = _recordCount;
+    for (NSUInteger i = start; i < _pendingCount; i++) {
+        AppendRecord(&_records, &_recordCount, &_recordCapacity, _pending[i]);
+    }
+    _pendingCount = start;
+    
+    if (_childRangeCount == _childRangeCapacity) {
+        _childRangeCapacity = _childRangeCapacity * 2 + 64;
+        _childRanges = reallocf(_childRanges, sizeof(NSRange) * _childRangeCapacity);
+    }
+    _childRanges[_childRangeCount] = NSMakeRange(first, count);
+    return _childRangeCount++;
+}
+
+// Records the subtree below root (but not root itself), returning the index of root's children in _childRanges.
+- (NSUInteger)recordDescendantsOfNode:(HTMLNode *)root
+{
+    typedef struct {
+        __unsafe_unretained HTMLNode *node;
+        NSUInteger nextChild;
+        NSUInteger firstPending;
+    } Frame;
+    
+    // Subtrees can be deep, so use a stack of our own instead of recursing. The tree keeps every node alive until we're done.
+    Frame *stack = malloc(sizeof(Frame) * 16);
+    NSUInteger depth = 1, capacity = 16;
+    stack[0] = (Frame){ .node = root, .nextChild = 0, .firstPending = _pendingCount };
+    for (;;) {
+        Frame *frame = &stack[depth - 1];
+        HTMLOrderedSetOf(HTMLNode *) *children = ChildrenOfNode(frame->node);
+        if (frame->nextChild < children.count) {
+            HTMLNode *child = [children objectAtIndex:frame->nextChild++];
+            NSNumber *finishedChildren = [child isKindOfClass:[HTMLElement class]] ? [_finishedElements objectForKey:child] : nil;
+            if (finishedChildren) {
+                AppendRecord(&_pending, &_pendingCount, &_pendingCapacity, [self recordForNode:child children:finishedChildren.unsignedIntegerValue]);
+                [_finishedElements removeObjectForKey:child];
+            } else if (ChildrenOfNode(child).count > 0) {
+                if (depth == capacity) {
+                    capacity *= 2;
+                    stack = reallocf(stack, sizeof(Frame) * capacity);
+                }
+                stack[depth++] = (Frame){ .node = child, .nextChild = 0, .firstPending = _pendingCount };
+            } else {
+                AppendRecord(&_pending, &_pendingCount, &_pendingCapacity, [self recordForNode:child children:NSNotFound]);
+            }
+            continue;
+        }
+        
+        NSUInteger childRange = [self flushPendingRecordsFromIndex:frame->firstPending];
+        HTMLNode *node = frame->node;
+        if (--depth == 0) {
+            free(stack);
+            return childRange;
+        }
+        AppendRecord(&_pending, &_pendingCount, &_pendingCapacity, [self recordForNode:node children:childRange]);
+    }
+}
+
+- (void)parserDidFinishElement:(HTMLElement *)element
+{
+    NSUInteger count = element.numberOfChildren;
+    if (count == 0) {
+        return;
+    }
+    NSUInteger childRange = [self recordDescendantsOfNode:element];
+    [_finishedElements setObject:@(childRange) forKey:element];
+    [[element mutableChildren] removeObjectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, count)]];
+}
+
+- (void)finishDocument:(HTMLDocument *)document
+{
+    NSUInteger count = document.numberOfChildren;
+    NSUInteger childRange = count > 0 ? [self recordDescendantsOfNode:document] : NSNotFound;
+    if (count > 0) {
+        [[document mutableChildren] removeObjectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, count)]];
+    }
+    
+    // Whatever's left was detached from the document during parsing.
+    [_finishedElements removeAllObjects];
+    free(_pending);
+    _pending = NULL;
+    _pendingCount = _pendingCapacity = 0;
+    
+    [document freezeStorage];
+    if (childRange != NSNotFound) {
+        SetLazyChildren(document, self, childRange);
+    }
+}
+
+#pragma mark HTMLNodeChildrenSource
+
+static id __nullable NilForNull(id object)
+{
+    return object == [NSNull null] ? nil : object;
+}
+
+- (HTMLOrderedSetOf(HTMLNode *) *)childrenForNode:(HTMLNode *)parent identifier:(NSUInteger)identifier
+{
+    NSRange range = _childRanges[identifier];
+    NSMutableArray *children = [NSMutableArray arrayWithCapacity:range.length];
+    for (NSUInteger i = range.location; i < NSMaxRange(range); i++) {
+        TapeRecord record = _records[i];
+        HTMLNode *node;
+        switch (record.kind) {
+            case TapeNodeKindElement: {
+                HTMLOrderedDictionary *attributes = NilForNull(_objects[record.object + 1]);
+                HTMLElement *element = attributes ? [[HTMLElement alloc] initWithTagName:_objects[record.object] sharedAttributes:attributes] : [[HTMLElement alloc] initWithTagName:_objects[record.object] attributes:nil];
+                element.htmlNamespace = (HTMLNamespace)record.htmlNamespace;
+                node = element;
+                break;
+            }
+            
+            case TapeNodeKindText:
+                node = [[HTMLTextNode alloc] initWithSharedData:_objects[record.object]];
+                break;
+            
+            case TapeNodeKindComment:
+                node = [[HTMLComment alloc] initWithData:_objects[record.object]];
+                break;
+            
+            case TapeNodeKindDocumentType:
+                node = [[HTMLDocumentType alloc] initWithName:_objects[record.object]
+                                             publicIdentifier:NilForNull(_objects[record.object + 1])
+                                             systemIdentifier:NilForNull(_objects[record.object + 2])];
+                break;
+        }
+        [node setParentNode:parent updateChildren:NO];
+        [node freezeStorage];
+        if (record.children != NSNotFound) {
+            SetLazyChildren(node, self, record.children);
+        }
+        [children addObject:node];
+    }
+    return [NSOrderedSet orderedSetWithArray:children];
+}
+
+- (void)appendTextOfChildrenWithIdentifier:(NSUInteger)identifier toString:(NSMutableString *)string
+{
+    // The tape doesn't change once the document is finished, so there's no need to synchronize.
+    NSRange *stack = malloc(sizeof(NSRange) * 16);
+    NSUInteger depth = 1, capacity = 16;
+    stack[0] = _childRanges[identifier];
+    while (depth > 0) {
+        NSRange *range = &stack[depth - 1];
+        if (range->length == 0) {
+            depth--;
+            continue;
+        }
+        TapeRecord record = _records[range->location];
+        range->location++;
+        range->length--;
+        if (record.kind == TapeNodeKindText) {
+            [string appendString:_objects[record.object]];
+        } else if (record.kind == TapeNodeKindElement && record.children != NSNotFound) {
+            if (depth == capacity) {
+                capacity *= 2;
+                stack = reallocf(stack, sizeof(NSRange) * capacity);
+            }
+            stack[depth++] = _childRanges[record.children];
+        }
+    }
+    free(stack);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
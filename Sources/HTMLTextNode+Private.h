@@ -0,0 +1,19 @@
+//  HTMLTextNode+Private.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLTextNode.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface HTMLTextNode (Private)
+
+/// Initializes a text node that uses an immutable string as is, and only copies it if the node's text changes.
+- (instancetype)initWithSharedData:(NSString *)data;
+
+/// The length of the node's text, without copying it.
+@property (readonly, assign, nonatomic) NSUInteger length;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -2,13 +2,17 @@
 //
 //  Public domain. https://github.com/nolanw/HTMLReader
 
-#import "HTMLTextNode.h"
+#import "HTMLTextNode+Private.h"
+#import "HTMLNode+Private.h"
+#import "HTMLString.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 @implementation HTMLTextNode
 {
-    NSMutableString *_data;
+    // Mutable until the node is frozen, except when shared with a copy.
+    NSString *_data;
+    BOOL _sharesData;
 }
 
 - (instancetype)initWithData:(NSString *)data
@@ -21,6 +25,17 @@ NS_ASSUME_NONNULL_BEGIN
     return self;
 }
 
+- (instancetype)initWithSharedData:(NSString *)data
+{
+    NSParameterAssert(data);
+    
+    if ((self = [super init])) {
+        _data = data;
+        _sharesData = YES;
+    }
+    return self;
+}
+
 - (instancetype)init
 {
     return [self initWithData:@""];
@@ -30,7 +45,12 @@ NS_ASSUME_NONNULL_BEGIN
 {
     NSParameterAssert(string);
     
-    [_data appendString:string];
+    WillMutateNode(self);
+    if (_sharesData) {
+        _data = [_data mutableCopy];
+        _sharesData = NO;
+    }
+    [(NSMutableString *)_data appendString:string];
 }
 
 - (NSString *)data
@@ -38,12 +58,31 @@ NS_ASSUME_NONNULL_BEGIN
     return [_data copy];
 }
 
+- (NSUInteger)length
+{
+    return _data.length;
+}
+
+- (uint64_t)contentHash
+{
+    return HashCombineString([super contentHash], _data);
+}
+
+- (void)freezeStorage
+{
+    [super freezeStorage];
+    _data = [_data copy];
+}
+
 #pragma mark NSCopying
 
 - (id)copyWithZone:(NSZone * __nullable)zone
 {
     HTMLTextNode *copy = [super copyWithZone:zone];
-    [copy->_data setString:_data];
+    
+    // Most copied text never changes, so it's only copied again (as mutable) if it does. When the original is frozen, there's no copying at all.
+    copy->_data = [_data copy];
+    copy->_sharesData = YES;
     return copy;
 }
 
@@ -0,0 +1,24 @@
+//  HTMLTokenPipeline.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLTokenizer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+    An HTMLTokenPipeline runs a tokenizer on another thread, a little ahead of the parser consuming its tokens.
+ 
+    Tokens are handed over in batches through a bounded ring, so neither thread waits on the other unless the ring is empty or full. Sometimes the tokenizer can't go on until the parser catches up: after start tags that make the parser change the tokenizer's state (e.g. `<script>` or `<textarea>`), and when the tokenizer needs to look at the parser's state. Then the tokenizer hands over what it has and waits for the parser to process all of it.
+ */
+@interface HTMLTokenPipeline : NSEnumerator
+
+/// Initializes a pipeline and starts the tokenizer on another thread. The tokenizer must not be touched by anyone else until the pipeline is stopped, except by the parser while it's processing a token.
+- (instancetype)initWithTokenizer:(HTMLTokenizer *)tokenizer NS_DESIGNATED_INITIALIZER;
+
+/// Stops the tokenizer if it's still going, throws away any tokens not yet taken, and waits for the tokenizer's thread to finish up. Must be called once the parser is done with the pipeline, from the parser's thread.
+- (void)stop;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,197 @@
+//  HTMLTokenPipeline.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLTokenPipeline.h"
+#import "HTMLString.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Big enough that handing over a batch is cheap compared to making its tokens, small enough that the parser gets going right away.
+static const NSUInteger BatchSize = 64;
+
+// Batches in flight. A power of two.
+static const NSUInteger RingCapacity = 16;
+
+typedef struct {
+    // Retained. NULL marks the end of the tokens.
+    void * __nullable tokens;
+    
+    // YES if the tokenizer is waiting for the parser to process the batch before carrying on.
+    BOOL waitsForParser;
+} Batch;
+
+@implementation HTMLTokenPipeline
+{
+    HTMLTokenizer *_tokenizer;
+    
+    // Written only by the tokenizer's thread at _tail, read only by the parser's thread at _head. The semaphores count filled and free slots, so each side only ever blocks when the ring is empty or full.
+    Batch _ring[RingCapacity];
+    NSUInteger _head, _tail;
+    dispatch_semaphore_t _filledSlots, _freeSlots;
+    
+    // Signalled by the parser's thread once it has processed a batch the tokenizer is waiting on.
+    dispatch_semaphore_t _parserCaughtUp;
+    
+    dispatch_group_t _tokenizing;
+    BOOL _cancelled;
+    
+    // Only touched by the tokenizer's thread.
+    NSMutableArray *_pendingTokens;
+    
+    // Only touched by the parser's thread.
+    NSArray *_currentTokens;
+    NSUInteger _currentIndex;
+    BOOL _currentWaitsForParser;
+    BOOL _finished;
+}
+
+- (instancetype)initWithTokenizer:(HTMLTokenizer *)tokenizer
+{
+    if ((self = [super init])) {
+        _tokenizer = tokenizer;
+        _filledSlots = dispatch_semaphore_create(0);
+        _freeSlots = dispatch_semaphore_create(RingCapacity);
+        _parserCaughtUp = dispatch_semaphore_create(0);
+        _tokenizing = dispatch_group_create();
+        _pendingTokens = [NSMutableArray arrayWithCapacity:BatchSize];
+        
+        // The pipeline outlives the tokenizer's thread (see -stop), so neither the block nor the tokenizer needs to retain it.
+        __unsafe_unretained __typeof__(self) unretainedSelf = self;
+        tokenizer.willConsultParser = ^{
+            [unretainedSelf handOverPendingTokensAndWaitForParser:YES];
+        };
+        dispatch_group_async(_tokenizing, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+            [unretainedSelf tokenize];
+        });
+    }
+    return self;
+}
+
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithTokenizer:");
+    return nil;
+}
+
+- (void)dealloc
+{
+    while (_head != _tail) {
+        Batch batch = _ring[_head++ % RingCapacity];
+        if (batch.tokens) {
+            CFRelease(batch.tokens);
+        }
+    }
+}
+
+#pragma mark Tokenizer's thread
+
+static BOOL IsCancelled(HTMLTokenPipeline *pipeline)
+{
+    return __atomic_load_n(&pipeline->_cancelled, __ATOMIC_ACQUIRE);
+}
+
+- (void)tokenize
+{
+    BOOL more = YES;
+    while (more && !IsCancelled(self)) {
+        @autoreleasepool {
+            id token = [_tokenizer nextObject];
+            if (token) {
+                [_pendingTokens addObject:token];
+                BOOL waitsForParser = ChangesTokenizerState(token);
+                if (waitsForParser || _pendingTokens.count == BatchSize) {
+                    [self handOverPendingTokensAndWaitForParser:waitsForParser];
+                }
+            } else {
+                more = NO;
+            }
+        }
+    }
+    [self handOverPendingTokensAndWaitForParser:NO];
+    [self enqueueBatch:(Batch){ .tokens = NULL }];
+}
+
+// Start tags that might have the parser switch the tokenizer's state. Some of them only do so in some insertion modes, but waiting when it turns out not to matter does no harm.
+static BOOL ChangesTokenizerState(id token)
+{
+    if (![token isKindOfClass:[HTMLStartTagToken class]]) return NO;
+    NSString *tagName = [(HTMLStartTagToken *)token tagName];
+    return StringIsEqualToAnyOf(tagName, @"script", @"style", @"textarea", @"title", @"plaintext", @"xmp", @"iframe", @"noembed", @"noframes", @"noscript");
+}
+
+- (void)handOverPendingTokensAndWaitForParser:(BOOL)waitsForParser
+{
+    if (_pendingTokens.count > 0 || waitsForParser) {
+        Batch batch = {
+            .tokens = (void *)CFBridgingRetain([_pendingTokens copy]),
+            .waitsForParser = waitsForParser,
+        };
+        [_pendingTokens removeAllObjects];
+        [self enqueueBatch:batch];
+    }
+    if (waitsForParser) {
+        dispatch_semaphore_wait(_parserCaughtUp, DISPATCH_TIME_FOREVER);
+    }
+}
+
+- (void)enqueueBatch:(Batch)batch
+{
+    dispatch_semaphore_wait(_freeSlots, DISPATCH_TIME_FOREVER);
+    _ring[_tail % RingCapacity] = batch;
+    _tail++;
+    dispatch_semaphore_signal(_filledSlots);
+}
+
+#pragma mark Parser's thread
+
+- (BOOL)dequeueBatch
+{
+    dispatch_semaphore_wait(_filledSlots, DISPATCH_TIME_FOREVER);
+    Batch batch = _ring[_head % RingCapacity];
+    _head++;
+    dispatch_semaphore_signal(_freeSlots);
+    if (!batch.tokens) {
+        _finished = YES;
+        _currentTokens = nil;
+        return NO;
+    }
+    _currentTokens = CFBridgingRelease(batch.tokens);
+    _currentIndex = 0;
+    _currentWaitsForParser = batch.waitsForParser;
+    return YES;
+}
+
+- (id __nullable)nextObject
+{
+    while (_currentIndex == _currentTokens.count) {
+        // Asking for another token means the parser has processed the last one.
+        if (_currentWaitsForParser) {
+            _currentWaitsForParser = NO;
+            dispatch_semaphore_signal(_parserCaughtUp);
+        }
+        if (_finished || ![self dequeueBatch]) return nil;
+    }
+    return _currentTokens[_currentIndex++];
+}
+
+- (void)stop
+{
+    __atomic_store_n(&_cancelled, YES, __ATOMIC_RELEASE);
+    
+    // Keep taking batches (and letting the tokenizer past any wait) until it notices it's been stopped.
+    _currentTokens = nil;
+    while (!_finished) {
+        if (_currentWaitsForParser) {
+            _currentWaitsForParser = NO;
+            dispatch_semaphore_signal(_parserCaughtUp);
+        }
+        [self dequeueBatch];
+    }
+    dispatch_group_wait(_tokenizing, DISPATCH_TIME_FOREVER);
+    _tokenizer.willConsultParser = nil;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -5,6 +5,8 @@
 #import <Foundation/Foundation.h>
 #import "HTMLOrderedDictionary.h"
 #import "HTMLParser.h"
+#import "HTMLParserStatistics.h"
+#import "HTMLStringPool.h"
 #import "HTMLTokenizerState.h"
 
 /**
@@ -17,6 +19,9 @@
 /// Initializes a tokenizer.
 - (instancetype)initWithString:(NSString *)string NS_DESIGNATED_INITIALIZER;
 
+/// Starts over with a new string in the data state, reusing the tokenizer's buffers. The parser is kept.
+- (void)resetWithString:(NSString *)string;
+
 /// The string where tokens come from.
 @property (readonly, copy, nonatomic) NSString *string;
 
@@ -26,6 +31,23 @@
 /// The parser that is consuming the tokenizer's tokens. Sometimes the tokenizer needs to know the parser's state.
 @property (weak, nonatomic) HTMLParser *parser;
 
+/// Called right before the tokenizer looks at the parser's state, on whichever thread is running the tokenizer. A tokenizer running ahead of its parser uses this to wait for the parser to catch up.
+@property (copy, nonatomic) void (^willConsultParser)(void);
+
+/// The most attributes to keep on one tag; any more are dropped. 0 means unlimited.
+@property (assign, nonatomic) NSUInteger maximumAttributesPerTag;
+
+/// YES if any attributes were dropped because of maximumAttributesPerTag.
+@property (readonly, assign, nonatomic) BOOL droppedAttributes;
+
+/// Where to intern attribute names and short attribute values, or nil to leave them be.
+@property (strong, nonatomic) HTMLStringPool * __nullable stringPool;
+
+#if HTMLREADER_COLLECT_STATISTICS
+/// Emitted tokens by type, visits to each tokenizer state, and character references, in the form described by -[HTMLDocument parserStatistics].
+@property (readonly, copy, nonatomic) NSDictionary *statistics;
+#endif
+
 @end
 
 /// An HTMLDOCTYPEToken represents a `<!DOCTYPE>` tag.
@@ -45,10 +45,29 @@
     HTMLTokenizerState _sourceAttributeValueState;
     NSMutableString *_currentAttributeName;
     NSMutableString *_currentAttributeValue;
+    
+    // Scratch storage for _currentAttributeValue, reused for each attribute. The name, value, and temporary buffers are all copied wherever they're kept.
+    NSMutableString *_attributeValueBuffer;
+    
+    // While _currentAttributeValue is nil, the value so far is this range of the input. Most attribute values are never read, so they are only cut out on demand.
+    NSRange _deferredAttributeValueRange;
+    BOOL _deferredAttributeValueNeedsPreprocessing;
+    
     NSMutableString *_temporaryBuffer;
     UTF32Char _additionalAllowedCharacter;
     NSString *_mostRecentEmittedStartTagName;
     BOOL _done;
+    
+#if HTMLREADER_COLLECT_STATISTICS
+    NSUInteger _stateVisits[HTMLCDATASectionTokenizerState + 1];
+    NSUInteger _characterTokenCount;
+    NSUInteger _commentTokenCount;
+    NSUInteger _DOCTYPETokenCount;
+    NSUInteger _startTagTokenCount;
+    NSUInteger _endTagTokenCount;
+    NSUInteger _namedCharacterReferenceCount;
+    NSUInteger _numericCharacterReferenceCount;
+#endif
 }
 
 - (instancetype)initWithString:(NSString *)string
@@ -57,17 +76,45 @@
     if (!self) return nil;
     
     _inputStream = [[HTMLPreprocessedInputStream alloc] initWithString:string];
-    __weak __typeof__(self) weakSelf = self;
+    // The tokenizer owns the input stream, so it outlives the block. (A weak reference would mean taking the runtime's weak reference lock, which parsers on other threads would contend for.)
+    __unsafe_unretained __typeof__(self) unretainedSelf = self;
     [_inputStream setErrorBlock:^(NSString *error) {
-        [weakSelf emitParseError:@"%@", error];
+        [unretainedSelf emitParseError:@"%@", error];
     }];
     self.state = HTMLDataTokenizerState;
     _tokenQueue = [NSMutableArray new];
     _characterBuffer = [NSMutableString new];
+    _currentAttributeName = [NSMutableString new];
+    _attributeValueBuffer = [NSMutableString new];
+    _temporaryBuffer = [NSMutableString new];
+    _deferredAttributeValueRange = NSMakeRange(NSNotFound, 0);
     
     return self;
 }
 
+- (void)resetWithString:(NSString *)string
+{
+    [_inputStream resetWithString:string];
+    self.state = HTMLDataTokenizerState;
+    [_tokenQueue removeAllObjects];
+    [_characterBuffer setString:@""];
+    _currentToken = nil;
+    [_currentAttributeName setString:@""];
+    _currentAttributeValue = nil;
+    _deferredAttributeValueRange = NSMakeRange(NSNotFound, 0);
+    [_temporaryBuffer setString:@""];
+    _additionalAllowedCharacter = 0;
+    _mostRecentEmittedStartTagName = nil;
+    _done = NO;
+    _droppedAttributes = NO;
+    
+#if HTMLREADER_COLLECT_STATISTICS
+    memset(_stateVisits, 0, sizeof(_stateVisits));
+    _characterTokenCount = _commentTokenCount = _DOCTYPETokenCount = _startTagTokenCount = _endTagTokenCount = 0;
+    _namedCharacterReferenceCount = _numericCharacterReferenceCount = 0;
+#endif
+}
+
 - (NSString *)string
 {
     return _inputStream.string;
@@ -87,11 +134,13 @@
         return c == '&' || c == '<';
     }];
     [self emitCharacterTokenWithString:string];
-    switch ([self consumeNextInputCharacter]) {
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '&':
-            return [self switchToState:HTMLCharacterReferenceInDataTokenizerState];
+            _state = HTMLCharacterReferenceInDataTokenizerState;
+            return;
         case '<':
-            return [self switchToState:HTMLTagOpenTokenizerState];
+            _state = HTMLTagOpenTokenizerState;
+            return;
         case EOF:
             _done = YES;
             break;
@@ -100,7 +149,7 @@
 
 - (void)characterReferenceInDataState
 {
-    [self switchToState:HTMLDataTokenizerState];
+    _state = HTMLDataTokenizerState;
     _additionalAllowedCharacter = (UTF32Char)EOF;
     NSString *data = [self attemptToConsumeCharacterReference];
     if (data) {
@@ -118,12 +167,14 @@
         }
         return c == '&' || c == '<';
     }];
-    [self emitCharacterTokenWithString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [self emitCharacterTokenWithString:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '&':
-            return [self switchToState:HTMLCharacterReferenceInRCDATATokenizerState];
+            _state = HTMLCharacterReferenceInRCDATATokenizerState;
+            return;
         case '<':
-            return [self switchToState:HTMLRCDATALessThanSignTokenizerState];
+            _state = HTMLRCDATALessThanSignTokenizerState;
+            return;
         case EOF:
             _done = YES;
             break;
@@ -132,7 +183,7 @@
 
 - (void)characterReferenceInRCDATAState
 {
-    [self switchToState:HTMLRCDATATokenizerState];
+    _state = HTMLRCDATATokenizerState;
     _additionalAllowedCharacter = (UTF32Char)EOF;
     NSString *data = [self attemptToConsumeCharacterReference];
     if (data) {
@@ -150,10 +201,11 @@
         }
         return c == '<';
     }];
-    [self emitCharacterTokenWithString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [self emitCharacterTokenWithString:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '<':
-            return [self switchToState:HTMLRAWTEXTLessThanSignTokenizerState];
+            _state = HTMLRAWTEXTLessThanSignTokenizerState;
+            return;
         case EOF:
             _done = YES;
             break;
@@ -168,10 +220,11 @@
         }
         return c == '<';
     }];
-    [self emitCharacterTokenWithString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [self emitCharacterTokenWithString:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '<':
-            return [self switchToState:HTMLScriptDataLessThanSignTokenizerState];
+            _state = HTMLScriptDataLessThanSignTokenizerState;
+            return;
         case EOF:
             _done = YES;
             break;
@@ -186,7 +239,7 @@
         }
         return NO;
     }];
-    [self emitCharacterTokenWithString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
+    [self emitCharacterTokenWithString:StringByReplacingNullCharacters(string, @"\uFFFD")];
     _done = YES;
 }
 
@@ -203,16 +256,16 @@ static inline BOOL is_lower(NSInteger c)
 - (void)tagOpenState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '!':
-            [self switchToState:HTMLMarkupDeclarationOpenTokenizerState];
+            _state = HTMLMarkupDeclarationOpenTokenizerState;
             break;
         case '/':
-            [self switchToState:HTMLEndTagOpenTokenizerState];
+            _state = HTMLEndTagOpenTokenizerState;
             break;
         case '?':
             [self emitParseError:@"Bogus ? in tag open state"];
-            [self switchToState:HTMLBogusCommentTokenizerState];
+            _state = HTMLBogusCommentTokenizerState;
             // SPEC We are to "emit a comment token whose data is the concatenation of all characters starting from and including the character that caused the state machine to switch into the bogus comment state...". This is effectively, but not explicitly, reconsuming the current input character.
             [_inputStream reconsumeCurrentInputCharacter];
             break;
@@ -221,10 +274,10 @@ static inline BOOL is_lower(NSInteger c)
                 _currentToken = [HTMLStartTagToken new];
                 unichar toAppend = c + (is_upper(c) ? 0x0020 : 0);
                 [_currentToken appendLongCharacterToTagName:toAppend];
-                [self switchToState:HTMLTagNameTokenizerState];
+                _state = HTMLTagNameTokenizerState;
             } else {
                 [self emitParseError:@"Unexpected character in tag open state"];
-                [self switchToState:HTMLDataTokenizerState];
+                _state = HTMLDataTokenizerState;
                 [self emitCharacterTokenWithString:@"<"];
                 [self reconsume:c];
             }
@@ -235,14 +288,14 @@ static inline BOOL is_lower(NSInteger c)
 - (void)endTagOpenState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '>':
             [self emitParseError:@"Unexpected > in end tag open state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             break;
         case EOF:
             [self emitParseError:@"EOF in end tag open state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCharacterTokenWithString:@"</"];
             [self reconsume:c];
             break;
@@ -251,10 +304,10 @@ static inline BOOL is_lower(NSInteger c)
                 _currentToken = [HTMLEndTagToken new];
                 unichar toAppend = c + (is_upper(c) ? 0x0020 : 0);
                 [_currentToken appendLongCharacterToTagName:toAppend];
-                [self switchToState:HTMLTagNameTokenizerState];
+                _state = HTMLTagNameTokenizerState;
             } else {
                 [self emitParseError:@"Unexpected character in end tag open state"];
-                [self switchToState:HTMLBogusCommentTokenizerState];
+                _state = HTMLBogusCommentTokenizerState;
                 // SPEC We are to "emit a comment token whose data is the concatenation of all characters starting from and including the character that caused the state machine to switch into the bogus comment state...". This is effectively, but not explicitly, reconsuming the current input character.
                 [self reconsume:c];
             }
@@ -265,18 +318,18 @@ static inline BOOL is_lower(NSInteger c)
 - (void)tagNameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
-            [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+            _state = HTMLBeforeAttributeNameTokenizerState;
             break;
         case '/':
-            [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+            _state = HTMLSelfClosingStartTagTokenizerState;
             break;
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '\0':
@@ -285,7 +338,7 @@ static inline BOOL is_lower(NSInteger c)
             break;
         case EOF:
             [self emitParseError:@"EOF in tag name state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             break;
         default:
             if (is_upper(c)) {
@@ -299,12 +352,12 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)RCDATALessThanSignState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (c == '/') {
-        _temporaryBuffer = [NSMutableString new];
-        [self switchToState:HTMLRCDATAEndTagOpenTokenizerState];
+        [_temporaryBuffer setString:@""];
+        _state = HTMLRCDATAEndTagOpenTokenizerState;
     } else {
-        [self switchToState:HTMLRCDATATokenizerState];
+        _state = HTMLRCDATATokenizerState;
         [self emitCharacterTokenWithString:@"<"];
         [self reconsume:c];
     }
@@ -312,19 +365,19 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)RCDATAEndTagOpenState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (is_upper(c)) {
         _currentToken = [HTMLEndTagToken new];
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c + 0x0020];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-        [self switchToState:HTMLRCDATAEndTagNameTokenizerState];
+        _state = HTMLRCDATAEndTagNameTokenizerState;
     } else if (is_lower(c)) {
         _currentToken = [HTMLEndTagToken new];
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-        [self switchToState:HTMLRCDATAEndTagNameTokenizerState];
+        _state = HTMLRCDATAEndTagNameTokenizerState;
     } else {
-        [self switchToState:HTMLRCDATATokenizerState];
+        _state = HTMLRCDATATokenizerState;
         [self emitCharacterTokenWithString:@"</"];
         [self reconsume:c];
     }
@@ -333,25 +386,25 @@ static inline BOOL is_lower(NSInteger c)
 - (void)RCDATAEndTagNameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+                _state = HTMLBeforeAttributeNameTokenizerState;
                 return;
             }
             break;
         case '/':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+                _state = HTMLSelfClosingStartTagTokenizerState;
                 return;
             }
             break;
         case '>':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLDataTokenizerState];
+                _state = HTMLDataTokenizerState;
                 [self emitCurrentToken];
                 return;
             }
@@ -364,7 +417,7 @@ static inline BOOL is_lower(NSInteger c)
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
     } else {
-        [self switchToState:HTMLRCDATATokenizerState];
+        _state = HTMLRCDATATokenizerState;
         [self emitCharacterTokenWithString:@"</"];
         [self emitCharacterTokenWithString:_temporaryBuffer];
         [self reconsume:c];
@@ -373,12 +426,12 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)RAWTEXTLessThanSignState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (c == '/') {
-        _temporaryBuffer = [NSMutableString new];
-        [self switchToState:HTMLRAWTEXTEndTagOpenTokenizerState];
+        [_temporaryBuffer setString:@""];
+        _state = HTMLRAWTEXTEndTagOpenTokenizerState;
     } else {
-        [self switchToState:HTMLRAWTEXTTokenizerState];
+        _state = HTMLRAWTEXTTokenizerState;
         [self emitCharacterTokenWithString:@"<"];
         [self reconsume:c];
     }
@@ -386,19 +439,19 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)RAWTEXTEndTagOpenState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (is_upper(c)) {
         _currentToken = [HTMLEndTagToken new];
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c + 0x0020];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-        [self switchToState:HTMLRAWTEXTEndTagNameTokenizerState];
+        _state = HTMLRAWTEXTEndTagNameTokenizerState;
     } else if (is_lower(c)) {
         _currentToken = [HTMLEndTagToken new];
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-        [self switchToState:HTMLRAWTEXTEndTagNameTokenizerState];
+        _state = HTMLRAWTEXTEndTagNameTokenizerState;
     } else {
-        [self switchToState:HTMLRAWTEXTTokenizerState];
+        _state = HTMLRAWTEXTTokenizerState;
         [self emitCharacterTokenWithString:@"</"];
         [self reconsume:c];
     }
@@ -407,25 +460,25 @@ static inline BOOL is_lower(NSInteger c)
 - (void)RAWTEXTEndTagNameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+                _state = HTMLBeforeAttributeNameTokenizerState;
                 return;
             }
             break;
         case '/':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+                _state = HTMLSelfClosingStartTagTokenizerState;
                 return;
             }
             break;
         case '>':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLDataTokenizerState];
+                _state = HTMLDataTokenizerState;
                 [self emitCurrentToken];
                 return;
             }
@@ -438,7 +491,7 @@ static inline BOOL is_lower(NSInteger c)
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
     } else {
-        [self switchToState:HTMLRAWTEXTTokenizerState];
+        _state = HTMLRAWTEXTTokenizerState;
         [self emitCharacterTokenWithString:@"</"];
         [self emitCharacterTokenWithString:_temporaryBuffer];
         [self reconsume:c];
@@ -448,17 +501,17 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataLessThanSignState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '/':
-            _temporaryBuffer = [NSMutableString new];
-            [self switchToState:HTMLScriptDataEndTagOpenTokenizerState];
+            [_temporaryBuffer setString:@""];
+            _state = HTMLScriptDataEndTagOpenTokenizerState;
             break;
         case '!':
-            [self switchToState:HTMLScriptDataEscapeStartTokenizerState];
+            _state = HTMLScriptDataEscapeStartTokenizerState;
             [self emitCharacterTokenWithString:@"<!"];
             break;
         default:
-            [self switchToState:HTMLScriptDataTokenizerState];
+            _state = HTMLScriptDataTokenizerState;
             [self emitCharacterTokenWithString:@"<"];
             [self reconsume:c];
             break;
@@ -467,19 +520,19 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)scriptDataEndTagOpenState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (is_upper(c)) {
         _currentToken = [HTMLEndTagToken new];
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c + 0x0020];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-        [self switchToState:HTMLScriptDataEndTagNameTokenizerState];
+        _state = HTMLScriptDataEndTagNameTokenizerState;
     } else if (is_lower(c)) {
         _currentToken = [HTMLEndTagToken new];
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-        [self switchToState:HTMLScriptDataEndTagNameTokenizerState];
+        _state = HTMLScriptDataEndTagNameTokenizerState;
     } else {
-        [self switchToState:HTMLScriptDataTokenizerState];
+        _state = HTMLScriptDataTokenizerState;
         [self emitCharacterTokenWithString:@"</"];
         [self reconsume:c];
     }
@@ -488,25 +541,25 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataEndTagNameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+                _state = HTMLBeforeAttributeNameTokenizerState;
                 return;
             }
             break;
         case '/':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+                _state = HTMLSelfClosingStartTagTokenizerState;
                 return;
             }
             break;
         case '>':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLDataTokenizerState];
+                _state = HTMLDataTokenizerState;
                 [self emitCurrentToken];
                 return;
             }
@@ -519,7 +572,7 @@ static inline BOOL is_lower(NSInteger c)
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
     } else {
-        [self switchToState:HTMLScriptDataTokenizerState];
+        _state = HTMLScriptDataTokenizerState;
         [self emitCharacterTokenWithString:@"</"];
         [self emitCharacterTokenWithString:_temporaryBuffer];
         [self reconsume:c];
@@ -528,24 +581,24 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)scriptDataEscapeStartState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (c == '-') {
-        [self switchToState:HTMLScriptDataEscapeStartDashTokenizerState];
+        _state = HTMLScriptDataEscapeStartDashTokenizerState;
         [self emitCharacterTokenWithString:@"-"];
     } else {
-        [self switchToState:HTMLScriptDataTokenizerState];
+        _state = HTMLScriptDataTokenizerState;
         [self reconsume:c];
     }
 }
 
 - (void)scriptDataEscapeStartDashState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (c == '-') {
-        [self switchToState:HTMLScriptDataEscapedDashDashTokenizerState];
+        _state = HTMLScriptDataEscapedDashDashTokenizerState;
         [self emitCharacterTokenWithString:@"-"];
     } else {
-        [self switchToState:HTMLScriptDataTokenizerState];
+        _state = HTMLScriptDataTokenizerState;
         [self reconsume:c];
     }
 }
@@ -558,16 +611,17 @@ static inline BOOL is_lower(NSInteger c)
         }
         return c == '-' || c == '<';
     }];
-    [self emitCharacterTokenWithString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [self emitCharacterTokenWithString:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
-            [self switchToState:HTMLScriptDataEscapedDashTokenizerState];
+            _state = HTMLScriptDataEscapedDashTokenizerState;
             [self emitCharacterTokenWithString:@"-"];
             break;
         case '<':
-            return [self switchToState:HTMLScriptDataEscapedLessThanSignTokenizerState];
+            _state = HTMLScriptDataEscapedLessThanSignTokenizerState;
+            return;
         case EOF:
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitParseError:@"EOF in script data escaped state"];
             [self reconsume:EOF];
             break;
@@ -577,26 +631,26 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataEscapedDashState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
-            [self switchToState:HTMLScriptDataEscapedDashDashTokenizerState];
+            _state = HTMLScriptDataEscapedDashDashTokenizerState;
             [self emitCharacterTokenWithString:@"-"];
             break;
         case '<':
-            [self switchToState:HTMLScriptDataEscapedLessThanSignTokenizerState];
+            _state = HTMLScriptDataEscapedLessThanSignTokenizerState;
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in script data escaped dash state"];
-            [self switchToState:HTMLScriptDataEscapedTokenizerState];
+            _state = HTMLScriptDataEscapedTokenizerState;
             [self emitCharacterTokenWithString:@"\uFFFD"];
             break;
         case EOF:
             [self emitParseError:@"EOF in script data escaped dash state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
-            [self switchToState:HTMLScriptDataEscapedTokenizerState];
+            _state = HTMLScriptDataEscapedTokenizerState;
             [self emitCharacterToken:(UTF32Char)c];
             break;
     }
@@ -605,29 +659,29 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataEscapedDashDashState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
             [self emitCharacterTokenWithString:@"-"];
             break;
         case '<':
-            [self switchToState:HTMLScriptDataEscapedLessThanSignTokenizerState];
+            _state = HTMLScriptDataEscapedLessThanSignTokenizerState;
             break;
         case '>':
-            [self switchToState:HTMLScriptDataTokenizerState];
+            _state = HTMLScriptDataTokenizerState;
             [self emitCharacterTokenWithString:@">"];
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in script data escaped dash dash state"];
-            [self switchToState:HTMLScriptDataEscapedTokenizerState];
+            _state = HTMLScriptDataEscapedTokenizerState;
             [self emitCharacterTokenWithString:@"\uFFFD"];
             break;
         case EOF:
             [self emitParseError:@"EOF in script data escaped dash dash state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
-            [self switchToState:HTMLScriptDataEscapedTokenizerState];
+            _state = HTMLScriptDataEscapedTokenizerState;
             [self emitCharacterToken:(UTF32Char)c];
             break;
     }
@@ -636,26 +690,26 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataEscapedLessThanSignState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '/':
-            _temporaryBuffer = [NSMutableString new];
-            [self switchToState:HTMLScriptDataEscapedEndTagOpenTokenizerState];
+            [_temporaryBuffer setString:@""];
+            _state = HTMLScriptDataEscapedEndTagOpenTokenizerState;
             break;
         default:
             if (is_upper(c)) {
-                _temporaryBuffer = [NSMutableString new];
+                [_temporaryBuffer setString:@""];
                 AppendLongCharacter(_temporaryBuffer, (UTF32Char)c + 0x0020);
-                [self switchToState:HTMLScriptDataDoubleEscapeStartTokenizerState];
+                _state = HTMLScriptDataDoubleEscapeStartTokenizerState;
                 [self emitCharacterTokenWithString:@"<"];
                 [self emitCharacterToken:(UTF32Char)c];
             } else if (is_lower(c)) {
-                _temporaryBuffer = [NSMutableString new];
+                [_temporaryBuffer setString:@""];
                 AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-                [self switchToState:HTMLScriptDataDoubleEscapeStartTokenizerState];
+                _state = HTMLScriptDataDoubleEscapeStartTokenizerState;
                 [self emitCharacterTokenWithString:@"<"];
                 [self emitCharacterToken:(UTF32Char)c];
             } else {
-                [self switchToState:HTMLScriptDataEscapedTokenizerState];
+                _state = HTMLScriptDataEscapedTokenizerState;
                 [self emitCharacterTokenWithString:@"<"];
                 [self reconsume:c];
             }
@@ -665,19 +719,19 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)scriptDataEscapedEndTagOpenState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (is_upper(c)) {
         _currentToken = [HTMLEndTagToken new];
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c + 0x0020];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-        [self switchToState:HTMLScriptDataEscapedEndTagNameTokenizerState];
+        _state = HTMLScriptDataEscapedEndTagNameTokenizerState;
     } else if (is_lower(c)) {
         _currentToken = [HTMLEndTagToken new];
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
-        [self switchToState:HTMLScriptDataEscapedEndTagNameTokenizerState];
+        _state = HTMLScriptDataEscapedEndTagNameTokenizerState;
     } else {
-        [self switchToState:HTMLScriptDataEscapedTokenizerState];
+        _state = HTMLScriptDataEscapedTokenizerState;
         [self emitCharacterTokenWithString:@"</"];
         [self reconsume:c];
     }
@@ -686,25 +740,25 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataEscapedEndTagNameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+                _state = HTMLBeforeAttributeNameTokenizerState;
                 return;
             }
             break;
         case '/':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+                _state = HTMLSelfClosingStartTagTokenizerState;
                 return;
             }
             break;
         case '>':
             if ([self currentTagIsAppropriateEndTagToken]) {
-                [self switchToState:HTMLDataTokenizerState];
+                _state = HTMLDataTokenizerState;
                 [self emitCurrentToken];
                 return;
             }
@@ -717,7 +771,7 @@ static inline BOOL is_lower(NSInteger c)
         [_currentToken appendLongCharacterToTagName:(UTF32Char)c];
         AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
     } else {
-        [self switchToState:HTMLScriptDataEscapedTokenizerState];
+        _state = HTMLScriptDataEscapedTokenizerState;
         [self emitCharacterTokenWithString:@"</"];
         [self emitCharacterTokenWithString:_temporaryBuffer];
         [self reconsume:c];
@@ -727,7 +781,7 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataDoubleEscapeStartState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
@@ -735,9 +789,9 @@ static inline BOOL is_lower(NSInteger c)
         case '/':
         case '>':
             if ([_temporaryBuffer isEqualToString:@"script"]) {
-                [self switchToState:HTMLScriptDataDoubleEscapedTokenizerState];
+                _state = HTMLScriptDataDoubleEscapedTokenizerState;
             } else {
-                [self switchToState:HTMLScriptDataEscapedTokenizerState];
+                _state = HTMLScriptDataEscapedTokenizerState;
             }
             [self emitCharacterToken:(UTF32Char)c];
             break;
@@ -749,7 +803,7 @@ static inline BOOL is_lower(NSInteger c)
                 AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
                 [self emitCharacterToken:(UTF32Char)c];
             } else {
-                [self switchToState:HTMLScriptDataEscapedTokenizerState];
+                _state = HTMLScriptDataEscapedTokenizerState;
                 [self reconsume:c];
             }
             break;
@@ -764,19 +818,19 @@ static inline BOOL is_lower(NSInteger c)
         }
         return c == '-' || c == '<';
     }];
-    [self emitCharacterTokenWithString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [self emitCharacterTokenWithString:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
-            [self switchToState:HTMLScriptDataDoubleEscapedDashTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedDashTokenizerState;
             [self emitCharacterTokenWithString:@"-"];
             break;
         case '<':
-            [self switchToState:HTMLScriptDataDoubleEscapedLessThanSignTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedLessThanSignTokenizerState;
             [self emitCharacterTokenWithString:@"<"];
             break;
         case EOF:
             [self emitParseError:@"EOF in script data double escaped state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
     }
@@ -785,27 +839,27 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataDoubleEscapedDashState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
-            [self switchToState:HTMLScriptDataDoubleEscapedDashDashTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedDashDashTokenizerState;
             [self emitCharacterTokenWithString:@"-"];
             break;
         case '<':
-            [self switchToState:HTMLScriptDataDoubleEscapedLessThanSignTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedLessThanSignTokenizerState;
             [self emitCharacterTokenWithString:@"<"];
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in script data double escaped dash state"];
-            [self switchToState:HTMLScriptDataDoubleEscapedTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedTokenizerState;
             [self emitCharacterTokenWithString:@"\uFFFD"];
             break;
         case EOF:
             [self emitParseError:@"EOF in script data double escaped dash state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
-            [self switchToState:HTMLScriptDataDoubleEscapedTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedTokenizerState;
             [self emitCharacterToken:(UTF32Char)c];
             break;
     }
@@ -814,30 +868,30 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataDoubleEscapedDashDashState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
             [self emitCharacterTokenWithString:@"-"];
             break;
         case '<':
-            [self switchToState:HTMLScriptDataDoubleEscapedLessThanSignTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedLessThanSignTokenizerState;
             [self emitCharacterTokenWithString:@"<"];
             break;
         case '>':
-            [self switchToState:HTMLScriptDataTokenizerState];
+            _state = HTMLScriptDataTokenizerState;
             [self emitCharacterTokenWithString:@">"];
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in script data double escaped dash dash state"];
-            [self switchToState:HTMLScriptDataDoubleEscapedTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedTokenizerState;
             [self emitCharacterTokenWithString:@"\uFFFD"];
             break;
         case EOF:
             [self emitParseError:@"EOF in script data double escaped dash dash state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
-            [self switchToState:HTMLScriptDataDoubleEscapedTokenizerState];
+            _state = HTMLScriptDataDoubleEscapedTokenizerState;
             [self emitCharacterToken:(UTF32Char)c];
             break;
     }
@@ -845,13 +899,13 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)scriptDataDoubleEscapedLessThanSignState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (c == '/') {
-        _temporaryBuffer = [NSMutableString new];
-        [self switchToState:HTMLScriptDataDoubleEscapeEndTokenizerState];
+        [_temporaryBuffer setString:@""];
+        _state = HTMLScriptDataDoubleEscapeEndTokenizerState;
         [self emitCharacterTokenWithString:@"/"];
     } else {
-        [self switchToState:HTMLScriptDataDoubleEscapedTokenizerState];
+        _state = HTMLScriptDataDoubleEscapedTokenizerState;
         [self reconsume:c];
     }
 }
@@ -859,7 +913,7 @@ static inline BOOL is_lower(NSInteger c)
 - (void)scriptDataDoubleEscapeEndState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
@@ -867,9 +921,9 @@ static inline BOOL is_lower(NSInteger c)
         case '/':
         case '>':
             if ([_temporaryBuffer isEqualToString:@"script"]) {
-                [self switchToState:HTMLScriptDataEscapedTokenizerState];
+                _state = HTMLScriptDataEscapedTokenizerState;
             } else {
-                [self switchToState:HTMLScriptDataDoubleEscapedTokenizerState];
+                _state = HTMLScriptDataDoubleEscapedTokenizerState;
             }
             [self emitCharacterToken:(UTF32Char)c];
             break;
@@ -881,7 +935,7 @@ static inline BOOL is_lower(NSInteger c)
                 AppendLongCharacter(_temporaryBuffer, (UTF32Char)c);
                 [self emitCharacterToken:(UTF32Char)c];
             } else {
-                [self switchToState:HTMLScriptDataDoubleEscapedTokenizerState];
+                _state = HTMLScriptDataDoubleEscapedTokenizerState;
                 [self reconsume:c];
             }
             break;
@@ -891,24 +945,24 @@ static inline BOOL is_lower(NSInteger c)
 - (void)beforeAttributeNameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             break;
         case '/':
-            [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+            _state = HTMLSelfClosingStartTagTokenizerState;
             break;
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in before attribute name state"];
-            _currentAttributeName = [NSMutableString new];
+            [_currentAttributeName setString:@""];
             AppendLongCharacter(_currentAttributeName, 0xFFFD);
-            [self switchToState:HTMLAttributeNameTokenizerState];
+            _state = HTMLAttributeNameTokenizerState;
             break;
         case '"':
         case '\'':
@@ -918,18 +972,18 @@ static inline BOOL is_lower(NSInteger c)
             goto anythingElse;
         case EOF:
             [self emitParseError:@"EOF in before attribute name state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
         anythingElse:
-            _currentAttributeName = [NSMutableString new];
+            [_currentAttributeName setString:@""];
             if (is_upper(c)) {
                 AppendLongCharacter(_currentAttributeName, (UTF32Char)c + 0x0020);
             } else {
                 AppendLongCharacter(_currentAttributeName, (UTF32Char)c);
             }
-            [self switchToState:HTMLAttributeNameTokenizerState];
+            _state = HTMLAttributeNameTokenizerState;
             break;
     }
 }
@@ -937,23 +991,23 @@ static inline BOOL is_lower(NSInteger c)
 - (void)attributeNameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
-            [self switchToState:HTMLAfterAttributeNameTokenizerState];
+            _state = HTMLAfterAttributeNameTokenizerState;
             break;
         case '/':
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+            _state = HTMLSelfClosingStartTagTokenizerState;
             break;
         case '=':
-            [self switchToState:HTMLBeforeAttributeValueTokenizerState];
+            _state = HTMLBeforeAttributeValueTokenizerState;
             break;
         case '>':
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '\0':
@@ -968,7 +1022,7 @@ static inline BOOL is_lower(NSInteger c)
         case EOF:
             [self emitParseError:@"EOF in attribute name state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
@@ -985,7 +1039,7 @@ static inline BOOL is_lower(NSInteger c)
 - (void)afterAttributeNameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
@@ -993,22 +1047,22 @@ static inline BOOL is_lower(NSInteger c)
             break;
         case '/':
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+            _state = HTMLSelfClosingStartTagTokenizerState;
             break;
         case '=':
-            [self switchToState:HTMLBeforeAttributeValueTokenizerState];
+            _state = HTMLBeforeAttributeValueTokenizerState;
             break;
         case '>':
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in after attribute name state"];
             [self addCurrentAttributeToCurrentToken];
-            _currentAttributeName = [NSMutableString new];
+            [_currentAttributeName setString:@""];
             AppendLongCharacter(_currentAttributeName, 0xFFFD);
-            [self switchToState:HTMLAttributeNameTokenizerState];
+            _state = HTMLAttributeNameTokenizerState;
             break;
         case '"':
         case '\'':
@@ -1018,19 +1072,19 @@ static inline BOOL is_lower(NSInteger c)
         case EOF:
             [self emitParseError:@"EOF in after attribute name state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
         anythingElse:
             [self addCurrentAttributeToCurrentToken];
-            _currentAttributeName = [NSMutableString new];
+            [_currentAttributeName setString:@""];
             if (is_upper(c)) {
                 AppendLongCharacter(_currentAttributeName, (UTF32Char)c + 0x0020);
             } else {
                 AppendLongCharacter(_currentAttributeName, (UTF32Char)c);
             }
-            [self switchToState:HTMLAttributeNameTokenizerState];
+            _state = HTMLAttributeNameTokenizerState;
             break;
     }
 }
@@ -1038,35 +1092,35 @@ static inline BOOL is_lower(NSInteger c)
 - (void)beforeAttributeValueState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             break;
         case '"':
-            _currentAttributeValue = [NSMutableString new];
-            [self switchToState:HTMLAttributeValueDoubleQuotedTokenizerState];
+            [self deferCurrentAttributeValueFromLocation:_inputStream->_scanLocation];
+            _state = HTMLAttributeValueDoubleQuotedTokenizerState;
             break;
         case '&':
-            _currentAttributeValue = [NSMutableString new];
-            [self switchToState:HTMLAttributeValueUnquotedTokenizerState];
+            [self startCurrentAttributeValue];
+            _state = HTMLAttributeValueUnquotedTokenizerState;
             [self reconsume:c];
             break;
         case '\'':
-            _currentAttributeValue = [NSMutableString new];
-            [self switchToState:HTMLAttributeValueSingleQuotedTokenizerState];
+            [self deferCurrentAttributeValueFromLocation:_inputStream->_scanLocation];
+            _state = HTMLAttributeValueSingleQuotedTokenizerState;
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in before attribute value state"];
-            _currentAttributeValue = [NSMutableString new];
+            [self startCurrentAttributeValue];
             AppendLongCharacter(_currentAttributeValue, 0xFFFD);
-            [self switchToState:HTMLAttributeValueUnquotedTokenizerState];
+            _state = HTMLAttributeValueUnquotedTokenizerState;
             break;
         case '>':
             [self emitParseError:@"Unexpected > in before attribute value state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '<':
@@ -1077,39 +1131,43 @@ static inline BOOL is_lower(NSInteger c)
         case EOF:
             [self emitParseError:@"EOF in before attribute value state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
         anythingElse:
-            _currentAttributeValue = [NSMutableString new];
-            AppendLongCharacter(_currentAttributeValue, (UTF32Char)c);
-            [self switchToState:HTMLAttributeValueUnquotedTokenizerState];
+            if (c <= 0xFFFF && _inputStream->_characters[_inputStream->_scanLocation - 1] == c) {
+                [self deferCurrentAttributeValueFromLocation:_inputStream->_scanLocation - 1];
+            } else {
+                [self startCurrentAttributeValue];
+                AppendLongCharacter(_currentAttributeValue, (UTF32Char)c);
+            }
+            _state = HTMLAttributeValueUnquotedTokenizerState;
             break;
     }
 }
 
 - (void)attributeValueDoubleQuotedState
 {
-    NSString *string = [self consumeCharactersUpToFirstPassingTest:^BOOL(UTF32Char c) {
+    [self consumeAttributeValueCharactersUpToFirstPassingTest:^BOOL(UTF32Char c) {
         if (c == '\0') {
             [self emitParseError:@"U+0000 NULL in attribute value double quoted state"];
         }
         return c == '"' || c == '&';
-    }] ?: @"";
-    [_currentAttributeValue appendString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    }];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '"':
-            return [self switchToState:HTMLAfterAttributeValueQuotedTokenizerState];
+            _state = HTMLAfterAttributeValueQuotedTokenizerState;
+            return;
         case '&':
-            [self switchToState:HTMLCharacterReferenceInAttributeValueTokenizerState];
+            _state = HTMLCharacterReferenceInAttributeValueTokenizerState;
             _additionalAllowedCharacter = '"';
             _sourceAttributeValueState = HTMLAttributeValueDoubleQuotedTokenizerState;
             break;
         case EOF:
             [self emitParseError:@"EOF in attribute value double quoted state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
     }
@@ -1117,25 +1175,25 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)attributeValueSingleQuotedState
 {
-    NSString *string = [self consumeCharactersUpToFirstPassingTest:^BOOL(UTF32Char c) {
+    [self consumeAttributeValueCharactersUpToFirstPassingTest:^BOOL(UTF32Char c) {
         if (c == '\0') {
             [self emitParseError:@"U+0000 NULL in attribute value single quoted state"];
         }
         return c == '\'' || c == '&';
-    }] ?: @"";
-    [_currentAttributeValue appendString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    }];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\'':
-            return [self switchToState:HTMLAfterAttributeValueQuotedTokenizerState];
+            _state = HTMLAfterAttributeValueQuotedTokenizerState;
+            return;
         case '&':
-            [self switchToState:HTMLCharacterReferenceInAttributeValueTokenizerState];
+            _state = HTMLCharacterReferenceInAttributeValueTokenizerState;
             _additionalAllowedCharacter = '\'';
             _sourceAttributeValueState = HTMLAttributeValueSingleQuotedTokenizerState;
             break;
         case EOF:
             [self emitParseError:@"EOF in attribute value single quoted state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
     }
@@ -1143,36 +1201,36 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)attributeValueUnquotedState
 {
-    NSString *string = [self consumeCharactersUpToFirstPassingTest:^BOOL(UTF32Char c) {
+    [self consumeAttributeValueCharactersUpToFirstPassingTest:^BOOL(UTF32Char c) {
         if (c == '\0') {
             [self emitParseError:@"U+0000 NULL in attribute value unquoted state"];
         } else if (c == '"' || c == '\'' || c == '<' || c == '=' || c == '`') {
             [self emitParseError:@"Unexpected %c in attribute value unquoted state", (char)c];
         }
         return is_whitespace(c) || c == '&' || c == '>';
-    }] ?: @"";
-    [_currentAttributeValue appendString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    }];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             [self addCurrentAttributeToCurrentToken];
-            return [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+            _state = HTMLBeforeAttributeNameTokenizerState;
+            return;
         case '&':
-            [self switchToState:HTMLCharacterReferenceInAttributeValueTokenizerState];
+            _state = HTMLCharacterReferenceInAttributeValueTokenizerState;
             _additionalAllowedCharacter = '>';
             _sourceAttributeValueState = HTMLAttributeValueUnquotedTokenizerState;
             break;
         case '>':
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in attribute value unquoted state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
     }
@@ -1180,45 +1238,46 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)characterReferenceInAttributeValueState
 {
+    [self stopDeferringCurrentAttributeValue];
     NSString *characters = [self attemptToConsumeCharacterReferenceAsPartOfAnAttribute];
     if (characters) {
         [_currentAttributeValue appendString:characters];
     } else {
         [_currentAttributeValue appendString:@"&"];
     }
-    [self switchToState:_sourceAttributeValueState];
+    _state = _sourceAttributeValueState;
 }
 
 - (void)afterAttributeValueQuotedState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+            _state = HTMLBeforeAttributeNameTokenizerState;
             break;
         case '/':
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLSelfClosingStartTagTokenizerState];
+            _state = HTMLSelfClosingStartTagTokenizerState;
             break;
         case '>':
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in after attribute value quoted state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
             [self emitParseError:@"Unexpected character in after attribute value quoted state"];
             [self addCurrentAttributeToCurrentToken];
-            [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+            _state = HTMLBeforeAttributeNameTokenizerState;
             [self reconsume:c];
             break;
     }
@@ -1227,20 +1286,20 @@ static inline BOOL is_lower(NSInteger c)
 - (void)selfClosingStartTagState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '>':
             [_currentToken setSelfClosingFlag:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in self closing start tag state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self reconsume:EOF];
             break;
         default:
             [self emitParseError:@"Unexpected character in self closing start tag state"];
-            [self switchToState:HTMLBeforeAttributeNameTokenizerState];
+            _state = HTMLBeforeAttributeNameTokenizerState;
             [self reconsume:c];
             break;
     }
@@ -1251,55 +1310,63 @@ static inline BOOL is_lower(NSInteger c)
     NSString *string = [self consumeCharactersUpToFirstPassingTest:^BOOL(UTF32Char c) {
         return c == '>';
     }];
-    _currentToken = [[HTMLCommentToken alloc] initWithData:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
+    _currentToken = [[HTMLCommentToken alloc] initWithData:StringByReplacingNullCharacters(string, @"\uFFFD")];
     [self emitCurrentToken];
-    [self switchToState:HTMLDataTokenizerState];
-    if ([self consumeNextInputCharacter] == (UTF32Char)EOF) {
+    _state = HTMLDataTokenizerState;
+    if (HTMLConsumeNextInputCharacter(_inputStream) == (UTF32Char)EOF) {
         [self reconsume:EOF];
     }
 }
 
+- (BOOL)adjustedCurrentNodeIsForeign
+{
+    if (_willConsultParser) {
+        _willConsultParser();
+    }
+    return _parser.adjustedCurrentNode.htmlNamespace != HTMLNamespaceHTML;
+}
+
 - (void)markupDeclarationOpenState
 {
     if ([_inputStream consumeString:@"--" matchingCase:YES]) {
         _currentToken = [[HTMLCommentToken alloc] initWithData:@""];
-        [self switchToState:HTMLCommentStartTokenizerState];
-    } else if (_parser.adjustedCurrentNode.htmlNamespace != HTMLNamespaceHTML && [_inputStream consumeString:@"[CDATA[" matchingCase:YES]) {
-        [self switchToState:HTMLCDATASectionTokenizerState];
+        _state = HTMLCommentStartTokenizerState;
+    } else if ([_inputStream unprocessedCharacterAtOffset:0] == '[' && [self adjustedCurrentNodeIsForeign] && [_inputStream consumeString:@"[CDATA[" matchingCase:YES]) {
+        _state = HTMLCDATASectionTokenizerState;
     } else if ([_inputStream consumeString:@"DOCTYPE" matchingCase:NO]) {
-        [self switchToState:HTMLDOCTYPETokenizerState];
+        _state = HTMLDOCTYPETokenizerState;
     } else {
         [self emitParseError:@"Bogus character in markup declaration open state"];
-        [self switchToState:HTMLBogusCommentTokenizerState];
+        _state = HTMLBogusCommentTokenizerState;
     }
 }
 
 - (void)commentStartState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
-            [self switchToState:HTMLCommentStartDashTokenizerState];
+            _state = HTMLCommentStartDashTokenizerState;
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in comment start state"];
             [_currentToken appendLongCharacter:0xFFFD];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
         case '>':
             [self emitParseError:@"Unexpected > in comment start state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in comment start state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             [self reconsume:EOF];
             break;
         default:
             [_currentToken appendLongCharacter:(UTF32Char)c];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
     }
 }
@@ -1307,31 +1374,31 @@ static inline BOOL is_lower(NSInteger c)
 - (void)commentStartDashState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
-            [self switchToState:HTMLCommentEndTokenizerState];
+            _state = HTMLCommentEndTokenizerState;
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in comment start dash state"];
             [_currentToken appendLongCharacter:'-'];
             [_currentToken appendLongCharacter:0xFFFD];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
         case '>':
             [self emitParseError:@"Unexpected > in comment start dash state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in comment start dash state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             [self reconsume:EOF];
             break;
         default:
             [_currentToken appendLongCharacter:'-'];
             [_currentToken appendLongCharacter:(UTF32Char)c];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
     }
 }
@@ -1344,13 +1411,14 @@ static inline BOOL is_lower(NSInteger c)
         }
         return c == '-';
     }];
-    [_currentToken appendString:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [_currentToken appendString:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
-            return [self switchToState:HTMLCommentEndDashTokenizerState];
+            _state = HTMLCommentEndDashTokenizerState;
+            return;
         case EOF:
             [self emitParseError:@"EOF in comment state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             [self reconsume:EOF];
             break;
@@ -1360,26 +1428,26 @@ static inline BOOL is_lower(NSInteger c)
 - (void)commentEndDashState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
-            [self switchToState:HTMLCommentEndTokenizerState];
+            _state = HTMLCommentEndTokenizerState;
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in comment end dash state"];
             [_currentToken appendLongCharacter:'-'];
             [_currentToken appendLongCharacter:0xFFFD];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
         case EOF:
             [self emitParseError:@"EOF in comment end dash state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             [self reconsume:EOF];
             break;
         default:
             [_currentToken appendLongCharacter:'-'];
             [_currentToken appendLongCharacter:(UTF32Char)c];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
     }
 }
@@ -1387,20 +1455,20 @@ static inline BOOL is_lower(NSInteger c)
 - (void)commentEndState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in comment end state"];
             [_currentToken appendString:@"--"];
             [_currentToken appendLongCharacter:0xFFFD];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
         case '!':
             [self emitParseError:@"Unexpected ! in comment end state"];
-            [self switchToState:HTMLCommentEndBangTokenizerState];
+            _state = HTMLCommentEndBangTokenizerState;
             break;
         case '-':
             [self emitParseError:@"Unexpected - in comment end state"];
@@ -1408,7 +1476,7 @@ static inline BOOL is_lower(NSInteger c)
             break;
         case EOF:
             [self emitParseError:@"EOF in comment end state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             [self reconsume:EOF];
             break;
@@ -1416,7 +1484,7 @@ static inline BOOL is_lower(NSInteger c)
             [self emitParseError:@"Unexpected character in comment end state"];
             [_currentToken appendString:@"--"];
             [_currentToken appendLongCharacter:(UTF32Char)c];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
     }
 }
@@ -1424,30 +1492,30 @@ static inline BOOL is_lower(NSInteger c)
 - (void)commentEndBangState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '-':
             [_currentToken appendString:@"--!"];
-            [self switchToState:HTMLCommentEndDashTokenizerState];
+            _state = HTMLCommentEndDashTokenizerState;
             break;
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '\0':
             [self emitParseError:@"U+0000 NULL in comment end bang state"];
             [_currentToken appendString:@"--!\uFFFD"];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
         case EOF:
             [self emitParseError:@"EOF in comment end bang state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             [self reconsume:EOF];
             break;
         default:
             [_currentToken appendString:@"--!"];
             [_currentToken appendLongCharacter:(UTF32Char)c];
-            [self switchToState:HTMLCommentTokenizerState];
+            _state = HTMLCommentTokenizerState;
             break;
     }
 }
@@ -1455,16 +1523,16 @@ static inline BOOL is_lower(NSInteger c)
 - (void)DOCTYPEState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
-            [self switchToState:HTMLBeforeDOCTYPENameTokenizerState];
+            _state = HTMLBeforeDOCTYPENameTokenizerState;
             break;
         case EOF:
             [self emitParseError:@"EOF in DOCTYPE state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             _currentToken = [HTMLDOCTYPEToken new];
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
@@ -1472,7 +1540,7 @@ static inline BOOL is_lower(NSInteger c)
             break;
         default:
             [self emitParseError:@"Unexpected character in DOCTYPE state"];
-            [self switchToState:HTMLBeforeDOCTYPENameTokenizerState];
+            _state = HTMLBeforeDOCTYPENameTokenizerState;
             [self reconsume:c];
             break;
     }
@@ -1481,7 +1549,7 @@ static inline BOOL is_lower(NSInteger c)
 - (void)beforeDOCTYPENameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
@@ -1491,18 +1559,18 @@ static inline BOOL is_lower(NSInteger c)
             [self emitParseError:@"U+0000 NULL in before DOCTYPE name state"];
             _currentToken = [HTMLDOCTYPEToken new];
             [_currentToken appendLongCharacterToName:0xFFFD];
-            [self switchToState:HTMLDOCTYPENameTokenizerState];
+            _state = HTMLDOCTYPENameTokenizerState;
             break;
         case '>':
             [self emitParseError:@"Unexpected > in before DOCTYPE name state"];
             _currentToken = [HTMLDOCTYPEToken new];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in before DOCTYPE name state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             _currentToken = [HTMLDOCTYPEToken new];
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
@@ -1515,7 +1583,7 @@ static inline BOOL is_lower(NSInteger c)
             } else {
                 [_currentToken appendLongCharacterToName:(UTF32Char)c];
             }
-            [self switchToState:HTMLDOCTYPENameTokenizerState];
+            _state = HTMLDOCTYPENameTokenizerState;
             break;
     }
 }
@@ -1523,15 +1591,15 @@ static inline BOOL is_lower(NSInteger c)
 - (void)DOCTYPENameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
-            [self switchToState:HTMLAfterDOCTYPENameTokenizerState];
+            _state = HTMLAfterDOCTYPENameTokenizerState;
             break;
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '\0':
@@ -1540,7 +1608,7 @@ static inline BOOL is_lower(NSInteger c)
             break;
         case EOF:
             [self emitParseError:@"EOF in DOCTYPE name state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1558,19 +1626,19 @@ static inline BOOL is_lower(NSInteger c)
 - (void)afterDOCTYPENameState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             break;
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in after DOCTYPE name state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1578,7 +1646,7 @@ static inline BOOL is_lower(NSInteger c)
         case 'P':
         case 'p':
             if ([_inputStream consumeString:@"UBLIC" matchingCase:NO]) {
-                [self switchToState:HTMLAfterDOCTYPEPublicKeywordTokenizerState];
+                _state = HTMLAfterDOCTYPEPublicKeywordTokenizerState;
             } else {
                 goto anythingElse;
             }
@@ -1586,7 +1654,7 @@ static inline BOOL is_lower(NSInteger c)
         case 'S':
         case 's':
             if ([_inputStream consumeString:@"YSTEM" matchingCase:NO]) {
-                [self switchToState:HTMLAfterDOCTYPESystemKeywordTokenizerState];
+                _state = HTMLAfterDOCTYPESystemKeywordTokenizerState;
             } else {
                 goto anythingElse;
             }
@@ -1595,7 +1663,7 @@ static inline BOOL is_lower(NSInteger c)
         anythingElse:
                 [self emitParseError:@"Unexpected character in after DOCTYPE name state"];
                 [_currentToken setForceQuirks:YES];
-                [self switchToState:HTMLBogusDOCTYPETokenizerState];
+                _state = HTMLBogusDOCTYPETokenizerState;
             break;
     }
 }
@@ -1603,32 +1671,32 @@ static inline BOOL is_lower(NSInteger c)
 - (void)afterDOCTYPEPublicKeywordState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
-            [self switchToState:HTMLBeforeDOCTYPEPublicIdentifierTokenizerState];
+            _state = HTMLBeforeDOCTYPEPublicIdentifierTokenizerState;
             break;
         case '"':
             [self emitParseError:@"Unexpected \" in after DOCTYPE public keyword state"];
             [_currentToken setPublicIdentifier:@""];
-            [self switchToState:HTMLDOCTYPEPublicIdentifierDoubleQuotedTokenizerState];
+            _state = HTMLDOCTYPEPublicIdentifierDoubleQuotedTokenizerState;
             break;
         case '\'':
             [self emitParseError:@"Unexpected ' in after DOCTYPE public keyword state"];
             [_currentToken setPublicIdentifier:@""];
-            [self switchToState:HTMLDOCTYPEPublicIdentifierSingleQuotedTokenizerState];
+            _state = HTMLDOCTYPEPublicIdentifierSingleQuotedTokenizerState;
             break;
         case '>':
             [self emitParseError:@"Unexpected > in after DOCTYPE public keyword state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in after DOCTYPE public keyword state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1636,7 +1704,7 @@ static inline BOOL is_lower(NSInteger c)
         default:
             [self emitParseError:@"Unexpected character in after DOCTYPE public keyword state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLBogusDOCTYPETokenizerState];
+            _state = HTMLBogusDOCTYPETokenizerState;
             break;
     }
 }
@@ -1644,7 +1712,7 @@ static inline BOOL is_lower(NSInteger c)
 - (void)beforeDOCTYPEPublicIdentifierState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
@@ -1652,21 +1720,21 @@ static inline BOOL is_lower(NSInteger c)
             break;
         case '"':
             [_currentToken setPublicIdentifier:@""];
-            [self switchToState:HTMLDOCTYPEPublicIdentifierDoubleQuotedTokenizerState];
+            _state = HTMLDOCTYPEPublicIdentifierDoubleQuotedTokenizerState;
             break;
         case '\'':
             [_currentToken setPublicIdentifier:@""];
-            [self switchToState:HTMLDOCTYPEPublicIdentifierSingleQuotedTokenizerState];
+            _state = HTMLDOCTYPEPublicIdentifierSingleQuotedTokenizerState;
             break;
         case '>':
             [self emitParseError:@"Unexpected > in before DOCTYPE public identifier state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in before DOCTYPE public identifier state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1674,7 +1742,7 @@ static inline BOOL is_lower(NSInteger c)
         default:
             [self emitParseError:@"Unexpected character in before DOCTYPE public identifier state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLBogusDOCTYPETokenizerState];
+            _state = HTMLBogusDOCTYPETokenizerState;
             break;
     }
 }
@@ -1687,19 +1755,20 @@ static inline BOOL is_lower(NSInteger c)
         }
         return c == '"' || c == '>';
     }];
-    [_currentToken appendStringToPublicIdentifier:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [_currentToken appendStringToPublicIdentifier:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '"':
-            return [self switchToState:HTMLAfterDOCTYPEPublicIdentifierTokenizerState];
+            _state = HTMLAfterDOCTYPEPublicIdentifierTokenizerState;
+            return;
         case '>':
             [self emitParseError:@"Unexpected > in DOCTYPE public identifier double quoted state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in DOCTYPE public identifier double quoted state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1715,19 +1784,20 @@ static inline BOOL is_lower(NSInteger c)
         }
         return c == '\'' || c == '>';
     }];
-    [_currentToken appendStringToPublicIdentifier:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [_currentToken appendStringToPublicIdentifier:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\'':
-            return [self switchToState:HTMLAfterDOCTYPEPublicIdentifierTokenizerState];
+            _state = HTMLAfterDOCTYPEPublicIdentifierTokenizerState;
+            return;
         case '>':
             [self emitParseError:@"Unexpected > in DOCTYPE public identifier single quoted state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in DOCTYPE public identifier single quoted state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1738,30 +1808,30 @@ static inline BOOL is_lower(NSInteger c)
 - (void)afterDOCTYPEPublicIdentifierState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
-            [self switchToState:HTMLBetweenDOCTYPEPublicAndSystemIdentifiersTokenizerState];
+            _state = HTMLBetweenDOCTYPEPublicAndSystemIdentifiersTokenizerState;
             break;
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '"':
             [self emitParseError:@"Unexpected \" in after DOCTYPE public identifier state"];
             [_currentToken setSystemIdentifier:@""];
-            [self switchToState:HTMLDOCTYPESystemIdentifierDoubleQuotedTokenizerState];
+            _state = HTMLDOCTYPESystemIdentifierDoubleQuotedTokenizerState;
             break;
         case '\'':
             [self emitParseError:@"Unexpected ' in after DOCTYPE public identifier state"];
             [_currentToken setSystemIdentifier:@""];
-            [self switchToState:HTMLDOCTYPESystemIdentifierSingleQuotedTokenizerState];
+            _state = HTMLDOCTYPESystemIdentifierSingleQuotedTokenizerState;
             break;
         case EOF:
             [self emitParseError:@"EOF in after DOCTYPE public identifier state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1769,7 +1839,7 @@ static inline BOOL is_lower(NSInteger c)
         default:
             [self emitParseError:@"Unexpected character in after DOCTYPE public identifier state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLBogusDOCTYPETokenizerState];
+            _state = HTMLBogusDOCTYPETokenizerState;
             break;
     }
 }
@@ -1777,27 +1847,27 @@ static inline BOOL is_lower(NSInteger c)
 - (void)betweenDOCTYPEPublicAndSystemIdentifiersState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             break;
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case '"':
             [_currentToken setSystemIdentifier:@""];
-            [self switchToState:HTMLDOCTYPESystemIdentifierDoubleQuotedTokenizerState];
+            _state = HTMLDOCTYPESystemIdentifierDoubleQuotedTokenizerState;
             break;
         case '\'':
             [_currentToken setSystemIdentifier:@""];
-            [self switchToState:HTMLDOCTYPESystemIdentifierSingleQuotedTokenizerState];
+            _state = HTMLDOCTYPESystemIdentifierSingleQuotedTokenizerState;
             break;
         case EOF:
             [self emitParseError:@"EOF in between DOCTYPE public and system identifiers state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1805,7 +1875,7 @@ static inline BOOL is_lower(NSInteger c)
         default:
             [self emitParseError:@"Unexpected character in between DOCTYPE public and system identifiers state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLBogusDOCTYPETokenizerState];
+            _state = HTMLBogusDOCTYPETokenizerState;
             break;
     }
 }
@@ -1813,32 +1883,32 @@ static inline BOOL is_lower(NSInteger c)
 - (void)afterDOCTYPESystemKeywordState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
-            [self switchToState:HTMLBeforeDOCTYPESystemIdentifierTokenizerState];
+            _state = HTMLBeforeDOCTYPESystemIdentifierTokenizerState;
             break;
         case '"':
             [self emitParseError:@"Unexpected \" in after DOCTYPE system keyword state"];
             [_currentToken setSystemIdentifier:@""];
-            [self switchToState:HTMLDOCTYPESystemIdentifierDoubleQuotedTokenizerState];
+            _state = HTMLDOCTYPESystemIdentifierDoubleQuotedTokenizerState;
             break;
         case '\'':
             [self emitParseError:@"Unexpected ' in after DOCTYPE system keyword state"];
             [_currentToken setSystemIdentifier:@""];
-            [self switchToState:HTMLDOCTYPESystemIdentifierSingleQuotedTokenizerState];
+            _state = HTMLDOCTYPESystemIdentifierSingleQuotedTokenizerState;
             break;
         case '>':
             [self emitParseError:@"Unexpected > in after DOCTYPE system keyword state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in after DOCTYPE system keyword state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1846,7 +1916,7 @@ static inline BOOL is_lower(NSInteger c)
         default:
             [self emitParseError:@"Unexpected character in after DOCTYPE system keyword state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLBogusDOCTYPETokenizerState];
+            _state = HTMLBogusDOCTYPETokenizerState;
             break;
     }
 }
@@ -1854,7 +1924,7 @@ static inline BOOL is_lower(NSInteger c)
 - (void)beforeDOCTYPESystemIdentifierState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
@@ -1862,21 +1932,21 @@ static inline BOOL is_lower(NSInteger c)
             break;
         case '"':
             [_currentToken setSystemIdentifier:@""];
-            [self switchToState:HTMLDOCTYPESystemIdentifierDoubleQuotedTokenizerState];
+            _state = HTMLDOCTYPESystemIdentifierDoubleQuotedTokenizerState;
             break;
         case '\'':
             [_currentToken setSystemIdentifier:@""];
-            [self switchToState:HTMLDOCTYPESystemIdentifierSingleQuotedTokenizerState];
+            _state = HTMLDOCTYPESystemIdentifierSingleQuotedTokenizerState;
             break;
         case '>':
             [self emitParseError:@"Unexpected > in before DOCTYPE system identifier state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in before DOCTYPE system identifier state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1884,7 +1954,7 @@ static inline BOOL is_lower(NSInteger c)
         default:
             [self emitParseError:@"Unexpected character in before DOCTYPE system identifier state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLBogusDOCTYPETokenizerState];
+            _state = HTMLBogusDOCTYPETokenizerState;
             break;
     }
 }
@@ -1897,19 +1967,20 @@ static inline BOOL is_lower(NSInteger c)
         }
         return c == '"' || c == '>';
     }];
-    [_currentToken appendStringToSystemIdentifier:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [_currentToken appendStringToSystemIdentifier:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '"':
-            return [self switchToState:HTMLAfterDOCTYPESystemIdentifierTokenizerState];
+            _state = HTMLAfterDOCTYPESystemIdentifierTokenizerState;
+            return;
         case '>':
             [self emitParseError:@"Unexpected > in DOCTYPE system identifier double quoted state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in DOCTYPE system identifier double quoted state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1925,19 +1996,20 @@ static inline BOOL is_lower(NSInteger c)
         }
         return c == '\'' || c == '>';
     }];
-    [_currentToken appendStringToSystemIdentifier:[string stringByReplacingOccurrencesOfString:@"\0" withString:@"\uFFFD"]];
-    switch ([self consumeNextInputCharacter]) {
+    [_currentToken appendStringToSystemIdentifier:StringByReplacingNullCharacters(string, @"\uFFFD")];
+    switch (HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\'':
-            return [self switchToState:HTMLAfterDOCTYPESystemIdentifierTokenizerState];
+            _state = HTMLAfterDOCTYPESystemIdentifierTokenizerState;
+            return;
         case '>':
             [self emitParseError:@"Unexpected > in DOCTYPE system identifier single quoted state"];
             [_currentToken setForceQuirks:YES];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in DOCTYPE system identifier single quoted state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
@@ -1948,38 +2020,38 @@ static inline BOOL is_lower(NSInteger c)
 - (void)afterDOCTYPESystemIdentifierState
 {
     UTF32Char c;
-    switch (c = [self consumeNextInputCharacter]) {
+    switch (c = HTMLConsumeNextInputCharacter(_inputStream)) {
         case '\t':
         case '\n':
         case '\f':
         case ' ':
             break;
         case '>':
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [self emitCurrentToken];
             break;
         case EOF:
             [self emitParseError:@"EOF in after DOCTYPE system identifier state"];
-            [self switchToState:HTMLDataTokenizerState];
+            _state = HTMLDataTokenizerState;
             [_currentToken setForceQuirks:YES];
             [self emitCurrentToken];
             [self reconsume:EOF];
             break;
         default:
             [self emitParseError:@"Unexpected character in after DOCTYPE system identifier state"];
-            [self switchToState:HTMLBogusDOCTYPETokenizerState];
+            _state = HTMLBogusDOCTYPETokenizerState;
             break;
     }
 }
 
 - (void)bogusDOCTYPEState
 {
-    UTF32Char c = [self consumeNextInputCharacter];
+    UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
     if (c == '>') {
-        [self switchToState:HTMLDataTokenizerState];
+        _state = HTMLDataTokenizerState;
         [self emitCurrentToken];
     } else if (c == (UTF32Char)EOF) {
-        [self switchToState:HTMLDataTokenizerState];
+        _state = HTMLDataTokenizerState;
         [self emitCurrentToken];
         [self reconsume:EOF];
     }
@@ -1987,10 +2059,10 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)CDATASectionState
 {
-    [self switchToState:HTMLDataTokenizerState];
+    _state = HTMLDataTokenizerState;
     NSInteger squareBracketsSeen = 0;
     for (;;) {
-        UTF32Char c = [self consumeNextInputCharacter];
+        UTF32Char c = HTMLConsumeNextInputCharacter(_inputStream);
         if (c == ']' && squareBracketsSeen < 2) {
             squareBracketsSeen++;
         } else if (c == ']' && squareBracketsSeen == 2) {
@@ -2013,7 +2085,8 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)resume
 {
-    switch (self.state) {
+    HTMLCountStatistic(_stateVisits[_state]++);
+    switch (_state) {
         case HTMLDataTokenizerState:
             return [self dataState];
         case HTMLCharacterReferenceInDataTokenizerState:
@@ -2156,21 +2229,11 @@ static inline BOOL is_lower(NSInteger c)
     }
 }
 
-- (UTF32Char)consumeNextInputCharacter
-{
-    return [_inputStream consumeNextInputCharacter];
-}
-
 - (NSString *)consumeCharactersUpToFirstPassingTest:(BOOL(^)(UTF32Char c))test
 {
     return [_inputStream consumeCharactersUpToFirstPassingTest:test];
 }
 
-- (void)switchToState:(HTMLTokenizerState)state
-{
-    self.state = state;
-}
-
 - (void)reconsume:(UTF32Char)character
 {
     [_inputStream reconsumeCurrentInputCharacter];
@@ -2192,6 +2255,19 @@ static inline BOOL is_lower(NSInteger c)
 
 - (void)emitCore:(id)token
 {
+#if HTMLREADER_COLLECT_STATISTICS
+    if ([token isKindOfClass:[HTMLCharacterToken class]]) {
+        _characterTokenCount++;
+    } else if ([token isKindOfClass:[HTMLStartTagToken class]]) {
+        _startTagTokenCount++;
+    } else if ([token isKindOfClass:[HTMLEndTagToken class]]) {
+        _endTagTokenCount++;
+    } else if ([token isKindOfClass:[HTMLCommentToken class]]) {
+        _commentTokenCount++;
+    } else if ([token isKindOfClass:[HTMLDOCTYPEToken class]]) {
+        _DOCTYPETokenCount++;
+    }
+#endif
     [_tokenQueue addObject:token];
 }
 
@@ -2229,16 +2305,90 @@ static inline BOOL is_lower(NSInteger c)
             [token.tagName isEqualToString:_mostRecentEmittedStartTagName]);
 }
 
+- (void)deferCurrentAttributeValueFromLocation:(NSUInteger)location
+{
+    _currentAttributeValue = nil;
+    _deferredAttributeValueRange = NSMakeRange(location, 0);
+    _deferredAttributeValueNeedsPreprocessing = NO;
+}
+
+- (void)startCurrentAttributeValue
+{
+    [_attributeValueBuffer setString:@""];
+    _currentAttributeValue = _attributeValueBuffer;
+}
+
+- (void)stopDeferringCurrentAttributeValue
+{
+    if (_currentAttributeValue) return;
+    
+    [self startCurrentAttributeValue];
+    if (_deferredAttributeValueRange.length > 0) {
+        HTMLDeferredString *deferred = [[HTMLDeferredString alloc] initWithSource:_inputStream.string range:_deferredAttributeValueRange preprocess:_deferredAttributeValueNeedsPreprocessing];
+        [_currentAttributeValue appendString:deferred.string];
+    }
+    _deferredAttributeValueRange = NSMakeRange(NSNotFound, 0);
+}
+
+- (void)consumeAttributeValueCharactersUpToFirstPassingTest:(BOOL(^)(UTF32Char c))test
+{
+    if (!_currentAttributeValue && _inputStream->_reconsume) {
+        [self stopDeferringCurrentAttributeValue];
+    }
+    
+    if (_currentAttributeValue) {
+        NSString *string = [self consumeCharactersUpToFirstPassingTest:test] ?: @"";
+        [_currentAttributeValue appendString:StringByReplacingNullCharacters(string, @"\uFFFD")];
+        return;
+    }
+    
+    __block BOOL sawNull = NO;
+    BOOL preprocessed;
+    NSRange range = [_inputStream skipCharactersUpToFirstPassingTest:^BOOL(UTF32Char c) {
+        if (c == '\0') {
+            sawNull = YES;
+        }
+        return test(c);
+    } preprocessed:&preprocessed];
+    NSAssert(NSMaxRange(_deferredAttributeValueRange) == range.location, @"deferred attribute value must be contiguous");
+    _deferredAttributeValueRange.length += range.length;
+    if (sawNull || preprocessed) {
+        _deferredAttributeValueNeedsPreprocessing = YES;
+    }
+}
+
 - (void)addCurrentAttributeToCurrentToken
 {
     HTMLTagToken *token = _currentToken;
     if ([token.attributes objectForKey:_currentAttributeName]) {
         [self emitParseError:@"Duplicate attribute"];
+    } else if (_maximumAttributesPerTag > 0 && token.attributes.count >= _maximumAttributesPerTag) {
+        _droppedAttributes = YES;
     } else {
-        [token.attributes setObject:(_currentAttributeValue ?: @"") forKey:_currentAttributeName];
+        // The value buffer gets reused for the next attribute.
+        id value = [_currentAttributeValue copy];
+        if (!value && _deferredAttributeValueRange.length > 0) {
+            value = [[HTMLDeferredString alloc] initWithSource:_inputStream.string range:_deferredAttributeValueRange preprocess:_deferredAttributeValueNeedsPreprocessing];
+        }
+        NSString *name = _currentAttributeName;
+        HTMLStringPool *pool = _stringPool;
+        if (pool) {
+            token.attributes.searchesKeysByPointer = YES;
+            name = [pool internString:name];
+            
+            // A short value costs little to build now, and often turns out to be one we've seen before.
+            if ([value isKindOfClass:[HTMLDeferredString class]]) {
+                if (_deferredAttributeValueRange.length <= pool.maximumValueLength) {
+                    value = [pool internString:((HTMLDeferredString *)value).string];
+                }
+            } else if (value && [(NSString *)value length] <= pool.maximumValueLength) {
+                value = [pool internString:value];
+            }
+        }
+        [token.attributes setObject:(value ?: @"") forKey:name];
     }
-    _currentAttributeName = nil;
     _currentAttributeValue = nil;
+    _deferredAttributeValueRange = NSMakeRange(NSNotFound, 0);
 }
 
 - (NSString *)attemptToConsumeCharacterReference
@@ -2267,6 +2417,7 @@ static inline BOOL is_lower(NSInteger c)
         case EOF:
             return nil;
         case '#': {
+            HTMLCountStatistic(_numericCharacterReferenceCount++);
             [_inputStream consumeNextInputCharacter];
             BOOL hex = [_inputStream consumeString:@"X" matchingCase:NO];
             unsigned int number;
@@ -2302,13 +2453,18 @@ static inline BOOL is_lower(NSInteger c)
             return StringWithLongCharacter(number);
         }
         default: {
+            HTMLCountStatistic(_namedCharacterReferenceCount++);
             NSString *substring = [_inputStream nextUnprocessedCharactersWithMaximumLength:LongestEntityNameLength];
             NSString *parsedName;
             NSString *replacement = StringForNamedEntity(substring, &parsedName);
             if (!replacement) {
-                NSScanner *scanner = [_inputStream unprocessedScanner];
                 NSCharacterSet *alphanumeric = [NSCharacterSet alphanumericCharacterSet];
-                if ([scanner scanCharactersFromSet:alphanumeric intoString:nil] && [scanner scanString:@";" intoString:nil]) {
+                NSUInteger offset = 0;
+                UTF32Char c;
+                while ((c = [_inputStream unprocessedCharacterAtOffset:offset]) != (UTF32Char)EOF && [alphanumeric characterIsMember:(unichar)c]) {
+                    offset++;
+                }
+                if (offset > 0 && c == ';') {
                     [self emitParseError:@"Unknown named entity with semicolon"];
                 }
                 return nil;
@@ -2345,6 +2501,47 @@ static inline BOOL is_lower(NSInteger c)
     return token;
 }
 
+#if HTMLREADER_COLLECT_STATISTICS
+- (NSDictionary *)statistics
+{
+    static NSString * const StateNames[] = {
+        @"Data", @"CharacterReferenceInData", @"RCDATA", @"CharacterReferenceInRCDATA",
+        @"RAWTEXT", @"ScriptData", @"PLAINTEXT", @"TagOpen",
+        @"EndTagOpen", @"TagName", @"RCDATALessThanSign", @"RCDATAEndTagOpen",
+        @"RCDATAEndTagName", @"RAWTEXTLessThanSign", @"RAWTEXTEndTagOpen", @"RAWTEXTEndTagName",
+        @"ScriptDataLessThanSign", @"ScriptDataEndTagOpen", @"ScriptDataEndTagName", @"ScriptDataEscapeStart",
+        @"ScriptDataEscapeStartDash", @"ScriptDataEscaped", @"ScriptDataEscapedDash", @"ScriptDataEscapedDashDash",
+        @"ScriptDataEscapedLessThanSign", @"ScriptDataEscapedEndTagOpen", @"ScriptDataEscapedEndTagName", @"ScriptDataDoubleEscapeStart",
+        @"ScriptDataDoubleEscaped", @"ScriptDataDoubleEscapedDash", @"ScriptDataDoubleEscapedDashDash", @"ScriptDataDoubleEscapedLessThanSign",
+        @"ScriptDataDoubleEscapeEnd", @"BeforeAttributeName", @"AttributeName", @"AfterAttributeName",
+        @"BeforeAttributeValue", @"AttributeValueDoubleQuoted", @"AttributeValueSingleQuoted", @"AttributeValueUnquoted",
+        @"CharacterReferenceInAttributeValue", @"AfterAttributeValueQuoted", @"SelfClosingStartTag", @"BogusComment",
+        @"MarkupDeclarationOpen", @"CommentStart", @"CommentStartDash", @"Comment",
+        @"CommentEndDash", @"CommentEnd", @"CommentEndBang", @"DOCTYPE",
+        @"BeforeDOCTYPEName", @"DOCTYPEName", @"AfterDOCTYPEName", @"AfterDOCTYPEPublicKeyword",
+        @"BeforeDOCTYPEPublicIdentifier", @"DOCTYPEPublicIdentifierDoubleQuoted", @"DOCTYPEPublicIdentifierSingleQuoted", @"AfterDOCTYPEPublicIdentifier",
+        @"BetweenDOCTYPEPublicAndSystemIdentifiers", @"AfterDOCTYPESystemKeyword", @"BeforeDOCTYPESystemIdentifier", @"DOCTYPESystemIdentifierDoubleQuoted",
+        @"DOCTYPESystemIdentifierSingleQuoted", @"AfterDOCTYPESystemIdentifier", @"BogusDOCTYPE", @"CDATASection",
+    };
+    _Static_assert(sizeof(StateNames) / sizeof(StateNames[0]) == HTMLCDATASectionTokenizerState + 1, "every tokenizer state needs a name");
+    
+    NSMutableDictionary *stateVisits = [NSMutableDictionary new];
+    for (NSUInteger i = 0; i < sizeof(StateNames) / sizeof(StateNames[0]); i++) {
+        if (_stateVisits[i] > 0) {
+            stateVisits[StateNames[i]] = @(_stateVisits[i]);
+        }
+    }
+    return @{ @"tokens": @{ @"character": @(_characterTokenCount),
+                            @"comment": @(_commentTokenCount),
+                            @"DOCTYPE": @(_DOCTYPETokenCount),
+                            @"startTag": @(_startTagTokenCount),
+                            @"endTag": @(_endTagTokenCount) },
+              @"tokenizerStateVisits": stateVisits,
+              @"namedCharacterReferences": @(_namedCharacterReferenceCount),
+              @"numericCharacterReferences": @(_numericCharacterReferenceCount) };
+}
+#endif
+
 #pragma mark NSObject
 
 - (instancetype)init
@@ -0,0 +1,117 @@
+//  HTMLTraversal.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLTraversal.h"
+#import "HTMLComment.h"
+#import "HTMLElement.h"
+#import "HTMLNode+Private.h"
+#import "HTMLTextNode.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+static BOOL IsReported(HTMLNode *node, HTMLTraversalNodeTypes types)
+{
+    if (types == HTMLTraversalAllNodes) {
+        return YES;
+    } else if ([node isKindOfClass:[HTMLElement class]]) {
+        return (types & HTMLTraversalElements) != 0;
+    } else if ([node isKindOfClass:[HTMLTextNode class]]) {
+        return (types & HTMLTraversalTextNodes) != 0;
+    } else if ([node isKindOfClass:[HTMLComment class]]) {
+        return (types & HTMLTraversalComments) != 0;
+    } else {
+        return (types & HTMLTraversalOtherNodes) != 0;
+    }
+}
+
+// Nodes hold on to their children and nothing gets removed mid-traversal, so nothing here needs retaining.
+typedef struct {
+    __unsafe_unretained HTMLNode *node;
+    __unsafe_unretained NSOrderedSet *children;
+    NSUInteger index;
+    NSUInteger count;
+    BOOL reported;
+} Level;
+
+BOOL HTMLTraverseTree(HTMLNode *root, HTMLTraversalNodeTypes types, HTMLTraversalFunction __nullable enter, HTMLTraversalFunction __nullable leave, void * __nullable context)
+{
+    NSCParameterAssert(root);
+    
+    Level *stack = NULL;
+    NSUInteger depth = 0, capacity = 0;
+    BOOL stopped = NO;
+    HTMLNode *node = root;
+    while (node) {
+        BOOL reported = IsReported(node, types);
+        HTMLTraversalAction action = reported && enter ? enter(node, context) : HTMLTraversalContinue;
+        if (action == HTMLTraversalStop) {
+            stopped = YES;
+            break;
+        }
+        
+        NSOrderedSet *children = action == HTMLTraversalSkipChildren ? nil : ChildrenOfNode(node);
+        NSUInteger count = children.count;
+        if (count > 0) {
+            if (depth == capacity) {
+                capacity = capacity * 2 + 16;
+                stack = reallocf(stack, sizeof(stack[0]) * capacity);
+            }
+            stack[depth++] = (Level){ .node = node, .children = children, .index = 0, .count = count, .reported = reported };
+            node = [children objectAtIndex:0];
+            continue;
+        }
+        
+        if (reported && leave && leave(node, context) == HTMLTraversalStop) {
+            stopped = YES;
+            break;
+        }
+        
+        // Move on to the next sibling, leaving any parents that are out of children.
+        node = nil;
+        while (depth > 0) {
+            Level *level = stack + depth - 1;
+            if (++level->index < level->count) {
+                node = [level->children objectAtIndex:level->index];
+                break;
+            }
+            depth--;
+            if (level->reported && leave && leave(level->node, context) == HTMLTraversalStop) {
+                stopped = YES;
+                break;
+            }
+        }
+        if (stopped) {
+            break;
+        }
+    }
+    free(stack);
+    return !stopped;
+}
+
+typedef struct {
+    __unsafe_unretained HTMLTraversalAction (^enter)(HTMLNode *node);
+    __unsafe_unretained HTMLTraversalAction (^leave)(HTMLNode *node);
+} Blocks;
+
+static HTMLTraversalAction EnterBlock(HTMLNode *node, void *context)
+{
+    return ((Blocks *)context)->enter(node);
+}
+
+static HTMLTraversalAction LeaveBlock(HTMLNode *node, void *context)
+{
+    return ((Blocks *)context)->leave(node);
+}
+
+@implementation HTMLNode (HTMLTraversal)
+
+- (BOOL)traverseNodesOfTypes:(HTMLTraversalNodeTypes)types enter:(HTMLTraversalAction (^ __nullable)(HTMLNode *node))enter leave:(HTMLTraversalAction (^ __nullable)(HTMLNode *node))leave
+{
+    Blocks blocks = { .enter = enter, .leave = leave };
+    return HTMLTraverseTree(self, types, enter ? EnterBlock : NULL, leave ? LeaveBlock : NULL, &blocks);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,205 @@
+//  HTMLTreeDiff.m
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLTreeDiff.h"
+#import "HTMLElement.h"
+#import "HTMLNode+Private.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface HTMLTreeChange ()
+
+- (instancetype)initWithType:(HTMLTreeChangeType)type oldNode:(HTMLNode * __nullable)oldNode updatedNode:(HTMLNode * __nullable)updatedNode NS_DESIGNATED_INITIALIZER;
+
+@end
+
+@implementation HTMLTreeChange
+
+- (instancetype)initWithType:(HTMLTreeChangeType)type oldNode:(HTMLNode * __nullable)oldNode updatedNode:(HTMLNode * __nullable)updatedNode
+{
+    if ((self = [super init])) {
+        _type = type;
+        _oldNode = oldNode;
+        _updatedNode = updatedNode;
+    }
+    return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-pragmas"
+#pragma clang diagnostic ignored "-Wobjc-designated-initializers"
+- (instancetype)init
+{
+    NSAssert(NO, @"send -initWithType:oldNode:updatedNode:");
+    return nil;
+}
+#pragma clang diagnostic pop
+
+- (NSString *)description
+{
+    NSString *type = @[ @"insertion", @"removal", @"modification" ][(NSUInteger)_type];
+    return [NSString stringWithFormat:@"<%@: %p %@ %@ -> %@>", self.class, self, type, _oldNode, _updatedNode];
+}
+
+@end
+
+// Whether two nodes are "the same node" in the sense that one could have been edited into the other without replacing it.
+static BOOL NodesCorrespond(HTMLNode *a, HTMLNode *b)
+{
+    if ([a class] != [b class]) {
+        return NO;
+    }
+    if ([a isKindOfClass:[HTMLElement class]]) {
+        HTMLElement *elementA = (HTMLElement *)a, *elementB = (HTMLElement *)b;
+        return elementA.htmlNamespace == elementB.htmlNamespace && [elementA.tagName isEqualToString:elementB.tagName];
+    }
+    return YES;
+}
+
+static void AddChange(NSMutableArray *changes, HTMLTreeChangeType type, HTMLNode * __nullable oldNode, HTMLNode * __nullable updatedNode)
+{
+    [changes addObject:[[HTMLTreeChange alloc] initWithType:type oldNode:oldNode updatedNode:updatedNode]];
+}
+
+// How far ahead to look for a corresponding child before giving up and calling a child removed. Keeps unmatched runs from taking quadratic time.
+static const NSUInteger CorrespondenceLookahead = 32;
+
+// Children that didn't match exactly are paired with the next corresponding child (if one is nearby) to be diffed later; anything left over was removed or inserted.
+static void DiffUnmatchedChildren(HTMLNode *oldNode, NSRange oldRange, HTMLNode *updatedNode, NSRange updatedRange, NSMutableArray *steps)
+{
+    NSUInteger j = updatedRange.location, updatedEnd = NSMaxRange(updatedRange);
+    for (NSUInteger i = oldRange.location; i < NSMaxRange(oldRange); i++) {
+        HTMLNode *oldChild = [oldNode childAtIndex:i];
+        NSUInteger match = NSNotFound;
+        for (NSUInteger k = j; k < updatedEnd && k - j < CorrespondenceLookahead; k++) {
+            if (NodesCorrespond(oldChild, [updatedNode childAtIndex:k])) {
+                match = k;
+                break;
+            }
+        }
+        if (match == NSNotFound) {
+            AddChange(steps, HTMLTreeChangeRemoval, oldChild, nil);
+            continue;
+        }
+        for (; j < match; j++) {
+            AddChange(steps, HTMLTreeChangeInsertion, nil, [updatedNode childAtIndex:j]);
+        }
+        AddChange(steps, HTMLTreeChangeModification, oldChild, [updatedNode childAtIndex:j++]);
+    }
+    for (; j < updatedEnd; j++) {
+        AddChange(steps, HTMLTreeChangeInsertion, nil, [updatedNode childAtIndex:j]);
+    }
+}
+
+// Past this many cells, the longest common subsequence table takes too much memory and time, so we skip straight to pairing up corresponding children.
+static const NSUInteger MaximumLCSTableSize = 1 << 20;
+
+// Adds the steps that turn oldNode's children into updatedNode's children. Insertions and removals are final; modifications pair up corresponding children that have yet to be compared.
+static void DiffChildren(HTMLNode *oldNode, HTMLNode *updatedNode, NSMutableArray *steps)
+{
+    NSUInteger oldCount = oldNode.numberOfChildren, updatedCount = updatedNode.numberOfChildren;
+    uint64_t *oldHashes = malloc(sizeof(uint64_t) * (oldCount + updatedCount));
+    uint64_t *updatedHashes = oldHashes + oldCount;
+    for (NSUInteger i = 0; i < oldCount; i++) {
+        oldHashes[i] = [oldNode childAtIndex:i].subtreeHash;
+    }
+    for (NSUInteger j = 0; j < updatedCount; j++) {
+        updatedHashes[j] = [updatedNode childAtIndex:j].subtreeHash;
+    }
+    
+    // Most edits leave a shared prefix and suffix, which need no further attention.
+    NSUInteger prefix = 0;
+    while (prefix < oldCount && prefix < updatedCount && oldHashes[prefix] == updatedHashes[prefix]) {
+        prefix++;
+    }
+    NSUInteger suffix = 0;
+    while (suffix < oldCount - prefix && suffix < updatedCount - prefix && oldHashes[oldCount - 1 - suffix] == updatedHashes[updatedCount - 1 - suffix]) {
+        suffix++;
+    }
+    NSUInteger n = oldCount - prefix - suffix, m = updatedCount - prefix - suffix;
+    
+    if (n == 0 || m == 0 || (n + 1) * (m + 1) > MaximumLCSTableSize) {
+        DiffUnmatchedChildren(oldNode, NSMakeRange(prefix, n), updatedNode, NSMakeRange(prefix, m), steps);
+        free(oldHashes);
+        return;
+    }
+    
+    // lengths[i][j] is the length of the longest common subsequence of the middle children from i and j onward.
+    const uint64_t *a = oldHashes + prefix, *b = updatedHashes + prefix;
+    uint32_t *lengths = calloc((n + 1) * (m + 1), sizeof(uint32_t));
+    #define LENGTH(i, j) lengths[(i) * (m + 1) + (j)]
+    for (NSUInteger i = n; i-- > 0; ) {
+        for (NSUInteger j = m; j-- > 0; ) {
+            if (a[i] == b[j]) {
+                LENGTH(i, j) = LENGTH(i + 1, j + 1) + 1;
+            } else {
+                LENGTH(i, j) = MAX(LENGTH(i + 1, j), LENGTH(i, j + 1));
+            }
+        }
+    }
+    
+    // Walk the table, diffing whatever lies between consecutive exact matches.
+    NSUInteger i = 0, j = 0, gapI = 0, gapJ = 0;
+    while (i < n && j < m) {
+        if (a[i] == b[j]) {
+            DiffUnmatchedChildren(oldNode, NSMakeRange(prefix + gapI, i - gapI), updatedNode, NSMakeRange(prefix + gapJ, j - gapJ), steps);
+            gapI = ++i;
+            gapJ = ++j;
+        } else if (LENGTH(i + 1, j) >= LENGTH(i, j + 1)) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    #undef LENGTH
+    DiffUnmatchedChildren(oldNode, NSMakeRange(prefix + gapI, n - gapI), updatedNode, NSMakeRange(prefix + gapJ, m - gapJ), steps);
+    
+    free(lengths);
+    free(oldHashes);
+}
+
+@implementation HTMLNode (HTMLTreeDiff)
+
+- (HTMLArrayOf(HTMLTreeChange *) *)changesToNode:(HTMLNode *)updatedNode
+{
+    NSParameterAssert(updatedNode);
+    
+    NSMutableArray *changes = [NSMutableArray new];
+    if (!NodesCorrespond(self, updatedNode)) {
+        AddChange(changes, HTMLTreeChangeRemoval, self, nil);
+        AddChange(changes, HTMLTreeChangeInsertion, nil, updatedNode);
+        return changes;
+    }
+    
+    // Each level's remaining steps wait on an explicit stack while a pair of corresponding children gets compared, so a deep tree can't overflow the call stack. Changes still come out in tree order.
+    NSMutableArray *pending = [NSMutableArray new];
+    AddChange(pending, HTMLTreeChangeModification, self, updatedNode);
+    NSMutableArray *stack = [NSMutableArray arrayWithObject:pending.objectEnumerator];
+    while (stack.count > 0) {
+        HTMLTreeChange *step = [stack.lastObject nextObject];
+        if (!step) {
+            [stack removeLastObject];
+            continue;
+        }
+        if (step.type != HTMLTreeChangeModification) {
+            [changes addObject:step];
+            continue;
+        }
+        HTMLNode *oldPair = step.oldNode, *updatedPair = step.updatedNode;
+        if (oldPair.subtreeHash == updatedPair.subtreeHash) {
+            continue;
+        }
+        if (oldPair.contentHash != updatedPair.contentHash) {
+            [changes addObject:step];
+        }
+        NSMutableArray *steps = [NSMutableArray new];
+        DiffChildren(oldPair, updatedPair, steps);
+        [stack addObject:steps.objectEnumerator];
+    }
+    return changes;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -15,4 +15,15 @@ NS_ASSUME_NONNULL_BEGIN
 
 @end
 
+/**
+    Calls a block once for each node in the subtree rooted at node, spreading the calls across multiple threads.
+ 
+    The subtree is divided at subtree boundaries into pieces that are then visited concurrently. Nothing may mutate the subtree until this function returns. A subtree that isn't frozen is visited on the calling thread instead, as unfrozen nodes can't be read from more than one thread at once.
+ 
+    @param block Called once for each node, possibly from any thread and concurrently with other calls. Returns an object to collect or nil to collect nothing.
+ 
+    @return The objects returned by the block, in the tree order of the nodes that produced them.
+ */
+extern NSArray * ConcurrentlyMapTree(HTMLNode *node, id __nullable (^block)(HTMLNode *node));
+
 NS_ASSUME_NONNULL_END
@@ -101,4 +101,128 @@ typedef struct {
 
 @end
 
+// A piece of a partitioned tree is either a lone node or the whole subtree rooted at a node.
+typedef struct {
+    __unsafe_unretained HTMLNode *node;
+    BOOL wholeSubtree;
+} Piece;
+
+typedef struct {
+    Piece *pieces;
+    NSUInteger count;
+    NSUInteger capacity;
+} PieceList;
+
+static void AppendPiece(PieceList *list, HTMLNode *node, BOOL wholeSubtree)
+{
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity * 2 + 16;
+        list->pieces = reallocf(list->pieces, sizeof(list->pieces[0]) * list->capacity);
+    }
+    list->pieces[list->count++] = (Piece){ .node = node, .wholeSubtree = wholeSubtree };
+}
+
+// Splits subtrees one level at a time until there are enough of them to keep every processor busy. Without knowing subtree sizes in advance (finding out would take a full traversal), a few pieces per processor gives dispatch_apply room to even out lopsided subtrees. Splitting stops after a fixed number of levels so a long chain of only children doesn't get split node by node.
+static PieceList PartitionTree(HTMLNode *root, NSUInteger desiredSubtrees)
+{
+    const NSUInteger MaximumLevels = 32;
+    PieceList list = {0};
+    AppendPiece(&list, root, YES);
+    NSUInteger subtreeCount = 1;
+    for (NSUInteger level = 0; subtreeCount < desiredSubtrees && level < MaximumLevels; level++) {
+        PieceList next = {0};
+        NSUInteger nextSubtreeCount = 0;
+        BOOL didSplit = NO;
+        for (NSUInteger i = 0; i < list.count; i++) {
+            Piece piece = list.pieces[i];
+            NSUInteger numberOfChildren = piece.wholeSubtree ? piece.node.numberOfChildren : 0;
+            if (numberOfChildren > 0) {
+                didSplit = YES;
+                AppendPiece(&next, piece.node, NO);
+                for (NSUInteger j = 0; j < numberOfChildren; j++) {
+                    AppendPiece(&next, [piece.node childAtIndex:j], YES);
+                }
+                nextSubtreeCount += numberOfChildren;
+            } else {
+                AppendPiece(&next, piece.node, piece.wholeSubtree);
+                if (piece.wholeSubtree) {
+                    nextSubtreeCount++;
+                }
+            }
+        }
+        free(list.pieces);
+        list = next;
+        subtreeCount = nextSubtreeCount;
+        if (!didSplit) {
+            break;
+        }
+    }
+    return list;
+}
+
+NSArray * ConcurrentlyMapTree(HTMLNode *node, id __nullable (^block)(HTMLNode *node))
+{
+    NSCParameterAssert(node);
+    NSCParameterAssert(block);
+    
+    // Unfrozen nodes fetch lazy children (as in a copy of a frozen document) and resolve attributes on first access, neither of which is safe from more than one thread. So only frozen trees get split up.
+    if (!node.isFrozen) {
+        NSMutableArray *results = [NSMutableArray new];
+        for (HTMLNode *descendant in [[HTMLTreeEnumerator alloc] initWithNode:node reversed:NO]) {
+            id result = block(descendant);
+            if (result) {
+                [results addObject:result];
+            }
+        }
+        return results;
+    }
+    
+    NSUInteger processorCount = [NSProcessInfo processInfo].activeProcessorCount;
+    PieceList list = PartitionTree(node, processorCount * 4);
+    
+    // Each chunk is a run of consecutive pieces with its own results array, so no locking is needed and concatenating the arrays restores tree order.
+    NSUInteger chunkCount = MIN(list.count, processorCount * 16);
+    NSMutableArray *chunkResults = [NSMutableArray arrayWithCapacity:chunkCount];
+    for (NSUInteger i = 0; i < chunkCount; i++) {
+        [chunkResults addObject:[NSMutableArray new]];
+    }
+    
+    dispatch_apply(chunkCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t chunk) { @autoreleasepool {
+        NSMutableArray *results = chunkResults[chunk];
+        NSUInteger start = list.count * chunk / chunkCount;
+        NSUInteger end = list.count * (chunk + 1) / chunkCount;
+        for (NSUInteger i = start; i < end; i++) {
+            Piece piece = list.pieces[i];
+            if (piece.wholeSubtree) {
+                HTMLTreeEnumerator *enumerator = [[HTMLTreeEnumerator alloc] initWithNode:piece.node reversed:NO];
+                for (HTMLNode *descendant in enumerator) {
+                    id result = block(descendant);
+                    if (result) {
+                        [results addObject:result];
+                    }
+                }
+            } else {
+                id result = block(piece.node);
+                if (result) {
+                    [results addObject:result];
+                }
+            }
+        }
+    }});
+    free(list.pieces);
+    
+    if (chunkCount == 1) {
+        return chunkResults[0];
+    }
+    NSUInteger total = 0;
+    for (NSArray *results in chunkResults) {
+        total += results.count;
+    }
+    NSMutableArray *merged = [NSMutableArray arrayWithCapacity:total];
+    for (NSArray *results in chunkResults) {
+        [merged addObjectsFromArray:results];
+    }
+    return merged;
+}
+
 NS_ASSUME_NONNULL_END
@@ -5,6 +5,7 @@
 #import "HTMLDocumentType.h"
 #import "HTMLElement.h"
 #import "HTMLNode.h"
+#import "HTMLParserOptions.h"
 #import "HTMLQuirksMode.h"
 #import "HTMLSupport.h"
 
@@ -31,9 +32,24 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (instancetype)initWithData:(NSData *)data contentTypeHeader:(NSString * __nullable)contentType;
 
+/**
+    Parses data of an unknown string encoding into an HTML document.
+ 
+    @param contentType The value of the HTTP Content-Type header, if present.
+    @param options     Limits and other options for parsing, or nil for the defaults.
+ */
++ (instancetype)documentWithData:(NSData *)data contentTypeHeader:(NSString * __nullable)contentType options:(HTMLParserOptions * __nullable)options;
+
 /// Parses an HTML string into a document.
 + (instancetype)documentWithString:(NSString *)string;
 
+/**
+    Parses an HTML string into a document.
+ 
+    @param options Limits and other options for parsing, or nil for the defaults.
+ */
++ (instancetype)documentWithString:(NSString *)string options:(HTMLParserOptions * __nullable)options;
+
 /// Initializes a document with a string of HTML.
 - (instancetype)initWithString:(NSString *)string;
 
@@ -47,6 +63,27 @@ NS_ASSUME_NONNULL_BEGIN
 /// The string encoding used to parse the document. Defaults to `NSUTF8StringEncoding` (e.g. if the document was created programmatically).
 @property (readonly, nonatomic) NSStringEncoding parsedStringEncoding;
 
+/**
+    Counts of what the parser did while building the document, for working out why a page was slow to parse. nil unless HTMLReader was built with HTMLREADER_COLLECT_STATISTICS defined to 1, or if the document wasn't parsed.
+ 
+    Values are NSNumber unless noted, under the keys:
+ 
+    * tokens: A dictionary of emitted token counts under the keys character, comment, DOCTYPE, startTag, and endTag.
+    * tokenizerStateVisits: A dictionary of how many times each tokenizer state ran, keyed by the state's name (e.g. "AttributeValueDoubleQuoted"). Unvisited states are omitted.
+    * namedCharacterReferences, numericCharacterReferences: Character references the tokenizer looked up.
+    * adoptionAgencyRuns: Times the adoption agency algorithm ran to fix misnested formatting elements.
+    * activeFormattingElementReconstructions: Times formatting elements were recreated after being implicitly closed.
+    * fosterParentedInsertions: Nodes inserted outside of a table they appeared in.
+    * insertionModeResets: Times the parser had to work out its insertion mode from the stack of open elements.
+    * maximumStackDepth: The most elements open at once.
+    * parseErrors: Parse errors encountered.
+    * encodingRestarts: 1 if parsing started over after finding a different string encoding, otherwise 0.
+ */
+@property (readonly, copy, nonatomic) HTMLDictOf(NSString *, id) * __nullable parserStatistics;
+
+/// The parser limits that were exceeded while parsing the document, meaning the document may be missing some input or differ from what a browser would build. See HTMLParserOptions.
+@property (readonly, assign, nonatomic) HTMLParserLimit exceededParserLimits;
+
 /// The document's quirks mode.
 @property (assign, nonatomic) HTMLQuirksMode quirksMode;
 
@@ -62,6 +99,37 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (readonly, nonatomic) HTMLElement * __nullable bodyElement;
 
+/**
+    A number that goes up whenever anything in the document changes: a node is added or removed, an attribute changes, or text or comment data changes. If two reads give the same value, nothing changed in between.
+ 
+    Changes to nodes that aren't (yet) part of the document don't count.
+ */
+@property (readonly, assign, nonatomic) NSUInteger mutationVersion;
+
+/**
+    How much selector query results the document remembers, counted in matched elements (a query that matched nothing counts as one). Defaults to 0, which remembers nothing.
+ 
+    While the query cache is on, sending the same selector to the same node (the document or any node in it) returns the earlier result until the document's mutationVersion changes. The least recently used results are forgotten first when the cache is full. Turn it on for documents that see many more queries than changes.
+ 
+    Lowering the capacity forgets results as needed. Setting it to 0 forgets everything, including the hit and miss counts, and turns the cache off. Set the capacity before sharing the document between threads.
+ */
+@property (assign, nonatomic) NSUInteger queryCacheCapacity;
+
+/// The number of selector queries answered by the query cache.
+@property (readonly, assign, nonatomic) NSUInteger queryCacheHitCount;
+
+/// The number of selector queries that the query cache had to pass along to be run.
+@property (readonly, assign, nonatomic) NSUInteger queryCacheMissCount;
+
+/**
+    Converts the document and every node in it to a compact, immutable form, releasing memory that was only useful while the document could change.
+ 
+    Once frozen, a document and its nodes can be read from any number of threads at once (including by selectors, textContent, and serialization) without further synchronization. Any attempt to change a frozen node throws an NSInternalInconsistencyException. Copies of frozen nodes are not frozen.
+ 
+    Freezing an already-frozen document does nothing.
+ */
+- (void)freeze;
+
 @end
 
 NS_ASSUME_NONNULL_END
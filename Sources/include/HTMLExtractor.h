@@ -0,0 +1,45 @@
+//  HTMLExtractor.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLElement.h"
+#import "HTMLParserOptions.h"
+#import "HTMLSelector.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+    An HTMLExtractor parses HTML looking only for elements matched by some selectors. It keeps their subtrees and throws away everything else as it goes.
+ 
+    Each element is matched as soon as the parser is done with it. Its contents are kept only if it or one of its ancestors is matched. The rest of the document is still tokenized and built, so the matches are the same as for a whole document. But unmatched elements are cut down to stubs: a tag name and attributes with no contents. A stub stays around only while later siblings might need it for combinators and structural pseudo-classes. Memory use follows the size of the matched content, not the size of the document. (Elements inside misnested formatting tags, which the parser may yet move, and elements before any content that rules out a frameset, wait until an ancestor is done.)
+ 
+    There is one way the matches can differ from a whole document's. A stray `<html>` or `<body>` start tag partway through adds its attributes to the root or body element, and elements matched before then don't see them. For example, `body.x p` on `<p>a</p><p>b</p><body class=x>` matches only the second paragraph.
+ 
+    Whether an element matches `:last-child`, `:only-child`, `:last-of-type`, `:only-of-type`, `:nth-last-child`, or `:nth-last-of-type` depends on siblings that come after it. When any selector uses one of those, the whole document is built and matched once parsing is done.
+ 
+    Matched elements can have stubs for ancestors and siblings, so treat each one as the root of its own subtree.
+ */
+@interface HTMLExtractor : NSObject
+
+/// Initializes an extractor. Throws an NSInvalidArgumentException if any selector could not be parsed.
+- (instancetype)initWithSelectors:(HTMLArrayOf(HTMLSelector *) *)selectors NS_DESIGNATED_INITIALIZER;
+
+/// The selectors to look for.
+@property (readonly, copy, nonatomic) HTMLArrayOf(HTMLSelector *) *selectors;
+
+/// Limits and other options for parsing, or nil for the defaults. The stopTest still applies. createsNodesOnDemand is ignored.
+@property (copy, nonatomic) HTMLParserOptions * __nullable options;
+
+/**
+    Parses a string of HTML and calls a block with each element that any of the selectors match.
+ 
+    @param block Called once per matching selector for each matched element. Elements come in the order the parser finishes them, so descendants come before their ancestors. Set `*stop` to YES to stop parsing. Keep the element if you like, but don't move it until parsing is done.
+ */
+- (void)extractFromString:(NSString *)string usingBlock:(void (^)(HTMLElement *element, NSUInteger selectorIndex, BOOL *stop))block;
+
+/// Parses a string of HTML and returns one array per selector of the elements it matched, in the order the parser finished them.
+- (HTMLArrayOf(HTMLArrayOf(HTMLElement *) *) *)elementsMatchedInString:(NSString *)string;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,50 @@
+//  HTMLFragmentParser.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLDocument.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+    An HTMLFragmentParser parses snippets of HTML as though each were the contents of a context element, the way a browser sets innerHTML.
+ 
+    A fragment parser reuses the same parsing machinery for every snippet and moves the parsed nodes into place all at once, so parsing many small snippets with one fragment parser is much cheaper than parsing each on its own. Fragment parsers are not thread-safe.
+ 
+    For more information, see http://www.whatwg.org/specs/web-apps/current-work/multipage/the-end.html#parsing-html-fragments
+ */
+@interface HTMLFragmentParser : NSObject
+
+/**
+    Initializes a fragment parser.
+ 
+    @param contextElement The element whose contents are being parsed. Its tag name and namespace affect how snippets are parsed (e.g. snippets for a `<title>` are just text), and a `<form>` among it and its ancestors becomes the snippets' form owner.
+ */
+- (instancetype)initWithContextElement:(HTMLElement *)contextElement NS_DESIGNATED_INITIALIZER;
+
+/// The element whose contents are being parsed.
+@property (readonly, strong, nonatomic) HTMLElement *contextElement;
+
+/// Limits and other options applied to each snippet, or nil for the defaults.
+@property (copy, nonatomic) HTMLParserOptions * __nullable options;
+
+/**
+    Parses a snippet of HTML.
+ 
+    @return A document whose children are the snippet's top-level nodes, without the html element a full document would have.
+ */
+- (HTMLDocument *)parseString:(NSString *)string;
+
+/**
+    Parses a snippet of HTML and adds its top-level nodes to the end of a node's children.
+ 
+    @param node The node that receives the parsed nodes. Need not be the context element.
+ */
+- (void)parseString:(NSString *)string appendingToNode:(HTMLNode *)node;
+
+/// Descriptions of the parse errors encountered in the most recently parsed snippet.
+@property (readonly, copy, nonatomic) HTMLArrayOf(NSString *) *errors;
+
+@end
+
+NS_ASSUME_NONNULL_END
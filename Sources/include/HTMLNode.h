@@ -12,23 +12,41 @@ NS_ASSUME_NONNULL_BEGIN
 /**
     HTMLNode is an abstract class representing a node in a parsed HTML tree.
  
-    A node maintains strong references to its children and a weak reference to its parents.
+    A node maintains strong references to its children and a non-retaining reference to its parent. If a parent is deallocated while one of its children lives on, the child's parentNode becomes nil; likewise for the document of every node in a deallocated document's tree.
  
-    @note Copying an HTMLNode does not copy its document, parentElement, or children.
+    For nodes that aren't frozen, the parentNode and document are cleared by the deallocating parent or document, on whichever thread deallocates it. Don't read them on one thread while another thread might be letting go of the last reference to the parent or document. Frozen nodes use zeroing weak references instead, so they can be read on any thread while their document is deallocated on another.
+ 
+    @note Copying an HTMLNode does not copy its document, parentElement, or children. To copy children too, see -deepCopy.
  */
 @interface HTMLNode : NSObject <NSCopying>
 
 /// Basically useless on its own; please call a subclass's initializer to initialize a useful HTMLNode.
 - (instancetype)init NS_DESIGNATED_INITIALIZER;
 
-/// The document in which this node appears, or nil if the node is not in a tree with a document at its root.
+/// The document in which this node appears, or nil if the node is not in a tree with a document at its root. Kept up to date as nodes move, so this is cheap to call.
 @property (readonly, strong, nonatomic) HTMLDocument * __nullable document;
 
 /// The node's parent, or nil if the node is a root node.
-@property (weak, nonatomic) HTMLNode * __nullable parentNode;
+@property (assign, nonatomic) HTMLNode * __nullable parentNode;
 
 /// The node's parent if it is an instance of HTMLElement, otherwise nil. Setter is equivalent to calling -setParentNode:.
-@property (weak, nonatomic) HTMLElement * __nullable parentElement;
+@property (assign, nonatomic) HTMLElement * __nullable parentElement;
+
+/**
+    YES if the node is part of a frozen document, otherwise NO.
+ 
+    A frozen node cannot be changed. Attempting to do so throws an NSInternalInconsistencyException.
+ 
+    @see -[HTMLDocument freeze]
+ */
+@property (readonly, assign, nonatomic, getter=isFrozen) BOOL frozen;
+
+/**
+    Returns a copy of the node and all of its descendants. The copy has no parent and is never frozen.
+ 
+    Copying a frozen node is cheap no matter how big its subtree: descendants are only copied once they're accessed, and their text and attributes are shared with the original until changed. This makes a frozen document a good template for many slightly different copies, as each copy costs about as much as the changes made to it. An unfrozen node's subtree is copied right away.
+ */
+- (instancetype)deepCopy;
 
 /// Removes the node from its parent, effectively detaching it from the tree.
 - (void)removeFromParentNode;
@@ -90,6 +108,22 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (copy, nonatomic) NSString *textContent;
 
+/**
+    The same string as textContent, but the subtree is traversed by multiple threads at once.
+ 
+    Only very large trees benefit; for anything smaller, the overhead makes this slower than textContent. Only frozen nodes are traversed concurrently; for any other node, this does the same work as textContent on the calling thread.
+ */
+@property (readonly, copy, nonatomic) NSString *concurrentTextContent;
+
+/**
+    A hash of the subtree rooted at the node, combining each node's type, tag name, namespace, attributes, and text.
+ 
+    Structurally identical subtrees have the same hash, even in different documents. Attribute order does not affect the hash. Different subtrees are very unlikely to share a hash, but it is not cryptographically secure.
+ 
+    The hash is computed when first needed, then cached until something in the subtree changes.
+ */
+@property (readonly, assign, nonatomic) uint64_t subtreeHash;
+
 /**
     Returns the contents of each child text node. Only direct children are considered; no further descendants are included.
  */
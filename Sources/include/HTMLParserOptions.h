@@ -0,0 +1,155 @@
+//  HTMLParserOptions.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <Foundation/Foundation.h>
+#import "HTMLSupport.h"
+
+@class HTMLElement;
+@class HTMLStringPool;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The resource limits that can cut parsing short or change the resulting tree.
+typedef NS_OPTIONS(NSUInteger, HTMLParserLimit)
+{
+    /// No limit was exceeded.
+    HTMLParserLimitNone = 0,
+    
+    /// Elements nested too deeply were added alongside the deepest allowed elements instead of inside them.
+    HTMLParserLimitDepth = 1 << 0,
+    
+    /// Parsing stopped after creating the maximum number of nodes.
+    HTMLParserLimitNodeCount = 1 << 1,
+    
+    /// Some elements' excess attributes were dropped.
+    HTMLParserLimitAttributeCount = 1 << 2,
+    
+    /// Some text nodes were truncated.
+    HTMLParserLimitTextLength = 1 << 3,
+    
+    /// Parsing stopped after processing the maximum number of tokens.
+    HTMLParserLimitTokenCount = 1 << 4,
+    
+    /// Parsing stopped after taking too long.
+    HTMLParserLimitDuration = 1 << 5,
+    
+    /// Only the beginning of the input was parsed.
+    HTMLParserLimitInputLength = 1 << 6,
+    
+    /// Parsing stopped at the end of the head or at an element that passed the stop test.
+    HTMLParserLimitStopCondition = 1 << 7,
+    
+    /// Some formatting elements were forgotten rather than reopened after misnested tags.
+    HTMLParserLimitFormattingElements = 1 << 8,
+};
+
+/// Content that can be left out of a parsed document as it's built.
+typedef NS_OPTIONS(NSUInteger, HTMLParserDiscard)
+{
+    /// Nothing is left out.
+    HTMLParserDiscardNone = 0,
+    
+    /// Comments are left out.
+    HTMLParserDiscardComments = 1 << 0,
+    
+    /// Text nodes of nothing but whitespace are left out, unless they're inside a `pre`, `listing`, or `textarea` element or they sit between two inline elements (like the space in `<b>one</b> <i>two</i>`). Whitespace that shares a text node with anything else is kept.
+    HTMLParserDiscardWhitespaceText = 1 << 1,
+    
+    /// The text inside `script` and `style` elements is left out. The elements themselves are kept.
+    HTMLParserDiscardScriptAndStyleText = 1 << 2,
+    
+    /// Everything inside `template` elements is left out. The elements themselves are kept.
+    HTMLParserDiscardTemplateContents = 1 << 3,
+};
+
+/**
+    An HTMLParserOptions changes how a document gets parsed.
+ 
+    By default no limits are imposed, as browsers parse any document to completion. When parsing untrusted pages, limits keep one hostile or badly broken page from taking unbounded time or memory. Each limit degrades the resulting tree rather than failing outright, and -[HTMLDocument exceededParserLimits] reports which limits were hit.
+ 
+    For all limits, 0 means unlimited.
+ */
+@interface HTMLParserOptions : NSObject <NSCopying>
+
+/**
+    The maximum depth of nested elements, counting the root element as 1. Elements that would be nested deeper are instead added alongside the deepest allowed elements, much like browsers do. Text and comments can still go inside the deepest elements. A misnested formatting end tag that would rearrange elements too deeply closes the formatting element instead.
+ 
+    Deeply nested trees are slow to parse and can exhaust the stack in code that recurses over them. Browsers use limits around 512.
+ */
+@property (assign, nonatomic) NSUInteger maximumDepth;
+
+/**
+    The maximum number of open formatting elements (such as `b`, `font`, or `a`) to keep track of for reopening after misnested tags. Once there are more, the oldest is forgotten: it isn't reopened later, and its end tag no longer rearranges the tree.
+ 
+    Reopening formatting elements and sorting out misnested end tags both look through every formatting element still being tracked, so a page full of unclosed formatting tags makes them take quadratic time. A limit of a few dozen leaves ordinary pages alone.
+ */
+@property (assign, nonatomic) NSUInteger maximumFormattingElements;
+
+/// The maximum number of nodes to create. Once it's reached, the rest of the input is ignored and the document is finished as if the input had ended.
+@property (assign, nonatomic) NSUInteger maximumNodeCount;
+
+/// The maximum number of attributes to keep on any one element. Later attributes are dropped.
+@property (assign, nonatomic) NSUInteger maximumAttributesPerElement;
+
+/// The maximum length of any one text node, in UTF-16 code units. Any more text in the node is dropped.
+@property (assign, nonatomic) NSUInteger maximumTextLength;
+
+/// The maximum number of tokens to process, bounding the total work of tree construction. Once it's reached, the rest of the input is ignored and the document is finished as if the input had ended.
+@property (assign, nonatomic) NSUInteger maximumTokenCount;
+
+/// The maximum time to spend parsing, in seconds. Once it's exceeded, the rest of the input is ignored and the document is finished as if the input had ended. The clock is checked periodically, so parsing may run slightly over.
+@property (assign, nonatomic) NSTimeInterval maximumDuration;
+
+/**
+    The maximum length of input to parse, in UTF-16 code units. The rest of the input is never looked at, and the document is finished as if the input had ended.
+ 
+    When parsing data, consider passing only the beginning of the data too, so the rest doesn't need to be downloaded or decoded.
+ */
+@property (assign, nonatomic) NSUInteger maximumInputLength;
+
+/**
+    YES if parsing should stop once the head element is finished. The default is NO.
+ 
+    This suits jobs that only need the title, meta, and link elements, such as link previews. The token that ended the head is still processed, so the document may have a body with a little something in it. Has no effect when parsing fragments.
+ */
+@property (assign, nonatomic) BOOL stopsAfterHead;
+
+/**
+    A block called with each element as it's created, before it has any children. If the block returns YES, the element is still added to the document but parsing stops there, and the document is finished as if the input had ended. The default is nil.
+ */
+@property (copy, nonatomic) BOOL (^ __nullable stopTest)(HTMLElement *element);
+
+/**
+    Content to leave out of the document. The default is HTMLParserDiscardNone.
+ 
+    Discarded content is never added to the tree, which saves both time and memory when it would go unused anyway. Everything else ends up where it would have been had nothing been discarded.
+ */
+@property (assign, nonatomic) HTMLParserDiscard discardedContent;
+
+/**
+    YES if a big document's nodes should never all be in memory at once. The default is NO.
+ 
+    This bounds peak memory rather than saving work, and it makes more allocations, not fewer. Nodes are still created as the tree is built. As parsing goes, each finished part of the tree is recorded in a compact form and its nodes are released. Afterwards, nodes are created again one level at a time as they are navigated to, and stay put once created. `textContent` reads straight from the recorded tree without creating any nodes, but selector queries visit, and so create, every node they search. Parsing is somewhat slower than without this option. It suits big documents whose full tree wouldn't comfortably fit in memory.
+ 
+    The resulting document is frozen (see -[HTMLDocument freeze]). Has no effect when parsing fragments.
+ */
+@property (assign, nonatomic) BOOL createsNodesOnDemand;
+
+/**
+    YES if the input should be tokenized on another thread while the tree is built on this one. The default is NO.
+ 
+    For large documents this can take parsing time down toward whichever of tokenization and tree construction is slower, rather than both added together. The tokenizer still needs to wait for tree construction to catch up after some start tags, such as `script` and `textarea`, so documents full of those see less benefit. Small documents are faster without it.
+ */
+@property (assign, nonatomic) BOOL tokenizesConcurrently;
+
+/**
+    A pool to share attribute names and short attribute values through, or nil to give each attribute its own strings. The default is nil.
+ 
+    Pages tend to repeat the same few attribute names and many of the same values (`class`, `rel`, `type`, and so on). Pooling them keeps one copy of each, whether for one document or, by handing the same pool to every parse, for many. Pooled values are built as they're parsed instead of the first time they're read (see -[HTMLStringPool maximumValueLength]).
+ */
+@property (strong, nonatomic) HTMLStringPool * __nullable stringPool;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -4,7 +4,15 @@
 
 #import "HTMLDocument.h"
 #import "HTMLEncoding.h"
+#import "HTMLExtractor.h"
+#import "HTMLFragmentParser.h"
+#import "HTMLParserOptions.h"
+#import "HTMLSanitizer.h"
 #import "HTMLSelector.h"
 #import "HTMLSerialization.h"
+#import "HTMLSnapshot.h"
+#import "HTMLStringPool.h"
 #import "HTMLTextNode.h"
+#import "HTMLTraversal.h"
+#import "HTMLTreeDiff.h"
 #import "NSString+HTMLEntities.h"
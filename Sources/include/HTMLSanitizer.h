@@ -0,0 +1,51 @@
+//  HTMLSanitizer.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLElement.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+    An HTMLSanitizer cleans up untrusted snippets of HTML, keeping only allowed elements, attributes, and URL schemes.
+ 
+    Snippets are parsed just as a browser would parse them as the contents of a context element, so implied end tags, misnested formatting elements, and foster parenting out of tables all come out the way a browser would see them. Each element is sanitized and serialized as soon as the parser is done with it, and its nodes are let go right away, so only the elements still open at any point are kept around.
+ 
+    Elements that aren't allowed are left out, but their contents are kept. Elements in removedElements are left out along with their contents. Comments are always left out. Sanitizers are not thread-safe.
+ */
+@interface HTMLSanitizer : NSObject
+
+/**
+    Initializes a sanitizer.
+ 
+    @param contextElement The element whose contents are being sanitized. Its tag name and namespace affect how snippets are parsed (e.g. a `<td>` in a snippet for a `<tr>` is kept, but it's ignored in a snippet for a `<div>`).
+ */
+- (instancetype)initWithContextElement:(HTMLElement *)contextElement NS_DESIGNATED_INITIALIZER;
+
+/// Initializes a sanitizer for the contents of a `<body>`.
+- (instancetype)init;
+
+/// The element whose contents are being sanitized.
+@property (readonly, strong, nonatomic) HTMLElement *contextElement;
+
+/// Tag names of the elements that are kept. Only elements in the HTML namespace are ever kept. The default is a conservative set of text formatting, list, table, and image elements.
+@property (copy, nonatomic) HTMLSetOf(NSString *) *allowedElements;
+
+/// Tag names of the elements that are left out along with their contents, even if allowed. The default includes `script`, `style`, `template`, embedded content, and `svg` and `math`.
+@property (copy, nonatomic) HTMLSetOf(NSString *) *removedElements;
+
+/// Names of the attributes that are kept on allowed elements. The default includes `href`, `src`, `alt`, `title`, and a few table attributes.
+@property (copy, nonatomic) HTMLSetOf(NSString *) *allowedAttributes;
+
+/// Names of the attributes whose values are URLs. An allowed URL attribute is only kept if its value is a relative URL or uses an allowed scheme. The default includes `href`, `src`, `cite`, `action`, and `formaction`.
+@property (copy, nonatomic) HTMLSetOf(NSString *) *URLAttributes;
+
+/// Lowercase URL schemes that are kept, without the colon. The default is `http`, `https`, and `mailto`.
+@property (copy, nonatomic) HTMLSetOf(NSString *) *allowedURLSchemes;
+
+/// Returns the sanitized HTML of a snippet.
+- (NSString *)sanitizeString:(NSString *)string;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -65,6 +65,16 @@ extern NSString * const HTMLSelectorLocationErrorKey;
 /// Returns the first node matched by selector, or nil if there is no such node. Throws an NSInvalidArgumentException if the selector could not be parsed.
 - (HTMLElement * __nullable)firstNodeMatchingParsedSelector:(HTMLSelector *)selector;
 
+/**
+    Returns the nodes matched by selector, in tree order, dividing the work among multiple threads. Throws an NSInvalidArgumentException if the selector could not be parsed.
+ 
+    Only very large trees benefit; for anything smaller, the overhead makes this slower than -nodesMatchingParsedSelector:. The Benchmarker's `concurrent` mode shows where the crossover lies. Only frozen nodes are searched concurrently; for any other node, this does the same work as -nodesMatchingParsedSelector: on the calling thread.
+ */
+- (HTMLArrayOf(HTMLElement *) *)concurrentNodesMatchingParsedSelector:(HTMLSelector *)selector;
+
+/// Returns the nodes matched by selectorString, dividing the work among multiple threads. Throws an NSInvalidArgumentException if selectorString cannot be parsed. See -concurrentNodesMatchingParsedSelector:.
+- (HTMLArrayOf(HTMLElement *) *)concurrentNodesMatchingSelector:(NSString *)selectorString;
+
 @end
 
 /// HTMLNthExpression represents the expression in an :nth-child (or similar) pseudo-class.
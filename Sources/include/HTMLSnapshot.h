@@ -0,0 +1,62 @@
+//  HTMLSnapshot.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLDocument.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+    HTMLSnapshot expands the HTMLDocument class to save and load a compact binary representation of a parsed document.
+ 
+    A snapshot records every node, attribute, and namespace along with the document's quirks mode and parsed string encoding. Strings are stored once no matter how many times they appear. Loading a snapshot does not parse any HTML, and nodes are only created when something asks for them.
+ 
+    Documents loaded from a snapshot are frozen (see -[HTMLDocument freeze]).
+ */
+@interface HTMLDocument (HTMLSnapshot)
+
+/**
+    Returns a snapshot of the document, suitable for saving to disk.
+ 
+    Snapshots larger than 4GB are not supported, and attempting to make one throws an NSInvalidArgumentException. Strings that are not valid Unicode are saved lossily.
+ */
+- (NSData *)snapshotData;
+
+/**
+    Loads a document from a snapshot. Only the snapshot's header is examined up front; nodes are created as they are accessed. The data must not change while the document exists.
+ 
+    If a snapshot turns out to be corrupt after loading has begun, an NSInternalInconsistencyException is thrown when the bad nodes are accessed.
+ 
+    @param error If loading fails, set to an error in the HTMLSnapshotErrorDomain (or, when reading a file, possibly an error from NSData).
+ 
+    @return A frozen document, or nil if the data is not a snapshot this version of HTMLReader understands.
+ */
++ (nullable instancetype)documentWithSnapshotData:(NSData *)data error:(NSError **)error;
+
+/**
+    Loads a document from a snapshot file, which is memory-mapped so only the parts that are used get read. The file must not change while the document exists.
+ 
+    @see +documentWithSnapshotData:error:
+ */
++ (nullable instancetype)documentWithContentsOfSnapshotFile:(NSString *)path error:(NSError **)error;
+
+@end
+
+/// Error domain for errors loading snapshots.
+extern NSString * const HTMLSnapshotErrorDomain;
+
+/// Error codes in the HTMLSnapshotErrorDomain.
+typedef NS_ENUM(NSInteger, HTMLSnapshotErrorCode)
+{
+    
+    /// The data does not start with a snapshot header.
+    HTMLSnapshotErrorNotASnapshot = 1,
+    
+    /// The snapshot was made by an incompatible version of HTMLReader.
+    HTMLSnapshotErrorUnsupportedVersion,
+    
+    /// The snapshot's header describes tables that do not fit in the data.
+    HTMLSnapshotErrorCorrupt,
+};
+
+NS_ASSUME_NONNULL_END
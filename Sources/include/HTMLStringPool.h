@@ -0,0 +1,46 @@
+//  HTMLStringPool.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import <Foundation/Foundation.h>
+#import "HTMLSupport.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+    An HTMLStringPool hands out one shared immutable string for each distinct string it's given, so repeated attribute names and values take up memory just once.
+ 
+    Give a pool to -[HTMLParserOptions stringPool] and the tokenizer interns every attribute name and every attribute value no longer than maximumValueLength. Use a new pool for each document, or share one among many documents (e.g. for a crawl). Pools are safe to use from many threads at once, and lookups of strings already in the pool don't wait on each other.
+ 
+    Elements parsed with a pool look for an attribute name by pointer before hashing it, so looking up attributes with strings from the same pool (e.g. `element[[pool internString:@"href"]]`) is a little quicker.
+ */
+@interface HTMLStringPool : NSObject
+
+/// A pool shared by the whole process.
++ (instancetype)sharedPool;
+
+/// Initializes an empty pool.
+- (instancetype)init NS_DESIGNATED_INITIALIZER;
+
+/**
+    Returns the pooled string equal to a string, adding an immutable copy of the string if there isn't one yet.
+ 
+    Once the pool holds maximumCount strings, strings not already in the pool come back as immutable copies without being added.
+ */
+- (NSString *)internString:(NSString *)string;
+
+/// The longest attribute value, in UTF-16 code units, that the tokenizer interns. Longer values are often one of a kind, and are left alone. The default is 32. Set this before sharing the pool.
+@property (assign, nonatomic) NSUInteger maximumValueLength;
+
+/// The most strings to keep in the pool, or 0 for no limit. The default is 65536. Set this before sharing the pool.
+@property (assign, nonatomic) NSUInteger maximumCount;
+
+/// The number of strings in the pool.
+@property (readonly, assign, nonatomic) NSUInteger count;
+
+/// Empties the pool. Strings handed out already are unaffected.
+- (void)removeAllStrings;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -16,6 +16,7 @@
 #define HTMLEnumeratorOf(T) HTMLGenericOf(NSEnumerator, T)
 #define HTMLMutableOrderedSetOf(T) HTMLGenericOf(NSMutableOrderedSet, T)
 #define HTMLOrderedSetOf(T) HTMLGenericOf(NSOrderedSet, T)
+#define HTMLSetOf(T) HTMLGenericOf(NSSet, T)
 
 // Nullability arrived in Xcode 6.3, let's degrade gracefully. I've left out the non-underscore-prefixed bits out of fear of unfortunate name collisions.
 #if !__has_feature(nullability)
@@ -0,0 +1,64 @@
+//  HTMLTraversal.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLNode.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// What a traversal should do after a callback returns.
+typedef NS_ENUM(NSInteger, HTMLTraversalAction)
+{
+    /// Carry on, including into the node's children.
+    HTMLTraversalContinue,
+    
+    /// Carry on, but don't visit the node's descendants. The node is still left. When returned from a leave callback, same as HTMLTraversalContinue.
+    HTMLTraversalSkipChildren,
+    
+    /// Stop the traversal without calling any more callbacks.
+    HTMLTraversalStop,
+};
+
+/// The kinds of nodes that a traversal reports to its callbacks. Nodes of other kinds are still traversed, just not reported.
+typedef NS_OPTIONS(NSUInteger, HTMLTraversalNodeTypes)
+{
+    HTMLTraversalElements = 1 << 0,
+    HTMLTraversalTextNodes = 1 << 1,
+    HTMLTraversalComments = 1 << 2,
+    
+    /// Documents and document types.
+    HTMLTraversalOtherNodes = 1 << 3,
+    
+    HTMLTraversalAllNodes = HTMLTraversalElements | HTMLTraversalTextNodes | HTMLTraversalComments | HTMLTraversalOtherNodes,
+};
+
+/// A callback for HTMLTraverseTree(). The context is whatever was passed to HTMLTraverseTree().
+typedef HTMLTraversalAction (*HTMLTraversalFunction)(HTMLNode *node, void * __nullable context);
+
+/**
+    Visits in tree order the nodes in the subtree rooted at root, calling enter when arriving at a node and leave once all of its descendants have been visited.
+ 
+    This is the fastest way to walk a tree: no objects are created, there's no message send to get from one node to the next, and entire subtrees can be skipped. Nothing may add or remove nodes in the subtree during the traversal.
+ 
+    @param types   The kinds of nodes to pass to the callbacks.
+    @param enter   Called when arriving at a node, or NULL. Returns whether to visit the node's children.
+    @param leave   Called when done with a node that was passed to enter (or would have been, were enter not NULL), or NULL.
+    @param context Passed along to the callbacks.
+ 
+    @return NO if a callback stopped the traversal, otherwise YES.
+ */
+extern BOOL HTMLTraverseTree(HTMLNode *root, HTMLTraversalNodeTypes types, HTMLTraversalFunction __nullable enter, HTMLTraversalFunction __nullable leave, void * __nullable context);
+
+/// HTMLTraversal expands the HTMLNode class to walk its subtree with callbacks.
+@interface HTMLNode (HTMLTraversal)
+
+/**
+    Visits in tree order the nodes in the subtree rooted at the node, calling enter when arriving at a node and leave once all of its descendants have been visited. See HTMLTraverseTree() for details.
+ 
+    @return NO if a block stopped the traversal, otherwise YES.
+ */
+- (BOOL)traverseNodesOfTypes:(HTMLTraversalNodeTypes)types enter:(HTMLTraversalAction (^ __nullable)(HTMLNode *node))enter leave:(HTMLTraversalAction (^ __nullable)(HTMLNode *node))leave;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,50 @@
+//  HTMLTreeDiff.h
+//
+//  Public domain. https://github.com/nolanw/HTMLReader
+
+#import "HTMLNode.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The kinds of differences between two trees.
+typedef NS_ENUM(NSInteger, HTMLTreeChangeType)
+{
+    /// A node (and its descendants) appears only in the updated tree.
+    HTMLTreeChangeInsertion,
+    
+    /// A node (and its descendants) appears only in the old tree.
+    HTMLTreeChangeRemoval,
+    
+    /// A node appears in both trees, but its own contents differ. For elements this means attributes; for text and comments, their data. Changes to its descendants are reported separately.
+    HTMLTreeChangeModification,
+};
+
+/// An HTMLTreeChange describes one difference between two trees.
+@interface HTMLTreeChange : NSObject
+
+/// What sort of change this is.
+@property (readonly, assign, nonatomic) HTMLTreeChangeType type;
+
+/// The node in the old tree, or nil for an insertion.
+@property (readonly, strong, nonatomic) HTMLNode * __nullable oldNode;
+
+/// The node in the updated tree, or nil for a removal.
+@property (readonly, strong, nonatomic) HTMLNode * __nullable updatedNode;
+
+@end
+
+/// HTMLTreeDiff expands the HTMLNode class to find the differences between two trees.
+@interface HTMLNode (HTMLTreeDiff)
+
+/**
+    Returns the changes that turn the subtree rooted at the node into the subtree rooted at updatedNode, in tree order.
+ 
+    Subtrees with equal subtreeHash values are assumed identical and skipped without being examined, so the cost depends mostly on how much has changed. Children are matched up by their hashes, so nodes that were inserted, removed, or moved come out as insertions and removals rather than a cascade of modifications.
+ 
+    If the two nodes are of different types (or are elements with different tag names or namespaces), the result is a removal of the node followed by an insertion of updatedNode. An empty array means the subtrees are structurally identical.
+ */
+- (HTMLArrayOf(HTMLTreeChange *) *)changesToNode:(HTMLNode *)updatedNode;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -1,27 +1,257 @@
 //  Benchmarker.m
 //
 //  Public domain. https://github.com/nolanw/HTMLReader
+//
+//  Usage: Benchmarker [phases] [selector] [concurrent] [memory] [--json]
+//
+//  With no modes, runs phases and selector. The phases mode times each stage of parsing separately over a generated corpus; see Corpus() below. The memory mode compares the most memory allocated at once while parsing with the memory the finished document keeps. --json prints machine-readable results to stdout instead of a table, so runs can be saved and compared between releases.
+//
+//  Besides the Xcode target, Benchmarker builds on Linux with GNUstep, gnustep-corebase, and libdispatch, e.g. from the repository root:
+//
+//      clang -O2 -fobjc-arc -fblocks $(gnustep-config --objc-flags) -ISources -ISources/include Sources/*.m Utilities/Benchmarker.m $(gnustep-config --base-libs) -lgnustep-corebase -ldispatch -o Benchmarker
+//
+//  Memory is counted in bytes allocated, not pages resident. On Linux the allocator is wrapped so every run gets its own peak; on macOS only the bytes still allocated afterwards can be found, so peaks are reported as n/a.
 
 #import "HTMLReader.h"
-#import <mach/mach_time.h>
+#import "HTMLEncoding+Private.h"
+#import "HTMLParser.h"
+#import "HTMLTokenizer.h"
+#import <time.h>
+#if defined(__APPLE__)
+#import <malloc/malloc.h>
+#elif defined(__GLIBC__)
+#import <errno.h>
+#import <malloc.h>
+#endif
+
+#pragma mark - Measuring
+
+// Every allocation made while benchmarking, where the platform lets us count them.
+static uint64_t AllocationCount;
 
-static NSTimeInterval Time(NSUInteger reps, void (^block)(void))
+static inline void CountAllocation(void)
 {
-    static mach_timebase_info_data_t timebaseInfo;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        mach_timebase_info(&timebaseInfo);
-    });
+    __atomic_fetch_add(&AllocationCount, 1, __ATOMIC_RELAXED);
+}
 
-    uint64_t elapsed = 0;
-    for (NSUInteger i = 0; i < reps; i++) {
-        uint64_t start = mach_absolute_time();
-        block();
-        uint64_t end = mach_absolute_time();
-        elapsed += (end - start);
+#if defined(__APPLE__)
+
+// malloc_logger is how Instruments watches allocations. Once it's set, libmalloc calls it for every allocation and deallocation in every zone.
+typedef void (MallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfFramesToSkip);
+extern MallocLogger *malloc_logger;
+
+static void CountingMallocLogger(uint32_t type, __unused uintptr_t arg1, __unused uintptr_t arg2, __unused uintptr_t arg3, __unused uintptr_t result, __unused uint32_t numberOfFramesToSkip)
+{
+    static const uint32_t AllocateType = 2;
+    if (type & AllocateType) {
+        CountAllocation();
     }
+}
+
+static BOOL StartCountingAllocations(void)
+{
+    malloc_logger = CountingMallocLogger;
+    return YES;
+}
+
+// The zones keep their own running total. (They don't keep a peak we can reset, and the logger is told about a reallocation only after the old block is gone, so there's no way to keep one ourselves.)
+static int64_t AllocatedBytes(void)
+{
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(NULL, &statistics);
+    return (int64_t)statistics.size_in_use;
+}
+
+static void ResetPeakAllocatedBytes(void)
+{
+}
+
+static int64_t PeakAllocatedBytes(void)
+{
+    return -1;
+}
+
+#elif defined(__GLIBC__)
+
+// Bytes in blocks that haven't been freed yet, and the most there have been since the peak was last reset.
+static int64_t LiveBytes;
+static int64_t PeakLiveBytes;
+
+static inline void AddLiveBytes(int64_t bytes)
+{
+    int64_t live = __atomic_add_fetch(&LiveBytes, bytes, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&PeakLiveBytes, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&PeakLiveBytes, &peak, live, YES, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static inline void * Allocated(void *pointer)
+{
+    if (pointer) {
+        CountAllocation();
+        AddLiveBytes((int64_t)malloc_usable_size(pointer));
+    }
+    return pointer;
+}
+
+// glibc lets the executable replace malloc and friends, and exports its own implementations under these names so we can forward to them. Every way in and out of the allocator is replaced, or the byte counts wouldn't balance.
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void *pointer, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void * __libc_valloc(size_t size);
+extern void * __libc_pvalloc(size_t size);
+extern void __libc_free(void *pointer);
+
+void * malloc(size_t size)
+{
+    return Allocated(__libc_malloc(size));
+}
+
+void * calloc(size_t count, size_t size)
+{
+    return Allocated(__libc_calloc(count, size));
+}
+
+void * realloc(void *pointer, size_t size)
+{
+    int64_t oldBytes = pointer ? (int64_t)malloc_usable_size(pointer) : 0;
+    void *result = __libc_realloc(pointer, size);
     
-    return (NSTimeInterval)elapsed * timebaseInfo.numer / timebaseInfo.denom / 1e9;
+    // A failed reallocation leaves the old block alone, but a zero-size one frees it.
+    if (result || size == 0) {
+        AddLiveBytes(-oldBytes);
+    }
+    return Allocated(result);
+}
+
+void * memalign(size_t alignment, size_t size)
+{
+    return Allocated(__libc_memalign(alignment, size));
+}
+
+void * aligned_alloc(size_t alignment, size_t size)
+{
+    return Allocated(__libc_memalign(alignment, size));
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size)
+{
+    if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *pointer = __libc_memalign(alignment, size);
+    if (!pointer) {
+        return ENOMEM;
+    }
+    *result = Allocated(pointer);
+    return 0;
+}
+
+void * valloc(size_t size)
+{
+    return Allocated(__libc_valloc(size));
+}
+
+void * pvalloc(size_t size)
+{
+    return Allocated(__libc_pvalloc(size));
+}
+
+void free(void *pointer)
+{
+    if (pointer) {
+        AddLiveBytes(-(int64_t)malloc_usable_size(pointer));
+    }
+    __libc_free(pointer);
+}
+
+static BOOL StartCountingAllocations(void)
+{
+    return YES;
+}
+
+static int64_t AllocatedBytes(void)
+{
+    return __atomic_load_n(&LiveBytes, __ATOMIC_RELAXED);
+}
+
+static void ResetPeakAllocatedBytes(void)
+{
+    __atomic_store_n(&PeakLiveBytes, __atomic_load_n(&LiveBytes, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+static int64_t PeakAllocatedBytes(void)
+{
+    return __atomic_load_n(&PeakLiveBytes, __ATOMIC_RELAXED);
+}
+
+#else
+
+static BOOL StartCountingAllocations(void)
+{
+    return NO;
+}
+
+static int64_t AllocatedBytes(void)
+{
+    return -1;
+}
+
+static void ResetPeakAllocatedBytes(void)
+{
+}
+
+static int64_t PeakAllocatedBytes(void)
+{
+    return -1;
+}
+
+#endif
+
+static BOOL CountingAllocations;
+
+static NSTimeInterval Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (NSTimeInterval)now.tv_sec + (NSTimeInterval)now.tv_nsec / 1e9;
+}
+
+typedef struct {
+    NSTimeInterval mean;
+    NSTimeInterval fastest;
+    
+    // Per repetition, or -1 if allocations aren't being counted.
+    double allocations;
+    
+    // The most memory allocated at once during any one repetition, beyond what was allocated when it started, or -1 if the peak can't be watched.
+    int64_t peakBytes;
+} Measurement;
+
+static Measurement Measure(NSUInteger reps, void (^block)(void))
+{
+    Measurement measurement = { .fastest = DBL_MAX, .peakBytes = -1 };
+    NSTimeInterval total = 0;
+    uint64_t allocationsBefore = __atomic_load_n(&AllocationCount, __ATOMIC_RELAXED);
+    for (NSUInteger i = 0; i < reps; i++) {
+        int64_t bytesBefore = AllocatedBytes();
+        ResetPeakAllocatedBytes();
+        @autoreleasepool {
+            NSTimeInterval start = Now();
+            block();
+            NSTimeInterval elapsed = Now() - start;
+            total += elapsed;
+            measurement.fastest = MIN(measurement.fastest, elapsed);
+        }
+        int64_t peak = PeakAllocatedBytes();
+        if (peak >= 0) {
+            measurement.peakBytes = MAX(measurement.peakBytes, peak - bytesBefore);
+        }
+    }
+    uint64_t allocations = __atomic_load_n(&AllocationCount, __ATOMIC_RELAXED) - allocationsBefore;
+    measurement.mean = total / reps;
+    measurement.allocations = CountingAllocations ? (double)allocations / reps : -1;
+    return measurement;
 }
 
 static NSString * PathForFixture(NSString *fixture)
@@ -29,49 +259,322 @@ static NSString * PathForFixture(NSString *fixture)
     return [[[@(__FILE__) stringByDeletingLastPathComponent] stringByAppendingPathComponent:@"Fixtures"] stringByAppendingPathComponent:fixture];
 }
 
+#pragma mark - Corpus
+
+// The corpus is generated rather than checked in so it's identical everywhere and needs no network access. Only the content matters, so a simple deterministic generator stands in for randomness.
+static uint32_t NextPseudorandom(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+static NSString * Page(NSString *title, NSString *body)
+{
+    return [NSString stringWithFormat:@"<!DOCTYPE html>\n<html lang=en><head><meta charset=utf-8><title>%@</title>"
+                                      @"<link rel=stylesheet href=/style.css><script>var loaded = 1 < 2 && true;</script></head>\n"
+                                      @"<body class=\"page %@\">%@</body></html>\n", title, title, body];
+}
+
+static NSString * Article(NSUInteger index, uint32_t *seed)
+{
+    static NSString * const Words[] = { @"parse", @"tree", @"token", @"node", @"element", @"selector", @"document", @"string", @"encoding", @"entity" };
+    NSMutableString *paragraph = [NSMutableString new];
+    NSUInteger wordCount = 20 + NextPseudorandom(seed) % 60;
+    for (NSUInteger i = 0; i < wordCount; i++) {
+        NSString *word = Words[NextPseudorandom(seed) % (sizeof(Words) / sizeof(Words[0]))];
+        switch (NextPseudorandom(seed) % 12) {
+            case 0: [paragraph appendFormat:@"<a href=\"/%@/%@\" title=\"More about %@\">%@</a> ", word, @(i), word, word]; break;
+            case 1: [paragraph appendFormat:@"<em>%@</em> ", word]; break;
+            case 2: [paragraph appendFormat:@"<code class=inline>%@()</code> ", word]; break;
+            default: [paragraph appendFormat:@"%@ ", word]; break;
+        }
+    }
+    return [NSString stringWithFormat:@"<article class=\"post card\" id=post-%@ data-index=%@>"
+                                      @"<header><h2><a href=\"/posts/%@\">Post number %@</a></h2><time datetime=2020-01-01>Jan 1</time></header>"
+                                      @"<p>%@<p>%@<img src=\"/images/%@.png\" alt=\"\" width=100 height=100>"
+                                      @"<ul class=tags><li><a href=/tags/a>a</a><li><a href=/tags/b>b</a></ul>"
+                                      @"<!-- end of post %@ --></article>\n",
+            @(index), @(index), @(index), @(index), paragraph, paragraph, @(index), @(index)];
+}
+
+static NSString * NewsPage(NSUInteger articleCount)
+{
+    uint32_t seed = 1;
+    NSMutableString *body = [NSMutableString stringWithString:@"<nav id=top><ul><li><a href=/>Home</a><li><a href=/about>About</a><li class=current><a href=/posts>Posts</a></ul></nav><main>"];
+    for (NSUInteger i = 0; i < articleCount; i++) {
+        [body appendString:Article(i, &seed)];
+    }
+    [body appendString:@"</main><form action=/search method=get><input name=q type=search><select name=sort><option>new<option selected>top</select><button>Search</button></form>"];
+    return Page(@"news", body);
+}
+
+// Misnested formatting elements (adoption agency), foster-parented table content, very deep nesting, and unclosed everything.
+static NSString * PathologicalPage(void)
+{
+    NSMutableString *body = [NSMutableString new];
+    for (NSUInteger i = 0; i < 2000; i++) {
+        [body appendString:@"<b><i><a href=#>x<p>y</b>z</i>w</a>"];
+    }
+    [body appendString:@"<table>"];
+    for (NSUInteger i = 0; i < 2000; i++) {
+        [body appendString:@"stray <b>text<tr><td>cell<p>para</table-ish>"];
+    }
+    [body appendString:@"</table>"];
+    for (NSUInteger i = 0; i < 5000; i++) {
+        [body appendString:@"<div><span>"];
+    }
+    for (NSUInteger i = 0; i < 2000; i++) {
+        [body appendString:@"<font color=red><s><u><tt><big><small><strike><nobr>"];
+    }
+    return Page(@"pathological", body);
+}
+
+static NSString * EntityPage(void)
+{
+    NSMutableString *body = [NSMutableString new];
+    for (NSUInteger i = 0; i < 5000; i++) {
+        [body appendString:@"<p title=\"&quot;Caf&eacute;&quot; &amp; co\">Fish &amp; chips &lt;3 &copy; &eacute;t&eacute; &notin &NotEqualTilde; &#233;&#x1F600;&#X26; &amp &bogus; 100&percnt; &hellip;</p>\n"];
+    }
+    return Page(@"entities", body);
+}
+
+static NSString * TablePage(void)
+{
+    NSMutableString *body = [NSMutableString stringWithString:@"<table class=data><caption>Numbers</caption><colgroup><col span=2><col></colgroup><thead><tr><th>A<th>B<th>C<th>D<th>E<th>F<th>G<th>H</thead>"];
+    for (NSUInteger row = 0; row < 5000; row++) {
+        [body appendFormat:@"<tr class=%@>", row % 2 ? @"odd" : @"even"];
+        for (NSUInteger column = 0; column < 8; column++) {
+            [body appendFormat:@"<td align=right>%@", @(row * 8 + column)];
+        }
+    }
+    [body appendString:@"</table>"];
+    return Page(@"tables", body);
+}
+
+static NSArray * Corpus(void)
+{
+    NSMutableArray *corpus = [NSMutableArray new];
+    void (^add)(NSString *, NSString *, NSUInteger) = ^(NSString *name, NSString *string, NSUInteger reps) {
+        if (string) {
+            [corpus addObject:@{ @"name": name, @"string": string, @"reps": @(reps) }];
+        }
+    };
+    add(@"small", NewsPage(3), 500);
+    add(@"medium", NewsPage(300), 10);
+    add(@"pathological", PathologicalPage(), 3);
+    add(@"entities", EntityPage(), 5);
+    add(@"tables", TablePage(), 5);
+    
+    // The single-page HTML specification is too big to check in, but it's a fine large document if you download it to Fixtures/html5.html.
+    add(@"html5", [NSString stringWithContentsOfFile:PathForFixture(@"html5.html") usedEncoding:nil error:nil], 1);
+    
+    return corpus;
+}
+
+#pragma mark - Reporting
+
+static NSMutableArray *Results;
+static BOOL PrintJSON;
+
+static void Report(NSString *benchmark, NSString *input, NSUInteger bytes, NSUInteger reps, Measurement measurement)
+{
+    NSMutableDictionary *result = [@{ @"benchmark": benchmark,
+                                      @"input": input,
+                                      @"bytes": @(bytes),
+                                      @"reps": @(reps),
+                                      @"meanSeconds": @(measurement.mean),
+                                      @"fastestSeconds": @(measurement.fastest) } mutableCopy];
+    if (measurement.allocations >= 0) {
+        result[@"allocations"] = @(llround(measurement.allocations));
+    }
+    if (measurement.peakBytes >= 0) {
+        result[@"peakBytes"] = @(measurement.peakBytes);
+    }
+    [Results addObject:result];
+    
+    if (!PrintJSON) {
+        NSString *allocations = measurement.allocations >= 0 ? [NSString stringWithFormat:@"%.0f", measurement.allocations] : @"n/a";
+        NSString *peak = measurement.peakBytes >= 0 ? [NSString stringWithFormat:@"%lldKB", (long long)(measurement.peakBytes / 1024)] : @"n/a";
+        printf("%-12s %-14s %10.3fms mean %10.3fms fastest %12s allocs %10s peak\n",
+               input.UTF8String, benchmark.UTF8String, measurement.mean * 1e3, measurement.fastest * 1e3, allocations.UTF8String, peak.UTF8String);
+    }
+}
+
+#pragma mark - Benchmarks
+
+static void BenchmarkPhases(void)
+{
+    NSArray *selectors = @[ @"article.post p > a[href^='/']", @"#post-2 h2", @"li:nth-child(odd)", @"td + td", @"p em, p code", @"*" ];
+    for (NSDictionary *item in Corpus()) {
+        NSString *name = item[@"name"];
+        NSString *string = item[@"string"];
+        NSUInteger reps = [item[@"reps"] unsignedIntegerValue];
+        NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+        NSUInteger bytes = data.length;
+        
+        Report(@"decode", name, bytes, reps, Measure(reps, ^{
+            NSString *decoded;
+            DeterminedStringEncodingForData(data, nil, &decoded);
+        }));
+        
+        Measurement tokenize = Measure(reps, ^{
+            for (__unused id token in [[HTMLTokenizer alloc] initWithString:string]) {}
+        });
+        Report(@"tokenize", name, bytes, reps, tokenize);
+        
+        // The parser changes the tokenizer's state as it goes, so tree construction can't run on tokens made ahead of time. "parse" is tokenizing and tree construction together; "tree" is what's left after taking away the tokenize run.
+        HTMLStringEncoding encoding = (HTMLStringEncoding){ .encoding = NSUTF8StringEncoding, .confidence = Certain };
+        Measurement parse = Measure(reps, ^{
+            (void)[[HTMLParser alloc] initWithString:string encoding:encoding context:nil].document;
+        });
+        Report(@"parse", name, bytes, reps, parse);
+        Report(@"tree", name, bytes, reps, (Measurement){
+            .mean = MAX(parse.mean - tokenize.mean, 0),
+            .fastest = MAX(parse.fastest - tokenize.fastest, 0),
+            .allocations = parse.allocations >= 0 ? MAX(parse.allocations - tokenize.allocations, 0) : -1,
+            .peakBytes = -1,
+        });
+        
+        HTMLDocument *document = [HTMLDocument documentWithString:string];
+        Report(@"select", name, bytes, reps, Measure(reps, ^{
+            for (NSString *selector in selectors) {
+                [document nodesMatchingSelector:selector];
+            }
+        }));
+        
+        Report(@"serialize", name, bytes, reps, Measure(reps, ^{
+            (void)document.serializedFragment;
+        }));
+        
+        Report(@"escape", name, bytes, reps, Measure(reps, ^{
+            [string html_stringByEscapingForHTML];
+        }));
+        
+        Report(@"unescape", name, bytes, reps, Measure(reps, ^{
+            [string html_stringByUnescapingHTML];
+        }));
+    }
+}
+
+static void BenchmarkSelectorFixture(void)
+{
+    NSString * const HTMLString = [NSString stringWithContentsOfFile:PathForFixture(@"query-selector.html") usedEncoding:nil error:nil];
+    HTMLDocument *selectorsDocument = (HTMLString) ? [HTMLDocument documentWithString:(NSString * __nonnull)HTMLString] : nil;
+    NSArray *selectorSuites = [NSArray arrayWithContentsOfFile:PathForFixture(@"query-selector.plist")];
+    NSUInteger reps = 5;
+    Report(@"select", @"query-selector", HTMLString.length, reps, Measure(reps, ^{
+        for (NSDictionary *suite in selectorSuites) {
+            NSInteger count = [suite[@"fraction"] integerValue];
+            for (NSInteger i = 0; i < count; i++) {
+                NSArray *selectors = suite[@"selectors"];
+                for (NSString *selector in selectors) {
+                    [selectorsDocument nodesMatchingSelector:selector];
+                }
+            }
+        }
+    }));
+}
+
+static void BenchmarkConcurrency(void)
+{
+    // Quadruple the document size until concurrent traversal consistently beats a single thread; the crossover depends heavily on processor count.
+    HTMLSelector *selector = [HTMLSelector selectorForString:@"article.post p > a[href^='/']"];
+    NSUInteger reps = 5;
+    for (NSUInteger posts = 16; posts <= 65536; posts *= 4) {
+        NSMutableString *string = [NSMutableString new];
+        for (NSUInteger i = 0; i < posts; i++) {
+            [string appendFormat:@"<article class=post id=post%@><h2>Post %@</h2><p>Some <em>text</em> and <a href='/%@'>a link</a>.<p>More text.</article>", @(i), @(i), @(i)];
+        }
+        HTMLDocument *document = [HTMLDocument documentWithString:string];
+        [document freeze];
+        NSUInteger nodeCount = 0;
+        for (__unused HTMLNode *node in document.treeEnumerator) nodeCount++;
+        NSString *input = [NSString stringWithFormat:@"%@ nodes", @(nodeCount)];
+        
+        Report(@"select", input, string.length, reps, Measure(reps, ^{ [document nodesMatchingParsedSelector:selector]; }));
+        Report(@"select-conc", input, string.length, reps, Measure(reps, ^{ [document concurrentNodesMatchingParsedSelector:selector]; }));
+        Report(@"text", input, string.length, reps, Measure(reps, ^{ (void)document.textContent; }));
+        Report(@"text-conc", input, string.length, reps, Measure(reps, ^{ (void)document.concurrentTextContent; }));
+    }
+}
+
+static void BenchmarkMemory(void)
+{
+    for (NSUInteger articles = 64; articles <= 16384; articles *= 4) {
+        NSString *string = NewsPage(articles);
+        NSUInteger bytes = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        HTMLDocument *document;
+        
+        // Both figures are measured from what was allocated just before parsing, so earlier pages don't affect later ones. Anything the parser leaves in this pool counts towards the peak, just as it would for a caller that parses a page and carries on.
+        int64_t before = AllocatedBytes();
+        ResetPeakAllocatedBytes();
+        @autoreleasepool {
+            document = [HTMLDocument documentWithString:string];
+        }
+        int64_t peak = PeakAllocatedBytes();
+        peak = peak >= 0 ? peak - before : -1;
+        int64_t documentBytes = AllocatedBytes() - before;
+        
+        NSUInteger nodeCount = 0;
+        for (__unused HTMLNode *node in document.treeEnumerator) nodeCount++;
+        NSString *input = [NSString stringWithFormat:@"%@ articles", @(articles)];
+        
+        NSMutableDictionary *result = [@{ @"benchmark": @"memory",
+                                          @"input": input,
+                                          @"bytes": @(bytes),
+                                          @"nodes": @(nodeCount) } mutableCopy];
+        if (before >= 0) {
+            result[@"documentBytes"] = @(documentBytes);
+        }
+        if (peak >= 0) {
+            result[@"peakBytes"] = @(peak);
+        }
+        [Results addObject:result];
+        if (!PrintJSON) {
+            NSString *documentSize = before >= 0 ? [NSString stringWithFormat:@"%lldKB", (long long)(documentBytes / 1024)] : @"n/a";
+            NSString *peakSize = peak >= 0 ? [NSString stringWithFormat:@"%lldKB", (long long)(peak / 1024)] : @"n/a";
+            NSString *ratio = peak >= 0 && documentBytes > 0 ? [NSString stringWithFormat:@"%.2fx", (double)peak / documentBytes] : @"n/a";
+            printf("%-14s %10luB input %8lu nodes %10s peak %10s document %6s\n",
+                   input.UTF8String, (unsigned long)bytes, (unsigned long)nodeCount, peakSize.UTF8String, documentSize.UTF8String, ratio.UTF8String);
+        }
+        document = nil;
+    }
+}
+
 int main(void) { @autoreleasepool {
     NSArray *arguments = [[NSProcessInfo processInfo] arguments];
     arguments = [arguments subarrayWithRange:NSMakeRange(1, arguments.count - 1)];
-    if (arguments.count == 0) arguments = @[ @"large", @"selector" ];
+    PrintJSON = [arguments containsObject:@"--json"];
+    NSMutableArray *modes = [arguments mutableCopy];
+    [modes removeObject:@"--json"];
+    if (modes.count == 0) [modes setArray:@[ @"phases", @"selector" ]];
     
-    if ([arguments containsObject:@"large"]) {
-        NSString *large = [NSString stringWithContentsOfFile:PathForFixture(@"html5.html") usedEncoding:nil error:nil];
-        NSTimeInterval largeParseTime = Time(1, ^{
-            [HTMLDocument documentWithString:large];
-        });
-        NSLog(@"Time for parsing fixture: %gs", largeParseTime);
+    Results = [NSMutableArray new];
+    CountingAllocations = StartCountingAllocations();
+    
+    if ([modes containsObject:@"phases"]) {
+        BenchmarkPhases();
     }
     
-    if ([arguments containsObject:@"selector"]) {
-        NSString * const HTMLString = [NSString stringWithContentsOfFile:PathForFixture(@"query-selector.html") usedEncoding:nil error:nil];
-        HTMLDocument *selectorsDocument = (HTMLString) ? [HTMLDocument documentWithString:(NSString * __nonnull)HTMLString] : nil;
-        NSArray *selectorSuites = [NSArray arrayWithContentsOfFile:PathForFixture(@"query-selector.plist")];
-        NSUInteger reps = 5;
-        NSTimeInterval selectorTime = Time(reps, ^{
-            for (NSDictionary *suite in selectorSuites) {
-                NSInteger count = [suite[@"fraction"] integerValue];
-                for (NSInteger i = 0; i < count; i++) {
-                    NSArray *selectors = suite[@"selectors"];
-                    for (NSString *selector in selectors) {
-                        [selectorsDocument nodesMatchingSelector:selector];
-                    }
-                }
-            }
-        });
-        NSLog(@"Time for selecting nodes: %gs (mean)", selectorTime / reps);
+    if ([modes containsObject:@"selector"]) {
+        BenchmarkSelectorFixture();
     }
     
-    if ([arguments containsObject:@"escape"]) {
-        NSString *large = [NSString stringWithContentsOfFile:PathForFixture(@"html5.html") usedEncoding:nil error:nil];
-        NSTimeInterval escapeTime = Time(1, ^{
-            [large html_stringByEscapingForHTML];
-        });
-        NSLog(@"Time for escaping fixture: %gs", escapeTime);
-        
-        NSTimeInterval unescapeTime = Time(1, ^{
-            [large html_stringByUnescapingHTML];
-        });
-        NSLog(@"Time for unescaping fixture: %gs", unescapeTime);
+    if ([modes containsObject:@"concurrent"]) {
+        BenchmarkConcurrency();
+    }
+    
+    if ([modes containsObject:@"memory"]) {
+        BenchmarkMemory();
+    }
+    
+    if (PrintJSON) {
+        NSDictionary *report = @{ @"operatingSystem": [NSProcessInfo processInfo].operatingSystemVersionString,
+                                  @"processors": @([NSProcessInfo processInfo].activeProcessorCount),
+                                  @"results": Results };
+        NSData *JSON = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:nil];
+        fwrite(JSON.bytes, 1, JSON.length, stdout);
+        printf("\n");
     }
     
     return 0;
@@ -92,8 +92,6 @@ int main(void) { @autoreleasepool
         @"x-user-defined": cfencoding(kCFStringEncodingInvalidId),
     };
     
-    #undef cfencoding
-    
     printf("static const NameCFEncodingMap StringEncodings[] = {\n");
     NSArray *uniqueNames = [NSSet setWithArray:labelsToNames.allValues].allObjects;
     NSArray *sortedNames = [uniqueNames sortedArrayUsingSelector:@selector(compare:)];
@@ -109,5 +107,78 @@ int main(void) { @autoreleasepool
     }
     printf("};\n\n");
     
+    // The single-byte encodings get lookup tables for HTMLReader's own decoder. ISO-8859-8-I uses the same index as ISO-8859-8, and the HTML standard turns x-user-defined into windows-1252.
+    NSDictionary *singleByteNamesToStringEncodings = @
+    {
+        @"IBM866": cfencoding(kCFStringEncodingDOSRussian),
+        @"ISO-8859-2": cfencoding(kCFStringEncodingISOLatin2),
+        @"ISO-8859-3": cfencoding(kCFStringEncodingISOLatin3),
+        @"ISO-8859-4": cfencoding(kCFStringEncodingISOLatin4),
+        @"ISO-8859-5": cfencoding(kCFStringEncodingISOLatinCyrillic),
+        @"ISO-8859-6": cfencoding(kCFStringEncodingISOLatinArabic),
+        @"ISO-8859-7": cfencoding(kCFStringEncodingISOLatinGreek),
+        @"ISO-8859-8": cfencoding(kCFStringEncodingISOLatinHebrew),
+        @"ISO-8859-10": cfencoding(kCFStringEncodingISOLatin6),
+        @"ISO-8859-13": cfencoding(kCFStringEncodingISOLatin7),
+        @"ISO-8859-14": cfencoding(kCFStringEncodingISOLatin8),
+        @"ISO-8859-15": cfencoding(kCFStringEncodingISOLatin9),
+        @"ISO-8859-16": cfencoding(kCFStringEncodingISOLatin10),
+        @"KOI8-R": cfencoding(kCFStringEncodingKOI8_R),
+        @"KOI8-U": cfencoding(kCFStringEncodingKOI8_U),
+        @"macintosh": cfencoding(kCFStringEncodingMacRoman),
+        @"windows-874": cfencoding(kCFStringEncodingDOSThai),
+        @"windows-1250": cfencoding(kCFStringEncodingWindowsLatin2),
+        @"windows-1251": cfencoding(kCFStringEncodingWindowsCyrillic),
+        @"windows-1252": cfencoding(kCFStringEncodingWindowsLatin1),
+        @"windows-1253": cfencoding(kCFStringEncodingWindowsGreek),
+        @"windows-1254": cfencoding(kCFStringEncodingWindowsLatin5),
+        @"windows-1255": cfencoding(kCFStringEncodingWindowsHebrew),
+        @"windows-1256": cfencoding(kCFStringEncodingWindowsArabic),
+        @"windows-1257": cfencoding(kCFStringEncodingWindowsBalticRim),
+        @"windows-1258": cfencoding(kCFStringEncodingWindowsVietnamese),
+        @"x-mac-cyrillic": cfencoding(kCFStringEncodingMacCyrillic),
+    };
+    
+    #undef cfencoding
+    
+    printf("static const SingleByteIndex SingleByteIndexes[] = {\n");
+    NSArray *sortedSingleByteNames = [singleByteNamesToStringEncodings.allKeys sortedArrayUsingSelector:@selector(compare:)];
+    for (NSString *name in sortedSingleByteNames) {
+        NSString *indexURL = [NSString stringWithFormat:@"https://encoding.spec.whatwg.org/index-%@.txt", name.lowercaseString];
+        NSString *index = [NSString stringWithContentsOfURL:(NSURL *)[NSURL URLWithString:indexURL] encoding:NSUTF8StringEncoding error:nil];
+        if (!index) {
+            NSLog(@"could not download index for %@", name);
+            return 1;
+        }
+        
+        // Pointers missing from the index are errors, which the HTML parser replaces with U+FFFD REPLACEMENT CHARACTER.
+        unichar codePoints[128];
+        for (NSUInteger i = 0; i < 128; i++) {
+            codePoints[i] = 0xFFFD;
+        }
+        for (NSString *line in [index componentsSeparatedByString:@"\n"]) {
+            if (line.length == 0 || [line hasPrefix:@"#"]) continue;
+            NSScanner *scanner = [NSScanner scannerWithString:line];
+            int pointer;
+            unsigned int codePoint;
+            if (![scanner scanInt:&pointer] || ![scanner scanString:@"0x" intoString:nil] || ![scanner scanHexInt:&codePoint] || pointer < 0 || pointer >= 128) {
+                NSLog(@"could not parse line in index for %@: %@", name, line);
+                return 1;
+            }
+            codePoints[pointer] = (unichar)codePoint;
+        }
+        
+        printf("    // %s\n", name.UTF8String);
+        printf("    { %s, {\n", [singleByteNamesToStringEncodings[name] UTF8String]);
+        for (NSUInteger row = 0; row < 128; row += 8) {
+            printf("        ");
+            for (NSUInteger i = row; i < row + 8; i++) {
+                printf(i + 1 < row + 8 ? "0x%04X, " : "0x%04X,\n", codePoints[i]);
+            }
+        }
+        printf("    } },\n");
+    }
+    printf("};\n\n");
+    
     return 0;
 } }